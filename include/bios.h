@@ -119,6 +119,7 @@
 //#define MAX_SWAPPABLE_DISKS 20
 
 void BIOS_ZeroExtendedSize(bool in);
+void BIOS_HostTimeSync(void);
 void char_out(Bit8u chr,Bit32u att,Bit8u page);
 void INT10_StartUp(void);
 void INT16_StartUp(void);
@@ -63,6 +63,14 @@ extern Bitu CPU_ArchitectureType;
 
 extern Bitu CPU_PrefetchQueueSize;
 
+/* Idle loop detection, devices report polls that found nothing new and
+ * anything with side effects resets the detection */
+extern Bitu CPU_IdlePolls;
+void CPU_IdlePoll(void);
+static INLINE void CPU_IdleReset(void) {
+	CPU_IdlePolls=0;
+}
+
 /* Some common Defines */
 /* A CPU Handler */
 typedef Bits (CPU_Decoder)(void);
@@ -79,6 +87,8 @@ Bits CPU_Core_Dynrec_Run(void);
 Bits CPU_Core_Dynrec_Trap_Run(void);
 Bits CPU_Core_Prefetch_Run(void);
 Bits CPU_Core_Prefetch_Trap_Run(void);
+Bits CPU_Core_Predecode_Run(void);
+Bits CPU_Core_Predecode_Trap_Run(void);
 
 void CPU_Enable_SkipAutoAdjust(void);
 void CPU_Disable_SkipAutoAdjust(void);
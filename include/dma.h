@@ -28,6 +28,7 @@ enum DMAEvent {
 };
 
 class DmaChannel;
+class SnapshotStream;
 typedef void (* DMA_CallBack)(DmaChannel * chan,DMAEvent event);
 
 class DmaChannel {
@@ -106,6 +107,8 @@ public:
 	}
 	void WriteControllerReg(Bitu reg,Bitu val,Bitu len);
 	Bitu ReadControllerReg(Bitu reg,Bitu len);
+	void SaveState(SnapshotStream & stream);
+	void LoadState(SnapshotStream & stream);
 };
 
 DmaChannel * GetDMAChannel(Bit8u chan);
@@ -195,6 +195,12 @@ void DOS_SetupTables(void);
 /* Internal DOS Setup Programs */
 void DOS_SetupPrograms(void);
 
+/* Boot images, only a machine with local directory mounts can be saved.
+   The mounts are described by their host paths and modification times. */
+bool DOS_ImageReady(void);
+std::string DOS_ImageMounts(void);
+bool DOS_ImageMountsValid(std::string const & mounts);
+
 /* Initialize Keyboard Layout */
 void DOS_KeyboardLayout_Init(Section* sec);
 
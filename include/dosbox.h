@@ -34,6 +34,7 @@ typedef Bitu (LoopHandler)(void);
 void DOSBOX_RunMachine();
 void DOSBOX_SetLoop(LoopHandler * handler);
 void DOSBOX_SetNormalLoop();
+Bitu DOSBOX_GetRunDepth(void);
 
 void DOSBOX_Init(void);
 
@@ -60,6 +61,7 @@ enum SVGACards {
 extern SVGACards svgaCard;
 extern MachineType machine;
 extern bool SDLNetInited;
+extern bool headless;
 
 #define IS_TANDY_ARCH ((machine==MCH_TANDY) || (machine==MCH_PCJR))
 #define IS_EGAVGA_ARCH ((machine==MCH_EGA) || (machine==MCH_VGA))
@@ -34,12 +34,21 @@
 typedef Bitu IO_ReadHandler(Bitu port,Bitu iolen);
 typedef void IO_WriteHandler(Bitu port,Bitu val,Bitu iolen);
 
+/* Optional handlers that move count elements of iolen bytes at once for the
+ * string io instructions. They return the number of elements they handled,
+ * the rest is transferred through the normal handlers. */
+typedef Bitu IO_BlockReadHandler(Bitu port,void * data,Bitu count,Bitu iolen);
+typedef Bitu IO_BlockWriteHandler(Bitu port,void const * data,Bitu count,Bitu iolen);
+
 extern IO_WriteHandler * io_writehandlers[3][IO_MAX];
 extern IO_ReadHandler * io_readhandlers[3][IO_MAX];
 
 void IO_RegisterReadHandler(Bitu port,IO_ReadHandler * handler,Bitu mask,Bitu range=1);
 void IO_RegisterWriteHandler(Bitu port,IO_WriteHandler * handler,Bitu mask,Bitu range=1);
 
+void IO_RegisterBlockReadHandler(Bitu port,IO_BlockReadHandler * handler,Bitu mask,Bitu range=1);
+void IO_RegisterBlockWriteHandler(Bitu port,IO_BlockWriteHandler * handler,Bitu mask,Bitu range=1);
+
 void IO_FreeReadHandler(Bitu port,Bitu mask,Bitu range=1);
 void IO_FreeWriteHandler(Bitu port,Bitu mask,Bitu range=1);
 
@@ -51,6 +60,14 @@ Bitu IO_ReadB(Bitu port);
 Bitu IO_ReadW(Bitu port);
 Bitu IO_ReadD(Bitu port);
 
+bool IO_CanReadBlock(Bitu port,Bitu iolen);
+bool IO_CanWriteBlock(Bitu port,Bitu iolen);
+Bitu IO_ReadBlock(Bitu port,void * data,Bitu count,Bitu iolen);
+Bitu IO_WriteBlock(Bitu port,void const * data,Bitu count,Bitu iolen);
+
+/* Log the port statistics when they are enabled with ioprofile */
+void IO_ProfileDump(void);
+
 /* Classes to manage the IO objects created by the various devices.
  * The io objects will remove itself on destruction.*/
 class IO_Base{
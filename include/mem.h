@@ -32,6 +32,7 @@ typedef Bit32s MemHandle;
 #define MEM_PAGESIZE 4096
 
 extern HostPt MemBase;
+extern Bit8u * MemDirty;			//Pages written since the last snapshot
 HostPt GetMemBase(void);
 
 bool MEM_A20_Enabled(void);
@@ -149,13 +150,21 @@ void mem_writeb(PhysPt pt,Bit8u val);
 void mem_writew(PhysPt pt,Bit16u val);
 void mem_writed(PhysPt pt,Bit32u val);
 
+/* Writes that bypass the page handlers have to flag the page for snapshots */
+static INLINE void MEM_MarkDirty(Bitu phys_page) {
+	MemDirty[phys_page]=1;
+}
+
 static INLINE void phys_writeb(PhysPt addr,Bit8u val) {
+	MEM_MarkDirty(addr>>12);
 	host_writeb(MemBase+addr,val);
 }
 static INLINE void phys_writew(PhysPt addr,Bit16u val){
+	MEM_MarkDirty(addr>>12);
 	host_writew(MemBase+addr,val);
 }
 static INLINE void phys_writed(PhysPt addr,Bit32u val){
+	MEM_MarkDirty(addr>>12);
 	host_writed(MemBase+addr,val);
 }
 
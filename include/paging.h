@@ -33,6 +33,18 @@
 #define USE_FULL_TLB
 #endif
 
+// enable this to use a small set-associative TLB that is filled on demand
+// instead, it only holds the most recently linked pages
+// NOTE: does not work with the dynamic core (dynrec is fine)
+//#define USE_COMPACT_TLB
+
+// enable this to count TLB lookups and misses, reported at shutdown
+//#define PAGING_TLB_STATS
+
+#if defined(USE_COMPACT_TLB)
+#undef USE_FULL_TLB
+#endif
+
 class PageDirectory;
 
 #define MEM_PAGE_SIZE	(4096)
@@ -40,6 +52,11 @@ class PageDirectory;
 
 #if defined(USE_FULL_TLB)
 #define TLB_SIZE		(1024*1024)
+#elif defined(USE_COMPACT_TLB)
+#define TLB_SIZE		(1024*1024)	// number of pages that can be linked
+#define TLB_SETS		4096		// This must be a power of 2
+#define TLB_WAYS		2
+#define TLB_NOPAGE		0xffffffff	// tag of an unused entry
 #else
 #define TLB_SIZE		65536	// This must a power of 2 and greater then LINK_START
 #define BANK_SHIFT		28
@@ -54,6 +71,7 @@ class PageDirectory;
 #define PFLAG_NOCODE		0x10			//No dynamic code can be generated here
 #define PFLAG_INIT			0x20			//No dynamic code can be generated here
 #define PFLAG_HASCODE16		0x40			//Page contains 16-bit dynamic code
+#define PFLAG_PREDECODE		0x80			//Page contains instructions of the predecode core
 #define PFLAG_HASCODE		(PFLAG_HASCODE32|PFLAG_HASCODE16)
 
 #define LINK_START	((1024+64)/4)			//Start right after the HMA
@@ -154,9 +172,18 @@ typedef struct {
 	PageHandler * readhandler;
 	PageHandler * writehandler;
 	Bit32u phys_page;
+#if defined(USE_COMPACT_TLB)
+	Bit32u lin_page;
+#endif
 } tlb_entry;
 #endif
 
+#if defined(PAGING_TLB_STATS)
+#define TLB_STAT(counter)	paging.stats.counter++
+#else
+#define TLB_STAT(counter)
+#endif
+
 struct PagingBlock {
 	Bitu			cr3;
 	Bitu			cr2;
@@ -172,6 +199,9 @@ struct PagingBlock {
 		PageHandler * writehandler[TLB_SIZE];
 		Bit32u	phys_page[TLB_SIZE];
 	} tlb;
+#elif defined(USE_COMPACT_TLB)
+	tlb_entry tlbh[TLB_SETS][TLB_WAYS];
+	tlb_entry tlb_miss;		// returned for pages that aren't linked
 #else
 	tlb_entry tlbh[TLB_SIZE];
 	tlb_entry *tlbh_banks[TLB_BANKS];
@@ -182,6 +212,13 @@ struct PagingBlock {
 	} links;
 	Bit32u		firstmb[LINK_START];
 	bool		enabled;
+#if defined(PAGING_TLB_STATS)
+	struct {
+		Bit64u lookups;
+		Bit64u misses;		// pages that had to be linked
+		Bit64u evictions;	// linked pages that were replaced by another page
+	} stats;
+#endif
 };
 
 extern PagingBlock paging; 
@@ -205,9 +242,11 @@ bool mem_unalignedwrited_checked(PhysPt address,Bit32u val);
 #if defined(USE_FULL_TLB)
 
 static INLINE HostPt get_tlb_read(PhysPt address) {
+	TLB_STAT(lookups);
 	return paging.tlb.read[address>>12];
 }
 static INLINE HostPt get_tlb_write(PhysPt address) {
+	TLB_STAT(lookups);
 	return paging.tlb.write[address>>12];
 }
 static INLINE PageHandler* get_tlb_readhandler(PhysPt address) {
@@ -228,6 +267,16 @@ static INLINE PhysPt PAGING_GetPhysicalAddress(PhysPt linAddr) {
 
 #else
 
+#if defined(USE_COMPACT_TLB)
+static INLINE tlb_entry *get_tlb_entry(PhysPt address) {
+	Bitu index=(address>>12);
+	tlb_entry *set=paging.tlbh[index&(TLB_SETS-1)];
+	if (set[0].lin_page==index) return &set[0];
+	if (set[1].lin_page==index) return &set[1];
+	// not linked, the init handlers of the miss entry link the page
+	return &paging.tlb_miss;
+}
+#else
 void PAGING_InitTLBBank(tlb_entry **bank);
 
 static INLINE tlb_entry *get_tlb_entry(PhysPt address) {
@@ -240,11 +289,14 @@ static INLINE tlb_entry *get_tlb_entry(PhysPt address) {
 	}
 	return &paging.tlbh[index];
 }
+#endif
 
 static INLINE HostPt get_tlb_read(PhysPt address) {
+	TLB_STAT(lookups);
 	return get_tlb_entry(address)->read;
 }
 static INLINE HostPt get_tlb_write(PhysPt address) {
+	TLB_STAT(lookups);
 	return get_tlb_entry(address)->write;
 }
 static INLINE PageHandler* get_tlb_readhandler(PhysPt address) {
@@ -255,6 +307,22 @@ static INLINE PageHandler* get_tlb_writehandler(PhysPt address) {
 }
 
 /* Use these helper functions to access linear addresses in readX/writeX functions */
+#if defined(USE_COMPACT_TLB)
+static INLINE PhysPt PAGING_GetPhysicalPage(PhysPt linePage) {
+	tlb_entry *entry = get_tlb_entry(linePage);
+	if (entry!=&paging.tlb_miss) return (entry->phys_page<<12);
+	// the page might have been replaced in the TLB, look it up
+	Bitu page=linePage>>12;
+	if (PAGING_MakePhysPage(page)) return (page<<12);
+	// not present, link it like an access would, this raises the page fault
+	PAGING_ForcePageInit(linePage);
+	return (get_tlb_entry(linePage)->phys_page<<12);
+}
+
+static INLINE PhysPt PAGING_GetPhysicalAddress(PhysPt linAddr) {
+	return PAGING_GetPhysicalPage(linAddr)|(linAddr&0xfff);
+}
+#else
 static INLINE PhysPt PAGING_GetPhysicalPage(PhysPt linePage) {
 	tlb_entry *entry = get_tlb_entry(linePage);
 	return (entry->phys_page<<12);
@@ -265,6 +333,7 @@ static INLINE PhysPt PAGING_GetPhysicalAddress(PhysPt linAddr) {
 	return (entry->phys_page<<12)|(linAddr&0xfff);
 }
 #endif
+#endif
 
 /* Special inlined memory reading/writing */
 
@@ -27,6 +27,7 @@ extern Bit32s CPU_CycleMax;
 
 typedef void (PIC_EOIHandler) (void);
 typedef void (* PIC_EventHandler)(Bitu val);
+typedef Bit64u PIC_EventHandle;
 
 
 extern Bitu PIC_IRQCheck;
@@ -54,8 +55,9 @@ void PIC_DeActivateIRQ(Bitu irq);
 void PIC_runIRQs(void);
 bool PIC_RunQueue(void);
 
-//Delay in milliseconds
-void PIC_AddEvent(PIC_EventHandler handler,float delay,Bitu val=0);
+//Delay in milliseconds, the handle can be used to cancel this single event
+PIC_EventHandle PIC_AddEvent(PIC_EventHandler handler,float delay,Bitu val=0);
+void PIC_RemoveEvent(PIC_EventHandle handle);
 void PIC_RemoveEvents(PIC_EventHandler handler);
 void PIC_RemoveSpecificEvents(PIC_EventHandler handler, Bitu val);
 
@@ -29,7 +29,8 @@
 
 #define RENDER_SKIP_CACHE	16
 //Enable this for scalers to support 0 input for empty lines
-//#define RENDER_NULL_INPUT
+//The vga passes 0 for the lines that didn't change
+#define RENDER_NULL_INPUT
 
 typedef struct {
 	struct { 
@@ -96,6 +97,8 @@ extern ScalerLineHandler_t RENDER_DrawLine;
 void RENDER_SetSize(Bitu width,Bitu height,Bitu bpp,float fps,double ratio,bool dblw,bool dblh);
 bool RENDER_StartUpdate(void);
 void RENDER_EndUpdate(bool abort);
+/* Waits for the frame of the render thread, before the output is changed */
+void RENDER_Flush(void);
 void RENDER_SetPal(Bit8u entry,Bit8u red,Bit8u green,Bit8u blue);
 bool RENDER_GetForceUpdate(void);
 void RENDER_SetForceUpdate(bool);
@@ -41,6 +41,11 @@ class DOS_Shell;
  * by "external" programs. (config) */
 extern DOS_Shell * first_shell;
 
+/* Boot image set up by the first shell, see BOOTIMAGE */
+bool SHELL_BootImagePending(void);
+bool SHELL_LoadBootImage(void);
+bool SHELL_SaveBootImage(void);
+
 
 class BatchFile {
 public:
@@ -113,6 +118,7 @@ public:
 	void CMD_PATH(char * args);
 	void CMD_SHIFT(char * args);
 	void CMD_VER(char * args);
+	void CMD_BOOTIMAGE(char * args);
 	/* The shell's variables */
 	Bit16u input_handle;
 	BatchFile * bf;
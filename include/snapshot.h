@@ -0,0 +1,82 @@
+/*
+ *  Copyright (C) 2002-2021  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef DOSBOX_SNAPSHOT_H
+#define DOSBOX_SNAPSHOT_H
+
+#ifndef DOSBOX_DOSBOX_H
+#include "dosbox.h"
+#endif
+#ifndef CH_STRING
+#define CH_STRING
+#include <string>
+#endif
+
+/* Growable buffer the machine state is written to and read back from */
+class SnapshotStream {
+public:
+	SnapshotStream();
+	~SnapshotStream();
+	void Write(void const * data,Bitu size);
+	void Read(void * data,Bitu size);
+	void Clear(void) { used=pos=0;failed=false; }
+	void Seek(Bitu where) { pos=where; }
+	Bitu Tell(void) const { return pos; }
+	Bitu Size(void) const { return used; }
+	Bit8u const * Data(void) const { return buffer; }
+	/* Set when state couldn't be stored, the snapshot is unusable then */
+	void Fail(void) { failed=true; }
+	bool Failed(void) const { return failed; }
+private:
+	Bit8u * buffer;
+	Bitu alloc;
+	Bitu used;
+	Bitu pos;
+	bool failed;
+};
+
+typedef void (SNAPSHOT_Handler)(SnapshotStream & stream);
+
+/* Modules register the state they want saved. Plain memory regions are
+   copied as is, handlers are used for state that needs fixing up when it is
+   loaded again. Registering an existing name replaces the entry. Any change
+   of the registrations discards the current snapshot. */
+void SNAPSHOT_AddRegion(char const * const name,void * data,Bitu size,Bitu flags=0);
+void SNAPSHOT_AddHandler(char const * const name,SNAPSHOT_Handler * save,SNAPSHOT_Handler * load,Bitu flags=0);
+void SNAPSHOT_Remove(char const * const name);
+
+/* The entry is also stored in image files, which are read back by another
+   run of the same build. Its state may not contain any host pointers. */
+#define SNAPSHOT_PERSISTENT 0x1
+
+/* Snapshots are kept in memory and can only be taken and restored between
+   emulation slices, not while a callback is running. Saving fails when the
+   memory for the state can't be allocated, the old snapshot is gone then. */
+bool SNAPSHOT_Save(void);
+bool SNAPSHOT_Load(void);
+bool SNAPSHOT_Available(void);
+
+/* Image files only hold the persistent entries. The key is checked when the
+   file is loaded, so an image made for a different setup is refused. */
+bool SNAPSHOT_SaveFile(char const * filename,std::string const & key);
+bool SNAPSHOT_LoadFile(char const * filename,std::string const & key);
+bool SNAPSHOT_FileKey(char const * filename,std::string & key);
+/* Handlers with state that differs between runs check this */
+bool SNAPSHOT_InFile(void);
+
+#endif
@@ -39,4 +39,8 @@ void TIMER_DelTickHandler(TIMER_TickHandler handler);
 /* This will add 1 milliscond to all timers */
 void TIMER_AddTick(void);
 
+/* Monotonic host clock in microseconds and a sleep until an absolute time on it */
+Bit64u TIMER_GetTicksUs(void);
+void TIMER_SleepUntilUs(Bit64u deadline);
+
 #endif
@@ -24,10 +24,16 @@
 #include "dosbox.h"
 #endif
 
-//Don't enable keeping changes and mapping lfb probably...
-#define VGA_LFB_MAPPED
-//#define VGA_KEEP_CHANGES
+//Don't enable keeping changes and mapping lfb, a mapped lfb skips the
+//handlers that mark the changed blocks of memory
+//#define VGA_LFB_MAPPED
+#define VGA_KEEP_CHANGES
 #define VGA_CHANGE_SHIFT	9
+//Planar modes are drawn from fastmem which is twice the size of the memory
+#define VGA_CHANGES_SIZE(_VMEM) ((((_VMEM)<<1) >> VGA_CHANGE_SHIFT) + 32)
+//Pages of video memory written since the last snapshot
+#define VGA_DIRTY_SHIFT	12
+#define VGA_DIRTY( _MEM ) VGADirty[ (_MEM) >> VGA_DIRTY_SHIFT ] = 1
 
 class PageHandler;
 
@@ -138,6 +144,8 @@ typedef struct {
 	Bitu parts_total;
 	Bitu parts_lines;
 	Bitu parts_left;
+	bool deferred;				// The frame is drawn in one part
+	Bitu raster_frames;			// Frames left to draw in parts
 	Bitu byte_panning_shift;
 	struct {
 #ifdef _EE
@@ -149,6 +157,7 @@ typedef struct {
 		float vdend, vtotal;
 		float hdend, htotal;
 		float parts;
+		float skip;
 #else
 		double framestart;
 		double vrstart, vrend;		// V-retrace
@@ -158,6 +167,7 @@ typedef struct {
 		double vdend, vtotal;
 		double hdend, htotal;
 		double parts;
+		double skip;
 #endif
 	} delay;
 	Bitu bpp;
@@ -376,12 +386,10 @@ typedef struct {
 
 typedef struct {
 	//Add a few more just to be safe
-	Bit8u*	map; /* allocated dynamically: [(VGA_MEMORY >> VGA_CHANGE_SHIFT) + 32] */
-	Bit8u	checkMask, frame, writeMask;
-	bool	active;
-	Bit32u  clearMask;
-	Bit32u	start, last;
-	Bit32u	lastAddress;
+	Bit8u*	map; /* allocated dynamically: [VGA_CHANGES_SIZE(vmemsize)] */
+	Bit8u	checkMask, writeMask;	/* Writes of the last frame, writes of this frame */
+	bool	redraw;					/* Something besides memory changed, draw the next frame in full */
+	Bitu	span;					/* Bytes of memory a line is drawn from */
 } VGA_Changes;
 
 typedef struct {
@@ -466,10 +474,12 @@ void VGA_SetCGA2Table(Bit8u val0,Bit8u val1);
 void VGA_SetCGA4Table(Bit8u val0,Bit8u val1,Bit8u val2,Bit8u val3);
 void VGA_ActivateHardwareCursor(void);
 void VGA_KillDrawing(void);
+void VGA_RasterChange(void);
 
 void VGA_SetOverride(bool vga_override);
 
 extern VGA_Type vga;
+extern Bit8u * VGADirty;
 
 /* Support for modular SVGA implementation */
 /* Video mode extra data to be passed to FinishSetMode_SVGA().
@@ -0,0 +1,290 @@
+/*
+ *  Copyright (C) 2002-2013  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include "dosbox.h"
+#include "cpu.h"
+#include "regs.h"
+#include "mem.h"
+#include "paging.h"
+#include "callback.h"
+#include "programs.h"
+#include "dos_inc.h"
+#include "timer.h"
+#include "setup.h"
+#if C_FPU
+#include "fpu.h"
+#endif
+
+/* The cores are compared on a fixed set of real mode workloads that are
+   copied into a conventional memory block. Every workload counts down ECX
+   and ends on a callback opcode, which makes the core return to us. */
+
+#define CPUBENCH_SLICE 10000
+#define CPUBENCH_CODE_SMC 0x3000
+#define CPUBENCH_GDT 0x800
+#define CPUBENCH_GDTR 0x818
+#define CPUBENCH_PAGES (3+256)
+#define CPUBENCH_LINEAR 0x400000
+
+void CPU_Core_Predecode_Cache_Init(bool enable_cache);
+#if (C_DYNAMIC_X86)
+void CPU_Core_Dyn_X86_Cache_Init(bool enable_cache);
+#elif (C_DYNREC)
+void CPU_Core_Dynrec_Cache_Init(bool enable_cache);
+#endif
+
+static const Bit8u cpubench_code[]={
+	/* alu: add/xor/shl/inc/imul/sub on 32bit registers */
+	0x66,0x01,0xd8,0x66,0x31,0xc2,0x66,0xd1,0xe3,0x66,0x43,0x66,0x0f,0xaf,0xf0,0x66,
+	0x29,0xf7,0x66,0x49,0x75,0xea,0xe9,0x90,0x00,
+	/* string: rep movsd 4kb followed by rep stosw 4kb */
+	0x66,0x89,0xcd,0xfc,0xbe,0x00,0x80,
+	0xbf,0x00,0xc0,0xb9,0x00,0x04,0x66,0xf3,0xa5,0xbf,0x00,0x80,0xb9,0x00,0x08,0x89,
+	0xe8,0xf3,0xab,0x66,0x4d,0x75,0xe5,0xeb,0x70,
+	/* fpu: fadd/fsqrt/fld/fmul/fstp on the stack */
+	0xdb,0xe3,0xd9,0xe8,0xd9,0xee,0xd8,
+	0xc1,0xd9,0xfa,0xd9,0xc0,0xd8,0xc8,0xdd,0xd8,0x66,0x49,0x75,0xf2,0xdb,0xe3,0xeb,
+	0x58,
+	/* paging: switch to paged protected mode, reload cr3 and touch 256 pages */
+	0x2e,0x0f,0x01,0x16,0x18,0x08,0x0f,0x22,0xd8,0x0f,0x20,0xc0,0x66,0x0d,0x01,
+	0x00,0x00,0x80,0x0f,0x22,0xc0,0xea,0x6b,0x00,0x08,0x00,0xb8,0x10,0x00,0x8e,0xd8,
+	0x8e,0xc0,0x0f,0x20,0xd8,0x0f,0x22,0xd8,0x66,0x89,0xd6,0xbb,0x00,0x01,0x67,0x66,
+	0x03,0x3e,0x66,0x81,0xc6,0x00,0x10,0x00,0x00,0x4b,0x75,0xf2,0x66,0x49,0x75,0xe2,
+	0x0f,0x20,0xc0,0x66,0x25,0xfe,0xff,0xff,0x7f,0x0f,0x22,0xc0,0xea,0xa1,0x00,0x00,
+	0x00,0x8c,0xc8,0x8e,0xd8,0x8e,0xc0,0xeb,0x00,
+	/* done: callback */
+	0xfe,0x38,0x00,0x00
+};
+#define CPUBENCH_PATCH_SEG 0x9f
+#define CPUBENCH_PATCH_CB 0xab
+
+/* smc: every iteration rewrites the immediate of the following instruction */
+static const Bit8u cpubench_smc[]={
+	0x2e,0xff,0x06,0x06,0x30,0xb8,0x34,0x12,0x01,0xc3,0x66,0x49,0x75,0xf2,0xfe,0x38,
+	0x00,0x00
+};
+#define CPUBENCH_PATCH_SMC_CB 0x10
+
+static const struct {
+	const char * name;
+	Bit16u start;
+	Bitu iterations;
+	Bitu instructions;		/* per iteration, string ops count every repetition */
+	bool paging;
+} cpubench_workloads[]={
+	{"alu",		0x00,				250000,	8,				false},
+	{"string",	0x19,				650,	9+1024+2048,	false},
+	{"fpu",		0x39,				300000,	7,				false},
+	{"paging",	0x51,				2000,	4+256*4+2,		true},
+	{"smc",		CPUBENCH_CODE_SMC,	400000,	5,				false},
+	{0,0,0,0,false}
+};
+
+static const struct {
+	const char * name;
+	CPU_Decoder * decoder;
+} cpubench_cores[]={
+	{"normal",		&CPU_Core_Normal_Run},
+#ifdef CORE_SIMPLE
+	{"simple",		&CPU_Core_Simple_Run},
+#endif
+#ifdef CORE_FULL
+	{"full",		&CPU_Core_Full_Run},
+#endif
+	{"prefetch",	&CPU_Core_Prefetch_Run},
+	{"predecode",	&CPU_Core_Predecode_Run},
+#if (C_DYNAMIC_X86)
+	{"dynamic",		&CPU_Core_Dyn_X86_Run},
+#elif (C_DYNREC)
+	{"dynamic",		&CPU_Core_Dynrec_Run},
+#endif
+	{0,0}
+};
+
+static Bitu CPUBENCH_Handler(void) {
+	/* Never called, the benchmark loop catches the callback itself */
+	return CBRET_NONE;
+}
+
+static double CPUBENCH_Millis(void) {
+#ifdef _EE
+	return (double)clock()*1000.0/CLOCKS_PER_SEC;
+#else
+	return (double)GetTicks();
+#endif
+}
+
+class CPUBENCH : public Program {
+public:
+	void Run(void) {
+		if (cmd->FindExist("/?",false)) {
+			WriteOut("Runs a set of workloads on every cpu core and reports the throughput.\n\n"
+				"CPUBENCH [/N scale] [/C core] [/F file]\n"
+				"  /N scale  multiply the number of iterations of every workload.\n"
+				"  /C core   only run the named core.\n"
+				"  /F file   append the results to a file on the host.\n");
+			return;
+		}
+		if (cpu.pmode) {
+			WriteOut("CPUBENCH needs to be run from real mode\n");
+			return;
+		}
+		Bitu scale=1;
+		if (cmd->FindString("/N",temp_line,true)) {
+			scale=atoi(temp_line.c_str());
+			if (!scale) scale=1;
+		}
+		std::string only;
+		cmd->FindString("/C",only,true);
+		FILE * out=0;
+		if (cmd->FindString("/F",temp_line,true)) {
+			out=fopen(temp_line.c_str(),"a");
+			if (!out) {
+				WriteOut("Can't open %s\n",temp_line.c_str());
+				return;
+			}
+		}
+		Bit16u seg;Bit16u blocks=0x1000;
+		if (!DOS_AllocateMemory(&seg,&blocks)) {
+			WriteOut("Not enough conventional memory\n");
+			if (out) fclose(out);
+			return;
+		}
+		CALLBACK_HandlerObject cb;
+		cb.Allocate(&CPUBENCH_Handler,"CPU benchmark");
+		Bit16u cb_num=cb.Get_callback();
+		PhysPt base=seg<<4;
+		for (Bitu i=0;i<sizeof(cpubench_code);i++) phys_writeb(base+i,cpubench_code[i]);
+		for (Bitu i=0;i<sizeof(cpubench_smc);i++) phys_writeb(base+CPUBENCH_CODE_SMC+i,cpubench_smc[i]);
+		phys_writew(base+CPUBENCH_PATCH_SEG,seg);
+		phys_writew(base+CPUBENCH_PATCH_CB,cb_num);
+		phys_writew(base+CPUBENCH_CODE_SMC+CPUBENCH_PATCH_SMC_CB,cb_num);
+		/* Flat 16bit code segment at the block and a flat 4gb data segment */
+		PhysPt gdt=base+CPUBENCH_GDT;
+		phys_writed(gdt+0x00,0);phys_writed(gdt+0x04,0);
+		phys_writed(gdt+0x08,0xffff|(base<<16));phys_writed(gdt+0x0c,((base>>16)&0xff)|0x9a00|(base&0xff000000));
+		phys_writed(gdt+0x10,0xffff);phys_writed(gdt+0x14,0x00cf9200);
+		phys_writew(base+CPUBENCH_GDTR,0x17);phys_writed(base+CPUBENCH_GDTR+2,gdt);
+		/* Page directory, a table identity mapping the first 4mb and one mapping 256 pages */
+		MemHandle pages=MEM_AllocatePages(CPUBENCH_PAGES,true);
+		if (pages) {
+			PhysPt dir=pages<<12;
+			for (Bitu i=0;i<1024;i++) {
+				phys_writed(dir+i*4,0);
+				phys_writed(((pages+1)<<12)+i*4,(i<<12)|3);
+				phys_writed(((pages+2)<<12)+i*4,i<256 ? (((pages+3+i)<<12)|3) : 0);
+			}
+			phys_writed(dir+0,((pages+1)<<12)|3);
+			phys_writed(dir+4,((pages+2)<<12)|3);
+		}
+
+		/* Save everything the workloads touch */
+		CPU_Regs old_regs=cpu_regs;
+		Bit16u old_segs[6];
+		for (Bitu i=0;i<6;i++) old_segs[i]=SegValue((SegNames)i);
+#if C_FPU
+		FPU_rec old_fpu=fpu;
+#endif
+		CPU_Decoder * old_decoder=cpudecoder;
+		Bits old_cycles=CPU_Cycles;Bits old_cycleleft=CPU_CycleLeft;
+		Bitu old_autodetermine=CPU_AutoDetermineMode;
+		Bitu old_prefetch=CPU_PrefetchQueueSize;
+		Bitu old_gdt_base=CPU_SGDT_base();Bitu old_gdt_limit=CPU_SGDT_limit();
+		Bitu old_cr3=PAGING_GetDirBase();
+		CPU_AutoDetermineMode=0;
+		if (!CPU_PrefetchQueueSize) CPU_PrefetchQueueSize=16;
+
+		Report(out,"core,workload,instructions,cycles,host_ms,ips,cycles_per_ns\n");
+		for (Bitu c=0;cpubench_cores[c].name;c++) {
+			if (!only.empty() && strcasecmp(only.c_str(),cpubench_cores[c].name)) continue;
+			if (cpubench_cores[c].decoder==&CPU_Core_Predecode_Run) CPU_Core_Predecode_Cache_Init(true);
+#if (C_DYNAMIC_X86)
+			if (cpubench_cores[c].decoder==&CPU_Core_Dyn_X86_Run) CPU_Core_Dyn_X86_Cache_Init(true);
+#elif (C_DYNREC)
+			if (cpubench_cores[c].decoder==&CPU_Core_Dynrec_Run) CPU_Core_Dynrec_Cache_Init(true);
+#endif
+			for (Bitu w=0;cpubench_workloads[w].name;w++) {
+				if (cpubench_workloads[w].paging && !pages) continue;
+				Bitu iterations=cpubench_workloads[w].iterations*scale;
+				reg_ecx=(Bit32u)iterations;
+				reg_eax=pages<<12;reg_edx=CPUBENCH_LINEAR;
+				reg_ebx=reg_esi=reg_edi=0;
+				reg_flags=0;
+				SegSet16(cs,seg);SegSet16(ds,seg);SegSet16(es,seg);
+				reg_eip=cpubench_workloads[w].start;
+				cpudecoder=cpubench_cores[c].decoder;
+				Bit64u cycles=0;
+				double start=CPUBENCH_Millis();
+				for (;;) {
+					CPU_Cycles=CPUBENCH_SLICE;CPU_CycleLeft=0;
+					Bits ret=(*cpudecoder)();
+					Bits left=CPU_Cycles>0 ? CPU_Cycles : 0;
+					cycles+=CPUBENCH_SLICE-(left+CPU_CycleLeft);
+					if (ret==(Bits)cb_num || ret<0 || ret>=CB_MAX) break;
+					if (ret>0) (*CallBack_Handlers[ret])();
+				}
+				double ms=CPUBENCH_Millis()-start;
+				double instructions=(double)iterations*cpubench_workloads[w].instructions;
+				double secs=ms>0 ? ms/1000.0 : 0.001;
+				Report(out,"%s,%s,%.0f,%.0f,%.3f,%.0f,%.6f\n",cpubench_cores[c].name,cpubench_workloads[w].name,
+					instructions,(double)cycles,ms,instructions/secs,(double)cycles/(secs*1.0e9));
+			}
+			if (cpubench_cores[c].decoder==&CPU_Core_Predecode_Run && old_decoder!=&CPU_Core_Predecode_Run)
+				CPU_Core_Predecode_Cache_Init(false);
+		}
+
+		cpu_regs=old_regs;
+		for (Bitu i=0;i<6;i++) SegSet16((SegNames)i,old_segs[i]);
+#if C_FPU
+		fpu=old_fpu;
+#endif
+		cpudecoder=old_decoder;
+		CPU_Cycles=old_cycles;CPU_CycleLeft=old_cycleleft;
+		CPU_AutoDetermineMode=old_autodetermine;
+		CPU_PrefetchQueueSize=old_prefetch;
+		CPU_LGDT(old_gdt_limit,old_gdt_base);
+		PAGING_SetDirBase(old_cr3);
+		if (pages) MEM_ReleasePages(pages);
+		DOS_FreeMemory(seg);
+		if (out) fclose(out);
+	}
+private:
+	void Report(FILE * out,const char * format,...) {
+		char buf[256];
+		va_list msg;
+		va_start(msg,format);
+		vsnprintf(buf,sizeof(buf),format,msg);
+		va_end(msg);
+		WriteOut("%s",buf);
+		if (out) fputs(buf,out);
+	}
+};
+
+static void CPUBENCH_ProgramStart(Program * * make) {
+	*make=new CPUBENCH;
+}
+
+void CPUBENCH_Init(Section* /*sec*/) {
+	PROGRAMS_MakeFile("CPUBENCH.COM",CPUBENCH_ProgramStart);
+}
@@ -27,6 +27,7 @@
 #include <string.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <string>
 
 #if defined (WIN32)
 #include <windows.h>
@@ -50,6 +51,8 @@
 #include "paging.h"
 #include "inout.h"
 #include "fpu.h"
+#include "pic.h"
+#include "SDL_thread.h"
 
 #define CACHE_MAXSIZE	(4096*3)
 #define CACHE_TOTAL		(1024*1024*8)
@@ -59,6 +62,7 @@
 #define DYN_HASH_SHIFT	(4)
 #define DYN_PAGE_HASH	(4096>>DYN_HASH_SHIFT)
 #define DYN_LINKS		(16)
+#define DYN_TIER_SLICE	(32)
 
 //#define DYN_LOG 1 //Turn logging on
 
@@ -249,6 +253,8 @@ static void dyn_restoreregister(DynReg * src_reg, DynReg * dst_reg) {
 	dst_reg->genreg->dynreg=dst_reg;	// necessary when register has been released
 }
 
+#include "dyn_cache_file.h"
+
 #include "core_dyn_x86/decoder.h"
 
 Bits CPU_Core_Dyn_X86_Run(void) {
@@ -284,6 +290,15 @@ restart_core:
 	CacheBlock * block=chandler->FindCacheBlock(ip_point&4095);
 	if (!block) {
 		if (!chandler->invalidation_map || (chandler->invalidation_map[ip_point&4095]<4)) {
+			if (GCC_UNLIKELY(cache_smc_demoted(chandler->GetPhysPage()) || !cache_tier_translate(ip_point))) {
+				/* Cold code or code that is modified too often, let the normal core run it for a while */
+				Bit32s slice=(CPU_Cycles>DYN_TIER_SLICE) ? DYN_TIER_SLICE : CPU_Cycles;
+				if (slice<1) slice=1;
+				CPU_CycleLeft+=CPU_Cycles-slice;
+				CPU_Cycles=slice;
+				fpu_saver = auto_dh_fpu();
+				return CPU_Core_Normal_Run();
+			}
 			block=CreateCacheBlock(chandler,ip_point,32);
 		} else {
 			Bit32s old_cycles=CPU_Cycles;
@@ -457,6 +472,27 @@ void CPU_Core_Dyn_X86_Cache_Init(bool enable_cache) {
 	cache_init(enable_cache);
 }
 
+void CPU_Core_Dyn_X86_SetCacheFile(const char * filename,Bitu maxsize_kb) {
+	/* Has to be set before the cache is initialized */
+	cache_file.filename=filename;
+	cache_file.maxsize=maxsize_kb*1024;
+}
+
+void CPU_Core_Dyn_X86_SetCompileLimit(Bitu blocks_per_ms) {
+	cache_tier_setlimit(blocks_per_ms);
+}
+
+void CPU_Core_Dyn_X86_LogSMC(void) {
+	cache_smc_log();
+}
+
+void CPU_Core_Dyn_X86_SetCacheSize(Bitu total_kb,Bitu blocks) {
+	/* Has to be set before the cache is initialized */
+	if (cache_initialized) return;
+	cache_size.total=total_kb*1024;
+	cache_size.blocks=blocks;
+}
+
 void CPU_Core_Dyn_X86_Cache_Close(void) {
 	cache_close();
 }
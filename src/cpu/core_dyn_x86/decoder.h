@@ -107,6 +107,8 @@ static bool MakeCodePage(Bitu lin_addr,CodePageHandler * &cph) {
 	cpagehandler->SetupAt(phys_page,handler);
 	MEM_SetPageHandler(phys_page,1,cpagehandler);
 	PAGING_UnlinkPages(lin_page,1);
+	/* Add translations of a previous session that belong to this page */
+	cache_file_attach(cpagehandler);
 	cph=cpagehandler;
 	return false;
 }
@@ -2197,6 +2199,7 @@ static CacheBlock * CreateCacheBlock(CodePageHandler * codepage,PhysPt start,Bit
 	decode.page.first=start >> 12;
 	decode.active_block=decode.block=cache_openblock();
 	decode.block->page.start=decode.page.index;
+	decode.block->mode=cache_file_cpumode();
 	codepage->AddCacheBlock(decode.block);
 
 	for (i=0;i<G_MAX;i++) {
@@ -27,6 +27,7 @@
 #include <string.h>
 #include <stddef.h>
 #include <stdlib.h>
+#include <string>
 
 #if defined (WIN32)
 #include <windows.h>
@@ -51,6 +52,7 @@
 #include "inout.h"
 #include "lazyflags.h"
 #include "pic.h"
+#include "SDL_thread.h"
 
 #ifdef _EE
 #undef MIPSEL
@@ -68,6 +70,10 @@
 #define DYN_HASH_SHIFT	(4)
 #define DYN_PAGE_HASH	(4096>>DYN_HASH_SHIFT)
 #define DYN_LINKS		(16)
+#define DYN_TRACE_USAGE		(256)	// block entries before a superblock is tried
+#define DYN_TRACE_SAMPLES	(32)	// block entries needed to follow its jump
+#define DYN_TIER_SLICE		(32)	// instructions run by the normal core for cold code
+#define DYN_TIER_PAGEEND	(16)	// code this close to the page end isn't left to the thread
 
 
 //#define DYN_LOG 1 //Turn Logging on.
@@ -160,6 +166,8 @@ static struct {
 #include "core_dynrec/risc_armv8le.h"
 #endif
 
+#include "dyn_cache_file.h"
+
 #include "core_dynrec/decoder.h"
 
 CacheBlockDynRec * LinkBlocks(BlockReturn ret) {
@@ -177,6 +185,50 @@ CacheBlockDynRec * LinkBlocks(BlockReturn ret) {
 	return block;
 }
 
+// let the normal core run code for a short time, the code is not
+// translated yet or the translation thread owns the cache
+static Bits RunNormalSlice(void) {
+	Bits slice=(CPU_Cycles>DYN_TIER_SLICE) ? DYN_TIER_SLICE : CPU_Cycles;
+	if (slice<1) slice=1;
+	CPU_CycleLeft+=CPU_Cycles-slice;
+	CPU_Cycles=slice;
+	return CPU_Core_Normal_Run();
+}
+
+// the translation thread translates the code at ip_point, returns false
+// if it has to be translated right away
+static bool RequestTranslation(CodePageHandlerDynRec * codepage,PhysPt ip_point) {
+	// the thread can't set up the following page
+	if ((ip_point&4095)>4096-DYN_TIER_PAGEEND) return false;
+	HostPt host=codepage->GetHostReadPt(codepage->GetPhysPage());
+	if (!host) return false;
+	// the decoder doesn't look at the cpu state the normal core changes
+	cache_tier.request.handler=codepage;
+	cache_tier.request.ip=ip_point;
+	cache_tier.request.host=host;
+	cache_tier.request.big=cpu.code.big;
+	cache_tier.request.mode=cache_file_cpumode();
+	// the cache belongs to the thread until it signals that it is done
+	cache_tier.busy=true;
+	SDL_SemPost(cache_tier.start);
+	return true;
+}
+
+static int TranslationThread(void * /*data*/) {
+	for (;;) {
+		SDL_SemWait(cache_tier.start);
+		if (cache_tier.quit) return 0;
+		decode.background=true;
+		decode.code_big=cache_tier.request.big;
+		decode.mode=cache_tier.request.mode;
+		decode.page.host=cache_tier.request.host;
+		CreateCacheBlock(cache_tier.request.handler,cache_tier.request.ip,32);
+		decode.background=false;
+		// the block is published to the emulation thread with this
+		SDL_SemPost(cache_tier.done);
+	}
+}
+
 /*
 	The core tries to find the block that should be executed next.
 	If such a block is found, it is run, otherwise the instruction
@@ -197,6 +249,9 @@ Bits CPU_Core_Dynrec_Run(void) {
 			if (DEBUG_HeavyIsBreakpoint()) return debugCallback;
 		#endif
 
+		// the normal core runs the code until the translation thread is done
+		if (GCC_UNLIKELY(cache_tier.busy) && !cache_tier_finish(false)) return RunNormalSlice();
+
 		CodePageHandlerDynRec * chandler=0;
 		// see if the current page is present and contains code
 		if (GCC_UNLIKELY(MakeCodePage(ip_point,chandler))) {
@@ -214,6 +269,12 @@ Bits CPU_Core_Dynrec_Run(void) {
 			// no block found, thus translate the instruction stream
 			// unless the instruction is known to be modified
 			if (!chandler->invalidation_map || (chandler->invalidation_map[ip_point&4095]<4)) {
+				// cold code or code that is modified too often,
+				// let the normal core run it for a while
+				if (GCC_UNLIKELY(cache_smc_demoted(chandler->GetPhysPage()) || !cache_tier_translate(ip_point)))
+					return RunNormalSlice();
+				if (cache_tier.threaded && RequestTranslation(chandler,ip_point))
+					return RunNormalSlice();
 				// translate up to 32 instructions
 				block=CreateCacheBlock(chandler,ip_point,32);
 			} else {
@@ -228,6 +289,9 @@ Bits CPU_Core_Dynrec_Run(void) {
 				CPU_CycleLeft+=old_cycles;
 				return nc_retcode;
 			}
+		} else if (GCC_UNLIKELY(block->trace==TRACE_CANDIDATE) && (block->usage>=DYN_TRACE_USAGE)) {
+			// frequently executed, merge it with the blocks on its preferred path
+			block=CreateSuperBlock(chandler,block,ip_point);
 		}
 
 run_block:
@@ -335,9 +399,55 @@ void CPU_Core_Dynrec_Init(void) {
 void CPU_Core_Dynrec_Cache_Init(bool enable_cache) {
 	// Initialize code cache and dynamic blocks
 	cache_init(enable_cache);
+	if (enable_cache && cache_tier.threaded && !cache_tier.thread) {
+		cache_tier.start=SDL_CreateSemaphore(0);
+		cache_tier.done=SDL_CreateSemaphore(0);
+		cache_tier.quit=false;
+		if (cache_tier.start && cache_tier.done)
+			cache_tier.thread=SDL_CreateThread(TranslationThread,0);
+		if (!cache_tier.thread) {
+			LOG_MSG("DYNREC:Can't start the translation thread");
+			if (cache_tier.start) SDL_DestroySemaphore(cache_tier.start);
+			if (cache_tier.done) SDL_DestroySemaphore(cache_tier.done);
+			cache_tier.threaded=false;
+		}
+	}
+}
+
+void CPU_Core_Dynrec_SetCacheFile(const char * filename,Bitu maxsize_kb) {
+	// has to be set before the cache is initialized
+	cache_file.filename=filename;
+	cache_file.maxsize=maxsize_kb*1024;
+}
+
+void CPU_Core_Dynrec_SetCacheSize(Bitu total_kb,Bitu blocks) {
+	// has to be set before the cache is initialized
+	if (cache_initialized) return;
+	cache_size.total=total_kb*1024;
+	cache_size.blocks=blocks;
+}
+
+void CPU_Core_Dynrec_SetCompileLimit(Bitu blocks_per_ms,bool threaded) {
+	cache_tier_setlimit(blocks_per_ms);
+	// has to be set before the cache is initialized
+	cache_tier.threaded=threaded;
+}
+
+void CPU_Core_Dynrec_LogSMC(void) {
+	cache_smc_log();
 }
 
 void CPU_Core_Dynrec_Cache_Close(void) {
+	if (cache_tier.thread) {
+		cache_tier_finish(true);
+		cache_tier.quit=true;
+		SDL_SemPost(cache_tier.start);
+		SDL_WaitThread(cache_tier.thread,0);
+		SDL_DestroySemaphore(cache_tier.start);
+		SDL_DestroySemaphore(cache_tier.done);
+		cache_tier.thread=0;
+		cache_tier.threaded=false;
+	}
 	cache_close();
 }
 
@@ -32,6 +32,11 @@
 */
 
 static CacheBlockDynRec * CreateCacheBlock(CodePageHandlerDynRec * codepage,PhysPt start,Bitu max_opcodes) {
+	if (!decode.background) {
+		decode.code_big=cpu.code.big;
+		decode.mode=cache_file_cpumode();
+		decode.page.host=NULL;
+	}
 	// initialize a load of variables
 	decode.code_start=start;
 	decode.code=start;
@@ -42,25 +47,34 @@ static CacheBlockDynRec * CreateCacheBlock(CodePageHandlerDynRec * codepage,Phys
 	decode.page.first=start >> 12;
 	decode.active_block=decode.block=cache_openblock();
 	decode.block->page.start=(Bit16u)decode.page.index;
+	decode.block->mode=decode.mode;
 	codepage->AddCacheBlock(decode.block);
 
 	InitFlagsOptimization();
+	dyn_regcache_reset();
 
 	// every codeblock that is run sets cache.block.running to itself
 	// so the block linking knows the last executed block
 	gen_mov_direct_ptr(&cache.block.running,(Bitu)decode.block);
+	// count the executions, frequently used blocks are kept longer in the cache
+	gen_add_direct_word(&decode.block->usage,1,true);
 
 	// start with the cycles check
 	gen_mov_word_to_reg(FC_RETOP,&CPU_Cycles,true);
 	save_info_dynrec[used_save_info_dynrec].branch_pos=gen_create_branch_long_leqzero(FC_RETOP);
 	save_info_dynrec[used_save_info_dynrec].type=cycle_check;
+	save_info_dynrec[used_save_info_dynrec].dirty_regs=0;
 	used_save_info_dynrec++;
 
 	decode.cycles=0;
 	while (max_opcodes--) {
+		// the translation thread can't continue in the next page,
+		// link to the block that starts there instead
+		if (decode.background && (decode.page.index>4096-DYN_TIER_PAGEEND)) break;
+		decode.flags_dead=dyn_flags_dead(max_opcodes+1);
 		// Init prefixes
-		decode.big_addr=cpu.code.big;
-		decode.big_op=cpu.code.big;
+		decode.big_addr=decode.code_big;
+		decode.big_op=decode.code_big;
 		decode.seg_prefix=0;
 		decode.seg_prefix_used=false;
 		decode.rep=REP_NONE;
@@ -68,6 +82,8 @@ static CacheBlockDynRec * CreateCacheBlock(CodePageHandlerDynRec * codepage,Phys
 		decode.op_start=decode.code;
 restart_prefix:
 		Bitu opcode;
+		// the longest instruction following the opcode still fits into the page
+		if (decode.background && (decode.page.index>4096-12)) goto illegalopcode;
 		if (!decode.page.invmap) opcode=decode_fetchb();
 		else {
 			// some entries in the invalidation map, see if the next
@@ -172,11 +188,14 @@ restart_prefix:
 		{
 			Bitu dual_code=decode_fetchb();
 			switch (dual_code) {
+				// these check the cpu state when they are translated,
+				// the translation thread leaves them to the normal core
 				case 0x00:
-					if ((reg_flags & FLAG_VM) || (!cpu.pmode)) goto illegalopcode;
+					if (decode.background || (reg_flags & FLAG_VM) || (!cpu.pmode)) goto illegalopcode;
 					dyn_grp6();
 					break;
 				case 0x01:
+					if (decode.background) goto illegalopcode;
 					if (dyn_grp7()) goto finish_block;
 					break;
 /*				case 0x02:
@@ -194,8 +213,8 @@ restart_prefix:
 				// short conditional jumps
 				case 0x80:case 0x81:case 0x82:case 0x83:case 0x84:case 0x85:case 0x86:case 0x87:	
 				case 0x88:case 0x89:case 0x8a:case 0x8b:case 0x8c:case 0x8d:case 0x8e:case 0x8f:	
-					dyn_branched_exit((BranchTypes)(dual_code&0xf),
-						decode.big_op ? (Bit32s)decode_fetchd() : (Bit16s)decode_fetchw());
+					if (dyn_branched_exit((BranchTypes)(dual_code&0xf),
+						decode.big_op ? (Bit32s)decode_fetchd() : (Bit16s)decode_fetchw())) break;
 					goto finish_block;
 
 				// conditional byte set instructions
@@ -277,8 +296,8 @@ restart_prefix:
 //		case 0x62: BOUND missing
 //		case 0x61: ARPL missing
 
-		case 0x66:decode.big_op=!cpu.code.big;goto restart_prefix;
-		case 0x67:decode.big_addr=!cpu.code.big;goto restart_prefix;
+		case 0x66:decode.big_op=!decode.code_big;goto restart_prefix;
+		case 0x67:decode.big_addr=!decode.code_big;goto restart_prefix;
 
 		// 'push imm8/16/32'
 		case 0x68:
@@ -297,7 +316,7 @@ restart_prefix:
 		// short conditional jumps
 		case 0x70:case 0x71:case 0x72:case 0x73:case 0x74:case 0x75:case 0x76:case 0x77:	
 		case 0x78:case 0x79:case 0x7a:case 0x7b:case 0x7c:case 0x7d:case 0x7e:case 0x7f:	
-			dyn_branched_exit((BranchTypes)(opcode&0xf),(Bit8s)decode_fetchb());	
+			if (dyn_branched_exit((BranchTypes)(opcode&0xf),(Bit8s)decode_fetchb())) break;
 			goto finish_block;
 
 		// 'op []/reg8,imm8'
@@ -595,6 +614,7 @@ restart_prefix:
 	// link to next block because the maximum number of opcodes has been reached
 	dyn_set_eip_end();
 	dyn_reduce_cycles();
+	dyn_regcache_writeback();
 	gen_jmp_ptr(&decode.block->link[0].to,offsetof(CacheBlockDynRec,cache.start));
 	dyn_closeblock();
     goto finish_block;
@@ -619,3 +639,35 @@ finish_block:
 
 	return decode.block;
 }
+
+/*
+	The function CreateSuperBlock translates a frequently executed block
+	that ends with a conditional jump again. The translation continues
+	along the preferred path of the jump and the blocks that follow as
+	long as their jumps have a preferred path as well, the other paths
+	leave the superblock through side exits.
+*/
+
+static CacheBlockDynRec * CreateSuperBlock(CodePageHandlerDynRec * codepage,CacheBlockDynRec * block,PhysPt start) {
+	if (block->crossblock) {
+		block->trace=TRACE_DONE;
+		return block;
+	}
+	if (dyn_trace_bias(block->usage,block->taken)==TRACE_BIAS_NONE) {
+		// no preferred path (yet), sample again
+		block->usage=0;
+		block->taken=0;
+		return block;
+	}
+	decode.trace.seg_start=start;
+	decode.trace.usage=block->usage;
+	decode.trace.taken=block->taken;
+	decode.trace.end=block->page.end;
+	// blocks that link to the old translation are relinked to the superblock
+	block->Clear();
+	decode.trace.active=true;
+	block=CreateCacheBlock(codepage,start,32);
+	decode.trace.active=false;
+	block->trace=TRACE_DONE;
+	return block;
+}
@@ -81,6 +81,11 @@ enum LoopTypes {
 	LOOP_NONE,LOOP_NE,LOOP_E,LOOP_JCXZ
 };
 
+// preferred path of a conditional jump (superblock translation)
+enum TraceBias {
+	TRACE_BIAS_NONE,TRACE_BIAS_NOTTAKEN,TRACE_BIAS_TAKEN
+};
+
 // rotate operand type
 enum grp2_types {
 	grp2_1,grp2_imm,grp2_cl
@@ -104,6 +109,12 @@ static struct DynDecode {
 	bool seg_prefix_used;	// segment overridden
 	Bit8u seg_prefix;		// segment prefix (if seg_prefix_used==true)
 
+	// cpu state the block is translated for, taken from the request
+	// when the translation thread translates it (see cache_tier)
+	bool background;
+	bool code_big;
+	Bit32u mode;
+
 	// block that contains the first instruction translated
 	CacheBlockDynRec * block;
 	// block that contains the current byte of the instruction stream
@@ -116,8 +127,23 @@ static struct DynDecode {
 		Bit8u * wmap;	// write map that indicates code presence for every byte of this page
 		Bit8u * invmap;	// invalidation map
 		Bitu first;		// page number 
+		HostPt host;	// memory of the page if the code is read from there
 	} page;
 
+	// the condition flags that the current instruction produces are
+	// overwritten before they are used (see dyn_flags_analyse)
+	bool flags_dead;
+
+	// superblock state, conditional jumps with a preferred path
+	// don't end the translation if active
+	struct {
+		bool active;
+		PhysPt seg_start;	// start of the part that formerly was a block of its own
+		Bitu usage;			// counters of the block the superblock replaces
+		Bitu taken;
+		Bitu end;			// where the replaced block ended in the page
+	} trace;
+
 	// modrm state of the current instruction (if used)
 	struct {
 //		Bitu val;
@@ -197,6 +223,8 @@ static bool MakeCodePage(Bitu lin_addr,CodePageHandlerDynRec * &cph) {
 	cpagehandler->SetupAt(phys_page,handler);
 	MEM_SetPageHandler(phys_page,1,cpagehandler);
 	PAGING_UnlinkPages(lin_page,1);
+	// add translations of a previous session that belong to this page
+	cache_file_attach(cpagehandler);
 	cph=cpagehandler;
 	return false;
 }
@@ -228,6 +256,7 @@ static Bit8u decode_fetchb(void) {
 	decode.page.wmap[decode.page.index]+=0x01;
 	decode.page.index++;
 	decode.code+=1;
+	if (decode.page.host) return host_readb(decode.page.host+decode.page.index-1);
 	return mem_readb(decode.code-1);
 }
 // fetch the next word of the instruction stream
@@ -244,6 +273,7 @@ static Bit16u decode_fetchw(void) {
 	*(Bit16u *)&decode.page.wmap[decode.page.index]+=0x0101;
 #endif
 	decode.code+=2;decode.page.index+=2;
+	if (decode.page.host) return host_readw(decode.page.host+decode.page.index-2);
 	return mem_readw(decode.code-2);
 }
 // fetch the next dword of the instruction stream
@@ -263,9 +293,16 @@ static Bit32u decode_fetchd(void) {
 	*(Bit32u *)&decode.page.wmap[decode.page.index]+=0x01010101;
 #endif
 	decode.code+=4;decode.page.index+=4;
+	if (decode.page.host) return host_readd(decode.page.host+decode.page.index-4);
 	return mem_readd(decode.code-4);
 }
 
+// read a byte of the current page of the instruction stream without fetching it
+static Bit8u decode_peekb(PhysPt addr) {
+	if (decode.page.host) return host_readb(decode.page.host+(addr&4095));
+	return mem_readb(addr);
+}
+
 #define START_WMMEM 64
 
 // adjust writemap mask to care for map holes due to special
@@ -316,7 +353,7 @@ static bool decode_fetchb_imm(Bitu & val) {
 		decode_advancepage();
 	}
 	// see if position is directly accessible
-	if (decode.page.invmap != NULL) {
+	if ((decode.page.invmap != NULL) && !decode.background) {
 		if (decode.page.invmap[decode.page.index] == 0) {
 			// position not yet modified
 			val=(Bit32u)decode_fetchb();
@@ -341,7 +378,7 @@ static bool decode_fetchb_imm(Bitu & val) {
 // otherwise val contains the current value read from the position
 static bool decode_fetchw_imm(Bitu & val) {
 	if (decode.page.index<4095) {
-		if (decode.page.invmap != NULL) {
+		if ((decode.page.invmap != NULL) && !decode.background) {
 			if ((decode.page.invmap[decode.page.index] == 0) &&
 				(decode.page.invmap[decode.page.index + 1] == 0)) {
 				// position not yet modified
@@ -369,7 +406,7 @@ static bool decode_fetchw_imm(Bitu & val) {
 // otherwise val contains the current value read from the position
 static bool decode_fetchd_imm(Bitu & val) {
 	if (decode.page.index<4093) {
-		if (decode.page.invmap != NULL) {
+		if ((decode.page.invmap != NULL) && !decode.background) {
 			if ((decode.page.invmap[decode.page.index] == 0) &&
 				(decode.page.invmap[decode.page.index + 1] == 0) &&
 				(decode.page.invmap[decode.page.index + 2] == 0) &&
@@ -405,6 +442,148 @@ static void INLINE dyn_get_modrm(void) {
 }
 
 
+// how calls to helper functions treat the cached guest registers
+enum RegCacheCalls {
+	RC_CALL_FULL,		// helper may access the guest registers (default)
+	RC_CALL_SYNC,		// helper only reads them (memory access that may fault)
+	RC_CALL_PURE		// helper only works on its parameters and the lazy flags
+};
+
+// translation state of the guest registers held in host registers,
+// the masks use the DRC_REG_ index as bit number
+static struct {
+	Bitu valid;			// host register contains the guest register
+	Bitu dirty;			// cpu_regs has to be updated from the host register
+	RegCacheCalls calls;
+	bool locked;		// no caching until the end of the block
+} regcache;
+
+#ifdef DRC_USE_REG_CACHE
+#define REGCACHE_MASK ((1<<DRC_REG_EAX)|(1<<DRC_REG_ECX)|(1<<DRC_REG_ESI)|(1<<DRC_REG_EDI))
+
+static HostReg dyn_regcache_host(Bitu reg_index) {
+	switch (reg_index) {
+		case DRC_REG_EAX: return FC_REGCACHE_EAX;
+		case DRC_REG_ECX: return FC_REGCACHE_ECX;
+		case DRC_REG_ESI: return FC_REGCACHE_ESI;
+		default: return FC_REGCACHE_EDI;
+	}
+}
+
+static bool INLINE dyn_regcache_cached(Bitu reg_index) {
+	return !regcache.locked && (REGCACHE_MASK & (1<<reg_index));
+}
+
+// make sure the host register contains the guest register
+static HostReg dyn_regcache_load(Bitu reg_index) {
+	HostReg hr=dyn_regcache_host(reg_index);
+	if (!(regcache.valid & (1<<reg_index))) {
+		gen_mov_word_to_reg(hr,DRCD_REG_VAL(reg_index),true);
+		regcache.valid|=1<<reg_index;
+	}
+	return hr;
+}
+
+// update cpu_regs from the host register if required
+static void dyn_regcache_store(Bitu reg_index) {
+	if (regcache.dirty & (1<<reg_index)) {
+		gen_mov_word_from_reg(dyn_regcache_host(reg_index),DRCD_REG_VAL(reg_index),true);
+		regcache.dirty&=~(1<<reg_index);
+	}
+}
+#endif
+
+// start of a new block, nothing is held in host registers
+static void dyn_regcache_reset(void) {
+	regcache.valid=0;
+	regcache.dirty=0;
+	regcache.calls=RC_CALL_FULL;
+	regcache.locked=false;
+}
+
+// update cpu_regs with all modified cached registers
+static void dyn_regcache_writeback(void) {
+#ifdef DRC_USE_REG_CACHE
+	for (Bitu i=0;i<8;i++) dyn_regcache_store(i);
+#endif
+}
+
+// write back and stop caching for the rest of the block, used before
+// code with several paths that would need different cache states
+static void dyn_regcache_lock(void) {
+	dyn_regcache_writeback();
+	regcache.valid=0;
+	regcache.locked=true;
+}
+
+static void INLINE dyn_regcache_calls(RegCacheCalls calls) {
+	regcache.calls=calls;
+}
+
+#ifdef DRC_USE_REG_CACHE
+// called by the backend before every generated function call, must not emit
+// code for pure calls as their position might be patched later
+static void dyn_regcache_before_call(void) {
+	if (regcache.calls!=RC_CALL_PURE) dyn_regcache_writeback();
+}
+
+// the helper might have changed cpu_regs
+static void dyn_regcache_after_call(void) {
+	if (regcache.calls==RC_CALL_FULL) regcache.valid=0;
+}
+
+// guest register access through the cache, see the MOV_REG_ macros
+// words and bytes are zero-extended like the loads from memory
+static void dyn_regcache_mov_word_to_reg(HostReg host_reg,Bitu reg_index,bool dword) {
+	if (dyn_regcache_cached(reg_index)) {
+		gen_mov_regs(host_reg,dyn_regcache_load(reg_index));
+		if (!dword) gen_extend_word(false,host_reg);
+	} else gen_mov_word_to_reg(host_reg,DRCD_REG_WORD(reg_index,dword),dword);
+}
+
+static void dyn_regcache_add_to_reg(HostReg host_reg,Bitu reg_index) {
+	if (dyn_regcache_cached(reg_index)) gen_lea(host_reg,dyn_regcache_load(reg_index),0,0);
+	else gen_add(host_reg,DRCD_REG_VAL(reg_index));
+}
+
+static void dyn_regcache_mov_word_from_reg(HostReg host_reg,Bitu reg_index,bool dword) {
+	if (dyn_regcache_cached(reg_index)) {
+		if (dword) {
+			gen_mov_regs(dyn_regcache_host(reg_index),host_reg);
+			regcache.valid|=1<<reg_index;
+			regcache.dirty|=1<<reg_index;
+			return;
+		} else if (regcache.valid & (1<<reg_index)) {
+			gen_mov_word_insert(dyn_regcache_host(reg_index),host_reg);
+			regcache.dirty|=1<<reg_index;
+			return;
+		}
+	}
+	gen_mov_word_from_reg(host_reg,DRCD_REG_WORD(reg_index,dword),dword);
+}
+
+static void dyn_regcache_mov_byte_to_reg_low(HostReg host_reg,Bitu reg_index,bool high_byte,bool canuseword) {
+	if (!high_byte && dyn_regcache_cached(reg_index)) {
+		gen_mov_regs(host_reg,dyn_regcache_load(reg_index));
+		gen_extend_byte(false,host_reg);
+		return;
+	}
+	// the high byte is read from memory
+	if (dyn_regcache_cached(reg_index)) dyn_regcache_store(reg_index);
+	if (canuseword) gen_mov_byte_to_reg_low_canuseword(host_reg,DRCD_REG_BYTE(reg_index,high_byte));
+	else gen_mov_byte_to_reg_low(host_reg,DRCD_REG_BYTE(reg_index,high_byte));
+}
+
+static void dyn_regcache_mov_byte_from_reg_low(HostReg host_reg,Bitu reg_index,bool high_byte) {
+	if (dyn_regcache_cached(reg_index)) {
+		dyn_regcache_store(reg_index);
+		regcache.valid&=~(1<<reg_index);
+	}
+	gen_mov_byte_from_reg_low(host_reg,DRCD_REG_BYTE(reg_index,high_byte));
+}
+#endif
+
+
 #ifdef DRC_USE_SEGS_ADDR
 
 #define MOV_SEG_VAL_TO_HOST_REG(host_reg, seg_index) gen_mov_seg16_to_reg(host_reg,(Bitu)(DRCD_SEG_VAL(seg_index)) - (Bitu)(&Segs))
@@ -439,6 +618,23 @@ static void INLINE dyn_get_modrm(void) {
 #define MOV_REG_BYTE_TO_HOST_REG_LOW_CANUSEWORD(host_reg, reg_index, high_byte) gen_mov_regbyte_to_reg_low_canuseword(host_reg,(Bitu)(DRCD_REG_BYTE(reg_index,high_byte)) - (Bitu)(&cpu_regs))
 #define MOV_REG_BYTE_FROM_HOST_REG_LOW(host_reg, reg_index, high_byte) gen_mov_regbyte_from_reg_low(host_reg,(Bitu)(DRCD_REG_BYTE(reg_index,high_byte)) - (Bitu)(&cpu_regs))
 
+#elif defined(DRC_USE_REG_CACHE)
+
+#define MOV_REG_VAL_TO_HOST_REG(host_reg, reg_index) dyn_regcache_mov_word_to_reg(host_reg,reg_index,true)
+#define ADD_REG_VAL_TO_HOST_REG(host_reg, reg_index) dyn_regcache_add_to_reg(host_reg,reg_index)
+
+#define MOV_REG_WORD16_TO_HOST_REG(host_reg, reg_index) dyn_regcache_mov_word_to_reg(host_reg,reg_index,false)
+#define MOV_REG_WORD32_TO_HOST_REG(host_reg, reg_index) dyn_regcache_mov_word_to_reg(host_reg,reg_index,true)
+#define MOV_REG_WORD_TO_HOST_REG(host_reg, reg_index, dword) dyn_regcache_mov_word_to_reg(host_reg,reg_index,dword)
+
+#define MOV_REG_WORD16_FROM_HOST_REG(host_reg, reg_index) dyn_regcache_mov_word_from_reg(host_reg,reg_index,false)
+#define MOV_REG_WORD32_FROM_HOST_REG(host_reg, reg_index) dyn_regcache_mov_word_from_reg(host_reg,reg_index,true)
+#define MOV_REG_WORD_FROM_HOST_REG(host_reg, reg_index, dword) dyn_regcache_mov_word_from_reg(host_reg,reg_index,dword)
+
+#define MOV_REG_BYTE_TO_HOST_REG_LOW(host_reg, reg_index, high_byte) dyn_regcache_mov_byte_to_reg_low(host_reg,reg_index,high_byte,false)
+#define MOV_REG_BYTE_TO_HOST_REG_LOW_CANUSEWORD(host_reg, reg_index, high_byte) dyn_regcache_mov_byte_to_reg_low(host_reg,reg_index,high_byte,true)
+#define MOV_REG_BYTE_FROM_HOST_REG_LOW(host_reg, reg_index, high_byte) dyn_regcache_mov_byte_from_reg_low(host_reg,reg_index,high_byte)
+
 #else
 
 #define MOV_REG_VAL_TO_HOST_REG(host_reg, reg_index) gen_mov_word_to_reg(host_reg,DRCD_REG_VAL(reg_index),true)
@@ -461,13 +657,13 @@ static void INLINE dyn_get_modrm(void) {
 
 #define DYN_LEA_MEM_MEM(ea_reg, op1, op2, scale, imm) dyn_lea_mem_mem(ea_reg,op1,op2,scale,imm)
 
-#if defined(DRC_USE_REGS_ADDR) && defined(DRC_USE_SEGS_ADDR)
+#if (defined(DRC_USE_REGS_ADDR) || defined(DRC_USE_REG_CACHE)) && defined(DRC_USE_SEGS_ADDR)
 
 #define DYN_LEA_SEG_PHYS_REG_VAL(ea_reg, op1_index, op2_index, scale, imm) dyn_lea_segphys_regval(ea_reg,op1_index,op2_index,scale,imm)
 #define DYN_LEA_REG_VAL_REG_VAL(ea_reg, op1_index, op2_index, scale, imm) dyn_lea_regval_regval(ea_reg,op1_index,op2_index,scale,imm)
 #define DYN_LEA_MEM_REG_VAL(ea_reg, op1, op2_index, scale, imm) dyn_lea_mem_regval(ea_reg,op1,op2_index,scale,imm)
 
-#elif defined(DRC_USE_REGS_ADDR)
+#elif defined(DRC_USE_REGS_ADDR) || defined(DRC_USE_REG_CACHE)
 
 #define DYN_LEA_SEG_PHYS_REG_VAL(ea_reg, op1_index, op2_index, scale, imm) dyn_lea_mem_regval(ea_reg,DRCD_SEG_PHYS(op1_index),op2_index,scale,imm)
 #define DYN_LEA_REG_VAL_REG_VAL(ea_reg, op1_index, op2_index, scale, imm) dyn_lea_regval_regval(ea_reg,op1_index,op2_index,scale,imm)
@@ -506,12 +702,12 @@ static INLINE void dyn_set_eip_last_end(HostReg reg) {
 
 // set reg_eip to the start of the current instruction
 static INLINE void dyn_set_eip_last(void) {
-	gen_add_direct_word(&reg_eip,decode.op_start-decode.code_start,cpu.code.big);
+	gen_add_direct_word(&reg_eip,decode.op_start-decode.code_start,decode.code_big);
 }
 
 // set reg_eip to the start of the next instruction
 static INLINE void dyn_set_eip_end(void) {
-	gen_add_direct_word(&reg_eip,decode.code-decode.code_start,cpu.code.big);
+	gen_add_direct_word(&reg_eip,decode.code-decode.code_start,decode.code_big);
 }
 
 // set reg_eip to the start of the next instruction plus an offset (imm)
@@ -623,7 +819,7 @@ static INLINE const Bit8u* gen_call_function_mm(void * func,Bitu op1,Bitu op2) {
 
 
 
-enum save_info_type {db_exception, cycle_check, string_break};
+enum save_info_type {db_exception, cycle_check, string_break, trace_exit};
 
 
 // function that is called on exceptions
@@ -643,6 +839,7 @@ static struct {
 	const Bit8u* branch_pos;
 	Bit32u eip_change;
 	Bitu cycles;
+	Bitu dirty_regs;	// cached guest registers that still have to be written back
 } save_info_dynrec[512];
 
 Bitu used_save_info_dynrec=0;
@@ -650,6 +847,7 @@ Bitu used_save_info_dynrec=0;
 
 // return from current block, with returncode
 static void dyn_return(BlockReturn retcode,bool ret_exception=false) {
+	dyn_regcache_writeback();
 	if (!ret_exception) {
 		gen_mov_dword_to_reg_imm(FC_RETOP,retcode);
 	}
@@ -666,11 +864,14 @@ static void dyn_run_code(void) {
 static void dyn_fill_blocks(void) {
 	for (Bitu sct=0; sct<used_save_info_dynrec; sct++) {
 		gen_fill_branch_long(save_info_dynrec[sct].branch_pos);
+		// host registers contain what was modified when the branch was taken
+		regcache.valid=regcache.dirty=save_info_dynrec[sct].dirty_regs;
+		regcache.calls=RC_CALL_FULL;
 		switch (save_info_dynrec[sct].type) {
 			case db_exception:
 				// code for exception handling, load cycles and call DynRunException
 				decode.cycles=save_info_dynrec[sct].cycles;
-				if (cpu.code.big) gen_call_function_II((void *)&DynRunException,save_info_dynrec[sct].eip_change,save_info_dynrec[sct].cycles);
+				if (decode.code_big) gen_call_function_II((void *)&DynRunException,save_info_dynrec[sct].eip_change,save_info_dynrec[sct].cycles);
 				else gen_call_function_II((void *)&DynRunException,save_info_dynrec[sct].eip_change&0xffff,save_info_dynrec[sct].cycles);
 				dyn_return(BR_Normal,true);
 				break;
@@ -683,6 +884,12 @@ static void dyn_fill_blocks(void) {
 				gen_add_direct_word(&reg_eip,save_info_dynrec[sct].eip_change,decode.big_op);
 				dyn_return(BR_Cycles);
 				break;
+			case trace_exit:
+				// side exit of a superblock, continue with the dispatcher
+				gen_sub_direct_word(&CPU_Cycles,save_info_dynrec[sct].cycles,true);
+				gen_add_direct_word(&reg_eip,save_info_dynrec[sct].eip_change,decode.code_big);
+				dyn_return(BR_Normal);
+				break;
 		}
 	}
 	used_save_info_dynrec=0;
@@ -705,8 +912,9 @@ static void dyn_check_exception(HostReg reg) {
 	save_info_dynrec[used_save_info_dynrec].cycles=decode.cycles;
 	// in case of an exception eip will point to the start of the current instruction
 	save_info_dynrec[used_save_info_dynrec].eip_change=decode.op_start-decode.code_start;
-	if (!cpu.code.big) save_info_dynrec[used_save_info_dynrec].eip_change&=0xffff;
+	if (!decode.code_big) save_info_dynrec[used_save_info_dynrec].eip_change&=0xffff;
 	save_info_dynrec[used_save_info_dynrec].type=db_exception;
+	save_info_dynrec[used_save_info_dynrec].dirty_regs=regcache.dirty;
 	used_save_info_dynrec++;
 }
 
@@ -779,16 +987,24 @@ bool DRC_CALL_CONV mem_writed_checked_drc(PhysPt address,Bit32u val) {
 
 // functions that enable access to the memory
 
+// call a memory access helper, a fault handler that runs during the
+// access returns with the guest registers unchanged
+static void dyn_mem_call(void * func) {
+	dyn_regcache_calls(RC_CALL_SYNC);
+	gen_call_function_raw(func);
+	dyn_regcache_calls(RC_CALL_FULL);
+}
+
 // read a byte from a given address and store it in reg_dst
 static void dyn_read_byte(HostReg reg_addr,HostReg reg_dst) {
 	gen_mov_regs(FC_OP1,reg_addr);
-	gen_call_function_raw((void *)&mem_readb_checked_drc);
+	dyn_mem_call((void *)&mem_readb_checked_drc);
 	dyn_check_exception(FC_RETOP);
 	gen_mov_byte_to_reg_low(reg_dst,&core_dynrec.readdata);
 }
 static void dyn_read_byte_canuseword(HostReg reg_addr,HostReg reg_dst) {
 	gen_mov_regs(FC_OP1,reg_addr);
-	gen_call_function_raw((void *)&mem_readb_checked_drc);
+	dyn_mem_call((void *)&mem_readb_checked_drc);
 	dyn_check_exception(FC_RETOP);
 	gen_mov_byte_to_reg_low_canuseword(reg_dst,&core_dynrec.readdata);
 }
@@ -797,7 +1013,7 @@ static void dyn_read_byte_canuseword(HostReg reg_addr,HostReg reg_dst) {
 static void dyn_write_byte(HostReg reg_addr,HostReg reg_val) {
 	gen_mov_regs(FC_OP2,reg_val);
 	gen_mov_regs(FC_OP1,reg_addr);
-	gen_call_function_raw((void *)&mem_writeb_checked_drc);
+	dyn_mem_call((void *)&mem_writeb_checked_drc);
 	dyn_check_exception(FC_RETOP);
 }
 
@@ -805,8 +1021,8 @@ static void dyn_write_byte(HostReg reg_addr,HostReg reg_val) {
 // from a given address and store it in reg_dst
 static void dyn_read_word(HostReg reg_addr,HostReg reg_dst,bool dword) {
 	gen_mov_regs(FC_OP1,reg_addr);
-	if (dword) gen_call_function_raw((void *)&mem_readd_checked_drc);
-	else gen_call_function_raw((void *)&mem_readw_checked_drc);
+	if (dword) dyn_mem_call((void *)&mem_readd_checked_drc);
+	else dyn_mem_call((void *)&mem_readw_checked_drc);
 	dyn_check_exception(FC_RETOP);
 	gen_mov_word_to_reg(reg_dst,&core_dynrec.readdata,dword);
 }
@@ -817,8 +1033,8 @@ static void dyn_write_word(HostReg reg_addr,HostReg reg_val,bool dword) {
 //	if (!dword) gen_extend_word(false,reg_val);
 	gen_mov_regs(FC_OP2,reg_val);
 	gen_mov_regs(FC_OP1,reg_addr);
-	if (dword) gen_call_function_raw((void *)&mem_writed_checked_drc);
-	else gen_call_function_raw((void *)&mem_writew_checked_drc);
+	if (dword) dyn_mem_call((void *)&mem_writed_checked_drc);
+	else dyn_mem_call((void *)&mem_writew_checked_drc);
 	dyn_check_exception(FC_RETOP);
 }
 
@@ -843,7 +1059,7 @@ static void dyn_lea_mem_mem(HostReg ea_reg,void* op1,void* op2,Bitu scale,Bits i
 	}
 }
 
-#ifdef DRC_USE_REGS_ADDR
+#if defined(DRC_USE_REGS_ADDR) || defined(DRC_USE_REG_CACHE)
 // effective address calculation helper
 // loads op1 into ea_reg and adds the scaled op2 and the immediate to it
 // op1 is cpu_regs[op1_index], op2 is cpu_regs[op2_index] 
@@ -881,7 +1097,7 @@ static void dyn_lea_mem_regval(HostReg ea_reg,void* op1,Bitu op2_index,Bitu scal
 #endif
 
 #ifdef DRC_USE_SEGS_ADDR
-#ifdef DRC_USE_REGS_ADDR
+#if defined(DRC_USE_REGS_ADDR) || defined(DRC_USE_REG_CACHE)
 // effective address calculation helper
 // loads op1 into ea_reg and adds the scaled op2 and the immediate to it
 // op1 is Segs[op1_index], op2 is cpu_regs[op2_index] 
@@ -1201,6 +1417,17 @@ static void gen_restore_reg(HostReg reg,HostReg dest_reg) {
 // they try to find out if a function can be replaced by another
 // one that does not generate any flags at all
 
+// maximum number of instructions looked at by the flags pre-pass
+#define FLAGS_SCAN_MAX 64
+
+// result of the flags pre-pass for the instructions that follow
+static struct {
+	PhysPt addr[FLAGS_SCAN_MAX];	// start of the instruction
+	bool dead[FLAGS_SCAN_MAX];		// produced condition flags are never used
+	Bitu count;
+	Bitu pos;						// next instruction to translate
+} flags_scan;
+
 static Bitu mf_functions_num=0;
 static struct {
 	const Bit8u* pos;
@@ -1210,6 +1437,8 @@ static struct {
 
 static void InitFlagsOptimization(void) {
 	mf_functions_num=0;
+	flags_scan.count=0;
+	flags_scan.pos=0;
 }
 
 // replace all queued functions with their simpler variants
@@ -1269,3 +1498,223 @@ static void AcquireFlags(Bitu flags_mask) {
 	mf_functions_num=0;
 #endif
 }
+
+
+// condition flag behaviour of the instructions known to the pre-pass
+enum FlagsOpType {
+	FOP_NONE,		// doesn't touch the condition flags
+	FOP_ALU,		// produces all condition flags
+	FOP_ALU_CF,		// produces all condition flags, uses the carry flag
+	FOP_INCDEC,		// produces all condition flags except the carry flag
+	FOP_SHIFT,		// produces all condition flags unless the count is zero
+	FOP_ROTATE,		// produces carry and overflow flag unless the count is zero
+	FOP_ROTATE_CF	// same as FOP_ROTATE, uses the carry flag
+};
+
+// size of the modrm byte including sib byte and displacement
+static Bitu dyn_flags_modrm_len(PhysPt addr,bool big_addr) {
+	Bit8u modrm=decode_peekb(addr);
+	Bitu mod=modrm>>6;
+	Bitu rm=modrm&7;
+	if (mod==3) return 1;
+	if (big_addr) {
+		Bitu len=1;
+		if (rm==4) {
+			len++;
+			if ((mod==0) && ((decode_peekb(addr+1)&7)==5)) return len+4;
+		} else if ((mod==0) && (rm==5)) return len+4;
+		if (mod==1) return len+1;
+		if (mod==2) return len+4;
+		return len;
+	}
+	if ((mod==0) && (rm==6)) return 3;
+	if (mod==1) return 2;
+	if (mod==2) return 3;
+	return 1;
+}
+
+// decode the length and condition flag behaviour of the instruction at addr,
+// returns zero if the instruction is not known or may use the flags
+static Bitu dyn_flags_decode(PhysPt addr,FlagsOpType & type,bool & count_known) {
+	bool big_op=decode.code_big;
+	bool big_addr=decode.code_big;
+	PhysPt start=addr;
+	Bitu opcode;
+	for (Bitu prefixes=0;;prefixes++) {
+		if (prefixes>4) return 0;
+		opcode=decode_peekb(addr++);
+		switch (opcode) {
+		case 0x26:case 0x2e:case 0x36:case 0x3e:case 0x64:case 0x65:
+			continue;
+		case 0x66:big_op=!big_op;continue;
+		case 0x67:big_addr=!big_addr;continue;
+		}
+		break;
+	}
+	Bitu immv=big_op ? 4 : 2;
+	type=FOP_NONE;
+	count_known=false;
+	if (opcode<0x40) {
+		switch (opcode&7) {
+		case 0:case 1:case 2:case 3:addr+=dyn_flags_modrm_len(addr,big_addr);break;
+		case 4:addr+=1;break;
+		case 5:addr+=immv;break;
+		default:return 0;	// segment push/pop, bcd adjustments
+		}
+		Bitu op=(opcode>>3)&7;
+		type=((op==2) || (op==3)) ? FOP_ALU_CF : FOP_ALU;
+		return addr-start;
+	}
+	Bitu reg;
+	switch (opcode) {
+	case 0x40:case 0x41:case 0x42:case 0x43:case 0x44:case 0x45:case 0x46:case 0x47:
+	case 0x48:case 0x49:case 0x4a:case 0x4b:case 0x4c:case 0x4d:case 0x4e:case 0x4f:
+		type=FOP_INCDEC;
+		break;
+	case 0x50:case 0x51:case 0x52:case 0x53:case 0x54:case 0x55:case 0x56:case 0x57:
+	case 0x58:case 0x59:case 0x5a:case 0x5b:case 0x5c:case 0x5d:case 0x5e:case 0x5f:
+	case 0x90:case 0x91:case 0x92:case 0x93:case 0x94:case 0x95:case 0x96:case 0x97:
+	case 0x98:case 0x99:
+		break;
+	case 0x80:case 0x82:case 0x81:case 0x83:
+		reg=(decode_peekb(addr)>>3)&7;
+		type=((reg==2) || (reg==3)) ? FOP_ALU_CF : FOP_ALU;
+		addr+=dyn_flags_modrm_len(addr,big_addr);
+		addr+=(opcode==0x81) ? immv : 1;
+		break;
+	case 0x84:case 0x85:
+		type=FOP_ALU;
+		addr+=dyn_flags_modrm_len(addr,big_addr);
+		break;
+	case 0x86:case 0x87:case 0x88:case 0x89:case 0x8a:case 0x8b:case 0x8d:
+		addr+=dyn_flags_modrm_len(addr,big_addr);
+		break;
+	case 0xa8:type=FOP_ALU;addr+=1;break;
+	case 0xa9:type=FOP_ALU;addr+=immv;break;
+	case 0xb0:case 0xb1:case 0xb2:case 0xb3:case 0xb4:case 0xb5:case 0xb6:case 0xb7:
+		addr+=1;
+		break;
+	case 0xb8:case 0xb9:case 0xba:case 0xbb:case 0xbc:case 0xbd:case 0xbe:case 0xbf:
+		addr+=immv;
+		break;
+	case 0xc0:case 0xc1:case 0xd0:case 0xd1:case 0xd2:case 0xd3:
+		reg=(decode_peekb(addr)>>3)&7;
+		if (reg<2) type=FOP_ROTATE;
+		else if (reg<4) type=FOP_ROTATE_CF;
+		else type=FOP_SHIFT;
+		addr+=dyn_flags_modrm_len(addr,big_addr);
+		if (opcode<0xc2) count_known=(decode_peekb(addr++)&0x1f)!=0;
+		else if (opcode<0xd2) count_known=true;
+		break;
+	case 0xc6:case 0xc7:
+		if ((decode_peekb(addr)>>3)&7) return 0;
+		addr+=dyn_flags_modrm_len(addr,big_addr);
+		addr+=(opcode==0xc7) ? immv : 1;
+		break;
+	case 0xf6:case 0xf7:
+		reg=(decode_peekb(addr)>>3)&7;
+		addr+=dyn_flags_modrm_len(addr,big_addr);
+		switch (reg) {
+		case 0:case 1:type=FOP_ALU;addr+=(opcode==0xf7) ? immv : 1;break;
+		case 2:break;
+		case 3:type=FOP_ALU;break;
+		default:return 0;	// multiplication/division
+		}
+		break;
+	case 0xfe:case 0xff:
+		reg=(decode_peekb(addr)>>3)&7;
+		if (reg>1) return 0;
+		type=FOP_INCDEC;
+		addr+=dyn_flags_modrm_len(addr,big_addr);
+		break;
+	default:
+		// conditional jumps, flag reading or block ending instructions
+		return 0;
+	}
+	return addr-start;
+}
+
+/*
+	Pre-pass that decodes the instructions following the current one and
+	determines the condition flags that are needed after each instruction.
+	An instruction whose flags are overwritten before any use doesn't need
+	to produce them, the simple variant of the operation is used instead.
+	The scan stops at the first instruction that uses the flags, ends the
+	block or isn't known, all flags are considered needed after that.
+	Like with the flags invalidation above, flags that would only be seen
+	by an exception handler are not taken into account.
+*/
+static void dyn_flags_analyse(Bitu max_insns) {
+	struct {
+		Bitu produces;	// flags that are produced (zero if the operation has no simple variant)
+		Bitu defines;	// flags that are always overwritten
+		Bitu uses;
+	} ops[FLAGS_SCAN_MAX];
+	flags_scan.count=0;
+	flags_scan.pos=0;
+	if (decode.page.index>=4096) return;
+	if (max_insns>FLAGS_SCAN_MAX) max_insns=FLAGS_SCAN_MAX;
+
+	PhysPt addr=decode.code;
+	Bitu index=decode.page.index;
+	Bitu count=0;
+	while (count<max_insns) {
+		// don't look beyond the current page or at modified code
+		if (index>4096-24) break;
+		if (decode.page.invmap && decode.page.invmap[index]) break;
+		FlagsOpType type;
+		bool count_known;
+		Bitu len=dyn_flags_decode(addr,type,count_known);
+		if (!len) break;
+		switch (type) {
+		case FOP_NONE:
+			ops[count].produces=0;ops[count].defines=0;ops[count].uses=0;
+			break;
+		case FOP_ALU:
+			ops[count].produces=FMASK_TEST;ops[count].defines=FMASK_TEST;ops[count].uses=0;
+			break;
+		case FOP_ALU_CF:
+			ops[count].produces=FMASK_TEST;ops[count].defines=FMASK_TEST;ops[count].uses=FLAG_CF;
+			break;
+		case FOP_INCDEC:
+			ops[count].produces=FMASK_TEST&~FLAG_CF;ops[count].defines=FMASK_TEST&~FLAG_CF;ops[count].uses=0;
+			break;
+		case FOP_SHIFT:
+			ops[count].produces=FMASK_TEST;ops[count].defines=count_known ? FMASK_TEST : 0;ops[count].uses=0;
+			break;
+		case FOP_ROTATE:
+			ops[count].produces=FLAG_CF|FLAG_OF;ops[count].defines=count_known ? (FLAG_CF|FLAG_OF) : 0;ops[count].uses=0;
+			break;
+		case FOP_ROTATE_CF:
+			// always generates the flags
+			ops[count].produces=0;ops[count].defines=count_known ? (FLAG_CF|FLAG_OF) : 0;ops[count].uses=FLAG_CF;
+			break;
+		}
+		flags_scan.addr[count]=addr;
+		count++;
+		addr+=len;
+		index+=len;
+	}
+
+	// walk backwards, all flags are needed behind the scanned instructions
+	Bitu needed=FMASK_TEST;
+	for (Bits ct=(Bits)count-1;ct>=0;ct--) {
+		flags_scan.dead[ct]=ops[ct].produces && !(needed & ops[ct].produces);
+		if (flags_scan.dead[ct]) {
+			// the simple variant leaves the flags untouched
+			needed|=ops[ct].uses;
+		} else needed=(needed & ~ops[ct].defines) | ops[ct].uses;
+	}
+	flags_scan.count=count;
+}
+
+// see if the condition flags produced by the instruction at the current
+// position are used, max_insns is the number of instructions that can
+// still be part of the block
+static bool dyn_flags_dead(Bitu max_insns) {
+	if ((flags_scan.pos>=flags_scan.count) || (flags_scan.addr[flags_scan.pos]!=decode.code)) {
+		dyn_flags_analyse(max_insns);
+		if (!flags_scan.count) return false;
+	}
+	return flags_scan.dead[flags_scan.pos++];
+}
@@ -403,9 +403,9 @@ static void dyn_push_seg(Bit8u seg) {
 	MOV_SEG_VAL_TO_HOST_REG(FC_OP1,seg);
 	if (decode.big_op) {
 		gen_extend_word(false,FC_OP1);
-		gen_call_function_raw((void*)&dynrec_push_dword);
+		dyn_mem_call((void*)&dynrec_push_dword);
 	} else {
-		gen_call_function_raw((void*)&dynrec_push_word);
+		dyn_mem_call((void*)&dynrec_push_word);
 	}
 }
 
@@ -416,29 +416,29 @@ static void dyn_pop_seg(Bit8u seg) {
 
 static void dyn_push_reg(Bit8u reg) {
 	MOV_REG_WORD_TO_HOST_REG(FC_OP1,reg,decode.big_op);
-	if (decode.big_op) gen_call_function_raw((void*)&dynrec_push_dword);
-	else gen_call_function_raw((void*)&dynrec_push_word);
+	if (decode.big_op) dyn_mem_call((void*)&dynrec_push_dword);
+	else dyn_mem_call((void*)&dynrec_push_word);
 }
 
 static void dyn_pop_reg(Bit8u reg) {
-	if (decode.big_op) gen_call_function_raw((void*)&dynrec_pop_dword);
-	else gen_call_function_raw((void*)&dynrec_pop_word);
+	if (decode.big_op) dyn_mem_call((void*)&dynrec_pop_dword);
+	else dyn_mem_call((void*)&dynrec_pop_word);
 	MOV_REG_WORD_FROM_HOST_REG(FC_RETOP,reg,decode.big_op);
 }
 
 static void dyn_push_byte_imm(Bit8s imm) {
 	gen_mov_dword_to_reg_imm(FC_OP1,(Bit32u)imm);
-	if (decode.big_op) gen_call_function_raw((void*)&dynrec_push_dword);
-	else gen_call_function_raw((void*)&dynrec_push_word);
+	if (decode.big_op) dyn_mem_call((void*)&dynrec_push_dword);
+	else dyn_mem_call((void*)&dynrec_push_word);
 }
 
 static void dyn_push_word_imm(Bitu imm) {
 	if (decode.big_op) {
 		gen_mov_dword_to_reg_imm(FC_OP1,imm);
-		gen_call_function_raw((void*)&dynrec_push_dword);
+		dyn_mem_call((void*)&dynrec_push_dword);
 	} else {
 		gen_mov_word_to_reg_imm(FC_OP1,(Bit16u)imm);
-		gen_call_function_raw((void*)&dynrec_push_word);
+		dyn_mem_call((void*)&dynrec_push_word);
 	}
 }
 
@@ -448,13 +448,13 @@ static void dyn_pop_ev(void) {
 		// save original ESP
 		MOV_REG_WORD32_TO_HOST_REG(FC_OP2,DRC_REG_ESP);
 		gen_protect_reg(FC_OP2);
-		if (decode.big_op) gen_call_function_raw((void*)&dynrec_pop_dword);
-		else gen_call_function_raw((void*)&dynrec_pop_word);
+		if (decode.big_op) dyn_mem_call((void*)&dynrec_pop_dword);
+		else dyn_mem_call((void*)&dynrec_pop_word);
 		dyn_fill_ea(FC_ADDR);
 		gen_mov_regs(FC_OP2,FC_RETOP);
 		gen_mov_regs(FC_OP1,FC_ADDR);
-		if (decode.big_op) gen_call_function_raw((void *)&mem_writed_checked_drc);
-		else gen_call_function_raw((void *)&mem_writew_checked_drc);
+		if (decode.big_op) dyn_mem_call((void *)&mem_writed_checked_drc);
+		else dyn_mem_call((void *)&mem_writew_checked_drc);
 		gen_extend_byte(false,FC_RETOP); // bool -> dword
 		const Bit8u* no_fault = gen_create_branch_on_zero(FC_RETOP, true);
 		// restore original ESP
@@ -463,8 +463,8 @@ static void dyn_pop_ev(void) {
 		dyn_check_exception(FC_RETOP);
 		gen_fill_branch(no_fault);
 	} else {
-		if (decode.big_op) gen_call_function_raw((void*)&dynrec_pop_dword);
-		else gen_call_function_raw((void*)&dynrec_pop_word);
+		if (decode.big_op) dyn_mem_call((void*)&dynrec_pop_dword);
+		else dyn_mem_call((void*)&dynrec_pop_word);
 		MOV_REG_WORD_FROM_HOST_REG(FC_RETOP,decode.modrm.rm,decode.big_op);
 	}
 }
@@ -852,8 +852,8 @@ static Bitu dyn_grp4_ev(void) {
 		gen_protect_addr_reg();
 		gen_mov_word_to_reg(FC_OP1,decode.big_op?(void*)(&reg_eip):(void*)(&reg_ip),decode.big_op);
 		gen_add_imm(FC_OP1,(Bit32u)(decode.code-decode.code_start));
-		if (decode.big_op) gen_call_function_raw((void*)&dynrec_push_dword);
-		else gen_call_function_raw((void*)&dynrec_push_word);
+		if (decode.big_op) dyn_mem_call((void*)&dynrec_push_dword);
+		else dyn_mem_call((void*)&dynrec_push_word);
 
 		gen_restore_addr_reg();
 		gen_mov_word_from_reg(FC_ADDR,decode.big_op?(void*)(&reg_eip):(void*)(&reg_ip),decode.big_op);
@@ -876,8 +876,8 @@ static Bitu dyn_grp4_ev(void) {
 			decode.big_op,FC_OP2,FC_ADDR,FC_RETOP);
 		return 1;
 	case 0x6:		// PUSH Ev
-		if (decode.big_op) gen_call_function_raw((void*)&dynrec_push_dword);
-		else gen_call_function_raw((void*)&dynrec_push_word);
+		if (decode.big_op) dyn_mem_call((void*)&dynrec_push_dword);
+		else dyn_mem_call((void*)&dynrec_push_word);
 		break;
 	default:
 //		IllegalOptionDynrec("dyn_grp4_ev");
@@ -1098,14 +1098,85 @@ static void dyn_sahf(void) {
 static void dyn_exit_link(Bits eip_change) {
 	gen_add_direct_word(&reg_eip,(decode.code-decode.code_start)+eip_change,decode.big_op);
 	dyn_reduce_cycles();
+	dyn_regcache_writeback();
 	gen_jmp_ptr(&decode.block->link[0].to,offsetof(CacheBlockDynRec,cache.start));
 	dyn_closeblock();
 }
 
 
-static void dyn_branched_exit(BranchTypes btype,Bit32s eip_add) {
+// see if the block counters show a clearly preferred path for the
+// conditional jump that ends the block
+static TraceBias dyn_trace_bias(Bitu usage,Bitu taken) {
+	if (taken>usage) taken=usage;
+	if ((usage-taken)*8>=usage*7) return TRACE_BIAS_NOTTAKEN;
+	if (taken*8>=usage*7) return TRACE_BIAS_TAKEN;
+	return TRACE_BIAS_NONE;
+}
+
+// continue the translation of a superblock across a conditional jump,
+// the less used path leaves the superblock through a side exit
+static bool dyn_trace_branch(BranchTypes btype,Bit32s eip_add) {
+	if (decode.active_block!=decode.block) return false;
+	if (decode.big_op!=decode.code_big) return false;
+	Bitu end=decode.page.index-1;
+	Bitu usage,taken;
+	if (decode.trace.seg_start==decode.code_start) {
+		// jump that ended the block which is replaced
+		if (decode.trace.end!=end) return false;
+		usage=decode.trace.usage;
+		taken=decode.trace.taken;
+	} else {
+		// the block that starts at the current part has to end with this jump
+		CacheBlockDynRec * seg=decode.page.code->FindCacheBlock(decode.trace.seg_start&4095);
+		if (!seg || (seg->trace!=TRACE_CANDIDATE) || (seg->page.end!=end)) return false;
+		if (seg->usage<DYN_TRACE_SAMPLES) return false;
+		usage=seg->usage;
+		taken=seg->taken;
+	}
+	Bitu eip_base=decode.code-decode.code_start;
+	BranchTypes exit_type;
+	Bit32u exit_eip;
+	switch (dyn_trace_bias(usage,taken)) {
+	case TRACE_BIAS_NOTTAKEN:
+		exit_type=btype;
+		exit_eip=(Bit32u)(eip_base+eip_add);
+		break;
+	case TRACE_BIAS_TAKEN:
+		// only forward jumps inside the page are followed
+		if ((eip_add<=0) || (decode.page.index+eip_add>=4096)) return false;
+		if (!decode.code_big && (reg_eip+eip_base+eip_add>0xffff)) return false;
+		exit_type=(BranchTypes)(btype^1);
+		exit_eip=(Bit32u)eip_base;
+		break;
+	default:
+		return false;
+	}
+
+	// the code behind the side exit needs the condition flags
+	AcquireFlags(FMASK_TEST);
+	dyn_branchflag_to_reg(exit_type);
+	save_info_dynrec[used_save_info_dynrec].branch_pos=gen_create_branch_long_nonzero(FC_RETOP,true);
+	save_info_dynrec[used_save_info_dynrec].eip_change=exit_eip;
+	save_info_dynrec[used_save_info_dynrec].cycles=decode.cycles;
+	save_info_dynrec[used_save_info_dynrec].type=trace_exit;
+	save_info_dynrec[used_save_info_dynrec].dirty_regs=regcache.dirty;
+	used_save_info_dynrec++;
+
+	if (exit_type!=btype) {
+		// continue at the jump target, the skipped bytes are not part of the block
+		decode.code+=eip_add;
+		decode.page.index+=eip_add;
+	}
+	decode.trace.seg_start=decode.code;
+	return true;
+}
+
+// returns true if the translation continues behind the jump (superblock)
+static bool dyn_branched_exit(BranchTypes btype,Bit32s eip_add) {
+	if (decode.trace.active && dyn_trace_branch(btype,eip_add)) return true;
 	Bitu eip_base=decode.code-decode.code_start;
 	dyn_reduce_cycles();
+	dyn_regcache_writeback();
 
 	dyn_branchflag_to_reg(btype);
 	const Bit8u* data=gen_create_branch_on_nonzero(FC_RETOP,true);
@@ -1116,9 +1187,15 @@ static void dyn_branched_exit(BranchTypes btype,Bit32s eip_add) {
  	gen_fill_branch(data);
 
  	// Branch taken
+	if (!decode.trace.active) {
+		// count it, frequently executed blocks might be merged with the preferred path
+		gen_add_direct_word(&decode.block->taken,1,true);
+		decode.block->trace=TRACE_CANDIDATE;
+	}
 	gen_add_direct_word(&reg_eip,eip_base+eip_add,decode.big_op);
  	gen_jmp_ptr(&decode.block->link[1].to,offsetof(CacheBlockDynRec,cache.start));
  	dyn_closeblock();
+	return false;
 }
 
 /*
@@ -1137,6 +1214,8 @@ static void dyn_set_byte_on_condition(BranchTypes btype) {
 
 static void dyn_loop(LoopTypes type) {
 	dyn_reduce_cycles();
+	// ECX is modified on only some of the paths
+	dyn_regcache_lock();
 	Bits eip_add=(Bit8s)decode_fetchb();
 	Bitu eip_base=decode.code-decode.code_start;
 	const Bit8u* branch1=0;
@@ -1184,9 +1263,9 @@ static void dyn_loop(LoopTypes type) {
 static void dyn_ret_near(Bitu bytes) {
 	dyn_reduce_cycles();
 
-	if (decode.big_op) gen_call_function_raw((void*)&dynrec_pop_dword);
+	if (decode.big_op) dyn_mem_call((void*)&dynrec_pop_dword);
 	else {
-		gen_call_function_raw((void*)&dynrec_pop_word);
+		dyn_mem_call((void*)&dynrec_pop_word);
 		gen_extend_word(false,FC_RETOP);
 	}
 	gen_mov_word_from_reg(FC_RETOP,decode.big_op?(void*)(&reg_eip):(void*)(&reg_ip),true);
@@ -1201,13 +1280,14 @@ static void dyn_call_near_imm(void) {
 	if (decode.big_op) imm=(Bit32s)decode_fetchd();
 	else imm=(Bit16s)decode_fetchw();
 	dyn_set_eip_end(FC_OP1);
-	if (decode.big_op) gen_call_function_raw((void*)&dynrec_push_dword);
-	else gen_call_function_raw((void*)&dynrec_push_word);
+	if (decode.big_op) dyn_mem_call((void*)&dynrec_push_dword);
+	else dyn_mem_call((void*)&dynrec_push_word);
 
 	dyn_set_eip_end(FC_OP1,imm);
 	gen_mov_word_from_reg(FC_OP1,decode.big_op?(void*)(&reg_eip):(void*)(&reg_ip),decode.big_op);
 
 	dyn_reduce_cycles();
+	dyn_regcache_writeback();
 	gen_jmp_ptr(&decode.block->link[0].to,offsetof(CacheBlockDynRec,cache.start));
 	dyn_closeblock();
 }
@@ -1315,6 +1395,7 @@ static void dyn_string(StringOps op) {
 		save_info_dynrec[used_save_info_dynrec].branch_pos=gen_create_branch_long_nonzero(FC_RETOP,true);
 		save_info_dynrec[used_save_info_dynrec].eip_change=decode.op_start-decode.code_start;
 		save_info_dynrec[used_save_info_dynrec].type=string_break;
+		save_info_dynrec[used_save_info_dynrec].dirty_regs=regcache.dirty;
 		used_save_info_dynrec++;
 	}
 }
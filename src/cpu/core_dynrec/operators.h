@@ -391,45 +391,59 @@ static void DRC_CALL_CONV dynrec_test_dword_simple(Bit32u op1,Bit32u op2) {
 }
 
 
+// call a helper that only works on its parameters and the lazy flags,
+// no guest register has to be written back for it
+static void INLINE dyn_pure_call(void* fct_ptr) {
+	dyn_regcache_calls(RC_CALL_PURE);
+	gen_call_function_raw(fct_ptr);
+	dyn_regcache_calls(RC_CALL_FULL);
+}
+
+// call the flags generating function unless the pre-pass found that
+// the produced flags are not used, the simple variant is called then
+static void INLINE dyn_flags_call(void* fct_ptr,void* simple_fct_ptr) {
+	dyn_pure_call(decode.flags_dead ? simple_fct_ptr : fct_ptr);
+}
+
 static void dyn_dop_byte_gencall(DualOps op) {
 	switch (op) {
 		case DOP_ADD:
 			InvalidateFlags((void*)&dynrec_add_byte_simple,t_ADDb);
-			gen_call_function_raw((void*)&dynrec_add_byte);
+			dyn_flags_call((void*)&dynrec_add_byte,(void*)&dynrec_add_byte_simple);
 			break;
 		case DOP_ADC:
 			AcquireFlags(FLAG_CF);
 			InvalidateFlagsPartially((void*)&dynrec_adc_byte_simple,t_ADCb);
-			gen_call_function_raw((void*)&dynrec_adc_byte);
+			dyn_flags_call((void*)&dynrec_adc_byte,(void*)&dynrec_adc_byte_simple);
 			break;
 		case DOP_SUB:
 			InvalidateFlags((void*)&dynrec_sub_byte_simple,t_SUBb);
-			gen_call_function_raw((void*)&dynrec_sub_byte);
+			dyn_flags_call((void*)&dynrec_sub_byte,(void*)&dynrec_sub_byte_simple);
 			break;
 		case DOP_SBB:
 			AcquireFlags(FLAG_CF);
 			InvalidateFlagsPartially((void*)&dynrec_sbb_byte_simple,t_SBBb);
-			gen_call_function_raw((void*)&dynrec_sbb_byte);
+			dyn_flags_call((void*)&dynrec_sbb_byte,(void*)&dynrec_sbb_byte_simple);
 			break;
 		case DOP_CMP:
 			InvalidateFlags((void*)&dynrec_cmp_byte_simple,t_CMPb);
-			gen_call_function_raw((void*)&dynrec_cmp_byte);
+			dyn_flags_call((void*)&dynrec_cmp_byte,(void*)&dynrec_cmp_byte_simple);
 			break;
 		case DOP_XOR:
 			InvalidateFlags((void*)&dynrec_xor_byte_simple,t_XORb);
-			gen_call_function_raw((void*)&dynrec_xor_byte);
+			dyn_flags_call((void*)&dynrec_xor_byte,(void*)&dynrec_xor_byte_simple);
 			break;
 		case DOP_AND:
 			InvalidateFlags((void*)&dynrec_and_byte_simple,t_ANDb);
-			gen_call_function_raw((void*)&dynrec_and_byte);
+			dyn_flags_call((void*)&dynrec_and_byte,(void*)&dynrec_and_byte_simple);
 			break;
 		case DOP_OR:
 			InvalidateFlags((void*)&dynrec_or_byte_simple,t_ORb);
-			gen_call_function_raw((void*)&dynrec_or_byte);
+			dyn_flags_call((void*)&dynrec_or_byte,(void*)&dynrec_or_byte_simple);
 			break;
 		case DOP_TEST:
 			InvalidateFlags((void*)&dynrec_test_byte_simple,t_TESTb);
-			gen_call_function_raw((void*)&dynrec_test_byte);
+			dyn_flags_call((void*)&dynrec_test_byte,(void*)&dynrec_test_byte_simple);
 			break;
 		default: IllegalOptionDynrec("dyn_dop_byte_gencall");
 	}
@@ -440,41 +454,41 @@ static void dyn_dop_word_gencall(DualOps op,bool dword) {
 		switch (op) {
 			case DOP_ADD:
 				InvalidateFlags((void*)&dynrec_add_dword_simple,t_ADDd);
-				gen_call_function_raw((void*)&dynrec_add_dword);
+				dyn_flags_call((void*)&dynrec_add_dword,(void*)&dynrec_add_dword_simple);
 				break;
 			case DOP_ADC:
 				AcquireFlags(FLAG_CF);
 				InvalidateFlagsPartially((void*)&dynrec_adc_dword_simple,t_ADCd);
-				gen_call_function_raw((void*)&dynrec_adc_dword);
+				dyn_flags_call((void*)&dynrec_adc_dword,(void*)&dynrec_adc_dword_simple);
 				break;
 			case DOP_SUB:
 				InvalidateFlags((void*)&dynrec_sub_dword_simple,t_SUBd);
-				gen_call_function_raw((void*)&dynrec_sub_dword);
+				dyn_flags_call((void*)&dynrec_sub_dword,(void*)&dynrec_sub_dword_simple);
 				break;
 			case DOP_SBB:
 				AcquireFlags(FLAG_CF);
 				InvalidateFlagsPartially((void*)&dynrec_sbb_dword_simple,t_SBBd);
-				gen_call_function_raw((void*)&dynrec_sbb_dword);
+				dyn_flags_call((void*)&dynrec_sbb_dword,(void*)&dynrec_sbb_dword_simple);
 				break;
 			case DOP_CMP:
 				InvalidateFlags((void*)&dynrec_cmp_dword_simple,t_CMPd);
-				gen_call_function_raw((void*)&dynrec_cmp_dword);
+				dyn_flags_call((void*)&dynrec_cmp_dword,(void*)&dynrec_cmp_dword_simple);
 				break;
 			case DOP_XOR:
 				InvalidateFlags((void*)&dynrec_xor_dword_simple,t_XORd);
-				gen_call_function_raw((void*)&dynrec_xor_dword);
+				dyn_flags_call((void*)&dynrec_xor_dword,(void*)&dynrec_xor_dword_simple);
 				break;
 			case DOP_AND:
 				InvalidateFlags((void*)&dynrec_and_dword_simple,t_ANDd);
-				gen_call_function_raw((void*)&dynrec_and_dword);
+				dyn_flags_call((void*)&dynrec_and_dword,(void*)&dynrec_and_dword_simple);
 				break;
 			case DOP_OR:
 				InvalidateFlags((void*)&dynrec_or_dword_simple,t_ORd);
-				gen_call_function_raw((void*)&dynrec_or_dword);
+				dyn_flags_call((void*)&dynrec_or_dword,(void*)&dynrec_or_dword_simple);
 				break;
 			case DOP_TEST:
 				InvalidateFlags((void*)&dynrec_test_dword_simple,t_TESTd);
-				gen_call_function_raw((void*)&dynrec_test_dword);
+				dyn_flags_call((void*)&dynrec_test_dword,(void*)&dynrec_test_dword_simple);
 				break;
 			default: IllegalOptionDynrec("dyn_dop_dword_gencall");
 		}
@@ -482,41 +496,41 @@ static void dyn_dop_word_gencall(DualOps op,bool dword) {
 		switch (op) {
 			case DOP_ADD:
 				InvalidateFlags((void*)&dynrec_add_word_simple,t_ADDw);
-				gen_call_function_raw((void*)&dynrec_add_word);
+				dyn_flags_call((void*)&dynrec_add_word,(void*)&dynrec_add_word_simple);
 				break;
 			case DOP_ADC:
 				AcquireFlags(FLAG_CF);
 				InvalidateFlagsPartially((void*)&dynrec_adc_word_simple,t_ADCw);
-				gen_call_function_raw((void*)&dynrec_adc_word);
+				dyn_flags_call((void*)&dynrec_adc_word,(void*)&dynrec_adc_word_simple);
 				break;
 			case DOP_SUB:
 				InvalidateFlags((void*)&dynrec_sub_word_simple,t_SUBw);
-				gen_call_function_raw((void*)&dynrec_sub_word);
+				dyn_flags_call((void*)&dynrec_sub_word,(void*)&dynrec_sub_word_simple);
 				break;
 			case DOP_SBB:
 				AcquireFlags(FLAG_CF);
 				InvalidateFlagsPartially((void*)&dynrec_sbb_word_simple,t_SBBw);
-				gen_call_function_raw((void*)&dynrec_sbb_word);
+				dyn_flags_call((void*)&dynrec_sbb_word,(void*)&dynrec_sbb_word_simple);
 				break;
 			case DOP_CMP:
 				InvalidateFlags((void*)&dynrec_cmp_word_simple,t_CMPw);
-				gen_call_function_raw((void*)&dynrec_cmp_word);
+				dyn_flags_call((void*)&dynrec_cmp_word,(void*)&dynrec_cmp_word_simple);
 				break;
 			case DOP_XOR:
 				InvalidateFlags((void*)&dynrec_xor_word_simple,t_XORw);
-				gen_call_function_raw((void*)&dynrec_xor_word);
+				dyn_flags_call((void*)&dynrec_xor_word,(void*)&dynrec_xor_word_simple);
 				break;
 			case DOP_AND:
 				InvalidateFlags((void*)&dynrec_and_word_simple,t_ANDw);
-				gen_call_function_raw((void*)&dynrec_and_word);
+				dyn_flags_call((void*)&dynrec_and_word,(void*)&dynrec_and_word_simple);
 				break;
 			case DOP_OR:
 				InvalidateFlags((void*)&dynrec_or_word_simple,t_ORw);
-				gen_call_function_raw((void*)&dynrec_or_word);
+				dyn_flags_call((void*)&dynrec_or_word,(void*)&dynrec_or_word_simple);
 				break;
 			case DOP_TEST:
 				InvalidateFlags((void*)&dynrec_test_word_simple,t_TESTw);
-				gen_call_function_raw((void*)&dynrec_test_word);
+				dyn_flags_call((void*)&dynrec_test_word,(void*)&dynrec_test_word_simple);
 				break;
 			default: IllegalOptionDynrec("dyn_dop_word_gencall");
 		}
@@ -667,18 +681,18 @@ static void dyn_sop_byte_gencall(SingleOps op) {
 	switch (op) {
 		case SOP_INC:
 			InvalidateFlagsPartially((void*)&dynrec_inc_byte_simple,t_INCb);
-			gen_call_function_raw((void*)&dynrec_inc_byte);
+			dyn_flags_call((void*)&dynrec_inc_byte,(void*)&dynrec_inc_byte_simple);
 			break;
 		case SOP_DEC:
 			InvalidateFlagsPartially((void*)&dynrec_dec_byte_simple,t_DECb);
-			gen_call_function_raw((void*)&dynrec_dec_byte);
+			dyn_flags_call((void*)&dynrec_dec_byte,(void*)&dynrec_dec_byte_simple);
 			break;
 		case SOP_NOT:
-			gen_call_function_raw((void*)&dynrec_not_byte);
+			dyn_pure_call((void*)&dynrec_not_byte);
 			break;
 		case SOP_NEG:
 			InvalidateFlags((void*)&dynrec_neg_byte_simple,t_NEGb);
-			gen_call_function_raw((void*)&dynrec_neg_byte);
+			dyn_flags_call((void*)&dynrec_neg_byte,(void*)&dynrec_neg_byte_simple);
 			break;
 		default: IllegalOptionDynrec("dyn_sop_byte_gencall");
 	}
@@ -689,18 +703,18 @@ static void dyn_sop_word_gencall(SingleOps op,bool dword) {
 		switch (op) {
 			case SOP_INC:
 				InvalidateFlagsPartially((void*)&dynrec_inc_dword_simple,t_INCd);
-				gen_call_function_raw((void*)&dynrec_inc_dword);
+				dyn_flags_call((void*)&dynrec_inc_dword,(void*)&dynrec_inc_dword_simple);
 				break;
 			case SOP_DEC:
 				InvalidateFlagsPartially((void*)&dynrec_dec_dword_simple,t_DECd);
-				gen_call_function_raw((void*)&dynrec_dec_dword);
+				dyn_flags_call((void*)&dynrec_dec_dword,(void*)&dynrec_dec_dword_simple);
 				break;
 			case SOP_NOT:
-				gen_call_function_raw((void*)&dynrec_not_dword);
+				dyn_pure_call((void*)&dynrec_not_dword);
 				break;
 			case SOP_NEG:
 				InvalidateFlags((void*)&dynrec_neg_dword_simple,t_NEGd);
-				gen_call_function_raw((void*)&dynrec_neg_dword);
+				dyn_flags_call((void*)&dynrec_neg_dword,(void*)&dynrec_neg_dword_simple);
 				break;
 			default: IllegalOptionDynrec("dyn_sop_dword_gencall");
 		}
@@ -708,18 +722,18 @@ static void dyn_sop_word_gencall(SingleOps op,bool dword) {
 		switch (op) {
 			case SOP_INC:
 				InvalidateFlagsPartially((void*)&dynrec_inc_word_simple,t_INCw);
-				gen_call_function_raw((void*)&dynrec_inc_word);
+				dyn_flags_call((void*)&dynrec_inc_word,(void*)&dynrec_inc_word_simple);
 				break;
 			case SOP_DEC:
 				InvalidateFlagsPartially((void*)&dynrec_dec_word_simple,t_DECw);
-				gen_call_function_raw((void*)&dynrec_dec_word);
+				dyn_flags_call((void*)&dynrec_dec_word,(void*)&dynrec_dec_word_simple);
 				break;
 			case SOP_NOT:
-				gen_call_function_raw((void*)&dynrec_not_word);
+				dyn_pure_call((void*)&dynrec_not_word);
 				break;
 			case SOP_NEG:
 				InvalidateFlags((void*)&dynrec_neg_word_simple,t_NEGw);
-				gen_call_function_raw((void*)&dynrec_neg_word);
+				dyn_flags_call((void*)&dynrec_neg_word,(void*)&dynrec_neg_word_simple);
 				break;
 			default: IllegalOptionDynrec("dyn_sop_word_gencall");
 		}
@@ -1115,32 +1129,32 @@ static void dyn_shift_byte_gencall(ShiftOps op) {
 	switch (op) {
 		case SHIFT_ROL:
 			InvalidateFlagsPartially((void*)&dynrec_rol_byte_simple,t_ROLb);
-			gen_call_function_raw((void*)&dynrec_rol_byte);
+			dyn_flags_call((void*)&dynrec_rol_byte,(void*)&dynrec_rol_byte_simple);
 			break;
 		case SHIFT_ROR:
 			InvalidateFlagsPartially((void*)&dynrec_ror_byte_simple,t_RORb);
-			gen_call_function_raw((void*)&dynrec_ror_byte);
+			dyn_flags_call((void*)&dynrec_ror_byte,(void*)&dynrec_ror_byte_simple);
 			break;
 		case SHIFT_RCL:
 			AcquireFlags(FLAG_CF);
-			gen_call_function_raw((void*)&dynrec_rcl_byte);
+			dyn_pure_call((void*)&dynrec_rcl_byte);
 			break;
 		case SHIFT_RCR:
 			AcquireFlags(FLAG_CF);
-			gen_call_function_raw((void*)&dynrec_rcr_byte);
+			dyn_pure_call((void*)&dynrec_rcr_byte);
 			break;
 		case SHIFT_SHL:
 		case SHIFT_SAL:
 			InvalidateFlagsPartially((void*)&dynrec_shl_byte_simple,t_SHLb);
-			gen_call_function_raw((void*)&dynrec_shl_byte);
+			dyn_flags_call((void*)&dynrec_shl_byte,(void*)&dynrec_shl_byte_simple);
 			break;
 		case SHIFT_SHR:
 			InvalidateFlagsPartially((void*)&dynrec_shr_byte_simple,t_SHRb);
-			gen_call_function_raw((void*)&dynrec_shr_byte);
+			dyn_flags_call((void*)&dynrec_shr_byte,(void*)&dynrec_shr_byte_simple);
 			break;
 		case SHIFT_SAR:
 			InvalidateFlagsPartially((void*)&dynrec_sar_byte_simple,t_SARb);
-			gen_call_function_raw((void*)&dynrec_sar_byte);
+			dyn_flags_call((void*)&dynrec_sar_byte,(void*)&dynrec_sar_byte_simple);
 			break;
 		default: IllegalOptionDynrec("dyn_shift_byte_gencall");
 	}
@@ -1151,32 +1165,32 @@ static void dyn_shift_word_gencall(ShiftOps op,bool dword) {
 		switch (op) {
 			case SHIFT_ROL:
 				InvalidateFlagsPartially((void*)&dynrec_rol_dword_simple,t_ROLd);
-				gen_call_function_raw((void*)&dynrec_rol_dword);
+				dyn_flags_call((void*)&dynrec_rol_dword,(void*)&dynrec_rol_dword_simple);
 				break;
 			case SHIFT_ROR:
 				InvalidateFlagsPartially((void*)&dynrec_ror_dword_simple,t_RORd);
-				gen_call_function_raw((void*)&dynrec_ror_dword);
+				dyn_flags_call((void*)&dynrec_ror_dword,(void*)&dynrec_ror_dword_simple);
 				break;
 			case SHIFT_RCL:
 				AcquireFlags(FLAG_CF);
-				gen_call_function_raw((void*)&dynrec_rcl_dword);
+				dyn_pure_call((void*)&dynrec_rcl_dword);
 				break;
 			case SHIFT_RCR:
 				AcquireFlags(FLAG_CF);
-				gen_call_function_raw((void*)&dynrec_rcr_dword);
+				dyn_pure_call((void*)&dynrec_rcr_dword);
 				break;
 			case SHIFT_SHL:
 			case SHIFT_SAL:
 				InvalidateFlagsPartially((void*)&dynrec_shl_dword_simple,t_SHLd);
-				gen_call_function_raw((void*)&dynrec_shl_dword);
+				dyn_flags_call((void*)&dynrec_shl_dword,(void*)&dynrec_shl_dword_simple);
 				break;
 			case SHIFT_SHR:
 				InvalidateFlagsPartially((void*)&dynrec_shr_dword_simple,t_SHRd);
-				gen_call_function_raw((void*)&dynrec_shr_dword);
+				dyn_flags_call((void*)&dynrec_shr_dword,(void*)&dynrec_shr_dword_simple);
 				break;
 			case SHIFT_SAR:
 				InvalidateFlagsPartially((void*)&dynrec_sar_dword_simple,t_SARd);
-				gen_call_function_raw((void*)&dynrec_sar_dword);
+				dyn_flags_call((void*)&dynrec_sar_dword,(void*)&dynrec_sar_dword_simple);
 				break;
 			default: IllegalOptionDynrec("dyn_shift_dword_gencall");
 		}
@@ -1184,32 +1198,32 @@ static void dyn_shift_word_gencall(ShiftOps op,bool dword) {
 		switch (op) {
 			case SHIFT_ROL:
 				InvalidateFlagsPartially((void*)&dynrec_rol_word_simple,t_ROLw);
-				gen_call_function_raw((void*)&dynrec_rol_word);
+				dyn_flags_call((void*)&dynrec_rol_word,(void*)&dynrec_rol_word_simple);
 				break;
 			case SHIFT_ROR:
 				InvalidateFlagsPartially((void*)&dynrec_ror_word_simple,t_RORw);
-				gen_call_function_raw((void*)&dynrec_ror_word);
+				dyn_flags_call((void*)&dynrec_ror_word,(void*)&dynrec_ror_word_simple);
 				break;
 			case SHIFT_RCL:
 				AcquireFlags(FLAG_CF);
-				gen_call_function_raw((void*)&dynrec_rcl_word);
+				dyn_pure_call((void*)&dynrec_rcl_word);
 				break;
 			case SHIFT_RCR:
 				AcquireFlags(FLAG_CF);
-				gen_call_function_raw((void*)&dynrec_rcr_word);
+				dyn_pure_call((void*)&dynrec_rcr_word);
 				break;
 			case SHIFT_SHL:
 			case SHIFT_SAL:
 				InvalidateFlagsPartially((void*)&dynrec_shl_word_simple,t_SHLw);
-				gen_call_function_raw((void*)&dynrec_shl_word);
+				dyn_flags_call((void*)&dynrec_shl_word,(void*)&dynrec_shl_word_simple);
 				break;
 			case SHIFT_SHR:
 				InvalidateFlagsPartially((void*)&dynrec_shr_word_simple,t_SHRw);
-				gen_call_function_raw((void*)&dynrec_shr_word);
+				dyn_flags_call((void*)&dynrec_shr_word,(void*)&dynrec_shr_word_simple);
 				break;
 			case SHIFT_SAR:
 				InvalidateFlagsPartially((void*)&dynrec_sar_word_simple,t_SARw);
-				gen_call_function_raw((void*)&dynrec_sar_word);
+				dyn_flags_call((void*)&dynrec_sar_word,(void*)&dynrec_sar_word_simple);
 				break;
 			default: IllegalOptionDynrec("dyn_shift_word_gencall");
 		}
@@ -1297,6 +1311,7 @@ static Bit32u DRC_CALL_CONV dynrec_dshr_dword_simple(Bit32u op1,Bit32u op2,Bit8u
 }
 
 static void dyn_dpshift_word_gencall(bool left) {
+	dyn_regcache_calls(RC_CALL_PURE);
 	if (left) {
 		const Bit8u* proc_addr=gen_call_function_R3((void*)&dynrec_dshl_word,FC_OP3);
 		InvalidateFlagsPartially((void*)&dynrec_dshl_word_simple,proc_addr,t_DSHLw);
@@ -1304,9 +1319,11 @@ static void dyn_dpshift_word_gencall(bool left) {
 		const Bit8u* proc_addr=gen_call_function_R3((void*)&dynrec_dshr_word,FC_OP3);
 		InvalidateFlagsPartially((void*)&dynrec_dshr_word_simple,proc_addr,t_DSHRw);
 	}
+	dyn_regcache_calls(RC_CALL_FULL);
 }
 
 static void dyn_dpshift_dword_gencall(bool left) {
+	dyn_regcache_calls(RC_CALL_PURE);
 	if (left) {
 		const Bit8u* proc_addr=gen_call_function_R3((void*)&dynrec_dshl_dword,FC_OP3);
 		InvalidateFlagsPartially((void*)&dynrec_dshl_dword_simple,proc_addr,t_DSHLd);
@@ -1314,6 +1331,7 @@ static void dyn_dpshift_dword_gencall(bool left) {
 		const Bit8u* proc_addr=gen_call_function_R3((void*)&dynrec_dshr_dword,FC_OP3);
 		InvalidateFlagsPartially((void*)&dynrec_dshr_dword_simple,proc_addr,t_DSHRd);
 	}
+	dyn_regcache_calls(RC_CALL_FULL);
 }
 
 
@@ -1355,23 +1373,23 @@ static Bit32u DRC_CALL_CONV dynrec_get_nzf_and_sf_eq_of(void)	{ return TFLG_NLE;
 
 static void dyn_branchflag_to_reg(BranchTypes btype) {
 	switch (btype) {
-		case BR_O:gen_call_function_raw((void*)&dynrec_get_of);break;
-		case BR_NO:gen_call_function_raw((void*)&dynrec_get_nof);break;
-		case BR_B:gen_call_function_raw((void*)&dynrec_get_cf);break;
-		case BR_NB:gen_call_function_raw((void*)&dynrec_get_ncf);break;
-		case BR_Z:gen_call_function_raw((void*)&dynrec_get_zf);break;
-		case BR_NZ:gen_call_function_raw((void*)&dynrec_get_nzf);break;
-		case BR_BE:gen_call_function_raw((void*)&dynrec_get_cf_or_zf);break;
-		case BR_NBE:gen_call_function_raw((void*)&dynrec_get_ncf_and_nzf);break;
-
-		case BR_S:gen_call_function_raw((void*)&dynrec_get_sf);break;
-		case BR_NS:gen_call_function_raw((void*)&dynrec_get_nsf);break;
-		case BR_P:gen_call_function_raw((void*)&dynrec_get_pf);break;
-		case BR_NP:gen_call_function_raw((void*)&dynrec_get_npf);break;
-		case BR_L:gen_call_function_raw((void*)&dynrec_get_sf_neq_of);break;
-		case BR_NL:gen_call_function_raw((void*)&dynrec_get_sf_eq_of);break;
-		case BR_LE:gen_call_function_raw((void*)&dynrec_get_zf_or_sf_neq_of);break;
-		case BR_NLE:gen_call_function_raw((void*)&dynrec_get_nzf_and_sf_eq_of);break;
+		case BR_O:dyn_pure_call((void*)&dynrec_get_of);break;
+		case BR_NO:dyn_pure_call((void*)&dynrec_get_nof);break;
+		case BR_B:dyn_pure_call((void*)&dynrec_get_cf);break;
+		case BR_NB:dyn_pure_call((void*)&dynrec_get_ncf);break;
+		case BR_Z:dyn_pure_call((void*)&dynrec_get_zf);break;
+		case BR_NZ:dyn_pure_call((void*)&dynrec_get_nzf);break;
+		case BR_BE:dyn_pure_call((void*)&dynrec_get_cf_or_zf);break;
+		case BR_NBE:dyn_pure_call((void*)&dynrec_get_ncf_and_nzf);break;
+
+		case BR_S:dyn_pure_call((void*)&dynrec_get_sf);break;
+		case BR_NS:dyn_pure_call((void*)&dynrec_get_nsf);break;
+		case BR_P:dyn_pure_call((void*)&dynrec_get_pf);break;
+		case BR_NP:dyn_pure_call((void*)&dynrec_get_npf);break;
+		case BR_L:dyn_pure_call((void*)&dynrec_get_sf_neq_of);break;
+		case BR_NL:dyn_pure_call((void*)&dynrec_get_sf_eq_of);break;
+		case BR_LE:dyn_pure_call((void*)&dynrec_get_zf_or_sf_neq_of);break;
+		case BR_NLE:dyn_pure_call((void*)&dynrec_get_nzf_and_sf_eq_of);break;
 	}
 }
 
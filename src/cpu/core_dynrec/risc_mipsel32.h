@@ -38,6 +38,8 @@
 //#define DRC_USE_REGS_ADDR
 // use FC_SEGS_ADDR to hold the address of "Segs" and to access it using FC_SEGS_ADDR
 //#define DRC_USE_SEGS_ADDR
+// keep some guest registers in the FC_REGCACHE_ registers while a block runs
+#define DRC_USE_REG_CACHE
 
 // register mapping
 typedef Bit8u HostReg;
@@ -52,6 +54,10 @@ typedef Bit8u HostReg;
 #define HOST_t6 14
 #define HOST_t7 15
 #define HOST_s0 16
+#define HOST_s1 17
+#define HOST_s2 18
+#define HOST_s3 19
+#define HOST_s4 20
 #define HOST_t8 24
 #define HOST_t9 25
 #define temp1 HOST_v1
@@ -91,6 +97,19 @@ typedef Bit8u HostReg;
 #define FC_SEGS_ADDR HOST_???
 #endif
 
+#ifdef DRC_USE_REG_CACHE
+// callee-saved registers that hold the cached guest registers,
+// they are preserved in gen_run_code and survive calls to helper functions
+#define FC_REGCACHE_EAX HOST_s1
+#define FC_REGCACHE_ECX HOST_s2
+#define FC_REGCACHE_ESI HOST_s3
+#define FC_REGCACHE_EDI HOST_s4
+
+// decoder functions that sync the cached registers around function calls
+static void dyn_regcache_before_call(void);
+static void dyn_regcache_after_call(void);
+#endif
+
 // save some state to improve code gen
 static bool temp1_valid = false;
 static Bit32u temp1_value;
@@ -294,6 +313,20 @@ static void gen_extend_word(bool sign,HostReg reg) {
 	}
 }
 
+#ifdef DRC_USE_REG_CACHE
+// replace the lower 16bit of dest_reg by the lower 16bit of src_reg
+static void gen_mov_word_insert(HostReg dest_reg,HostReg src_reg) {
+	cache_addw(0xffff);		// andi temp2, src_reg, 0xffff
+	cache_addw(0x3000+(src_reg<<5)+temp2);
+	cache_addw((dest_reg<<11)+(16<<6)+2);	// srl dest_reg, dest_reg, 16
+	cache_addw(dest_reg);
+	cache_addw((dest_reg<<11)+(16<<6));	// sll dest_reg, dest_reg, 16
+	cache_addw(dest_reg);
+	cache_addw((dest_reg<<11)+0x25);	// or dest_reg, dest_reg, temp2
+	cache_addw((dest_reg<<5)+temp2);
+}
+#endif
+
 // add a 32bit value from memory to a full register
 static void gen_add(HostReg reg,void* op) {
 	gen_mov_word_to_reg(temp2, op, 1);
@@ -391,10 +424,16 @@ static INLINE void gen_lea(HostReg dest_reg,Bitu scale,Bits imm) {
 static void INLINE gen_call_function_raw(void * func) {
 #if C_DEBUG
 	if (((Bit32u)cache.pos ^ (Bit32u)func) & 0xf0000000) LOG_MSG("jump overflow\n");
+#endif
+#ifdef DRC_USE_REG_CACHE
+	dyn_regcache_before_call();
 #endif
 	temp1_valid = false;
 	cache_addd(0x0c000000+(((Bit32u)func>>2)&0x3ffffff));		// jal func
 	DELAY;
+#ifdef DRC_USE_REG_CACHE
+	dyn_regcache_after_call();
+#endif
 }
 
 // generate a call to a function with paramcount parameters
@@ -552,6 +591,47 @@ static void INLINE gen_fill_branch_long(const Bit8u* data) {
 }
 #endif
 
+#ifdef DRC_USE_REG_CACHE
+static void gen_run_code(void) {
+	temp1_valid = false;
+	cache_addd(0x27bdffd0);			// addiu $sp, $sp, -48
+	cache_addd(0xafb00004);			// sw $s0, 4($sp)
+#if defined(_EE)
+	// the caller may keep 64bit values in the saved registers
+	cache_addd(0xffb10008);			// sd $s1, 8($sp)
+	cache_addd(0xffb20010);			// sd $s2, 16($sp)
+	cache_addd(0xffb30018);			// sd $s3, 24($sp)
+	cache_addd(0xffb40020);			// sd $s4, 32($sp)
+#else
+	cache_addd(0xafb10008);			// sw $s1, 8($sp)
+	cache_addd(0xafb20010);			// sw $s2, 16($sp)
+	cache_addd(0xafb30018);			// sw $s3, 24($sp)
+	cache_addd(0xafb40020);			// sw $s4, 32($sp)
+#endif
+	cache_addd(0x00800008);			// jr $a0
+	cache_addd(0xafbf0000);			// sw $ra, 0($sp)
+}
+
+// return from a function
+static void gen_return_function(void) {
+	temp1_valid = false;
+	cache_addd(0x8fbf0000);			// lw $ra, 0($sp)
+	cache_addd(0x8fb00004);			// lw $s0, 4($sp)
+#if defined(_EE)
+	cache_addd(0xdfb10008);			// ld $s1, 8($sp)
+	cache_addd(0xdfb20010);			// ld $s2, 16($sp)
+	cache_addd(0xdfb30018);			// ld $s3, 24($sp)
+	cache_addd(0xdfb40020);			// ld $s4, 32($sp)
+#else
+	cache_addd(0x8fb10008);			// lw $s1, 8($sp)
+	cache_addd(0x8fb20010);			// lw $s2, 16($sp)
+	cache_addd(0x8fb30018);			// lw $s3, 24($sp)
+	cache_addd(0x8fb40020);			// lw $s4, 32($sp)
+#endif
+	cache_addd(0x03e00008);			// jr $ra
+	cache_addd(0x27bd0030);			// addiu $sp, $sp, 48
+}
+#else
 static void gen_run_code(void) {
 	temp1_valid = false;
 	cache_addd(0x27bdfff0);			// addiu $sp, $sp, -16
@@ -568,6 +648,7 @@ static void gen_return_function(void) {
 	cache_addd(0x03e00008);			// jr $ra
 	cache_addd(0x27bd0010);			// addiu $sp, $sp, 16
 }
+#endif
 
 #ifdef DRC_FLAGS_INVALIDATION
 // called when a call to a function can be replaced by a
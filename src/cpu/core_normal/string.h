@@ -28,6 +28,56 @@ enum STRING_OP {
 
 #define LoadD(_BLAH) _BLAH
 
+#define STRING_IOBLOCK 64
+
+/* Move the data of a repeated ins/outs in chunks when the port has a block
+   handler, returns the amount of elements left for the single element path */
+static Bitu DoStringBlockIO(STRING_OP type,PhysPt base,Bitu & index,Bitu add_mask,Bits add_index,Bitu count) {
+	Bitu iolen=1 << (type % 3);
+	bool out=(type<R_INSB);
+	if (out ? !IO_CanWriteBlock(reg_dx,iolen) : !IO_CanReadBlock(reg_dx,iolen)) return count;
+	add_index*=iolen;
+	union {
+		Bit8u b[STRING_IOBLOCK];
+		Bit16u w[STRING_IOBLOCK];
+		Bit32u d[STRING_IOBLOCK];
+	} buf;
+	while (count) {
+		Bitu chunk=(count<STRING_IOBLOCK) ? count : STRING_IOBLOCK;
+		Bitu i;
+		if (out) {
+			for (i=0;i<chunk;i++) {
+				switch (iolen) {
+				case 1:buf.b[i]=LoadMb(base+index);break;
+				case 2:buf.w[i]=LoadMw(base+index);break;
+				default:buf.d[i]=LoadMd(base+index);break;
+				}
+				index=(index+add_index) & add_mask;
+			}
+			/* Whatever the handler did not take goes out one by one */
+			for (i=IO_WriteBlock(reg_dx,&buf,chunk,iolen);i<chunk;i++) {
+				switch (iolen) {
+				case 1:IO_WriteB(reg_dx,buf.b[i]);break;
+				case 2:IO_WriteW(reg_dx,buf.w[i]);break;
+				default:IO_WriteD(reg_dx,buf.d[i]);break;
+				}
+			}
+		} else {
+			Bitu done=IO_ReadBlock(reg_dx,&buf,chunk,iolen);
+			for (i=0;i<chunk;i++) {
+				switch (iolen) {
+				case 1:SaveMb(base+index,(i<done) ? buf.b[i] : (Bit8u)IO_ReadB(reg_dx));break;
+				case 2:SaveMw(base+index,(i<done) ? buf.w[i] : (Bit16u)IO_ReadW(reg_dx));break;
+				default:SaveMd(base+index,(i<done) ? buf.d[i] : (Bit32u)IO_ReadD(reg_dx));break;
+				}
+				index=(index+add_index) & add_mask;
+			}
+		}
+		count-=chunk;
+	}
+	return 0;
+}
+
 static void DoString(STRING_OP type) {
 	PhysPt  si_base,di_base;
 	Bitu	si_index,di_index;
@@ -59,6 +109,10 @@ static void DoString(STRING_OP type) {
 		}
 	}
 	add_index=cpu.direction;
+	if ((type<R_MOVSB) && (count>1)) {
+		if (type<R_INSB) count=DoStringBlockIO(type,si_base,si_index,add_mask,add_index,count);
+		else count=DoStringBlockIO(type,di_base,di_index,add_mask,add_index,count);
+	}
 	if (count) switch (type) {
 	case R_OUTSB:
 		for (;count>0;count--) {
@@ -0,0 +1,739 @@
+/*
+ *  Copyright (C) 2002-2021  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*
+	The predecode core is the normal core with a cache of decoded
+	instructions. The first time code is run its prefixes and opcodes
+	are decoded as usual and recorded in blocks of straight-line code.
+	Each recorded instruction holds the address of its handler and the
+	prefix state, later runs of that code jump from one handler to the
+	next one (computed goto with gcc) without decoding the prefixes
+	and the opcode again. The operands, the ModRM byte and displacements
+	are read from the host memory of the code page directly instead of
+	through the TLB.
+
+	Pages that contain recorded code are protected like the code pages
+	of the dynamic core, writes to the recorded instructions drop the
+	blocks that contain them.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dosbox.h"
+#include "mem.h"
+#include "cpu.h"
+#include "lazyflags.h"
+#include "inout.h"
+#include "callback.h"
+#include "pic.h"
+#include "fpu.h"
+#include "paging.h"
+
+#if C_DEBUG
+#include "debug.h"
+#endif
+
+#if (!C_CORE_INLINE)
+#define LoadMb(off) mem_readb(off)
+#define LoadMw(off) mem_readw(off)
+#define LoadMd(off) mem_readd(off)
+#define SaveMb(off,val)	mem_writeb(off,val)
+#define SaveMw(off,val)	mem_writew(off,val)
+#define SaveMd(off,val)	mem_writed(off,val)
+#else
+#define LoadMb(off) mem_readb_inline(off)
+#define LoadMw(off) mem_readw_inline(off)
+#define LoadMd(off) mem_readd_inline(off)
+#define SaveMb(off,val)	mem_writeb_inline(off,val)
+#define SaveMw(off,val)	mem_writew_inline(off,val)
+#define SaveMd(off,val)	mem_writed_inline(off,val)
+#endif
+
+extern Bitu cycle_count;
+
+#if C_FPU
+#define CPU_FPU	1						//Enable FPU escape instructions
+#endif
+
+#define CPU_PIC_CHECK 1
+#define CPU_TRAP_CHECK 1
+
+#define CPU_TRAP_DECODER	CPU_Core_Predecode_Trap_Run
+
+#define OPCODE_NONE			0x000
+#define OPCODE_0F			0x100
+#define OPCODE_SIZE			0x200
+
+#define PREFIX_ADDR			0x1
+#define PREFIX_REP			0x2
+
+#define TEST_PREFIX_ADDR	(core.prefixes & PREFIX_ADDR)
+#define TEST_PREFIX_REP		(core.prefixes & PREFIX_REP)
+
+#define DO_PREFIX_SEG(_SEG)					\
+	BaseDS=SegBase(_SEG);					\
+	BaseSS=SegBase(_SEG);					\
+	core.base_val_ds=_SEG;					\
+	core.seg_prefix=_SEG;					\
+	goto restart_opcode;
+
+#define DO_PREFIX_ADDR()								\
+	core.prefixes=(core.prefixes & ~PREFIX_ADDR) |		\
+	(cpu.code.big ^ PREFIX_ADDR);						\
+	core.ea_table=&EATable[(core.prefixes&1) * 256];	\
+	goto restart_opcode;
+
+#define DO_PREFIX_REP(_ZERO)				\
+	core.prefixes|=PREFIX_REP;				\
+	core.rep_zero=_ZERO;					\
+	goto restart_opcode;
+
+typedef PhysPt (*GetEAHandler)(void);
+
+static const Bit32u AddrMaskTable[2]={0x0000ffff,0xffffffff};
+
+#define PREDECODE_NOSEG		0xff
+
+// jump directly to the handlers of the instructions
+#if defined(__GNUC__)
+#define PREDECODE_THREADED
+#endif
+
+static struct {
+	Bitu opcode_index;
+	PhysPt cseip;
+	HostPt host;			// host memory of the code page minus its linear address, NULL if unknown
+	PhysPt base_ds,base_ss;
+	SegNames base_val_ds;
+	bool rep_zero;
+	Bitu prefixes;
+	GetEAHandler * ea_table;
+	Bitu seg_prefix;		// segment override prefix, PREDECODE_NOSEG if none
+} core;
+
+#define GETIP		(core.cseip-SegBase(cs))
+#define SAVEIP		reg_eip=GETIP;
+#define LOADIP		core.cseip=(SegBase(cs)+reg_eip);
+
+#define SegBase(c)	SegPhys(c)
+#define BaseDS		core.base_ds
+#define BaseSS		core.base_ss
+
+// recorded instructions don't cross a page, their bytes are read from host memory,
+// the call keeps the code of the handlers small
+static INLINE Bit8u Fetchb() {
+	Bit8u temp;
+	if (core.host) temp=host_readb(core.host+core.cseip);
+	else temp=mem_readb(core.cseip);
+	core.cseip+=1;
+	return temp;
+}
+
+static INLINE Bit16u Fetchw() {
+	Bit16u temp;
+	if (core.host) temp=host_readw(core.host+core.cseip);
+	else temp=mem_readw(core.cseip);
+	core.cseip+=2;
+	return temp;
+}
+static INLINE Bit32u Fetchd() {
+	Bit32u temp;
+	if (core.host) temp=host_readd(core.host+core.cseip);
+	else temp=mem_readd(core.cseip);
+	core.cseip+=4;
+	return temp;
+}
+
+#define Push_16 CPU_Push16
+#define Push_32 CPU_Push32
+#define Pop_16 CPU_Pop16
+#define Pop_32 CPU_Pop32
+
+#include "instructions.h"
+#include "core_normal/support.h"
+#include "core_normal/string.h"
+
+
+#define EALookupTable (core.ea_table)
+
+#if defined(PREDECODE_THREADED)
+// the cases of the instruction handlers get a label, the address of
+// each label is taken by dispatching every opcode once at startup
+static const void * predecode_handlers[1024];
+static bool predecode_filling=false;
+
+#define PREDECODE_HANDLER(_NAME)									\
+	if (GCC_UNLIKELY(predecode_filling)) {							\
+		predecode_handlers[opcode]=&&_NAME;							\
+		goto fill_next;												\
+	}																\
+	_NAME:
+
+#undef CASE_W
+#undef CASE_D
+#undef CASE_B
+#undef CASE_0F_W
+#undef CASE_0F_D
+#undef CASE_0F_B
+
+#define CASE_W(_WHICH)							\
+	case (OPCODE_NONE+_WHICH):					\
+	PREDECODE_HANDLER(op_w_##_WHICH)
+
+#define CASE_D(_WHICH)							\
+	case (OPCODE_SIZE+_WHICH):					\
+	PREDECODE_HANDLER(op_d_##_WHICH)
+
+#define CASE_B(_WHICH)							\
+	case (OPCODE_NONE+_WHICH):					\
+	case (OPCODE_SIZE+_WHICH):					\
+	PREDECODE_HANDLER(op_b_##_WHICH)
+
+#define CASE_0F_W(_WHICH)						\
+	case ((OPCODE_0F|OPCODE_NONE)+_WHICH):		\
+	PREDECODE_HANDLER(op_0f_w_##_WHICH)
+
+#define CASE_0F_D(_WHICH)						\
+	case ((OPCODE_0F|OPCODE_SIZE)+_WHICH):		\
+	PREDECODE_HANDLER(op_0f_d_##_WHICH)
+
+#define CASE_0F_B(_WHICH)						\
+	case ((OPCODE_0F|OPCODE_NONE)+_WHICH):		\
+	case ((OPCODE_0F|OPCODE_SIZE)+_WHICH):		\
+	PREDECODE_HANDLER(op_0f_b_##_WHICH)
+#endif
+
+
+#define PREDECODE_OPS			16		// maximum number of instructions in a block
+#if defined(_EE)
+#define PREDECODE_BLOCKS		1024
+#define PREDECODE_PAGES			32
+#else
+#define PREDECODE_BLOCKS		8192
+#define PREDECODE_PAGES			256
+#endif
+#define PREDECODE_HASH_SHIFT	4
+#define PREDECODE_PAGE_HASH		(4096>>PREDECODE_HASH_SHIFT)
+
+// a recorded instruction
+struct PredecodeOp {
+#if defined(PREDECODE_THREADED)
+	const void * handler;	// the code that runs the instruction
+#endif
+	Bit16u opcode;		// opcode including the 0x0f and operand size index
+	Bit8u oplen;		// size of the prefixes and the opcode
+	Bit8u len;			// size of the instruction, zero if it ends the block
+	Bit8u prefixes;
+	Bit8u seg_ds,seg_ss;	// segments of the memory operands, after the segment prefix
+	bool rep_zero;
+};
+
+class CodePageHandlerPredecode;
+
+// straight-line instructions starting at the same address
+struct PredecodeBlock {
+	Bit16u start,end;		// where in the page is the original code
+	Bitu count;				// number of recorded instructions
+	Bitu big;				// code size the instructions were decoded for
+	CodePageHandlerPredecode * handler;
+	PredecodeBlock * next;	// hash chain or free list
+	PredecodeOp ops[PREDECODE_OPS];
+};
+
+static struct {
+	PredecodeBlock * block;		// the block that is currently run
+	Bitu index;					// the next instruction of that block
+	PhysPt next;				// the address the next instruction is expected at
+	HostPt host;				// host memory of the code of that block, see core.host
+	struct {
+		PredecodeBlock * block;	// the block that is currently recorded
+		PhysPt start;			// address of the instruction being recorded
+		PhysPt next;			// address of the next instruction of the block
+		bool pending;			// an instruction was started but didn't complete yet
+		PredecodeOp op;
+	} rec;
+	PredecodeBlock * free_blocks;
+	CodePageHandlerPredecode * free_pages;
+	CodePageHandlerPredecode * used_pages;
+	CodePageHandlerPredecode * last_page;
+} predecode;
+
+static PredecodeBlock * predecode_blocks=NULL;
+static CodePageHandlerPredecode * predecode_pages=NULL;
+
+static void predecode_abortrecord(void);
+
+// the CodePageHandlerPredecode class holds the blocks recorded in a page
+// and drops them when the code they were recorded from is modified
+class CodePageHandlerPredecode : public PageHandler {
+public:
+	void SetupAt(Bitu _phys_page,PageHandler * _old_pagehandler) {
+		phys_page=_phys_page;
+		// save the old pagehandler to provide direct read access to the memory,
+		// and to be able to restore it later on
+		old_pagehandler=_old_pagehandler;
+		flags=(old_pagehandler->flags|PFLAG_PREDECODE)&~PFLAG_WRITEABLE;
+		hostmem=old_pagehandler->GetHostReadPt(phys_page);
+
+		active_blocks=0;
+		active_count=16;
+		memset(&hash_map,0,sizeof(hash_map));
+		memset(&write_map,0,sizeof(write_map));
+	}
+
+	// drop blocks that contain code which has been modified
+	void InvalidateRange(Bitu start,Bitu end) {
+		Bits index=end>>PREDECODE_HASH_SHIFT;
+		while (index>=0) {
+			Bitu map=0;
+			// see if there is still some code in the range
+			for (Bitu count=start;count<=end;count++) map+=write_map[count];
+			if (!map) return;
+			PredecodeBlock * block=hash_map[index];
+			while (block) {
+				PredecodeBlock * nextblock=block->next;
+				if (start<=block->end && end>=block->start) DelBlock(block);
+				block=nextblock;
+			}
+			index--;
+		}
+	}
+
+	void CodeWritten(Bitu start,Bitu end) {
+		// the block that is being recorded isn't in the write map yet
+		if (predecode.rec.block && (predecode.rec.block->handler==this) &&
+			(end>=predecode.rec.block->start)) predecode_abortrecord();
+		Bitu map=0;
+		for (Bitu count=start;count<=end;count++) map+=write_map[count];
+		if (!map) {
+			if (active_blocks || predecode.rec.block) return;
+			// delay the page releasing a bit
+			active_count--;
+			if (!active_count) Release();
+			return;
+		}
+		InvalidateRange(start,end);
+	}
+
+	void writeb(PhysPt addr,Bitu val){
+		if (GCC_UNLIKELY(old_pagehandler->flags&PFLAG_HASROM)) return;
+		addr&=4095;
+		if (host_readb(hostmem+addr)==(Bit8u)val) return;
+		host_writeb(hostmem+addr,val);
+		CodeWritten(addr,addr);
+	}
+	void writew(PhysPt addr,Bitu val){
+		if (GCC_UNLIKELY(old_pagehandler->flags&PFLAG_HASROM)) return;
+		addr&=4095;
+		if (host_readw(hostmem+addr)==(Bit16u)val) return;
+		host_writew(hostmem+addr,val);
+		CodeWritten(addr,addr+1);
+	}
+	void writed(PhysPt addr,Bitu val){
+		if (GCC_UNLIKELY(old_pagehandler->flags&PFLAG_HASROM)) return;
+		addr&=4095;
+		if (host_readd(hostmem+addr)==(Bit32u)val) return;
+		host_writed(hostmem+addr,val);
+		CodeWritten(addr,addr+3);
+	}
+	bool writeb_checked(PhysPt addr,Bitu val) {
+		writeb(addr,val);
+		return false;
+	}
+	bool writew_checked(PhysPt addr,Bitu val) {
+		writew(addr,val);
+		return false;
+	}
+	bool writed_checked(PhysPt addr,Bitu val) {
+		writed(addr,val);
+		return false;
+	}
+
+	// add a recorded block to this page
+	void AddBlock(PredecodeBlock * block) {
+		Bitu index=block->start>>PREDECODE_HASH_SHIFT;
+		block->next=hash_map[index];
+		hash_map[index]=block;
+		for (Bitu i=block->start;i<=block->end;i++) write_map[i]++;
+		active_blocks++;
+	}
+	// remove a block and put it on the free list
+	void DelBlock(PredecodeBlock * block) {
+		active_blocks--;
+		active_count=16;
+		PredecodeBlock * * bwhere=&hash_map[block->start>>PREDECODE_HASH_SHIFT];
+		while (*bwhere!=block) bwhere=&((*bwhere)->next);
+		*bwhere=block->next;
+		for (Bitu i=block->start;i<=block->end;i++) write_map[i]--;
+		// the instructions of the current block are decoded again
+		if (predecode.block==block) predecode.block=NULL;
+		block->next=predecode.free_blocks;
+		predecode.free_blocks=block;
+	}
+	PredecodeBlock * FindBlock(Bitu start,Bitu big) {
+		PredecodeBlock * block=hash_map[start>>PREDECODE_HASH_SHIFT];
+		while (block) {
+			if ((block->start==start) && (block->big==big)) return block;
+			block=block->next;
+		}
+		return NULL;
+	}
+
+	void Release(void) {
+		MEM_SetPageHandler(phys_page,1,old_pagehandler);	// revert to old handler
+		PAGING_ClearTLB();
+
+		// remove page from the lists
+		if (prev) prev->next=next;
+		else predecode.used_pages=next;
+		if (next) next->prev=prev;
+		else predecode.last_page=prev;
+		next=predecode.free_pages;
+		predecode.free_pages=this;
+		prev=NULL;
+	}
+	void ClearRelease(void) {
+		if (predecode.rec.block && (predecode.rec.block->handler==this)) predecode_abortrecord();
+		for (Bitu i=0;i<PREDECODE_PAGE_HASH;i++) {
+			while (hash_map[i]) DelBlock(hash_map[i]);
+		}
+		Release();
+	}
+
+	HostPt GetHostReadPt(Bitu phys_page) {
+		hostmem=old_pagehandler->GetHostReadPt(phys_page);
+		return hostmem;
+	}
+	HostPt GetHostMem(void) {
+		return hostmem;
+	}
+	HostPt GetHostWritePt(Bitu phys_page) {
+		return GetHostReadPt( phys_page );
+	}
+public:
+	CodePageHandlerPredecode * next, * prev;	// page linking
+private:
+	PageHandler * old_pagehandler;
+
+	PredecodeBlock * hash_map[PREDECODE_PAGE_HASH];
+	// there are write_map[i] blocks that cover the byte at address i
+	Bit8u write_map[4096];
+
+	Bitu active_blocks;		// the number of blocks in this page
+	Bitu active_count;		// delaying parameter to not immediately release a page
+	HostPt hostmem;
+	Bitu phys_page;
+};
+
+static void predecode_abortrecord(void) {
+	PredecodeBlock * block=predecode.rec.block;
+	block->next=predecode.free_blocks;
+	predecode.free_blocks=block;
+	predecode.rec.block=NULL;
+	predecode.rec.pending=false;
+}
+
+static void predecode_endrecord(void) {
+	PredecodeBlock * block=predecode.rec.block;
+	predecode.rec.block=NULL;
+	predecode.rec.pending=false;
+	if (!block->count) {
+		block->next=predecode.free_blocks;
+		predecode.free_blocks=block;
+		return;
+	}
+	block->handler->AddBlock(block);
+}
+
+// the recorded instruction completed, len is zero if it changed the control flow
+static void predecode_addop(Bitu len) {
+	PredecodeBlock * block=predecode.rec.block;
+	Bitu start=predecode.rec.start&4095;
+	Bitu size=len ? len : predecode.rec.op.oplen;
+	predecode.rec.pending=false;
+	if (!size || (start+size>4096)) {
+		// the opcode wasn't reached or the instruction continues in the next page
+		predecode_endrecord();
+		return;
+	}
+	switch (predecode.rec.op.opcode) {
+	case 0x101:case 0x301:		// lmsw, invlpg
+	case 0x122:case 0x322:		// mov crX,reg
+		// the code page mapping might change
+		len=0;
+		break;
+	}
+	predecode.rec.op.len=(Bit8u)len;
+#if defined(PREDECODE_THREADED)
+	predecode.rec.op.handler=predecode_handlers[predecode.rec.op.opcode];
+#endif
+	block->ops[block->count++]=predecode.rec.op;
+	block->end=(Bit16u)(start+size-1);
+	predecode.rec.next=predecode.rec.start+len;
+	if (!len || (block->count>=PREDECODE_OPS)) predecode_endrecord();
+}
+
+static void predecode_clear(void) {
+	if (predecode.rec.block) predecode_abortrecord();
+	while (predecode.used_pages) predecode.used_pages->ClearRelease();
+	predecode.block=NULL;
+}
+
+// prepare recording a new block at ip_point, returns false
+// if the code in this page can't be recorded
+static bool predecode_startrecord(PhysPt ip_point) {
+	if (!predecode_blocks) return false;
+	// start over when all blocks are used
+	if (!predecode.free_blocks) predecode_clear();
+
+	CodePageHandlerPredecode * cph;
+	PageHandler * handler=get_tlb_readhandler(ip_point);
+	if (handler->flags & PFLAG_PREDECODE) {
+		cph=(CodePageHandlerPredecode *)handler;
+	} else {
+		// only plain memory that isn't used by the dynamic core
+		if ((handler->flags & (PFLAG_READABLE|PFLAG_HASCODE|PFLAG_NOCODE|PFLAG_INIT))!=PFLAG_READABLE) return false;
+		Bitu lin_page=ip_point>>12;
+		Bitu phys_page=lin_page;
+		if (!PAGING_MakePhysPage(phys_page)) return false;
+		if (!predecode.free_pages) predecode.used_pages->ClearRelease();
+		cph=predecode.free_pages;
+		predecode.free_pages=cph->next;
+
+		cph->prev=predecode.last_page;
+		cph->next=NULL;
+		if (predecode.last_page) predecode.last_page->next=cph;
+		predecode.last_page=cph;
+		if (!predecode.used_pages) predecode.used_pages=cph;
+
+		cph->SetupAt(phys_page,handler);
+		MEM_SetPageHandler(phys_page,1,cph);
+		PAGING_UnlinkPages(lin_page,1);
+	}
+
+	PredecodeBlock * block=predecode.free_blocks;
+	predecode.free_blocks=block->next;
+	block->start=block->end=(Bit16u)(ip_point&4095);
+	block->count=0;
+	block->big=cpu.code.big;
+	block->handler=cph;
+	block->next=NULL;
+	predecode.rec.block=block;
+	predecode.rec.next=ip_point;
+	return true;
+}
+
+static PredecodeBlock * predecode_findblock(PhysPt ip_point) {
+	PageHandler * handler=get_tlb_readhandler(ip_point);
+	if (!(handler->flags & PFLAG_PREDECODE)) return NULL;
+	CodePageHandlerPredecode * cph=(CodePageHandlerPredecode *)handler;
+	PredecodeBlock * block=cph->FindBlock(ip_point&4095,cpu.code.big);
+	if (block) predecode.host=cph->GetHostMem()-(ip_point&~4095);
+	return block;
+}
+
+// set up the prefix state of a recorded instruction, the operands
+// follow the prefixes and the opcode
+static INLINE void predecode_setupop(const PredecodeOp * op,PhysPt ip_point) {
+	core.cseip=ip_point+op->oplen;
+	core.host=predecode.host;
+	core.opcode_index=op->opcode&(OPCODE_0F|OPCODE_SIZE);
+	core.prefixes=op->prefixes;
+	core.rep_zero=op->rep_zero;
+	core.ea_table=&EATable[(op->prefixes&PREFIX_ADDR)*256];
+	BaseDS=SegBase((SegNames)op->seg_ds);
+	BaseSS=SegBase((SegNames)op->seg_ss);
+	core.base_val_ds=(SegNames)op->seg_ds;
+}
+
+Bits CPU_Core_Predecode_Run(void) {
+	Bitu opcode;
+	PhysPt ip_point;
+	PredecodeBlock * block;
+	const PredecodeOp * op;
+#if defined(PREDECODE_THREADED)
+	if (GCC_UNLIKELY(!predecode_handlers[0])) {
+		for (opcode=0;opcode<1024;opcode++) predecode_handlers[opcode]=&&illegal_opcode;
+		predecode_filling=true;
+		opcode=0;
+		goto fill_dispatch;
+fill_next:
+		if (++opcode<1024) goto fill_dispatch;
+		predecode_filling=false;
+	}
+#endif
+	// other code might have run in the meantime
+	predecode.block=NULL;
+	while (CPU_Cycles-->0) {
+		ip_point=SegBase(cs)+reg_eip;
+		if (GCC_UNLIKELY(predecode.rec.block!=NULL)) {
+			// the last instruction didn't complete or changed the control flow
+			if (predecode.rec.pending) predecode_addop(0);
+			else if (ip_point!=predecode.rec.next) predecode_endrecord();
+		}
+		block=predecode.block;
+		if (!block || (ip_point!=predecode.next)) {
+			block=predecode_findblock(ip_point);
+			predecode.block=block;
+			predecode.index=0;
+			if (block && predecode.rec.block) predecode_endrecord();
+		}
+#if C_DEBUG
+#if C_HEAVY_DEBUG
+		if (DEBUG_HeavyIsBreakpoint()) {
+			FillFlags();
+			return debugCallback;
+		};
+#endif
+		cycle_count++;
+#endif
+		if (block) {
+			// run the next recorded instruction
+run_recorded:
+			op=&block->ops[predecode.index++];
+			if (op->len && (predecode.index<block->count)) predecode.next=ip_point+op->len;
+			else predecode.block=NULL;
+			predecode_setupop(op,ip_point);
+			opcode=op->opcode;
+#if defined(PREDECODE_THREADED)
+			goto *op->handler;
+#else
+			goto dispatch;
+#endif
+		}
+		if (!predecode.rec.block) predecode_startrecord(ip_point);
+		if (predecode.rec.block) {
+			predecode.rec.start=ip_point;
+			predecode.rec.pending=true;
+			predecode.rec.op.oplen=0;
+		}
+		core.cseip=ip_point;
+		core.host=NULL;
+		core.opcode_index=cpu.code.big*0x200;
+		core.prefixes=cpu.code.big;
+		core.ea_table=&EATable[cpu.code.big*256];
+		BaseDS=SegBase(ds);
+		BaseSS=SegBase(ss);
+		core.base_val_ds=ds;
+		core.seg_prefix=PREDECODE_NOSEG;
+restart_opcode:
+		opcode=core.opcode_index+Fetchb();
+		if (predecode.rec.pending) {
+			predecode.rec.op.opcode=(Bit16u)opcode;
+			predecode.rec.op.oplen=(Bit8u)(core.cseip-ip_point);
+			predecode.rec.op.prefixes=(Bit8u)core.prefixes;
+			if (core.seg_prefix==PREDECODE_NOSEG) {
+				predecode.rec.op.seg_ds=ds;
+				predecode.rec.op.seg_ss=ss;
+			} else predecode.rec.op.seg_ds=predecode.rec.op.seg_ss=(Bit8u)core.seg_prefix;
+			predecode.rec.op.rep_zero=core.rep_zero;
+		}
+#if defined(PREDECODE_THREADED)
+		goto *predecode_handlers[opcode];
+fill_dispatch:
+#else
+dispatch:
+#endif
+		switch (opcode) {
+		#include "core_normal/prefix_none.h"
+		#include "core_normal/prefix_0f.h"
+		#include "core_normal/prefix_66.h"
+		#include "core_normal/prefix_66_0f.h"
+		default:
+#if defined(PREDECODE_THREADED)
+			if (predecode_filling) goto fill_next;
+#endif
+		illegal_opcode:
+#if C_DEBUG
+			{
+				Bitu len=(GETIP-reg_eip);
+				LOADIP;
+				if (len>16) len=16;
+				char tempcode[16*2+1];char * writecode=tempcode;
+				for (;len>0;len--) {
+					sprintf(writecode,"%02X",mem_readb(core.cseip++));
+					writecode+=2;
+				}
+				LOG(LOG_CPU,LOG_NORMAL)("Illegal/Unhandled opcode %s",tempcode);
+			}
+#endif
+			CPU_Exception(6,0);
+			continue;
+		}
+		SAVEIP;
+		if (predecode.rec.pending) predecode_addop(core.cseip-ip_point);
+#if !C_HEAVY_DEBUG
+		// go on with the next instruction of the block without the checks above
+		block=predecode.block;
+		if (block && (core.cseip==predecode.next) && (CPU_Cycles>0)) {
+			CPU_Cycles--;
+			ip_point=core.cseip;
+#if C_DEBUG
+			cycle_count++;
+#endif
+			goto run_recorded;
+		}
+#endif
+	}
+	FillFlags();
+	return CBRET_NONE;
+decode_end:
+	SAVEIP;
+	FillFlags();
+	return CBRET_NONE;
+}
+
+Bits CPU_Core_Predecode_Trap_Run(void) {
+	Bits oldCycles = CPU_Cycles;
+	CPU_Cycles = 1;
+	cpu.trap_skip = false;
+
+	Bits ret=CPU_Core_Predecode_Run();
+	if (!cpu.trap_skip) CPU_DebugException(DBINT_STEP,reg_eip);
+	CPU_Cycles = oldCycles-1;
+	cpudecoder = &CPU_Core_Predecode_Run;
+
+	return ret;
+}
+
+void CPU_Core_Predecode_Init(void) {
+
+}
+
+void CPU_Core_Predecode_Cache_Init(bool enable_cache) {
+	// the recorded code is dropped when another core is selected
+	predecode_clear();
+	if (!enable_cache || predecode_blocks) return;
+	predecode_blocks=(PredecodeBlock*)malloc(PREDECODE_BLOCKS*sizeof(PredecodeBlock));
+	if (!predecode_blocks) E_Exit("Allocating predecode blocks has failed");
+	predecode.free_blocks=NULL;
+	for (Bits i=PREDECODE_BLOCKS-1;i>=0;i--) {
+		predecode_blocks[i].next=predecode.free_blocks;
+		predecode.free_blocks=&predecode_blocks[i];
+	}
+	predecode_pages=new CodePageHandlerPredecode[PREDECODE_PAGES];
+	predecode.free_pages=NULL;
+	for (Bits i=PREDECODE_PAGES-1;i>=0;i--) {
+		predecode_pages[i].next=predecode.free_pages;
+		predecode.free_pages=&predecode_pages[i];
+	}
+	predecode.used_pages=NULL;
+	predecode.last_page=NULL;
+}
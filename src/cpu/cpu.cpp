@@ -22,6 +22,7 @@
 #include <stddef.h>
 #include "dosbox.h"
 #include "cpu.h"
+#include "pic.h"
 #include "memory.h"
 #include "debug.h"
 #include "mapper.h"
@@ -30,6 +31,7 @@
 #include "paging.h"
 #include "lazyflags.h"
 #include "support.h"
+#include "snapshot.h"
 
 Bitu DEBUG_EnableDebugger(void);
 extern void GFX_SetTitle(Bit32s cycles ,int frameskip,bool paused);
@@ -71,15 +73,28 @@ Bitu CPU_PrefetchQueueSize=0;
 void CPU_Core_Full_Init(void);
 void CPU_Core_Normal_Init(void);
 void CPU_Core_Simple_Init(void);
+void CPU_Core_Predecode_Init(void);
+void CPU_Core_Predecode_Cache_Init(bool enable_cache);
 #if (C_DYNAMIC_X86)
 void CPU_Core_Dyn_X86_Init(void);
 void CPU_Core_Dyn_X86_Cache_Init(bool enable_cache);
 void CPU_Core_Dyn_X86_Cache_Close(void);
 void CPU_Core_Dyn_X86_SetFPUMode(bool dh_fpu);
+void CPU_Core_Dyn_X86_SetCacheFile(const char * filename,Bitu maxsize_kb);
+void CPU_Core_Dyn_X86_SetCacheSize(Bitu total_kb,Bitu blocks);
+void CPU_Core_Dyn_X86_SetCompileLimit(Bitu blocks_per_ms);
+void CPU_Core_Dyn_X86_LogSMC(void);
 #elif (C_DYNREC)
 void CPU_Core_Dynrec_Init(void);
 void CPU_Core_Dynrec_Cache_Init(bool enable_cache);
 void CPU_Core_Dynrec_Cache_Close(void);
+void CPU_Core_Dynrec_SetCacheFile(const char * filename,Bitu maxsize_kb);
+void CPU_Core_Dynrec_SetCacheSize(Bitu total_kb,Bitu blocks);
+void CPU_Core_Dynrec_SetCompileLimit(Bitu blocks_per_ms,bool threaded);
+void CPU_Core_Dynrec_LogSMC(void);
+#endif
+#if (C_DYNAMIC_X86) || (C_DYNREC)
+static bool cpu_smclog=false;
 #endif
 
 /* In debug mode exceptions are tested and dosbox exits when 
@@ -2049,6 +2064,45 @@ static Bits HLT_Decode(void) {
 	return 0;
 }
 
+/* A guest loop that keeps polling the same location with nothing new to
+   find and only a few cycles in between is treated like a hlt. The rest
+   of the slice up to the next pic event is skipped, so an idle machine
+   ends up sleeping in the main loop. */
+#define CPU_IDLE_LOOPCYCLES 64
+#define CPU_IDLE_POLLS 16
+
+Bitu CPU_IdlePolls = 0;
+static struct {
+	bool enabled;
+	Bit16u cs;
+	Bit32u eip;
+	Bitu ticks;
+	Bits index;
+	Bit64s iodelay;
+} cpu_idle;
+
+void CPU_IdlePoll(void) {
+	if (!cpu_idle.enabled) return;
+	Bits index=PIC_TickIndexND();
+	Bits distance=(PIC_Ticks==cpu_idle.ticks) ? (index-cpu_idle.index) : index;
+	/* The io delay of the poll itself does not count as loop work */
+	Bit64s iodelay=CPU_IODelayRemoved-cpu_idle.iodelay;
+	if (iodelay>0) distance-=(Bits)iodelay;
+	if ((SegValue(cs)!=cpu_idle.cs) || (reg_eip!=cpu_idle.eip) ||
+		(distance<0) || (distance>CPU_IDLE_LOOPCYCLES)) {
+		cpu_idle.cs=SegValue(cs);
+		cpu_idle.eip=reg_eip;
+		CPU_IdlePolls=0;
+	} else if (++CPU_IdlePolls>=CPU_IDLE_POLLS) {
+		CPU_IODelayRemoved += CPU_Cycles;
+		CPU_Cycles=0;
+		index=PIC_TickIndexND();
+	}
+	cpu_idle.ticks=PIC_Ticks;
+	cpu_idle.index=index;
+	cpu_idle.iodelay=CPU_IODelayRemoved;
+}
+
 void CPU_HLT(Bitu oldeip) {
 	reg_eip=oldeip;
 	CPU_IODelayRemoved += CPU_Cycles;
@@ -2163,6 +2217,31 @@ void CPU_Reset_AutoAdjust(void) {
 	ticksScheduled = 0;
 }
 
+/* Decoder pointers and descriptor tables are stored as they are, the
+   snapshot is only restored in the session that took it */
+static void CPU_SnapshotSave(SnapshotStream & stream) {
+	stream.Write(&cpu_regs,sizeof(cpu_regs));
+	stream.Write(&Segs,sizeof(Segs));
+	stream.Write(&cpu,sizeof(cpu));
+	stream.Write(&cpu_tss,sizeof(cpu_tss));
+	stream.Write(&lflags,sizeof(lflags));
+	stream.Write(&CPU_Cycles,sizeof(CPU_Cycles));
+	stream.Write(&CPU_CycleLeft,sizeof(CPU_CycleLeft));
+	stream.Write(&cpudecoder,sizeof(cpudecoder));
+}
+
+static void CPU_SnapshotLoad(SnapshotStream & stream) {
+	stream.Read(&cpu_regs,sizeof(cpu_regs));
+	stream.Read(&Segs,sizeof(Segs));
+	stream.Read(&cpu,sizeof(cpu));
+	stream.Read(&cpu_tss,sizeof(cpu_tss));
+	stream.Read(&lflags,sizeof(lflags));
+	stream.Read(&CPU_Cycles,sizeof(CPU_Cycles));
+	stream.Read(&CPU_CycleLeft,sizeof(CPU_CycleLeft));
+	stream.Read(&cpudecoder,sizeof(cpudecoder));
+	CPU_IdleReset();
+}
+
 class CPU: public Module_base {
 private:
 	static bool inited;
@@ -2220,6 +2299,7 @@ public:
 #ifdef CORE_FULL
 		CPU_Core_Full_Init();
 #endif
+		CPU_Core_Predecode_Init();
 #if (C_DYNAMIC_X86)
 		CPU_Core_Dyn_X86_Init();
 #elif (C_DYNREC)
@@ -2227,6 +2307,7 @@ public:
 #endif
 		MAPPER_AddHandler(CPU_CycleDecrease,MK_f11,MMOD1,"cycledown","Dec Cycles");
 		MAPPER_AddHandler(CPU_CycleIncrease,MK_f12,MMOD1,"cycleup"  ,"Inc Cycles");
+		SNAPSHOT_AddHandler("cpu",CPU_SnapshotSave,CPU_SnapshotLoad);
 		Change_Config(configuration);	
 		CPU_JMP(false,0,0,0);					//Setup the first cpu core
 	}
@@ -2236,6 +2317,8 @@ public:
 		//CPU_CycleLeft=0;//needed ?
 		CPU_Cycles=0;
 		CPU_SkipCycleAutoAdjust=false;
+		cpu_idle.enabled=section->Get_bool("idledetect");
+		CPU_IdleReset();
 
 		Prop_multival* p = section->Get_multival("cycles");
 		std::string type = p->GetSection()->Get_string("type");
@@ -2327,6 +2410,8 @@ public:
 		} else if (core == "full") {
 			cpudecoder=&CPU_Core_Full_Run;
 #endif
+		} else if (core == "predecode") {
+			cpudecoder=&CPU_Core_Predecode_Run;
 		} else if (core == "auto") {
 			cpudecoder=&CPU_Core_Normal_Run;
 #if (C_DYNAMIC_X86)
@@ -2349,10 +2434,21 @@ public:
 		}
 
 #if (C_DYNAMIC_X86)
+		Prop_path* pp=section->Get_path("dyncachefile");
+		CPU_Core_Dyn_X86_SetCacheFile(pp->realpath.c_str(),(Bitu)section->Get_int("dyncachefilesize"));
+		CPU_Core_Dyn_X86_SetCacheSize((Bitu)section->Get_int("dyncachesize"),(Bitu)section->Get_int("dyncacheblocks"));
+		CPU_Core_Dyn_X86_SetCompileLimit((Bitu)section->Get_int("dyncompilelimit"));
+		cpu_smclog=section->Get_bool("dynsmclog");
 		CPU_Core_Dyn_X86_Cache_Init((core == "dynamic") || (core == "dynamic_nodhfpu"));
 #elif (C_DYNREC)
+		Prop_path* pp=section->Get_path("dyncachefile");
+		CPU_Core_Dynrec_SetCacheFile(pp->realpath.c_str(),(Bitu)section->Get_int("dyncachefilesize"));
+		CPU_Core_Dynrec_SetCacheSize((Bitu)section->Get_int("dyncachesize"),(Bitu)section->Get_int("dyncacheblocks"));
+		CPU_Core_Dynrec_SetCompileLimit((Bitu)section->Get_int("dyncompilelimit"),section->Get_bool("dynthread"));
+		cpu_smclog=section->Get_bool("dynsmclog");
 		CPU_Core_Dynrec_Cache_Init( core == "dynamic" );
 #endif
+		CPU_Core_Predecode_Cache_Init( core == "predecode" );
 
 		CPU_ArchitectureType = CPU_ARCHTYPE_MIXED;
 		std::string cputype(section->Get_string("cputype"));
@@ -2411,8 +2507,10 @@ static CPU * test;
 
 void CPU_ShutDown(Section* sec) {
 #if (C_DYNAMIC_X86)
+	if (cpu_smclog) CPU_Core_Dyn_X86_LogSMC();
 	CPU_Core_Dyn_X86_Cache_Close();
 #elif (C_DYNREC)
+	if (cpu_smclog) CPU_Core_Dynrec_LogSMC();
 	CPU_Core_Dynrec_Cache_Close();
 #endif
 	delete test;
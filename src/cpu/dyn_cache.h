@@ -19,6 +19,13 @@
 
 class CodePageHandlerDynRec;	// forward
 
+// superblock state of a cache block
+enum TraceState {
+	TRACE_NONE=0,		// block doesn't end with a conditional jump
+	TRACE_CANDIDATE,	// block ends with a conditional jump, taken is counted
+	TRACE_DONE			// superblock, not extended any further
+};
+
 // basic cache block representation
 class CacheBlockDynRec {
 public:
@@ -55,6 +62,10 @@ public:
 		CacheBlockDynRec * from;	// the from-block can transfer control to this block
 	} link[2];	// maximum two links (conditional jumps)
 	CacheBlockDynRec * crossblock;
+	Bit32u mode;	// cpu state the code was translated for (see cache_file_cpumode)
+	Bit32u usage;	// incremented each time the block is entered
+	Bit32u taken;	// incremented each time the final conditional jump is taken
+	Bit8u trace;	// superblock state (TraceState)
 };
 
 static struct {
@@ -71,6 +82,191 @@ static struct {
 } cache;
 
 
+// dimensions of the cache, can be changed until the cache is initialized
+static struct {
+	Bitu total;		// size of the code cache in bytes
+	Bitu blocks;	// number of cache blocks
+} cache_size={CACHE_TOTAL,CACHE_BLOCKS};
+
+// blocks that were entered at least this often since the cache pointer
+// passed them the last time are kept (the count is halved instead)
+#define CACHE_HOT_USAGE		64
+// maximum number of block groups that are skipped to keep hot code
+#define CACHE_HOT_TRIES		16
+
+// tiered translation: code is run by the normal core when it is reached
+// the first time and translated when it is reached again, at most
+// limit blocks are translated per emulated millisecond
+#define CACHE_TIER_SETS		256		// must be a power of 2
+#define CACHE_TIER_WAYS		4
+#define CACHE_TIER_NONE		0xffffffff
+#define CACHE_TIER_WRITES	64		// code page writes that can wait for the translation thread
+static struct {
+	Bitu limit;		// zero translates all code when it is first reached
+	Bitu budget;	// blocks that still may be translated in this millisecond
+	Bitu tick;
+	struct {
+		PhysPt ip;	// code start that waits for translation
+		Bitu seen;	// millisecond it was reached
+	} pending[CACHE_TIER_SETS][CACHE_TIER_WAYS];
+
+	// the translation can be done by a thread while the normal core runs,
+	// the thread owns the cache (blocks, pages and decoder) while busy is set
+	bool threaded;
+	bool busy;
+	volatile bool quit;
+	SDL_Thread * thread;
+	SDL_sem * start, * done;
+	struct {
+		CodePageHandlerDynRec * handler;
+		PhysPt ip;		// linear address of the code
+		HostPt host;	// memory of the code page
+		bool big;		// code segment size
+		Bit32u mode;	// cpu state (see cache_file_cpumode)
+	} request;
+	// writes to code pages while the thread translates, they are checked
+	// against the code when the cache is owned again
+	struct {
+		CodePageHandlerDynRec * handler;
+		Bit16u start,end;
+	} writes[CACHE_TIER_WRITES];
+	Bitu write_count;
+} cache_tier;
+
+static void cache_tier_setlimit(Bitu blocks_per_ms) {
+	cache_tier.limit=blocks_per_ms;
+	cache_tier.budget=blocks_per_ms;
+	for (Bitu i=0;i<CACHE_TIER_SETS;i++)
+		for (Bitu j=0;j<CACHE_TIER_WAYS;j++) cache_tier.pending[i][j].ip=CACHE_TIER_NONE;
+}
+
+// decide if the code at ip_point is translated now, otherwise the
+// caller lets the normal core run it for a short time
+static bool cache_tier_translate(PhysPt ip_point) {
+	if (!cache_tier.limit) return true;
+	if (cache_tier.tick!=PIC_Ticks) {
+		cache_tier.tick=PIC_Ticks;
+		cache_tier.budget=cache_tier.limit;
+	}
+	// the translation request is remembered, the translation reads
+	// the code again so writes to the page in the meantime don't matter
+	Bitu set=(ip_point^(ip_point>>12))&(CACHE_TIER_SETS-1);
+	for (Bitu i=0;i<CACHE_TIER_WAYS;i++) {
+		if (cache_tier.pending[set][i].ip!=ip_point) continue;
+		if (!cache_tier.budget) return false;
+		cache_tier.budget--;
+		cache_tier.pending[set][i].ip=CACHE_TIER_NONE;
+		return true;
+	}
+	// replace a free entry, otherwise the one that waits longest
+	Bitu way=0;
+	for (Bitu i=0;i<CACHE_TIER_WAYS;i++) {
+		if (cache_tier.pending[set][i].ip==CACHE_TIER_NONE) {
+			way=i;
+			break;
+		}
+		if ((Bits)(cache_tier.pending[set][i].seen-cache_tier.pending[set][way].seen)<0) way=i;
+	}
+	cache_tier.pending[set][way].ip=ip_point;
+	cache_tier.pending[set][way].seen=PIC_Ticks;
+	return false;
+}
+
+static void cache_tier_write(CodePageHandlerDynRec * handler,Bitu start,Bitu end);
+
+// self-modifying code statistics of the code pages, a page whose code is
+// modified more than limit times in a period is left to the normal core,
+// the time it is demoted doubles each time it happens again
+#define CACHE_SMC_SETS		64		// must be a power of 2
+#define CACHE_SMC_WAYS		4
+#define CACHE_SMC_PERIOD	100		// milliseconds
+#define CACHE_SMC_LIMIT		64
+#define CACHE_SMC_MAXLEVEL	6
+static struct CacheSMCPage {
+	Bitu phys_page;
+	Bitu writes;		// writes that modified translated code
+	Bitu blocks;		// cache blocks that were cleared by these writes
+	Bitu demotions;		// number of times the page was left to the normal core
+	Bitu level;
+	Bitu period_start;
+	Bitu period_writes;
+	Bitu demoted_until;
+} cache_smc[CACHE_SMC_SETS][CACHE_SMC_WAYS];
+static Bitu cache_smc_dropped;	// pages whose statistics had to make room for another page
+
+static CacheSMCPage * cache_smc_find(Bitu phys_page) {
+	CacheSMCPage * set=cache_smc[phys_page&(CACHE_SMC_SETS-1)];
+	for (Bitu i=0;i<CACHE_SMC_WAYS;i++)
+		if (set[i].writes && set[i].phys_page==phys_page) return &set[i];
+	return NULL;
+}
+
+static CacheSMCPage * cache_smc_get(Bitu phys_page) {
+	CacheSMCPage * page=cache_smc_find(phys_page);
+	if (page) return page;
+	// replace an unused entry, otherwise the page that was written to the
+	// longest time ago, pages that are demoted right now are kept if possible
+	CacheSMCPage * set=cache_smc[phys_page&(CACHE_SMC_SETS-1)];
+	page=&set[0];
+	for (Bitu i=0;i<CACHE_SMC_WAYS;i++) {
+		CacheSMCPage * way=&set[i];
+		if (!way->writes) {
+			page=way;
+			break;
+		}
+		bool demoted=((Bits)(way->demoted_until-PIC_Ticks))>0;
+		bool page_demoted=((Bits)(page->demoted_until-PIC_Ticks))>0;
+		if (demoted!=page_demoted) {
+			if (page_demoted) page=way;
+		} else if ((Bits)(way->period_start-page->period_start)<0) page=way;
+	}
+	if (page->writes) cache_smc_dropped++;
+	memset(page,0,sizeof(CacheSMCPage));
+	page->phys_page=phys_page;
+	page->period_start=PIC_Ticks;
+	return page;
+}
+
+static void cache_smc_write(Bitu phys_page,Bitu blocks) {
+	CacheSMCPage * page=cache_smc_get(phys_page);
+	page->writes++;
+	page->blocks+=blocks;
+	if ((PIC_Ticks-page->period_start)>=CACHE_SMC_PERIOD) {
+		// a quiet period lowers the time the page is demoted next time
+		if ((page->period_writes<CACHE_SMC_LIMIT/4) && page->level) page->level--;
+		page->period_start=PIC_Ticks;
+		page->period_writes=0;
+	}
+	if (++page->period_writes<CACHE_SMC_LIMIT) return;
+	// the code is modified faster than it can be translated
+	page->period_writes=0;
+	page->demotions++;
+	page->demoted_until=PIC_Ticks+(CACHE_SMC_PERIOD<<page->level);
+	if (page->level<CACHE_SMC_MAXLEVEL) page->level++;
+	LOG(LOG_CPU,LOG_NORMAL)("DYNREC:Code in page %X is modified too often, running it in the normal core",phys_page);
+}
+
+// check if the code in a page is left to the normal core instead of being translated
+static bool cache_smc_demoted(Bitu phys_page) {
+	CacheSMCPage * page=cache_smc_find(phys_page);
+	if (!page || !page->demotions) return false;
+	return ((Bits)(page->demoted_until-PIC_Ticks))>0;
+}
+
+static void cache_smc_log(void) {
+	LOG_MSG("Self-modifying code statistics:");
+	for (Bitu i=0;i<CACHE_SMC_SETS;i++) {
+		for (Bitu j=0;j<CACHE_SMC_WAYS;j++) {
+			CacheSMCPage * page=&cache_smc[i][j];
+			if (!page->writes) continue;
+			LOG_MSG("Page %05" sBitfs(X) ": %" sBitfs(d) " code writes, %" sBitfs(d) " blocks cleared, demoted %" sBitfs(d) " times%s",
+				page->phys_page,page->writes,page->blocks,page->demotions,
+				cache_smc_demoted(page->phys_page) ? " (now)" : "");
+		}
+	}
+	if (cache_smc_dropped) LOG_MSG("Statistics of %" sBitfs(d) " pages were dropped to make room for others",cache_smc_dropped);
+}
+
 // cache memory pointers, to be malloc'd later
 static Bit8u * cache_code_start_ptr=NULL;
 static Bit8u * cache_code=NULL;
@@ -115,6 +311,7 @@ public:
 	bool InvalidateRange(Bitu start,Bitu end) {
 		Bits index=1+(end>>DYN_HASH_SHIFT);
 		bool is_current_block=false;	// if the current block is modified, it has to be exited as soon as possible
+		Bitu cleared=0;
 
 		Bit32u ip_point=SegPhys(cs)+reg_eip;
 		ip_point=(PAGING_GetPhysicalPage(ip_point)-(phys_page<<12))+(ip_point&0xfff);
@@ -122,7 +319,7 @@ public:
 			Bitu map=0;
 			// see if there is still some code in the range
 			for (Bitu count=start;count<=end;count++) map+=write_map[count];
-			if (!map) return is_current_block;	// no more code, finished
+			if (!map) break;	// no more code, finished
 
 			CacheBlockDynRec * block=hash_map[index];
 			while (block) {
@@ -131,11 +328,13 @@ public:
 				if (start<=block->page.end && end>=block->page.start) {
 					if (ip_point<=block->page.end && ip_point>=block->page.start) is_current_block=true;
 					block->Clear();		// clear the block, decrements the write_map accordingly
+					cleared++;
 				}
 				block=nextblock;
 			}
 			index--;
 		}
+		cache_smc_write(phys_page,cleared);
 		return is_current_block;
 	}
 
@@ -148,6 +347,11 @@ public:
 		addr&=4095;
 		if (host_readb(hostmem+addr)==(Bit8u)val) return;
 		host_writeb(hostmem+addr,val);
+		if (GCC_UNLIKELY(cache_tier.busy)) {
+			// the translation thread owns the maps
+			cache_tier_write(this,addr,addr);
+			return;
+		}
 		// see if there's code where we are writing to
 		if (!host_readb(&write_map[addr])) {
 			if (active_blocks) return;		// still some blocks in this page
@@ -169,6 +373,11 @@ public:
 		addr&=4095;
 		if (host_readw(hostmem+addr)==(Bit16u)val) return;
 		host_writew(hostmem+addr,val);
+		if (GCC_UNLIKELY(cache_tier.busy)) {
+			// the translation thread owns the maps
+			cache_tier_write(this,addr,addr+1);
+			return;
+		}
 		// see if there's code where we are writing to
 		if (!host_readw(&write_map[addr])) {
 			if (active_blocks) return;		// still some blocks in this page
@@ -195,6 +404,11 @@ public:
 		addr&=4095;
 		if (host_readd(hostmem+addr)==(Bit32u)val) return;
 		host_writed(hostmem+addr,val);
+		if (GCC_UNLIKELY(cache_tier.busy)) {
+			// the translation thread owns the maps
+			cache_tier_write(this,addr,addr+3);
+			return;
+		}
 		// see if there's code where we are writing to
 		if (!host_readd(&write_map[addr])) {
 			if (active_blocks) return;		// still some blocks in this page
@@ -220,6 +434,11 @@ public:
 		}
 		addr&=4095;
 		if (host_readb(hostmem+addr)==(Bit8u)val) return false;
+		if (GCC_UNLIKELY(cache_tier.busy)) {
+			host_writeb(hostmem+addr,val);
+			cache_tier_write(this,addr,addr);
+			return false;
+		}
 		// see if there's code where we are writing to
 		if (!host_readb(&write_map[addr])) {
 			if (!active_blocks) {
@@ -248,6 +467,11 @@ public:
 		}
 		addr&=4095;
 		if (host_readw(hostmem+addr)==(Bit16u)val) return false;
+		if (GCC_UNLIKELY(cache_tier.busy)) {
+			host_writew(hostmem+addr,val);
+			cache_tier_write(this,addr,addr+1);
+			return false;
+		}
 		// see if there's code where we are writing to
 		if (!host_readw(&write_map[addr])) {
 			if (!active_blocks) {
@@ -281,6 +505,11 @@ public:
 		}
 		addr&=4095;
 		if (host_readd(hostmem+addr)==(Bit32u)val) return false;
+		if (GCC_UNLIKELY(cache_tier.busy)) {
+			host_writed(hostmem+addr,val);
+			cache_tier_write(this,addr,addr+3);
+			return false;
+		}
 		// see if there's code where we are writing to
 		if (!host_readd(&write_map[addr])) {
 			if (!active_blocks) {
@@ -308,6 +537,20 @@ public:
 		return false;
 	}
 
+	// a write that was noted while the translation thread owned the cache,
+	// the memory is written already
+	void InvalidateWrite(Bitu start,Bitu end) {
+		Bitu map=0;
+		for (Bitu i=start;i<=end;i++) map+=write_map[i];
+		if (!map) return;
+		if (!invalidation_map) {
+			invalidation_map=(Bit8u*)malloc(4096);
+			memset(invalidation_map,0,4096);
+		}
+		for (Bitu i=start;i<=end;i++) invalidation_map[i]++;
+		InvalidateRange(start,end);
+	}
+
     // add a cache block to this page and note it in the hash map
 	void AddCacheBlock(CacheBlockDynRec * block) {
 		Bitu index=1+(block->page.start>>DYN_HASH_SHIFT);
@@ -387,6 +630,10 @@ public:
 		Release();	// now can release this page
 	}
 
+	Bitu GetPhysPage(void) {
+		return phys_page;
+	}
+
 	CacheBlockDynRec * FindCacheBlock(Bitu start) {
 		CacheBlockDynRec * block=hash_map[1+(start>>DYN_HASH_SHIFT)];
 		// see if there's a cache block present at the start address
@@ -422,6 +669,33 @@ private:
 };
 
 
+// take the cache back from the translation thread, returns false if it's
+// still busy and there was no waiting for it
+static bool cache_tier_finish(bool wait) {
+	if (!cache_tier.busy) return true;
+	if (wait) SDL_SemWait(cache_tier.done);
+	else if (SDL_SemTryWait(cache_tier.done)) return false;
+	cache_tier.busy=false;
+	// the new block is in the hash map of its page now, the code may have
+	// been written to while it was translated
+	for (Bitu i=0;i<cache_tier.write_count;i++)
+		cache_tier.writes[i].handler->InvalidateWrite(cache_tier.writes[i].start,cache_tier.writes[i].end);
+	cache_tier.write_count=0;
+	return true;
+}
+
+static void cache_tier_write(CodePageHandlerDynRec * handler,Bitu start,Bitu end) {
+	if (cache_tier.write_count>=CACHE_TIER_WRITES) cache_tier_finish(true);
+	if (!cache_tier.busy) {
+		handler->InvalidateWrite(start,end);
+		return;
+	}
+	cache_tier.writes[cache_tier.write_count].handler=handler;
+	cache_tier.writes[cache_tier.write_count].start=(Bit16u)start;
+	cache_tier.writes[cache_tier.write_count].end=(Bit16u)end;
+	cache_tier.write_count++;
+}
+
 static INLINE void cache_addunusedblock(CacheBlockDynRec * block) {
 	// block has become unused, add it to the freelist
 	block->cache.next=cache.block.free;
@@ -434,6 +708,10 @@ static CacheBlockDynRec * cache_getblock(void) {
 	if (!ret) E_Exit("Ran out of CacheBlocks" );
 	cache.block.free=ret->cache.next;
 	ret->cache.next=0;
+	ret->mode=0;
+	ret->usage=0;
+	ret->taken=0;
+	ret->trace=TRACE_NONE;
 	return ret;
 }
 
@@ -484,13 +762,48 @@ void CacheBlockDynRec::Clear(void) {
 }
 
 
+// the block after this one that can be used to start a new translation
+static CacheBlockDynRec * cache_nextblock(CacheBlockDynRec * block) {
+	if (!block->cache.next || (block->cache.next->cache.start>(cache_code_start_ptr + cache_size.total - CACHE_MAXSIZE)))
+		return cache.block.first;
+	return block->cache.next;
+}
+
+// see if a block has been executed frequently since the last pass,
+// such blocks get another chance but their usage count is aged
+static bool cache_keephot(CacheBlockDynRec * block) {
+	if (!block->page.handler || (block->usage<CACHE_HOT_USAGE)) return false;
+	block->usage>>=1;
+	block->taken>>=1;
+	return true;
+}
+
 static CacheBlockDynRec * cache_openblock(void) {
 	CacheBlockDynRec * block=cache.block.active;
+	// find enough space that doesn't contain hot code, the number of
+	// tries is limited but the aging makes sure space is found eventually
+	for (Bitu tries=0;tries<CACHE_HOT_TRIES;tries++) {
+		CacheBlockDynRec * scan=block;
+		Bitu size=block->cache.size;
+		bool hot=cache_keephot(block);
+		while (!hot && (size<CACHE_MAXSIZE) && scan->cache.next) {
+			scan=scan->cache.next;
+			size+=scan->cache.size;
+			hot=cache_keephot(scan);
+		}
+		if (!hot) break;
+		block=cache_nextblock(scan);
+	}
+	cache.block.active=block;
 	// check for enough space in this block
 	Bitu size=block->cache.size;
 	CacheBlockDynRec * nextblock=block->cache.next;
 	if (block->page.handler) 
 		block->Clear();
+	block->mode=0;
+	block->usage=0;
+	block->taken=0;
+	block->trace=TRACE_NONE;
 	// block size must be at least CACHE_MAXSIZE
 	while (size<CACHE_MAXSIZE) {
 		if (!nextblock)
@@ -500,6 +813,10 @@ static CacheBlockDynRec * cache_openblock(void) {
 		CacheBlockDynRec * tempblock=nextblock->cache.next;
 		if (nextblock->page.handler) 
 			nextblock->Clear();
+		nextblock->mode=0;
+		nextblock->usage=0;
+		nextblock->taken=0;
+		nextblock->trace=TRACE_NONE;
 		// block is free now
 		cache_addunusedblock(nextblock);
 		nextblock=tempblock;
@@ -543,12 +860,7 @@ static void cache_closeblock(void) {
 		}
 	}
 	// advance the active block pointer
-	if (!block->cache.next || (block->cache.next->cache.start>(cache_code_start_ptr + CACHE_TOTAL - CACHE_MAXSIZE))) {
-//		LOG_MSG("Cache full restarting");
-		cache.block.active=cache.block.first;
-	} else {
-		cache.block.active=block->cache.next;
-	}
+	cache.block.active=cache_nextblock(block);
 }
 
 
@@ -596,6 +908,9 @@ static INLINE void cache_addq(Bit64u val) {
 static void dyn_return(BlockReturn retcode,bool ret_exception);
 static void dyn_run_code(void);
 
+static void cache_file_load(void);
+static void cache_file_save(void);
+
 
 /* Define temporary pagesize so the MPROTECT case and the regular case share as much code as possible */
 #if (C_HAVE_MPROTECT)
@@ -614,12 +929,12 @@ static void cache_init(bool enable) {
 		cache_initialized = true;
 		if (cache_blocks == NULL) {
 			// allocate the cache blocks memory
-			cache_blocks=(CacheBlockDynRec*)malloc(CACHE_BLOCKS*sizeof(CacheBlockDynRec));
+			cache_blocks=(CacheBlockDynRec*)malloc(cache_size.blocks*sizeof(CacheBlockDynRec));
 			if(!cache_blocks) E_Exit("Allocating cache_blocks has failed");
-			memset(cache_blocks,0,sizeof(CacheBlockDynRec)*CACHE_BLOCKS);
+			memset(cache_blocks,0,sizeof(CacheBlockDynRec)*cache_size.blocks);
 			cache.block.free=&cache_blocks[0];
 			// initialize the cache blocks
-			for (i=0;i<CACHE_BLOCKS-1;i++) {
+			for (i=0;i<(Bits)cache_size.blocks-1;i++) {
 				cache_blocks[i].link[0].to=(CacheBlockDynRec *)1;
 				cache_blocks[i].link[1].to=(CacheBlockDynRec *)1;
 				cache_blocks[i].cache.next=&cache_blocks[i+1];
@@ -628,12 +943,12 @@ static void cache_init(bool enable) {
 		if (cache_code_start_ptr==NULL) {
 			// allocate the code cache memory
 #if defined (WIN32)
-			cache_code_start_ptr=(Bit8u*)VirtualAlloc(0,CACHE_TOTAL+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP,
+			cache_code_start_ptr=(Bit8u*)VirtualAlloc(0,cache_size.total+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP,
 				MEM_COMMIT,PAGE_EXECUTE_READWRITE);
 			if (!cache_code_start_ptr)
-				cache_code_start_ptr=(Bit8u*)malloc(CACHE_TOTAL+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP);
+				cache_code_start_ptr=(Bit8u*)malloc(cache_size.total+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP);
 #else
-			cache_code_start_ptr=(Bit8u*)malloc(CACHE_TOTAL+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP);
+			cache_code_start_ptr=(Bit8u*)malloc(cache_size.total+CACHE_MAXSIZE+PAGESIZE_TEMP-1+PAGESIZE_TEMP);
 #endif
 			if(!cache_code_start_ptr) E_Exit("Allocating dynamic cache failed");
 
@@ -644,14 +959,14 @@ static void cache_init(bool enable) {
 			cache_code=cache_code+PAGESIZE_TEMP;
 
 #if (C_HAVE_MPROTECT)
-			if(mprotect(cache_code_link_blocks,CACHE_TOTAL+CACHE_MAXSIZE+PAGESIZE_TEMP,PROT_WRITE|PROT_READ|PROT_EXEC))
+			if(mprotect(cache_code_link_blocks,cache_size.total+CACHE_MAXSIZE+PAGESIZE_TEMP,PROT_WRITE|PROT_READ|PROT_EXEC))
 				LOG_MSG("Setting execute permission on the code cache has failed");
 #endif
 			CacheBlockDynRec * block=cache_getblock();
 			cache.block.first=block;
 			cache.block.active=block;
 			block->cache.start=&cache_code[0];
-			block->cache.size=CACHE_TOTAL;
+			block->cache.size=cache_size.total;
 			block->cache.next=0;						// last block in the list
 		}
 		// setup the default blocks for block linkage returns
@@ -680,10 +995,13 @@ static void cache_init(bool enable) {
 			newpage->next=cache.free_pages;
 			cache.free_pages=newpage;
 		}
+		// try to reuse the translations of a previous session
+		cache_file_load();
 	}
 }
 
 static void cache_close(void) {
+	if (cache_initialized) cache_file_save();
 /*	for (;;) {
 		if (cache.used_pages) {
 			CodePageHandler * cpage=cache.used_pages;
@@ -0,0 +1,346 @@
+/*
+ *  Copyright (C) 2002-2021  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+
+/*
+	Persistent translation cache.
+
+	On shutdown the translated cache blocks are written to a file together
+	with the guest code they were created from (as a hash), the cpu mode
+	and their position in the code cache. The next session places them at
+	exactly the same position in the code cache, so the generated code does
+	not need any relocation. This only works if the code cache and the cache
+	block array end up at the same host addresses with the same binary,
+	otherwise the whole file is rejected.
+	The restored blocks are pending until the guest page they belong to
+	becomes a code page. If the guest bytes and the cpu mode still match
+	they are added to the page, otherwise they are dropped.
+	Only blocks that are contained in a single page and that do not access
+	their own code (write map masks) are stored.
+*/
+
+
+#define CACHE_FILE_VERSION	1
+
+// marks a restored block that has not been added to its page yet
+#define DYN_MODE_PENDING	0x80000000
+
+struct CacheFileHeader {
+	char magic[8];
+	Bit32u version;
+	char build[24];				// compile date and time of the binary
+	Bit32u cache_total;
+	Bit32u cache_blocks;
+	Bit32u block_size;
+	Bit64u code_base;			// host address of the code cache
+	Bit64u blocks_base;			// host address of the cache blocks
+	Bit64u code_fn;				// host address of a function, differs for other binaries
+	Bit32u count;				// number of stored blocks
+};
+
+struct CacheFileEntry {
+	Bit32u phys_page;
+	Bit16u start,end;			// where in the page is the original code
+	Bit32u mode;				// cpu mode the code was translated for
+	Bit32u hash;				// hash of the original code bytes
+	Bit32u offset;				// position of the block in the code cache
+	Bit32u size;
+	Bit32u index;				// cache block that held the code
+};
+
+static struct {
+	std::string filename;
+	Bitu maxsize;				// maximum amount of code to store (bytes)
+	CacheFileEntry * entries;	// sorted by physical page
+	CacheBlockDynRec * * blocks;
+	Bitu count;
+	Bitu pending;
+} cache_file={"",0,NULL,NULL,0,0};
+
+
+static Bit32u cache_file_hash(const Bit8u * data,Bitu len) {
+	// FNV-1a
+	Bit32u hash=0x811c9dc5;
+	for (Bitu i=0;i<len;i++) {
+		hash^=data[i];
+		hash*=0x01000193;
+	}
+	return hash;
+}
+
+// the cpu state that influences the translation process
+static Bit32u cache_file_cpumode(void) {
+	Bit32u mode=0;
+	if (cpu.code.big) mode|=0x01;
+	if (cpu.pmode) mode|=0x02;
+	if (reg_flags & FLAG_VM) mode|=0x04;
+	if (paging.enabled) mode|=0x08;
+	return mode;
+}
+
+static void cache_file_setupheader(CacheFileHeader & head) {
+	memset(&head,0,sizeof(head));
+	memcpy(head.magic,"DBDRCACH",8);
+	head.version=CACHE_FILE_VERSION;
+	strncpy(head.build,__DATE__ " " __TIME__,sizeof(head.build)-1);
+	head.cache_total=cache_size.total;
+	head.cache_blocks=cache_size.blocks;
+	head.block_size=sizeof(CacheBlockDynRec);
+	head.code_base=(Bit64u)(Bitu)cache_code;
+	head.blocks_base=(Bit64u)(Bitu)cache_blocks;
+	head.code_fn=(Bit64u)(Bitu)&cache_init;
+}
+
+static bool cache_file_storable(CacheBlockDynRec * block) {
+	// only blocks that are completely contained in one page
+	if (!block->page.handler || !block->hash.index) return false;
+	if (block->crossblock || block->cache.wmapmask) return false;
+	if (block->mode & DYN_MODE_PENDING) return false;
+	return true;
+}
+
+static void cache_file_save(void) {
+	if (cache_file.filename.empty() || !cache_file.maxsize) return;
+
+	// collect the blocks in cache order, this is ascending code position
+	Bitu count=0;
+	Bitu total=0;
+	CacheBlockDynRec * block;
+	for (block=cache.block.first;block;block=block->cache.next) {
+		if (!cache_file_storable(block)) continue;
+		if (total+block->cache.size>cache_file.maxsize) continue;
+		total+=block->cache.size;
+		count++;
+	}
+	if (!count) return;
+
+	FILE * f=fopen(cache_file.filename.c_str(),"wb");
+	if (!f) {
+		LOG_MSG("DYNREC:Can't create cache file %s",cache_file.filename.c_str());
+		return;
+	}
+	CacheFileHeader head;
+	cache_file_setupheader(head);
+	head.count=(Bit32u)count;
+	bool ok=(fwrite(&head,sizeof(head),1,f)==1);
+
+	total=0;
+	for (block=cache.block.first;block && ok;block=block->cache.next) {
+		if (!cache_file_storable(block)) continue;
+		if (total+block->cache.size>cache_file.maxsize) continue;
+		total+=block->cache.size;
+		HostPt hostmem=block->page.handler->GetHostReadPt(block->page.handler->GetPhysPage());
+		if (!hostmem) {
+			// no direct access to the guest code, it can't be validated later
+			head.count--;
+			continue;
+		}
+		CacheFileEntry entry;
+		entry.phys_page=(Bit32u)block->page.handler->GetPhysPage();
+		entry.start=block->page.start;
+		entry.end=block->page.end;
+		entry.mode=block->mode;
+		entry.hash=cache_file_hash(hostmem+block->page.start,block->page.end-block->page.start+1);
+		entry.offset=(Bit32u)(block->cache.start-cache_code);
+		entry.size=(Bit32u)block->cache.size;
+		entry.index=(Bit32u)(block-cache_blocks);
+		ok=(fwrite(&entry,sizeof(entry),1,f)==1) &&
+			(fwrite(block->cache.start,1,block->cache.size,f)==block->cache.size);
+	}
+	if (ok && head.count!=count) {
+		// some blocks were skipped, correct the header
+		ok=!fseek(f,0,SEEK_SET) && (fwrite(&head,sizeof(head),1,f)==1);
+	}
+	fclose(f);
+	if (!ok) {
+		LOG_MSG("DYNREC:Error writing cache file %s",cache_file.filename.c_str());
+		remove(cache_file.filename.c_str());
+	}
+}
+
+static int cache_file_compare(const void * a,const void * b) {
+	const CacheFileEntry * ea=(const CacheFileEntry *)a;
+	const CacheFileEntry * eb=(const CacheFileEntry *)b;
+	if (ea->phys_page!=eb->phys_page) return (ea->phys_page<eb->phys_page) ? -1 : 1;
+	return (ea->start<eb->start) ? -1 : (ea->start>eb->start);
+}
+
+// add a cache block covering code_start with size to the end of the list
+static CacheBlockDynRec * cache_file_linkblock(CacheBlockDynRec * last,CacheBlockDynRec * block,Bitu code_start,Bitu size) {
+	block->cache.start=&cache_code[code_start];
+	block->cache.size=size;
+	block->cache.next=0;
+	if (last) last->cache.next=block;
+	else cache.block.first=block;
+	return block;
+}
+
+static void cache_file_load(void) {
+	if (cache_file.filename.empty() || !cache_file.maxsize) return;
+	// the code cache has to be unused
+	if (cache.block.first->cache.next || cache.block.first->page.handler) return;
+
+	FILE * f=fopen(cache_file.filename.c_str(),"rb");
+	if (!f) return;
+	CacheFileHeader head,cur;
+	cache_file_setupheader(cur);
+	if ((fread(&head,sizeof(head),1,f)!=1) || (head.count==0)) {
+		fclose(f);
+		return;
+	}
+	head.count=0;	// not part of the compare
+	if (memcmp(&head,&cur,sizeof(head))) {
+		LOG_MSG("DYNREC:Cache file %s does not match this session, ignored",cache_file.filename.c_str());
+		fclose(f);
+		return;
+	}
+	fseek(f,0,SEEK_SET);
+	if (fread(&head,sizeof(head),1,f)!=1) {
+		fclose(f);
+		return;
+	}
+
+	CacheFileEntry * entries=(CacheFileEntry *)malloc(head.count*sizeof(CacheFileEntry));
+	CacheBlockDynRec * * blocks=(CacheBlockDynRec * *)malloc(head.count*sizeof(CacheBlockDynRec *));
+	Bit8u * used=(Bit8u *)malloc(cache_size.blocks);
+	if (!entries || !blocks || !used) E_Exit("Allocating the cache file tables has failed");
+	memset(used,0,cache_size.blocks);
+
+	// read and verify the entries, the code goes directly into the cache
+	Bitu count;
+	Bitu pos=0;
+	bool ok=true;
+	for (count=0;count<head.count;count++) {
+		CacheFileEntry & entry=entries[count];
+		if (fread(&entry,sizeof(entry),1,f)!=1) break;
+		if ((entry.offset<pos) || (entry.size==0) || (entry.offset+entry.size>cache_size.total) ||
+			(entry.index>=cache_size.blocks) || used[entry.index] || (entry.start>entry.end) ||
+			(entry.end>4095) || (fread(&cache_code[entry.offset],1,entry.size,f)!=entry.size)) {
+			ok=false;
+			break;
+		}
+		used[entry.index]=1;
+		pos=entry.offset+entry.size;
+	}
+	fclose(f);
+	if (!ok || count!=head.count) {
+		LOG_MSG("DYNREC:Cache file %s is corrupt, ignored",cache_file.filename.c_str());
+		free(entries);
+		free(blocks);
+		free(used);
+		return;
+	}
+
+	// rebuild the free list without the blocks that are taken by the file
+	cache.block.free=0;
+	for (Bits i=(Bits)cache_size.blocks-1;i>=0;i--) {
+		if (used[i]) continue;
+		cache_blocks[i].page.handler=0;
+		cache_addunusedblock(&cache_blocks[i]);
+	}
+	free(used);
+
+	// rebuild the list of cache blocks, gaps are filled with free blocks
+	CacheBlockDynRec * last=0;
+	pos=0;
+	for (count=0;count<head.count;count++) {
+		CacheFileEntry & entry=entries[count];
+		if (entry.offset>pos) last=cache_file_linkblock(last,cache_getblock(),pos,entry.offset-pos);
+		CacheBlockDynRec * block=&cache_blocks[entry.index];
+		memset(block,0,sizeof(CacheBlockDynRec));
+		block->link[0].to=&link_blocks[0];
+		block->link[1].to=&link_blocks[1];
+		block->mode=entry.mode|DYN_MODE_PENDING;
+		last=cache_file_linkblock(last,block,entry.offset,entry.size);
+		pos=entry.offset+entry.size;
+	}
+	if (pos<cache_size.total) {
+		last=cache_file_linkblock(last,cache_getblock(),pos,cache_size.total-pos);
+		cache.block.active=last;
+	} else cache.block.active=cache.block.first;
+#if (C_DYNREC)
+	// the code was written as data, make it visible to the instruction cache
+	cache_block_closing(cache_code,cache_size.total);
+#endif
+
+	// sort by page so the blocks of a page can be found fast
+	qsort(entries,head.count,sizeof(CacheFileEntry),cache_file_compare);
+	for (count=0;count<head.count;count++) blocks[count]=&cache_blocks[entries[count].index];
+
+	cache_file.entries=entries;
+	cache_file.blocks=blocks;
+	cache_file.count=head.count;
+	cache_file.pending=head.count;
+	LOG_MSG("DYNREC:Restored %d blocks from %s",(int)head.count,cache_file.filename.c_str());
+}
+
+// a page was turned into a code page, add the restored blocks that still match
+static void cache_file_attach(CodePageHandlerDynRec * cph) {
+	if (GCC_LIKELY(!cache_file.pending)) return;
+	Bit32u phys_page=(Bit32u)cph->GetPhysPage();
+
+	// find the first entry of this page
+	Bitu lo=0,hi=cache_file.count;
+	while (lo<hi) {
+		Bitu mid=(lo+hi)/2;
+		if (cache_file.entries[mid].phys_page<phys_page) lo=mid+1;
+		else hi=mid;
+	}
+	if (lo>=cache_file.count || cache_file.entries[lo].phys_page!=phys_page) return;
+	HostPt hostmem=cph->GetHostReadPt(phys_page);
+	if (!hostmem) return;
+
+	Bit32u mode=cache_file_cpumode();
+	for (Bitu i=lo;i<cache_file.count && cache_file.entries[i].phys_page==phys_page;i++) {
+		CacheFileEntry & entry=cache_file.entries[i];
+		CacheBlockDynRec * block=cache_file.blocks[i];
+		if (!block) continue;
+		if (!(block->mode & DYN_MODE_PENDING)) {
+			// the space of this block has been reused in the meantime
+			cache_file.blocks[i]=0;
+			cache_file.pending--;
+			continue;
+		}
+		// keep it for later if the cpu currently runs in a different mode
+		if (entry.mode!=mode) continue;
+		cache_file.blocks[i]=0;
+		cache_file.pending--;
+		if (cache_file_hash(hostmem+entry.start,entry.end-entry.start+1)!=entry.hash) {
+			// guest code differs, the space is free for new code now
+			block->mode=0;
+			continue;
+		}
+		if (cph->FindCacheBlock(entry.start)) {
+			block->mode=0;
+			continue;
+		}
+		block->mode=entry.mode;
+		block->page.start=entry.start;
+		block->page.end=entry.end;
+		cph->AddCacheBlock(block);
+		for (Bitu addr=entry.start;addr<=entry.end;addr++) cph->write_map[addr]++;
+	}
+	if (!cache_file.pending) {
+		free(cache_file.entries);
+		free(cache_file.blocks);
+		cache_file.entries=NULL;
+		cache_file.blocks=NULL;
+		cache_file.count=0;
+	}
+}
@@ -29,6 +29,7 @@
 #include "cpu.h"
 #include "debug.h"
 #include "setup.h"
+#include "snapshot.h"
 
 #define LINK_TOTAL		(64*1024)
 
@@ -694,6 +695,7 @@ void PAGING_LinkPage(Bitu lin_page,Bitu phys_page) {
 	if (lin_page>=TLB_SIZE || phys_page>=TLB_SIZE) 
 		E_Exit("Illegal page");
 
+	TLB_STAT(misses);
 	if (paging.links.used>=PAGING_LINKS) {
 		LOG(LOG_PAGING,LOG_NORMAL)("Not enough paging links, resetting cache");
 		PAGING_ClearTLB();
@@ -716,6 +718,7 @@ void PAGING_LinkPage_ReadOnly(Bitu lin_page,Bitu phys_page) {
 	if (lin_page>=TLB_SIZE || phys_page>=TLB_SIZE) 
 		E_Exit("Illegal page");
 
+	TLB_STAT(misses);
 	if (paging.links.used>=PAGING_LINKS) {
 		LOG(LOG_PAGING,LOG_NORMAL)("Not enough paging links, resetting cache");
 		PAGING_ClearTLB();
@@ -731,6 +734,111 @@ void PAGING_LinkPage_ReadOnly(Bitu lin_page,Bitu phys_page) {
 	paging.tlb.writehandler[lin_page]=&init_page_handler_userro;
 }
 
+#elif defined(USE_COMPACT_TLB)
+
+static INLINE void InitTLBEntry(tlb_entry *entry) {
+	entry->read=0;
+	entry->write=0;
+	entry->readhandler=&init_page_handler;
+	entry->writehandler=&init_page_handler;
+	entry->lin_page=TLB_NOPAGE;
+}
+
+// get the entry a page is linked into, the least recently linked
+// page of the set is replaced if the page isn't present yet
+static tlb_entry *GetTLBLinkEntry(Bitu lin_page) {
+	tlb_entry *set=paging.tlbh[lin_page&(TLB_SETS-1)];
+	if (set[0].lin_page==lin_page) return &set[0];
+	if (set[1].lin_page==lin_page) return &set[1];
+	if (set[1].lin_page!=TLB_NOPAGE) TLB_STAT(evictions);
+	set[1]=set[0];
+	set[0].lin_page=lin_page;
+	return &set[0];
+}
+
+void PAGING_InitTLB(void) {
+	for (Bitu i=0;i<TLB_SETS;i++) {
+		for (Bitu j=0;j<TLB_WAYS;j++) InitTLBEntry(&paging.tlbh[i][j]);
+	}
+	InitTLBEntry(&paging.tlb_miss);
+	paging.links.used=0;
+}
+
+void PAGING_ClearTLB(void) {
+	Bit32u * entries=&paging.links.entries[0];
+	for (;paging.links.used>0;paging.links.used--) {
+		Bitu page=*entries++;
+		tlb_entry *entry = get_tlb_entry(page<<12);
+		// pages that were replaced in the meantime are gone already
+		if (entry!=&paging.tlb_miss) InitTLBEntry(entry);
+	}
+	paging.links.used=0;
+}
+
+void PAGING_UnlinkPages(Bitu lin_page,Bitu pages) {
+	for (;pages>0;pages--) {
+		tlb_entry *entry = get_tlb_entry(lin_page<<12);
+		if (entry!=&paging.tlb_miss) InitTLBEntry(entry);
+		lin_page++;
+	}
+}
+
+void PAGING_MapPage(Bitu lin_page,Bitu phys_page) {
+	if (lin_page<LINK_START) {
+		paging.firstmb[lin_page]=phys_page;
+		PAGING_UnlinkPages(lin_page,1);
+	} else {
+		PAGING_LinkPage(lin_page,phys_page);
+	}
+}
+
+void PAGING_LinkPage(Bitu lin_page,Bitu phys_page) {
+	PageHandler * handler=MEM_GetPageHandler(phys_page);
+	Bitu lin_base=lin_page << 12;
+	if (lin_page>=TLB_SIZE || phys_page>=TLB_SIZE) 
+		E_Exit("Illegal page");
+
+	TLB_STAT(misses);
+	if (paging.links.used>=PAGING_LINKS) {
+		LOG(LOG_PAGING,LOG_NORMAL)("Not enough paging links, resetting cache");
+		PAGING_ClearTLB();
+	}
+
+	tlb_entry *entry = GetTLBLinkEntry(lin_page);
+	entry->phys_page=phys_page;
+	if (handler->flags & PFLAG_READABLE) entry->read=handler->GetHostReadPt(phys_page)-lin_base;
+	else entry->read=0;
+	if (handler->flags & PFLAG_WRITEABLE) entry->write=handler->GetHostWritePt(phys_page)-lin_base;
+	else entry->write=0;
+
+	paging.links.entries[paging.links.used++]=lin_page;
+	entry->readhandler=handler;
+	entry->writehandler=handler;
+}
+
+void PAGING_LinkPage_ReadOnly(Bitu lin_page,Bitu phys_page) {
+	PageHandler * handler=MEM_GetPageHandler(phys_page);
+	Bitu lin_base=lin_page << 12;
+	if (lin_page>=TLB_SIZE || phys_page>=TLB_SIZE) 
+		E_Exit("Illegal page");
+
+	TLB_STAT(misses);
+	if (paging.links.used>=PAGING_LINKS) {
+		LOG(LOG_PAGING,LOG_NORMAL)("Not enough paging links, resetting cache");
+		PAGING_ClearTLB();
+	}
+
+	tlb_entry *entry = GetTLBLinkEntry(lin_page);
+	entry->phys_page=phys_page;
+	if (handler->flags & PFLAG_READABLE) entry->read=handler->GetHostReadPt(phys_page)-lin_base;
+	else entry->read=0;
+	entry->write=0;
+
+	paging.links.entries[paging.links.used++]=lin_page;
+	entry->readhandler=handler;
+	entry->writehandler=&init_page_handler_userro;
+}
+
 #else
 
 static INLINE void InitTLBInt(tlb_entry *bank) {
@@ -795,6 +903,7 @@ void PAGING_LinkPage(Bitu lin_page,Bitu phys_page) {
 	if (lin_page>=(TLB_SIZE*(TLB_BANKS+1)) || phys_page>=(TLB_SIZE*(TLB_BANKS+1))) 
 		E_Exit("Illegal page");
 
+	TLB_STAT(misses);
 	if (paging.links.used>=PAGING_LINKS) {
 		LOG(LOG_PAGING,LOG_NORMAL)("Not enough paging links, resetting cache");
 		PAGING_ClearTLB();
@@ -818,6 +927,7 @@ void PAGING_LinkPage_ReadOnly(Bitu lin_page,Bitu phys_page) {
 	if (lin_page>=(TLB_SIZE*(TLB_BANKS+1)) || phys_page>=(TLB_SIZE*(TLB_BANKS+1))) 
 		E_Exit("Illegal page");
 
+	TLB_STAT(misses);
 	if (paging.links.used>=PAGING_LINKS) {
 		LOG(LOG_PAGING,LOG_NORMAL)("Not enough paging links, resetting cache");
 		PAGING_ClearTLB();
@@ -871,6 +981,25 @@ bool PAGING_Enabled(void) {
 	return paging.enabled;
 }
 
+/* Only the registers and the low memory mapping are kept, the tlb gets
+   rebuilt from the page tables after loading */
+static void PAGING_SnapshotSave(SnapshotStream & stream) {
+	stream.Write(&paging.cr3,sizeof(paging.cr3));
+	stream.Write(&paging.cr2,sizeof(paging.cr2));
+	stream.Write(&paging.enabled,sizeof(paging.enabled));
+	stream.Write(paging.firstmb,sizeof(paging.firstmb));
+}
+
+static void PAGING_SnapshotLoad(SnapshotStream & stream) {
+	stream.Read(&paging.cr3,sizeof(paging.cr3));
+	stream.Read(&paging.cr2,sizeof(paging.cr2));
+	stream.Read(&paging.enabled,sizeof(paging.enabled));
+	stream.Read(paging.firstmb,sizeof(paging.firstmb));
+	paging.base.page=paging.cr3 >> 12;
+	paging.base.addr=paging.cr3 & ~4095;
+	PAGING_ClearTLB();
+}
+
 class PAGING:public Module_base{
 public:
 	PAGING(Section* configuration):Module_base(configuration){
@@ -882,11 +1011,28 @@ public:
 			paging.firstmb[i]=i;
 		}
 		pf_queue.used=0;
+		SNAPSHOT_AddHandler("paging",PAGING_SnapshotSave,PAGING_SnapshotLoad,SNAPSHOT_PERSISTENT);
+	}
+	~PAGING(){
+		SNAPSHOT_Remove("paging");
+#if defined(PAGING_TLB_STATS)
+		if (paging.stats.lookups) {
+			LOG_MSG("Paging: %.0f TLB lookups, %.0f misses (%.4f%%), %.0f evictions",
+				(double)paging.stats.lookups,(double)paging.stats.misses,
+				100.0*(double)paging.stats.misses/(double)paging.stats.lookups,
+				(double)paging.stats.evictions);
+		}
+#endif
 	}
-	~PAGING(){}
 };
 
 static PAGING* test;
+
+static void PAGING_ShutDown(Section * /*sec*/) {
+	delete test;
+}
+
 void PAGING_Init(Section * sec) {
 	test = new PAGING(sec);
+	sec->AddDestroyFunction(&PAGING_ShutDown);
 }
@@ -70,6 +70,11 @@ static void LogLDT(void);
 static void LogIDT(void);
 static void LogPages(char* selname);
 static void LogCPUInfo(void);
+#if (C_DYNAMIC_X86)
+void CPU_Core_Dyn_X86_LogSMC(void);
+#elif (C_DYNREC)
+void CPU_Core_Dynrec_LogSMC(void);
+#endif
 static void OutputVecTable(char* filename);
 static void DrawVariables(void);
 
@@ -1294,6 +1299,12 @@ bool ParseCommand(char* str) {
 
 	if (command == "CPU") {LogCPUInfo(); return true;}
 
+#if (C_DYNAMIC_X86)
+	if (command == "SMC") {CPU_Core_Dyn_X86_LogSMC(); return true;}
+#elif (C_DYNREC)
+	if (command == "SMC") {CPU_Core_Dynrec_LogSMC(); return true;}
+#endif
+
 	if (command == "INTVEC") {
 		if (found[0] != 0) {
 			OutputVecTable(found);
@@ -1382,6 +1393,9 @@ bool ParseCommand(char* str) {
 		DEBUG_ShowMsg("LDT                       - Lists descriptors of the LDT.\n");
 		DEBUG_ShowMsg("IDT                       - Lists descriptors of the IDT.\n");
 		DEBUG_ShowMsg("PAGING [page]             - Display content of page table.\n");
+#if (C_DYNAMIC_X86) || (C_DYNREC)
+		DEBUG_ShowMsg("SMC                       - Show self-modifying code per dynamic code page.\n");
+#endif
 		DEBUG_ShowMsg("EXTEND                    - Toggle additional info.\n");
 		DEBUG_ShowMsg("TIMERIRQ                  - Run the system timer.\n");
 
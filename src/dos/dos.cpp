@@ -20,6 +20,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <sys/stat.h>
+#include <typeinfo>
 #include "dosbox.h"
 #include "bios.h"
 #include "mem.h"
@@ -30,6 +32,8 @@
 #include "setup.h"
 #include "support.h"
 #include "serialport.h"
+#include "snapshot.h"
+#include "bios_disk.h"
 
 DOS_Block dos;
 DOS_InfoBlock dos_infoblock;
@@ -1271,6 +1275,170 @@ static Bitu DOS_26Handler(void) {
 }
 
 
+/* The kernel variables, the tables in it are set up the same way by every
+   run and the country table is a host pointer */
+static void DOS_SnapshotSave(SnapshotStream & stream) {
+	stream.Write(&dos,sizeof(dos));
+	Bit16u strategy=DOS_GetMemAllocStrategy();
+	stream.Write(&strategy,sizeof(strategy));
+}
+
+static void DOS_SnapshotLoad(SnapshotStream & stream) {
+	DOS_Block block;
+	stream.Read(&block,sizeof(block));
+	block.tables=dos.tables;
+	dos=block;
+	Bit16u strategy;
+	stream.Read(&strategy,sizeof(strategy));
+	DOS_SetMemAllocStrategy(strategy);
+	/* An image is started at a later time, the clock follows the host */
+	if (SNAPSHOT_InFile()) BIOS_HostTimeSync();
+}
+
+static void WriteString(SnapshotStream & stream,char const * str) {
+	Bit32u len=(Bit32u)strlen(str);
+	stream.Write(&len,sizeof(len));
+	stream.Write(str,len);
+}
+
+static std::string ReadString(SnapshotStream & stream) {
+	Bit32u len;
+	stream.Read(&len,sizeof(len));
+	std::string str(len,0);
+	if (len) stream.Read(&str[0],len);
+	return str;
+}
+
+enum { IMAGE_DRIVE_NONE=0,IMAGE_DRIVE_LOCAL,IMAGE_DRIVE_OTHER };
+
+/* Drives stay mounted across in memory snapshots. An image has to bring
+   back the local directories mounted before it was saved. */
+static void DOS_DrivesSave(SnapshotStream & stream) {
+	if (!SNAPSHOT_InFile()) return;
+	for (Bitu i=0;i<DOS_DRIVES;i++) {
+		Bit8u type=IMAGE_DRIVE_NONE;
+		if (Drives[i]) type=(typeid(*Drives[i])==typeid(localDrive)) ? IMAGE_DRIVE_LOCAL : IMAGE_DRIVE_OTHER;
+		stream.Write(&type,sizeof(type));
+		if (type==IMAGE_DRIVE_LOCAL) {
+			localDrive * ldp=(localDrive *)Drives[i];
+			Bit16u bytes_sector,total_clusters,free_clusters;Bit8u sectors_cluster;
+			ldp->AllocationInfo(&bytes_sector,&sectors_cluster,&total_clusters,&free_clusters);
+			Bit8u mediaid=ldp->GetMediaByte();
+			WriteString(stream,ldp->getBasedir());
+			stream.Write(&bytes_sector,sizeof(bytes_sector));
+			stream.Write(&sectors_cluster,sizeof(sectors_cluster));
+			stream.Write(&total_clusters,sizeof(total_clusters));
+			stream.Write(&free_clusters,sizeof(free_clusters));
+			stream.Write(&mediaid,sizeof(mediaid));
+			WriteString(stream,ldp->dirCache.GetLabel());
+		}
+		if (type!=IMAGE_DRIVE_NONE) WriteString(stream,Drives[i]->curdir);
+	}
+}
+
+static void DOS_DrivesLoad(SnapshotStream & stream) {
+	if (!SNAPSHOT_InFile()) return;
+	for (Bitu i=0;i<DOS_DRIVES;i++) {
+		Bit8u type;
+		stream.Read(&type,sizeof(type));
+		if (type==IMAGE_DRIVE_LOCAL) {
+			std::string basedir=ReadString(stream);
+			Bit16u bytes_sector,total_clusters,free_clusters;Bit8u sectors_cluster,mediaid;
+			stream.Read(&bytes_sector,sizeof(bytes_sector));
+			stream.Read(&sectors_cluster,sizeof(sectors_cluster));
+			stream.Read(&total_clusters,sizeof(total_clusters));
+			stream.Read(&free_clusters,sizeof(free_clusters));
+			stream.Read(&mediaid,sizeof(mediaid));
+			std::string label=ReadString(stream);
+			if (Drives[i] && (typeid(*Drives[i])!=typeid(localDrive) ||
+				basedir!=((localDrive *)Drives[i])->getBasedir())) {
+				if (DriveManager::UnmountDrive(i)) {
+					LOG_MSG("DOS:Can't replace drive %c: with the one from the image",(int)('A'+i));
+					ReadString(stream);
+					continue;
+				}
+				Drives[i]=0;
+			}
+			if (!Drives[i]) {
+				Drives[i]=new localDrive(basedir.c_str(),bytes_sector,sectors_cluster,total_clusters,free_clusters,mediaid);
+				/* Only floppies get their label updated */
+				Drives[i]->dirCache.SetLabel(label.c_str(),false,mediaid==0xF0);
+			}
+		} else if (type==IMAGE_DRIVE_NONE && Drives[i]) {
+			if (DriveManager::UnmountDrive(i)) LOG_MSG("DOS:Can't unmount drive %c: for the image",(int)('A'+i));
+			else Drives[i]=0;
+		}
+		if (type!=IMAGE_DRIVE_NONE) {
+			std::string curdir=ReadString(stream);
+			if (Drives[i] && curdir.size()<DOS_PATHLENGTH) strcpy(Drives[i]->curdir,curdir.c_str());
+		}
+	}
+}
+
+bool DOS_ImageReady(void) {
+	for (Bitu i=0;i<DOS_DRIVES;i++) {
+		if (!Drives[i] || i==25) continue;
+		if (typeid(*Drives[i])!=typeid(localDrive)) {
+			LOG_MSG("DOS:Drive %c: isn't a local directory and can't be kept in an image",(int)('A'+i));
+			return false;
+		}
+	}
+	for (Bitu i=0;i<MAX_DISK_IMAGES;i++) {
+		if (imageDiskList[i]) {
+			LOG_MSG("DOS:Disk images can't be kept in an image");
+			return false;
+		}
+	}
+	for (Bitu i=0;i<DOS_FILES;i++) {
+		if (Files[i] && !(Files[i]->GetInformation() & 0x8000)) {
+			LOG_MSG("DOS:File %s is open and can't be kept in an image",Files[i]->GetName() ? Files[i]->GetName() : "");
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Returns the host modification time of a mounted directory */
+static bool MountTime(std::string dir,unsigned long & mtime) {
+	while (dir.size()>1 && dir[dir.size()-1]==CROSS_FILESPLIT) dir.erase(dir.size()-1);
+	struct stat test;
+	if (stat(dir.c_str(),&test)) return false;
+	mtime=(unsigned long)test.st_mtime;
+	return true;
+}
+
+std::string DOS_ImageMounts(void) {
+	std::string mounts;
+	for (Bitu i=0;i<DOS_DRIVES;i++) {
+		if (!Drives[i] || typeid(*Drives[i])!=typeid(localDrive)) continue;
+		char const * basedir=((localDrive *)Drives[i])->getBasedir();
+		unsigned long mtime=0;
+		MountTime(basedir,mtime);
+		char line[CROSS_LEN+32];
+		sprintf(line,"%s\t%lu\n",basedir,mtime);
+		mounts+=line;
+	}
+	return mounts;
+}
+
+bool DOS_ImageMountsValid(std::string const & mounts) {
+	std::string::size_type pos=0;
+	while (pos<mounts.size()) {
+		std::string::size_type end=mounts.find('\n',pos);
+		if (end==std::string::npos) return false;
+		std::string line=mounts.substr(pos,end-pos);
+		pos=end+1;
+		std::string::size_type tab=line.rfind('\t');
+		if (tab==std::string::npos) return false;
+		unsigned long mtime;
+		if (!MountTime(line.substr(0,tab),mtime) || mtime!=strtoul(line.c_str()+tab+1,0,10)) {
+			LOG_MSG("DOS:Mounted directory %s changed since the image was made",line.substr(0,tab).c_str());
+			return false;
+		}
+	}
+	return true;
+}
+
 class DOS:public Module_base{
 private:
 	CALLBACK_HandlerObject callback[7];
@@ -1321,8 +1489,13 @@ public:
 		dos.version.minor=0;
 		dos.direct_output=false;
 		dos.internal_output=false;
+
+		SNAPSHOT_AddHandler("dos",DOS_SnapshotSave,DOS_SnapshotLoad,SNAPSHOT_PERSISTENT);
+		SNAPSHOT_AddHandler("drives",DOS_DrivesSave,DOS_DrivesLoad,SNAPSHOT_PERSISTENT);
 	}
 	~DOS(){
+		SNAPSHOT_Remove("drives");
+		SNAPSHOT_Remove("dos");
 		for (Bit16u i=0;i<DOS_DRIVES;i++) delete Drives[i];
 	}
 };
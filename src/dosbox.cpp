@@ -63,6 +63,7 @@ void DOS_Init(Section*);
 
 
 void CPU_Init(Section*);
+void CPUBENCH_Init(Section*);
 
 #if C_FPU
 void FPU_Init(Section*);
@@ -102,6 +103,7 @@ void TIMER_Init(Section*);
 void BIOS_Init(Section*);
 void DEBUG_Init(Section*);
 void CMOS_Init(Section*);
+void SNAPSHOT_Init(Section*);
 
 void MSCDEX_Init(Section*);
 void DRIVES_Init(Section*);
@@ -121,6 +123,7 @@ void INT10_Init(Section*);
 static LoopHandler * loop;
 
 bool SDLNetInited;
+bool headless;					//No video or audio output, run as fast as possible
 
 static Bit32u ticksRemain;
 static Bit32u ticksLast;
@@ -128,8 +131,16 @@ static Bit32u ticksAdded;
 Bit32s ticksDone;
 Bit32u ticksScheduled;
 bool ticksLocked;
+static bool ticksPrecise;		//Pace on the microsecond clock instead of GetTicks
+static Bit64u ticksPreciseBase;	//Microsecond clock at startup, it counts from host boot
+static Bit32s ticksDoneUs;		//Microseconds of ticksDone below a millisecond when pacing precisely
 void increaseticks();
 
+static INLINE Bit32u PacingTicks(void) {
+	if (ticksPrecise) return (Bit32u)((TIMER_GetTicksUs()-ticksPreciseBase)/1000);
+	return GetTicks();
+}
+
 static Bitu Normal_Loop(void) {
 	Bits ret;
 	while (1) {
@@ -161,9 +172,10 @@ void increaseticks() { //Make it return ticksRemain and set it in the function a
 	if (GCC_UNLIKELY(ticksLocked)) { // For Fast Forward Mode
 		ticksRemain=5;
 		/* Reset any auto cycle guessing for this frame */
-		ticksLast = GetTicks();
+		ticksLast = PacingTicks();
 		ticksAdded = 0;
 		ticksDone = 0;
+		ticksDoneUs = 0;
 		ticksScheduled = 0;
 		return;
 	}
@@ -172,11 +184,24 @@ void increaseticks() { //Make it return ticksRemain and set it in the function a
 	static Bitu sleep1count = 0;
 
 	Bit32u ticksNew;
-	ticksNew = GetTicks();
+	ticksNew = PacingTicks();
 	ticksScheduled += ticksAdded;
 	if (ticksNew <= ticksLast) { //lower should not be possible, only equal.
 		ticksAdded = 0;
 
+		if (ticksPrecise) {
+			/* Sleep until the next millisecond of the pacing clock and keep the
+			   part of a millisecond slept for the next cycle guess */
+			Bit64u sleepStart = TIMER_GetTicksUs();
+			TIMER_SleepUntilUs(ticksPreciseBase + (Bit64u)(ticksLast + 1) * 1000);
+			Bit64s doneUs = (Bit64s)ticksDone * 1000 + ticksDoneUs - (Bit64s)(TIMER_GetTicksUs() - sleepStart);
+			if (doneUs < 0)
+				doneUs = 0;
+			ticksDone = (Bit32s)(doneUs / 1000);
+			ticksDoneUs = (Bit32s)(doneUs % 1000);
+			return;
+		}
+
 		if (!CPU_CycleAutoAdjust || CPU_SkipCycleAutoAdjust || sleep1count < 3) {
 			wrap_delay(1);
 		} else {
@@ -224,9 +249,11 @@ void increaseticks() { //Make it return ticksRemain and set it in the function a
 	if (!CPU_CycleAutoAdjust || CPU_SkipCycleAutoAdjust) return;
 	
 	if (ticksScheduled >= 250 || ticksDone >= 250 || (ticksAdded > 15 && ticksScheduled >= 5) ) {
-		if(ticksDone < 1) ticksDone = 1; // Protect against div by zero
+		if(ticksDone < 1) { ticksDone = 1; ticksDoneUs = 0; } // Protect against div by zero
 		/* ratio we are aiming for is around 90% usage*/
-		Bit32s ratio = (ticksScheduled * (CPU_CyclePercUsed*90*1024/100/100)) / ticksDone;
+		Bit32s ratio;
+		if (ticksPrecise) ratio = (Bit32s)(((Bit64s)ticksScheduled * (CPU_CyclePercUsed*90*1024/100/100) * 1000) / ((Bit64s)ticksDone * 1000 + ticksDoneUs));
+		else ratio = (ticksScheduled * (CPU_CyclePercUsed*90*1024/100/100)) / ticksDone;
 		Bit32s new_cmax = CPU_CycleMax;
 		Bit64s cproc = (Bit64s)CPU_CycleMax * (Bit64s)ticksScheduled;
 		float ratioremoved = 0.0; //increase scope for logging
@@ -293,6 +320,7 @@ void increaseticks() { //Make it return ticksRemain and set it in the function a
 		//Reset cycleguessing parameters.
 		CPU_IODelayRemoved = 0;
 		ticksDone = 0;
+		ticksDoneUs = 0;
 		ticksScheduled = 0;
 		lastsleepDone = -1;
 		sleep1count = 0;
@@ -314,15 +342,24 @@ void DOSBOX_SetNormalLoop() {
 	loop=Normal_Loop;
 }
 
+static Bitu run_depth = 0;
+
 void DOSBOX_RunMachine(void){
 	Bitu ret;
+	run_depth++;
 	do {
 		ret=(*loop)();
 	} while (!ret);
+	run_depth--;
+}
+
+Bitu DOSBOX_GetRunDepth(void) {
+	return run_depth;
 }
 
 static void DOSBOX_UnlockSpeed( bool pressed ) {
 	static bool autoadjust = false;
+	if (headless) return;
 	if (pressed) {
 		LOG_MSG("Fast Forward ON");
 		ticksLocked = true;
@@ -347,8 +384,12 @@ static void DOSBOX_RealInit(Section * sec) {
 	/* Initialize some dosbox internals */
 
 	ticksRemain=0;
-	ticksLast=GetTicks();
-	ticksLocked = false;
+	ticksPrecise=(std::string(section->Get_string("pacing"))=="precise");
+	ticksPreciseBase=TIMER_GetTicksUs();
+	ticksLast=PacingTicks();
+	/* Nothing is shown or heard in headless mode, so never wait for the clock */
+	ticksLocked = headless;
+	if (headless) LOG_MSG("DOSBox: Running headless");
 	DOSBOX_SetLoop(&Normal_Loop);
 	MSG_Init(section);
 
@@ -421,6 +462,19 @@ void DOSBOX_Init(void) {
 	Pstring = secprop->Add_path("captures",Property::Changeable::Always,"capture");
 	Pstring->Set_help("Directory where things like wave, midi, screenshot get captured.");
 
+	const char* pacings[] = { "ms", "precise", 0 };
+	Pstring = secprop->Add_string("pacing",Property::Changeable::OnlyAtStart,"ms");
+	Pstring->Set_values(pacings);
+	Pstring->Set_help(
+		"How the emulation is kept in sync with the host clock.\n"
+		"  ms: Millisecond timer, idle time is slept in whole milliseconds.\n"
+		"  precise: Microsecond monotonic clock, sleeps until the exact start\n"
+		"           of the next emulated millisecond.");
+
+	Pbool = secprop->Add_bool("ioprofile",Property::Changeable::OnlyAtStart,false);
+	Pbool->Set_help("Count the accesses and the time spent in the handlers of every io port.\n"
+		"The busiest ports are written to the log with the ioprofile mapper key and on exit.");
+
 #if C_DEBUG
 	LOG_StartUp();
 #endif
@@ -441,6 +495,7 @@ void DOSBOX_Init(void) {
 	secprop->AddInitFunction(&PROGRAMS_Init);
 	secprop->AddInitFunction(&TIMER_Init);//done
 	secprop->AddInitFunction(&CMOS_Init);//done
+	secprop->AddInitFunction(&SNAPSHOT_Init);
 
 	secprop=control->AddSection_prop("render",&RENDER_Init,true);
 	Pint = secprop->Add_int("frameskip",Property::Changeable::Always,0);
@@ -450,6 +505,12 @@ void DOSBOX_Init(void) {
 	Pbool = secprop->Add_bool("aspect",Property::Changeable::Always,false);
 	Pbool->Set_help("Do aspect correction, if your output method doesn't support scaling this can slow things down!");
 
+#if !defined(_EE)
+	Pbool = secprop->Add_bool("thread",Property::Changeable::OnlyAtStart,false);
+	Pbool->Set_help("Run the scaler in a separate thread, the emulation continues with the next frame\n"
+	                "while the previous one is scaled. Adds one frame of latency to the output.");
+#endif
+
 	Pmulti = secprop->Add_multi("scaler",Property::Changeable::Always," ");
 	Pmulti->SetValue("normal2x");
 	Pmulti->Set_help("Scaler used to enlarge/enhance low resolution modes. If 'forced' is appended,\n"
@@ -486,17 +547,21 @@ void DOSBOX_Init(void) {
 #if (C_DYNAMIC_X86) || (C_DYNREC)
 		"dynamic",
 #endif
-		"normal", "simple",0 };
+		"normal", "simple", "predecode",0 };
 	Pstring = secprop->Add_string("core",Property::Changeable::WhenIdle,"auto");
 	Pstring->Set_values(cores);
 	Pstring->Set_help("CPU Core used in emulation. auto will switch to dynamic if available and\n"
-		"appropriate.");
+		"appropriate. predecode replays decoded instructions through their handler addresses.");
 
 	const char* cputype_values[] = { "auto", "386", "386_slow", "486_slow", "pentium_slow", "386_prefetch", 0};
 	Pstring = secprop->Add_string("cputype",Property::Changeable::Always,"auto");
 	Pstring->Set_values(cputype_values);
 	Pstring->Set_help("CPU Type used in emulation. auto is the fastest choice.");
 
+	Pbool = secprop->Add_bool("idledetect",Property::Changeable::Always,false);
+	Pbool->Set_help("Detect tight loops polling the keyboard or the BIOS timer and skip\n"
+		"the rest of their time slice, so an idle machine doesn't use a full host core.\n"
+		"Programs that calibrate delay loops on such polls may run incorrectly.");
 
 	Pmulti_remain = secprop->Add_multiremain("cycles",Property::Changeable::Always," ");
 	Pmulti_remain->Set_help(
@@ -525,9 +590,53 @@ void DOSBOX_Init(void) {
 	Pint->SetMinMax(1,1000000);
 	Pint->Set_help("Setting it lower than 100 will be a percentage.");
 
+#if (C_DYNAMIC_X86) || (C_DYNREC)
+#if defined(_EE)
+	Pint = secprop->Add_int("dyncachesize",Property::Changeable::OnlyAtStart,2048);
+#else
+	Pint = secprop->Add_int("dyncachesize",Property::Changeable::OnlyAtStart,8192);
+#endif
+	Pint->SetMinMax(256,262144);
+	Pint->Set_help("Size (in KB) of the memory that holds the code translated by the dynamic core.");
+
+#if defined(_EE)
+	Pint = secprop->Add_int("dyncacheblocks",Property::Changeable::OnlyAtStart,45*1024);
+#elif (C_DYNAMIC_X86)
+	Pint = secprop->Add_int("dyncacheblocks",Property::Changeable::OnlyAtStart,64*1024);
+#else
+	Pint = secprop->Add_int("dyncacheblocks",Property::Changeable::OnlyAtStart,128*1024);
+#endif
+	Pint->SetMinMax(1024,1048576);
+	Pint->Set_help("Number of translated code blocks the dynamic core can hold.");
+
+	Pint = secprop->Add_int("dyncompilelimit",Property::Changeable::OnlyAtStart,0);
+	Pint->SetMinMax(0,100000);
+	Pint->Set_help("Number of code blocks the dynamic core translates per emulated millisecond.\n"
+		"Code is translated when it is reached again and runs on the normal core until then,\n"
+		"which avoids stalls when a lot of new code is loaded. 0 translates all code at once.");
+
+#if (C_DYNREC)
+	Pbool = secprop->Add_bool("dynthread",Property::Changeable::OnlyAtStart,false);
+	Pbool->Set_help("Translate code in a separate thread, the normal core runs it until the translation is done.\n"
+		"Code is translated when it is first reached unless dyncompilelimit is set.");
+#endif
+
+	Pbool = secprop->Add_bool("dynsmclog",Property::Changeable::OnlyAtStart,false);
+	Pbool->Set_help("Write the self-modifying code statistics of the dynamic core to the log on exit.");
+
+	Pstring = secprop->Add_path("dyncachefile",Property::Changeable::OnlyAtStart,"");
+	Pstring->Set_help("File used to keep the code translated by the dynamic core between sessions.\n"
+		"Translations are only reused if the guest code is unchanged. Empty disables it.");
+
+	Pint = secprop->Add_int("dyncachefilesize",Property::Changeable::OnlyAtStart,1024);
+	Pint->SetMinMax(0,65536);
+	Pint->Set_help("Maximum amount of translated code (in KB) that is stored in dyncachefile.");
+#endif
+
 #if C_FPU
 	secprop->AddInitFunction(&FPU_Init);
 #endif
+	secprop->AddInitFunction(&CPUBENCH_Init);
 	secprop->AddInitFunction(&DMA_Init);//done
 	secprop->AddInitFunction(&VGA_Init);
 	secprop->AddInitFunction(&KEYBOARD_Init);
@@ -771,6 +880,11 @@ void DOSBOX_Init(void) {
 	Pstring = secprop->Add_string("keyboardlayout",Property::Changeable::WhenIdle, "auto");
 	Pstring->Set_help("Language code of the keyboard layout (or none).");
 
+	Pstring = secprop->Add_path("bootimage",Property::Changeable::OnlyAtStart,"");
+	Pstring->Set_help("File that keeps the machine as it is when BOOTIMAGE runs in the autoexec.\n"
+		"Later starts load it instead of running the autoexec up to that point.\n"
+		"It is made again when the configuration or a mounted directory changes.");
+
 	// Mscdex
 	secprop->AddInitFunction(&MSCDEX_Init);
 	secprop->AddInitFunction(&DRIVES_Init);
@@ -25,6 +25,7 @@
 #include "cross.h"
 #include "mem.h"
 #include "fpu.h"
+#include "snapshot.h"
 #include "cpu.h"
 
 FPU_rec fpu;
@@ -628,6 +629,7 @@ void FPU_ESC7_Normal(Bitu rm) {
 
 void FPU_Init(Section*) {
 	FPU_FINIT();
+	SNAPSHOT_AddRegion("fpu",&fpu,sizeof(fpu));
 }
 
 #endif
@@ -61,6 +61,7 @@ static const u64 Black = GS_SETREG_RGBAQ(0x00,0x00,0x00,0x80,0x00);
 static bool pal_changed = false;
 static bool gsInited = false;
 static bool render_update = false;
+static bool render_changed = false;	/* Any line of the frame was drawn */
 static int render_frameskip = 0;
 static bool render_aspect = false;
 static bool render_invert = false;
@@ -239,7 +240,8 @@ void RENDER_SetSize(Bitu width,Bitu height,Bitu bpp,float fps, double ratio, boo
 
 static void RENDER_CopyLine(Bitu vidstart, Bitu line, VGA_Line_Handler handler) {
 	if(!render_update) return;
-	handler(vidstart, line, render_buf + render_pos);
+	/* Unchanged lines return 0 and keep what the texture holds */
+	if (handler(vidstart, line, render_buf + render_pos)) render_changed = true;
 	render_pos += render_pitch;
 }
 
@@ -300,6 +302,7 @@ static void RENDER_EmptyLineHandler(Bitu vidstart, Bitu line, VGA_Line_Handler h
 bool RENDER_StartUpdate() {
 	static Bitu count = 0;
 	
+	if (headless) return false;
 	if (render_update) return false;
 
 	if (vblank_count >= (gsGlobal->Mode == GS_MODE_PAL ? 50 : 60)) {
@@ -321,6 +324,7 @@ bool RENDER_StartUpdate() {
 
 	render_pos = 0;
 	render_update = true;
+	render_changed = false;
 	RENDER_DrawLine = RENDER_CopyLine;
 	return true;
 }
@@ -331,19 +335,43 @@ void RENDER_EndUpdate(bool abort) {
 
 	RENDER_DrawLine = RENDER_EmptyLineHandler;
 	
-	VideoFlip();
+	/* Nothing to upload if the frame is the same, the screen keeps showing it */
+	if (render_changed || pal_changed) VideoFlip();
 	
 	render_update = false;
 }
 
 #else
 
+#include "SDL.h"
+#include "SDL_thread.h"
 #include "render_scalers.h"
 #include "render_glsl.h"
 
 Render_t render;
 ScalerLineHandler_t RENDER_DrawLine;
 
+/* With the render thread the emulation only copies the lines of a frame into
+   a buffer and the thread scales it, while the next frame is drawn into the
+   other buffer. All GFX calls are still done by the emulation thread. */
+#define RENDER_THREAD_BUFFERS 2
+
+static struct {
+	bool enabled;
+	bool busy;						//The thread is scaling a frame
+	volatile bool quit;
+	SDL_Thread * thread;
+	SDL_sem * start, * done;
+	Bit8u * buffer[RENDER_THREAD_BUFFERS];
+	Bit8u present[RENDER_THREAD_BUFFERS][SCALER_MAXHEIGHT];
+	Bitu lines[RENDER_THREAD_BUFFERS];
+	Bitu fill;						//Buffer the emulation draws into
+	Bitu job;						//Buffer the thread scales
+	Bit8u * pixels;					//Output locked for the frame
+	Bitu pitch;
+	ScalerLineHandler_t drawLine;	//Line handler used by the thread
+} render_thread;
+
 static void RENDER_CallBack( GFX_CallBackFunctions_t function );
 
 static void Check_Palette(void) {
@@ -410,13 +438,17 @@ static void RENDER_StartLineHandler(const void * s) {
 		Bitu *cache = (Bitu*)(render.scale.cacheRead);
 		for (Bits x=render.src.start;x>0;) {
 			if (GCC_UNLIKELY(src[0] != cache[0])) {
-				if (!GFX_StartUpdate( render.scale.outWrite, render.scale.outPitch )) {
+				ScalerLineHandler_t & drawLine = render_thread.enabled ? render_thread.drawLine : RENDER_DrawLine;
+				if (render_thread.enabled) {
+					render.scale.outWrite = render_thread.pixels;
+					render.scale.outPitch = render_thread.pitch;
+				} else if (!GFX_StartUpdate( render.scale.outWrite, render.scale.outPitch )) {
 					RENDER_DrawLine = RENDER_EmptyLineHandler;
 					return;
 				}
 				render.scale.outWrite += render.scale.outPitch * Scaler_ChangedLines[0];
-				RENDER_DrawLine = render.scale.lineHandler;
-				RENDER_DrawLine( s );
+				drawLine = render.scale.lineHandler;
+				drawLine( s );
 				return;
 			}
 			x--; src++; cache++;
@@ -452,16 +484,182 @@ static void RENDER_ClearCacheHandler(const void * src) {
 	render.scale.lineHandler( src );
 }
 
+/* Copies the lines of the frame for the render thread, lines that are the
+   same as in the previous frame are only marked */
+static void RENDER_ThreadLineHandler(const void * s) {
+	Bitu fill = render_thread.fill;
+	Bitu line = render_thread.lines[fill];
+	if (GCC_UNLIKELY(line >= render.src.height))
+		return;
+	render_thread.present[fill][line] = s ? 1 : 0;
+	if (s)
+		memcpy(render_thread.buffer[fill] + line * render.scale.cachePitch, s, render.scale.cachePitch);
+	render_thread.lines[fill] = line + 1;
+}
+
+static void RENDER_ThreadDraw(void) {
+	const Bit8u *src = render_thread.buffer[render_thread.job];
+	const Bit8u *present = render_thread.present[render_thread.job];
+	for (Bitu i=0;i<render_thread.lines[render_thread.job];i++) {
+		render_thread.drawLine( present[i] ? src : 0 );
+		src += render.scale.cachePitch;
+	}
+}
+
+static int RENDER_ThreadLoop(void * /*data*/) {
+	for (;;) {
+		SDL_SemWait(render_thread.start);
+		if (render_thread.quit)
+			return 0;
+		RENDER_ThreadDraw();
+		SDL_SemPost(render_thread.done);
+	}
+}
+
+extern Bitu PIC_Ticks;
+/* Hands the scaled frame to the output and the capture */
+static void RENDER_FinishUpdate( bool abort ) {
+	if (GCC_UNLIKELY(CaptureState & (CAPTURE_IMAGE|CAPTURE_VIDEO))) {
+		Bitu pitch, flags;
+		flags = 0;
+		if (render.src.dblw != render.src.dblh) {
+			if (render.src.dblw) flags|=CAPTURE_FLAG_DBLW;
+			if (render.src.dblh) flags|=CAPTURE_FLAG_DBLH;
+		}
+		if (render.scale.outWrite==NULL) flags|=CAPTURE_FLAG_DUPLICATE;
+		float fps = render.src.fps;
+		pitch = render.scale.cachePitch;
+		if (render.frameskip.max)
+			fps /= 1+render.frameskip.max;
+		CAPTURE_AddImage( render.src.width, render.src.height, render.src.bpp, pitch,
+			flags, fps, (Bit8u *)&scalerSourceCache, (Bit8u*)&render.pal.rgb );
+	}
+	if ( render.scale.outWrite ) {
+		GFX_EndUpdate( abort? NULL : Scaler_ChangedLines );
+		render.frameskip.hadSkip[render.frameskip.index] = 0;
+	} else {
+#if 0
+		Bitu total = 0, i;
+		render.frameskip.hadSkip[render.frameskip.index] = 1;
+		for (i = 0;i<RENDER_SKIP_CACHE;i++) 
+			total += render.frameskip.hadSkip[i];
+		LOG_MSG( "Skipped frame %d %d", PIC_Ticks, (total * 100) / RENDER_SKIP_CACHE );
+#endif
+		if (RENDER_GetForceUpdate()) GFX_EndUpdate(0);
+	}
+	render.frameskip.index = (render.frameskip.index + 1) & (RENDER_SKIP_CACHE - 1);
+}
+
+/* Completes the frame the thread is scaling. Returns false when it's not
+   done yet and there was no waiting for it. */
+static bool RENDER_ThreadFinish( bool wait ) {
+	if (!render_thread.busy)
+		return true;
+	if (wait)
+		SDL_SemWait(render_thread.done);
+	else if (SDL_SemTryWait(render_thread.done))
+		return false;
+	render_thread.busy = false;
+	render_thread.pixels = 0;
+	RENDER_FinishUpdate( false );
+	return true;
+}
+
+/* Sets up the scaling of the drawn frame, the thread is idle */
+static void RENDER_ThreadStart(void) {
+	Bitu fill = render_thread.fill;
+	Bitu lines = render_thread.lines[fill];
+	if (render.scale.inMode == scalerMode8) {
+		Check_Palette();
+	}
+	render.scale.inLine = 0;
+	render.scale.outLine = 0;
+	render.scale.cacheRead = (Bit8u*)&scalerSourceCache;
+	render.scale.outWrite = 0;
+	render.scale.outPitch = 0;
+	Scaler_ChangedLines[0] = 0;
+	Scaler_ChangedLineIndex = 0;
+	/* A full update can't skip lines, those are taken from the cache. Otherwise
+	   look for a changed line first, without one there is nothing to scale. */
+	bool full = render.scale.clearCache || render.pal.changed;
+	bool changed = full;
+	Bit8u *src = render_thread.buffer[fill];
+	Bit8u *present = render_thread.present[fill];
+	const Bit8u *cache = (Bit8u*)&scalerSourceCache;
+	for (Bitu i=0;i<lines;i++) {
+		if (!present[i]) {
+			if (full) {
+				memcpy(src, cache, render.scale.cachePitch);
+				present[i] = 1;
+			}
+		} else if (!changed && memcmp(src, cache, render.src.start * sizeof(Bitu))) {
+			changed = true;
+		}
+		src += render.scale.cachePitch;
+		cache += render.scale.cachePitch;
+	}
+	if (!lines || !changed) {
+		RENDER_FinishUpdate( false );
+		return;
+	}
+	if (GCC_UNLIKELY(!GFX_StartUpdate( render_thread.pixels, render_thread.pitch ))) {
+		render_thread.pixels = 0;
+		return;
+	}
+	if (render.scale.clearCache) {
+		render.scale.outWrite = render_thread.pixels;
+		render.scale.outPitch = render_thread.pitch;
+		render.scale.clearCache = false;
+		render_thread.drawLine = RENDER_ClearCacheHandler;
+	} else if (render.pal.changed) {
+		render.scale.outWrite = render_thread.pixels;
+		render.scale.outPitch = render_thread.pitch;
+		render_thread.drawLine = render.scale.linePalHandler;
+	} else {
+		render_thread.drawLine = RENDER_StartLineHandler;
+	}
+	render_thread.job = fill;
+	render_thread.fill = (fill + 1) % RENDER_THREAD_BUFFERS;
+	if (GCC_UNLIKELY(CaptureState & (CAPTURE_IMAGE|CAPTURE_VIDEO))) {
+		/* The capture needs the scaled frame right away */
+		RENDER_ThreadDraw();
+		render_thread.pixels = 0;
+		RENDER_FinishUpdate( false );
+		return;
+	}
+	render_thread.busy = true;
+	SDL_SemPost(render_thread.start);
+}
+
+void RENDER_Flush(void) {
+	if (render_thread.enabled)
+		RENDER_ThreadFinish( true );
+}
+
 bool RENDER_StartUpdate(void) {
+	if (GCC_UNLIKELY(headless))
+		return false;
 	if (GCC_UNLIKELY(render.updating))
 		return false;
 	if (GCC_UNLIKELY(!render.active))
 		return false;
+	/* Show the last frame as soon as the thread is done with it */
+	if (render_thread.enabled)
+		RENDER_ThreadFinish( false );
 	if (GCC_UNLIKELY(render.frameskip.count<render.frameskip.max)) {
 		render.frameskip.count++;
 		return false;
 	}
 	render.frameskip.count=0;
+	if (render_thread.enabled) {
+		render_thread.lines[render_thread.fill] = 0;
+		RENDER_DrawLine = RENDER_ThreadLineHandler;
+		render.fullFrame = render.scale.clearCache ||
+			(render.scale.inMode == scalerMode8 && render.pal.first <= render.pal.last) ||
+			(CaptureState & (CAPTURE_IMAGE|CAPTURE_VIDEO));
+		render.updating = true;
+		return true;
+	}
 	if (render.scale.inMode == scalerMode8) {
 		Check_Palette();
 	}
@@ -501,46 +699,25 @@ bool RENDER_StartUpdate(void) {
 }
 
 static void RENDER_Halt( void ) {
+	RENDER_Flush( );
 	RENDER_DrawLine = RENDER_EmptyLineHandler;
 	GFX_EndUpdate( 0 );
 	render.updating=false;
 	render.active=false;
 }
 
-extern Bitu PIC_Ticks;
 void RENDER_EndUpdate( bool abort ) {
 	if (GCC_UNLIKELY(!render.updating))
 		return;
 	RENDER_DrawLine = RENDER_EmptyLineHandler;
-	if (GCC_UNLIKELY(CaptureState & (CAPTURE_IMAGE|CAPTURE_VIDEO))) {
-		Bitu pitch, flags;
-		flags = 0;
-		if (render.src.dblw != render.src.dblh) {
-			if (render.src.dblw) flags|=CAPTURE_FLAG_DBLW;
-			if (render.src.dblh) flags|=CAPTURE_FLAG_DBLH;
-		}
-		if (render.scale.outWrite==NULL) flags|=CAPTURE_FLAG_DUPLICATE;
-		float fps = render.src.fps;
-		pitch = render.scale.cachePitch;
-		if (render.frameskip.max)
-			fps /= 1+render.frameskip.max;
-		CAPTURE_AddImage( render.src.width, render.src.height, render.src.bpp, pitch,
-			flags, fps, (Bit8u *)&scalerSourceCache, (Bit8u*)&render.pal.rgb );
-	}
-	if ( render.scale.outWrite ) {
-		GFX_EndUpdate( abort? NULL : Scaler_ChangedLines );
-		render.frameskip.hadSkip[render.frameskip.index] = 0;
+	if (render_thread.enabled) {
+		/* Aborted frames are dropped, the next one is drawn in full anyway */
+		RENDER_ThreadFinish( true );
+		if (!abort)
+			RENDER_ThreadStart( );
 	} else {
-#if 0
-		Bitu total = 0, i;
-		render.frameskip.hadSkip[render.frameskip.index] = 1;
-		for (i = 0;i<RENDER_SKIP_CACHE;i++) 
-			total += render.frameskip.hadSkip[i];
-		LOG_MSG( "Skipped frame %d %d", PIC_Ticks, (total * 100) / RENDER_SKIP_CACHE );
-#endif
-		if (RENDER_GetForceUpdate()) GFX_EndUpdate(0);
+		RENDER_FinishUpdate( abort );
 	}
-	render.frameskip.index = (render.frameskip.index + 1) & (RENDER_SKIP_CACHE - 1);
 	render.updating=false;
 }
 
@@ -814,6 +991,7 @@ forcenormal:
 	memset(render.pal.modified, 0, sizeof(render.pal.modified));
 	//Finish this frame using a copy only handler
 	RENDER_DrawLine = RENDER_FinishLineHandler;
+	render_thread.lines[render_thread.fill] = 0;
 	render.scale.outWrite = 0;
 	/* Signal the next frame to first reinit the cache */
 	render.scale.clearCache = true;
@@ -828,6 +1006,7 @@ static void RENDER_CallBack( GFX_CallBackFunctions_t function ) {
 		render.scale.clearCache = true;
 		return;
 	} else if ( function == GFX_CallBackReset) {
+		RENDER_Flush( );
 		GFX_EndUpdate( 0 );	
 		RENDER_Reset();
 	} else {
@@ -853,6 +1032,8 @@ void RENDER_SetSize(Bitu width,Bitu height,Bitu bpp,float fps,double ratio,bool
 	render.src.dblh=dblh;
 	render.src.fps=fps;
 	render.src.ratio=ratio;
+	/* Without output there is no need for a scaler or a window */
+	if (headless) return;
 	RENDER_Reset( );
 }
 
@@ -893,6 +1074,49 @@ void RENDER_SetForceUpdate(bool f) {
 	render.forceUpdate = f;
 }
 
+static void RENDER_ShutDown(Section * /*sec*/) {
+	if (!render_thread.enabled)
+		return;
+	if (render_thread.busy)
+		SDL_SemWait(render_thread.done);
+	render_thread.busy = false;
+	render_thread.quit = true;
+	SDL_SemPost(render_thread.start);
+	SDL_WaitThread(render_thread.thread, 0);
+	SDL_DestroySemaphore(render_thread.start);
+	SDL_DestroySemaphore(render_thread.done);
+	for (Bitu i=0;i<RENDER_THREAD_BUFFERS;i++)
+		free(render_thread.buffer[i]);
+	render_thread.enabled = false;
+}
+
+static void RENDER_StartThread(void) {
+	Bitu i;
+	for (i=0;i<RENDER_THREAD_BUFFERS;i++) {
+		render_thread.buffer[i] = (Bit8u*)malloc(sizeof(scalerSourceCache_t));
+		render_thread.lines[i] = 0;
+	}
+	render_thread.start = SDL_CreateSemaphore(0);
+	render_thread.done = SDL_CreateSemaphore(0);
+	render_thread.quit = false;
+	render_thread.busy = false;
+	render_thread.fill = 0;
+	render_thread.pixels = 0;
+	bool ok = render_thread.start && render_thread.done;
+	for (i=0;i<RENDER_THREAD_BUFFERS;i++)
+		if (!render_thread.buffer[i]) ok = false;
+	if (ok) render_thread.thread = SDL_CreateThread(RENDER_ThreadLoop, 0);
+	if (!ok || !render_thread.thread) {
+		LOG_MSG("RENDER:Can't start the render thread, scaling in the emulation thread");
+		if (render_thread.start) SDL_DestroySemaphore(render_thread.start);
+		if (render_thread.done) SDL_DestroySemaphore(render_thread.done);
+		for (i=0;i<RENDER_THREAD_BUFFERS;i++)
+			free(render_thread.buffer[i]);
+		return;
+	}
+	render_thread.enabled = true;
+}
+
 #if C_OPENGL
 static bool RENDER_GetShader(std::string& shader_path, char *old_src) {
 	char* src;
@@ -1031,7 +1255,14 @@ void RENDER_Init(Section * sec) {
 				   render.scale.forced))
 		RENDER_CallBack( GFX_CallBackReset );
 
-	if(!running) render.updating=true;
+	if(!running) {
+		render.updating=true;
+		Scaler_Init();
+		if (section->Get_bool("thread")) {
+			sec->AddDestroyFunction(&RENDER_ShutDown);
+			RENDER_StartThread();
+		}
+	}
 	running = true;
 
 	MAPPER_AddHandler(DecreaseFrameSkip,MK_f7,MMOD1,"decfskip","Dec Fskip");
@@ -16,7 +16,14 @@
  *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
  */
 
+#if defined (SCALERVECTOR)
+/* SCALERBLOCK scales a full block with the SCALERVECTOR instructions */
 #if defined (SCALERLINEAR)
+static conc2d(SIMD_TARGET,SCALERVECTOR) void conc4d(SCALERNAME,SBPP,L,SCALERVECTOR)(void) {
+#else
+static conc2d(SIMD_TARGET,SCALERVECTOR) void conc4d(SCALERNAME,SBPP,R,SCALERVECTOR)(void) {
+#endif
+#elif defined (SCALERLINEAR)
 static void conc3d(SCALERNAME,SBPP,L)(void) {
 #else
 static void conc3d(SCALERNAME,SBPP,R)(void) {
@@ -155,6 +162,11 @@ lastagain:
 			line4 = (PTYPE *)(((Bit8u*)line0)+ render.scale.outPitch * 4);
 #endif
 #endif //defined(SCALERLINEAR)
+#if defined(SCALERVECTOR)
+			SCALERBLOCK;
+			line0 += SCALERWIDTH * SCALER_BLOCKSIZE;
+			fc += SCALER_BLOCKSIZE;
+#else
 			for (Bitu i = 0; i<SCALER_BLOCKSIZE;i++) {
 				SCALERFUNC;
 				line0 += SCALERWIDTH;
@@ -172,6 +184,7 @@ lastagain:
 #endif
 				fc++;
 			}
+#endif
 #if defined(SCALERLINEAR)
 #if (SCALERHEIGHT > 1) 
 			BituMove((Bit8u*)(&line0[-SCALER_BLOCKSIZE*SCALERWIDTH])+render.scale.outPitch  ,WC[0], SCALER_BLOCKSIZE *SCALERWIDTH*PSIZE);
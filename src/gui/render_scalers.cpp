@@ -26,6 +26,31 @@
 #include "render.h"
 #include <string.h>
 
+/* The simple scalers handle whole vectors of pixels at once when the input
+   and output depth are the same or the input is 8 bit palette. SSE2 is always
+   there on x86-64 and has to be enabled for the build on x86. */
+#if defined(__SSE2__) && !defined(WORDS_BIGENDIAN)
+#include <emmintrin.h>
+#define RENDER_SCALER_SSE2
+#endif
+
+/* The complex scalers have vector versions that Scaler_Init picks by the
+   features of the cpu, the build doesn't have to enable SSE2 or AVX2 */
+#if RENDER_USE_ADVANCED_SCALERS>2 && !defined(WORDS_BIGENDIAN) && \
+	(defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64))
+#include <emmintrin.h>
+#define RENDER_SCALER_VECTOR
+#if defined(__GNUC__)
+#include <immintrin.h>
+#define RENDER_SCALER_AVX2
+#define SIMD_TARGET_SSE2	__attribute__((target("sse2")))
+#define SIMD_TARGET_AVX2	__attribute__((target("avx2")))
+#else
+#include <intrin.h>
+#define SIMD_TARGET_SSE2
+#endif
+#endif
+
 Bit8u Scaler_Aspect[SCALER_MAXHEIGHT];
 Bit16u Scaler_ChangedLines[SCALER_MAXHEIGHT];
 Bitu Scaler_ChangedLineIndex;
@@ -440,4 +465,51 @@ ScalerComplexBlock_t ScaleAdvInterp3x = {
 };
 
 #endif
+
+/* Switch the complex scalers to the vector versions the cpu can run */
+void Scaler_Init(void) {
+#if defined(RENDER_SCALER_VECTOR)
+	bool sse2,avx2=false;
+#if defined(__GNUC__)
+	__builtin_cpu_init();
+	sse2=__builtin_cpu_supports("sse2")!=0;
+	avx2=__builtin_cpu_supports("avx2")!=0;
+#else
+	int info[4];
+	__cpuid(info,1);
+	sse2=(info[3] & (1<<26))!=0;
+#endif
+	if (sse2) {
+		ScaleAdvMame2x.Linear[0]=AdvMame2x_8_L_SSE2;
+		ScaleAdvMame2x.Linear[1]=ScaleAdvMame2x.Linear[2]=AdvMame2x_16_L_SSE2;
+		ScaleAdvMame2x.Linear[3]=AdvMame2x_32_L_SSE2;
+		ScaleAdvMame2x.Random[0]=AdvMame2x_8_R_SSE2;
+		ScaleAdvMame2x.Random[1]=ScaleAdvMame2x.Random[2]=AdvMame2x_16_R_SSE2;
+		ScaleAdvMame2x.Random[3]=AdvMame2x_32_R_SSE2;
+		ScaleAdvMame3x.Linear[3]=AdvMame3x_32_L_SSE2;
+		ScaleAdvMame3x.Random[3]=AdvMame3x_32_R_SSE2;
+		ScaleHQ2x.Linear[1]=ScaleHQ2x.Linear[2]=HQ2x_16_L_SSE2;
+		ScaleHQ2x.Linear[3]=HQ2x_32_L_SSE2;
+		ScaleHQ2x.Random[1]=ScaleHQ2x.Random[2]=HQ2x_16_R_SSE2;
+		ScaleHQ2x.Random[3]=HQ2x_32_R_SSE2;
+		ScaleHQ3x.Linear[1]=ScaleHQ3x.Linear[2]=HQ3x_16_L_SSE2;
+		ScaleHQ3x.Linear[3]=HQ3x_32_L_SSE2;
+		ScaleHQ3x.Random[1]=ScaleHQ3x.Random[2]=HQ3x_16_R_SSE2;
+		ScaleHQ3x.Random[3]=HQ3x_32_R_SSE2;
+	}
+#if defined(RENDER_SCALER_AVX2)
+	/* AVX2 gathers the YUV values of the HQ scalers */
+	if (avx2) {
+		ScaleHQ2x.Linear[1]=ScaleHQ2x.Linear[2]=HQ2x_16_L_AVX2;
+		ScaleHQ2x.Linear[3]=HQ2x_32_L_AVX2;
+		ScaleHQ2x.Random[1]=ScaleHQ2x.Random[2]=HQ2x_16_R_AVX2;
+		ScaleHQ2x.Random[3]=HQ2x_32_R_AVX2;
+		ScaleHQ3x.Linear[1]=ScaleHQ3x.Linear[2]=HQ3x_16_L_AVX2;
+		ScaleHQ3x.Linear[3]=HQ3x_32_L_AVX2;
+		ScaleHQ3x.Random[1]=ScaleHQ3x.Random[2]=HQ3x_16_R_AVX2;
+		ScaleHQ3x.Random[3]=HQ3x_32_R_AVX2;
+	}
+#endif
+#endif
+}
 #endif
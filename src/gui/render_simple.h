@@ -95,7 +95,28 @@ static void conc4d(SCALERNAME,SBPP,DBPP,R)(const void *s) {
 #endif
 #endif //defined(SCALERLINEAR)
 			hadChange = 1;
-			for (Bitu i = x > 32 ? 32 : x;i>0;i--,x--) {
+			Bitu run = x > 32 ? 32 : x;
+#if defined(SCALERSIMD)
+			for (;run>=SIMD_PIXELS;run-=SIMD_PIXELS,x-=SIMD_PIXELS) {
+				SIMD_FETCH
+				src+=SIMD_PIXELS;cache+=SIMD_PIXELS;
+				SCALERSIMD
+				line0 += SIMD_PIXELS*SCALERWIDTH;
+#if (SCALERHEIGHT > 1) 
+				line1 += SIMD_PIXELS*SCALERWIDTH;
+#endif
+#if (SCALERHEIGHT > 2) 
+				line2 += SIMD_PIXELS*SCALERWIDTH;
+#endif
+#if (SCALERHEIGHT > 3) 
+				line3 += SIMD_PIXELS*SCALERWIDTH;
+#endif
+#if (SCALERHEIGHT > 4) 
+				line4 += SIMD_PIXELS*SCALERWIDTH;
+#endif
+			}
+#endif
+			for (;run>0;run--,x--) {
 				const SRCTYPE S = *src;
 				*cache = S;
 				src++;cache++;
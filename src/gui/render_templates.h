@@ -77,6 +77,69 @@
 
 #define redblueMask (redMask | blueMask)
 
+#if defined(RENDER_SCALER_SSE2) && (DBPP > 8) && ((SBPP == DBPP) || (SBPP == 8) || (SBPP == 9))
+/* SIMD_PIXELS output pixels fit a vector, SIMD_FETCH reads their source
+   into V and updates the cache */
+#define SIMD_PIXELS	(16/PSIZE)
+#if SBPP == DBPP
+/* The pixels are copied without conversion */
+#define SIMD_FETCH												\
+	const __m128i V = _mm_loadu_si128((const __m128i *)src);	\
+	_mm_storeu_si128((__m128i *)cache,V);
+#elif DBPP == 32
+/* SSE2 can't gather, the palette lookups fill the vector one by one */
+#define SIMD_FETCH												\
+	const __m128i V = _mm_setr_epi32(							\
+		render.pal.lut.b32[src[0]],render.pal.lut.b32[src[1]],	\
+		render.pal.lut.b32[src[2]],render.pal.lut.b32[src[3]]);	\
+	*(Bit32u *)cache = *(const Bit32u *)src;
+#else
+#define SIMD_FETCH												\
+	const __m128i V = _mm_setr_epi16(							\
+		render.pal.lut.b16[src[0]],render.pal.lut.b16[src[1]],	\
+		render.pal.lut.b16[src[2]],render.pal.lut.b16[src[3]],	\
+		render.pal.lut.b16[src[4]],render.pal.lut.b16[src[5]],	\
+		render.pal.lut.b16[src[6]],render.pal.lut.b16[src[7]]);	\
+	_mm_storel_epi64((__m128i *)cache,_mm_loadl_epi64((const __m128i *)src));
+#endif
+#if DBPP == 32
+#define SIMD_SET(_VAL)			_mm_set1_epi32(_VAL)
+#define SIMD_ADD				_mm_add_epi32
+#define SIMD_SLL				_mm_slli_epi32
+#define SIMD_SRL				_mm_srli_epi32
+#define SIMD_UNPACKLO			_mm_unpacklo_epi32
+#define SIMD_UNPACKHI			_mm_unpackhi_epi32
+/* Every pixel three times, only done for 32 bit */
+#define SIMD_STORE3(_DST,_A)											\
+	_mm_storeu_si128((__m128i*)(_DST),_mm_shuffle_epi32(_A,_MM_SHUFFLE(1,0,0,0)));		\
+	_mm_storeu_si128((__m128i*)((_DST)+4),_mm_shuffle_epi32(_A,_MM_SHUFFLE(2,2,1,1)));	\
+	_mm_storeu_si128((__m128i*)((_DST)+8),_mm_shuffle_epi32(_A,_MM_SHUFFLE(3,3,3,2)))
+#else
+#define SIMD_SET(_VAL)			_mm_set1_epi16((Bit16s)(_VAL))
+#define SIMD_ADD				_mm_add_epi16
+#define SIMD_SLL				_mm_slli_epi16
+#define SIMD_SRL				_mm_srli_epi16
+#define SIMD_UNPACKLO			_mm_unpacklo_epi16
+#define SIMD_UNPACKHI			_mm_unpackhi_epi16
+#endif
+#define SIMD_AND(_A,_MASK)		_mm_and_si128(_A,SIMD_SET(_MASK))
+#define SIMD_STORE1(_DST,_A)										\
+	_mm_storeu_si128((__m128i*)(_DST),_A)
+/* Pixels of _A and _B after each other */
+#define SIMD_STORE2(_DST,_A,_B)										\
+	_mm_storeu_si128((__m128i*)(_DST),SIMD_UNPACKLO(_A,_B));				\
+	_mm_storeu_si128((__m128i*)((_DST)+SIMD_PIXELS),SIMD_UNPACKHI(_A,_B))
+/* One colour of the TV halfpixel. It's done on the colour alone so it can't
+   overflow the 16 bit lanes, the result is the same as multiplying in place. */
+#define SIMD_TVCOLOR(_A,_MASK,_SHIFT,_DIV)							\
+	SIMD_SLL(SIMD_SRL(SIMD_ADD(SIMD_SRL(SIMD_AND(_A,_MASK),_SHIFT),		\
+		SIMD_SLL(SIMD_SRL(SIMD_AND(_A,_MASK),_SHIFT),2)),_DIV),_SHIFT)
+#define SIMD_TV(_A,_DIV)											\
+	_mm_or_si128(_mm_or_si128(SIMD_TVCOLOR(_A,redMask,redShift,_DIV),	\
+		SIMD_TVCOLOR(_A,greenMask,greenShift,_DIV)),					\
+		SIMD_TVCOLOR(_A,blueMask,blueShift,_DIV))
+#endif
+
 
 #if SBPP == 8 || SBPP == 9
 #define SC scalerSourceCache.b8
@@ -248,11 +311,16 @@ static void conc3d(Cache,SBPP,DBPP) (const void * s) {
 #define SCALERHEIGHT	1
 #define SCALERFUNC								\
 	line0[0] = P;
+#if defined(SIMD_PIXELS)
+#define SCALERSIMD								\
+	SIMD_STORE1(line0,V);
+#endif
 #include "render_simple.h"
 #undef SCALERNAME
 #undef SCALERWIDTH
 #undef SCALERHEIGHT
 #undef SCALERFUNC
+#undef SCALERSIMD
 
 #define SCALERNAME		Normal2x
 #define SCALERWIDTH		2
@@ -262,11 +330,17 @@ static void conc3d(Cache,SBPP,DBPP) (const void * s) {
 	line0[1] = P;								\
 	line1[0] = P;								\
 	line1[1] = P;
+#if defined(SIMD_PIXELS)
+#define SCALERSIMD								\
+	SIMD_STORE2(line0,V,V);						\
+	SIMD_STORE2(line1,V,V);
+#endif
 #include "render_simple.h"
 #undef SCALERNAME
 #undef SCALERWIDTH
 #undef SCALERHEIGHT
 #undef SCALERFUNC
+#undef SCALERSIMD
 
 #define SCALERNAME		Normal3x
 #define SCALERWIDTH		3
@@ -281,11 +355,18 @@ static void conc3d(Cache,SBPP,DBPP) (const void * s) {
 	line2[0] = P;								\
 	line2[1] = P;								\
 	line2[2] = P;
+#if defined(SIMD_STORE3)
+#define SCALERSIMD								\
+	SIMD_STORE3(line0,V);						\
+	SIMD_STORE3(line1,V);						\
+	SIMD_STORE3(line2,V);
+#endif
 #include "render_simple.h"
 #undef SCALERNAME
 #undef SCALERWIDTH
 #undef SCALERHEIGHT
 #undef SCALERFUNC
+#undef SCALERSIMD
 
 #define SCALERNAME		NormalDw
 #define SCALERWIDTH		2
@@ -293,11 +374,16 @@ static void conc3d(Cache,SBPP,DBPP) (const void * s) {
 #define SCALERFUNC								\
 	line0[0] = P;								\
 	line0[1] = P;
+#if defined(SIMD_PIXELS)
+#define SCALERSIMD								\
+	SIMD_STORE2(line0,V,V);
+#endif
 #include "render_simple.h"
 #undef SCALERNAME
 #undef SCALERWIDTH
 #undef SCALERHEIGHT
 #undef SCALERFUNC
+#undef SCALERSIMD
 
 #define SCALERNAME		NormalDh
 #define SCALERWIDTH		1
@@ -305,11 +391,17 @@ static void conc3d(Cache,SBPP,DBPP) (const void * s) {
 #define SCALERFUNC								\
 	line0[0] = P;								\
 	line1[0] = P;
+#if defined(SIMD_PIXELS)
+#define SCALERSIMD								\
+	SIMD_STORE1(line0,V);						\
+	SIMD_STORE1(line1,V);
+#endif
 #include "render_simple.h"
 #undef SCALERNAME
 #undef SCALERWIDTH
 #undef SCALERHEIGHT
 #undef SCALERFUNC
+#undef SCALERSIMD
 
 #if (DBPP > 8)
 
@@ -327,11 +419,20 @@ static void conc3d(Cache,SBPP,DBPP) (const void * s) {
 	line1[0]=halfpixel;						\
 	line1[1]=halfpixel;						\
 }
+#if defined(SIMD_PIXELS)
+#define SCALERSIMD									\
+{													\
+	const __m128i H=SIMD_TV(V,3);					\
+	SIMD_STORE2(line0,V,V);							\
+	SIMD_STORE2(line1,H,H);							\
+}
+#endif
 #include "render_simple.h"
 #undef SCALERNAME
 #undef SCALERWIDTH
 #undef SCALERHEIGHT
 #undef SCALERFUNC
+#undef SCALERSIMD
 
 #define SCALERNAME		TV3x
 #define SCALERWIDTH		3
@@ -352,11 +453,22 @@ static void conc3d(Cache,SBPP,DBPP) (const void * s) {
 	line2[1]=halfpixel;						\
 	line2[2]=halfpixel;						\
 }
+#if defined(SIMD_STORE3)
+#define SCALERSIMD							\
+{											\
+	const __m128i H=SIMD_TV(V,3);			\
+	const __m128i Q=SIMD_TV(V,4);			\
+	SIMD_STORE3(line0,V);					\
+	SIMD_STORE3(line1,H);					\
+	SIMD_STORE3(line2,Q);					\
+}
+#endif
 #include "render_simple.h"
 #undef SCALERNAME
 #undef SCALERWIDTH
 #undef SCALERHEIGHT
 #undef SCALERFUNC
+#undef SCALERSIMD
 
 #define SCALERNAME		RGB2x
 #define SCALERWIDTH		2
@@ -366,11 +478,17 @@ static void conc3d(Cache,SBPP,DBPP) (const void * s) {
 	line0[1]=P & greenMask;			\
 	line1[0]=P & blueMask;				\
 	line1[1]=P;
+#if defined(SIMD_PIXELS)
+#define SCALERSIMD									\
+	SIMD_STORE2(line0,SIMD_AND(V,redMask),SIMD_AND(V,greenMask));	\
+	SIMD_STORE2(line1,SIMD_AND(V,blueMask),V);
+#endif
 #include "render_simple.h"
 #undef SCALERNAME
 #undef SCALERWIDTH
 #undef SCALERHEIGHT
 #undef SCALERFUNC
+#undef SCALERSIMD
 
 #define SCALERNAME		RGB3x
 #define SCALERWIDTH		3
@@ -399,11 +517,17 @@ static void conc3d(Cache,SBPP,DBPP) (const void * s) {
 	line0[1]=P;							\
 	line1[0]=0;							\
 	line1[1]=0;
+#if defined(SIMD_PIXELS)
+#define SCALERSIMD						\
+	SIMD_STORE2(line0,V,V);				\
+	SIMD_STORE2(line1,_mm_setzero_si128(),_mm_setzero_si128());
+#endif
 #include "render_simple.h"
 #undef SCALERNAME
 #undef SCALERWIDTH
 #undef SCALERHEIGHT
 #undef SCALERFUNC
+#undef SCALERSIMD
 
 #define SCALERNAME		Scan3x
 #define SCALERWIDTH		3
@@ -418,11 +542,18 @@ static void conc3d(Cache,SBPP,DBPP) (const void * s) {
 	line2[0]=0;				\
 	line2[1]=0;				\
 	line2[2]=0;
+#if defined(SIMD_STORE3)
+#define SCALERSIMD			\
+	SIMD_STORE3(line0,V);	\
+	SIMD_STORE3(line1,V);	\
+	SIMD_STORE3(line2,_mm_setzero_si128());
+#endif
 #include "render_simple.h"
 #undef SCALERNAME
 #undef SCALERWIDTH
 #undef SCALERHEIGHT
 #undef SCALERFUNC
+#undef SCALERSIMD
 
 #endif		//#if RENDER_USE_ADVANCED_SCALERS>0
 
@@ -434,6 +565,42 @@ static void conc3d(Cache,SBPP,DBPP) (const void * s) {
 
 #if (SBPP == DBPP) 
 
+#if defined(RENDER_SCALER_VECTOR)
+/* The vector versions of the complex scalers work on SSE2_PIXELS at once */
+#define SSE2_PIXELS		(16/PSIZE)
+#if DBPP == 8
+#define SSE2_CMPEQ		_mm_cmpeq_epi8
+#define SSE2_UNPACKLO	_mm_unpacklo_epi8
+#define SSE2_UNPACKHI	_mm_unpackhi_epi8
+#elif DBPP == 32
+#define SSE2_CMPEQ		_mm_cmpeq_epi32
+#define SSE2_UNPACKLO	_mm_unpacklo_epi32
+#define SSE2_UNPACKHI	_mm_unpackhi_epi32
+#else
+#define SSE2_CMPEQ		_mm_cmpeq_epi16
+#define SSE2_UNPACKLO	_mm_unpacklo_epi16
+#define SSE2_UNPACKHI	_mm_unpackhi_epi16
+#endif
+#define SSE2_LOAD(_SRC)				_mm_loadu_si128((const __m128i *)&(_SRC))
+/* _A where _MASK is set, _B elsewhere */
+#define SSE2_SELECT(_MASK,_A,_B)	_mm_or_si128(_mm_and_si128(_MASK,_A),_mm_andnot_si128(_MASK,_B))
+/* Pixels of _A and _B after each other */
+#define SSE2_STORE2(_DST,_A,_B)										\
+	_mm_storeu_si128((__m128i*)(_DST),SSE2_UNPACKLO(_A,_B));			\
+	_mm_storeu_si128((__m128i*)((_DST)+SSE2_PIXELS),SSE2_UNPACKHI(_A,_B))
+#if DBPP == 32
+/* Pixels of _A, _B and _C after each other, only done for 32 bit */
+#define SSE2_STORE3(_DST,_A,_B,_C)																	\
+{																									\
+	const __m128 ab=_mm_castsi128_ps(_mm_unpacklo_epi32(_A,_B)),abh=_mm_castsi128_ps(_mm_unpackhi_epi32(_A,_B));	\
+	const __m128 bc=_mm_castsi128_ps(_mm_unpacklo_epi32(_B,_C)),bch=_mm_castsi128_ps(_mm_unpackhi_epi32(_B,_C));	\
+	const __m128 ca=_mm_castsi128_ps(_mm_unpacklo_epi32(_C,_A)),cah=_mm_castsi128_ps(_mm_unpackhi_epi32(_C,_A));	\
+	_mm_storeu_ps((float*)(_DST),_mm_shuffle_ps(ab,ca,_MM_SHUFFLE(3,0,1,0)));						\
+	_mm_storeu_ps((float*)((_DST)+4),_mm_shuffle_ps(bc,abh,_MM_SHUFFLE(1,0,3,2)));					\
+	_mm_storeu_ps((float*)((_DST)+8),_mm_shuffle_ps(cah,bch,_MM_SHUFFLE(3,2,3,0)));					\
+}
+#endif
+#endif
 
 #if (DBPP > 8)
 
@@ -443,8 +610,22 @@ static void conc3d(Cache,SBPP,DBPP) (const void * s) {
 #define SCALERWIDTH		2
 #define SCALERHEIGHT	2
 #include "render_templates_hq2x.h"
-#define SCALERFUNC		conc2d(Hq2x,SBPP)(line0, line1, fc)
+#define SCALERFUNC		conc2d(Hq2x,SBPP)(line0, line1, fc, conc2d(HqPattern,SBPP)(fc))
+#include "render_loops.h"
+#if defined(RENDER_SCALER_VECTOR)
+#define SCALERVECTOR	SSE2
+#define SCALERBLOCK		conc3d(Hq2xBlock,SBPP,SSE2)(line0, line1, fc)
+#include "render_loops.h"
+#undef SCALERVECTOR
+#undef SCALERBLOCK
+#endif
+#if defined(RENDER_SCALER_AVX2)
+#define SCALERVECTOR	AVX2
+#define SCALERBLOCK		conc3d(Hq2xBlock,SBPP,AVX2)(line0, line1, fc)
 #include "render_loops.h"
+#undef SCALERVECTOR
+#undef SCALERBLOCK
+#endif
 #undef SCALERNAME
 #undef SCALERWIDTH
 #undef SCALERHEIGHT
@@ -454,12 +635,27 @@ static void conc3d(Cache,SBPP,DBPP) (const void * s) {
 #define SCALERWIDTH		3
 #define SCALERHEIGHT	3
 #include "render_templates_hq3x.h"
-#define SCALERFUNC		conc2d(Hq3x,SBPP)(line0, line1, line2, fc)
+#define SCALERFUNC		conc2d(Hq3x,SBPP)(line0, line1, line2, fc, conc2d(HqPattern,SBPP)(fc))
+#include "render_loops.h"
+#if defined(RENDER_SCALER_VECTOR)
+#define SCALERVECTOR	SSE2
+#define SCALERBLOCK		conc3d(Hq3xBlock,SBPP,SSE2)(line0, line1, line2, fc)
 #include "render_loops.h"
+#undef SCALERVECTOR
+#undef SCALERBLOCK
+#endif
+#if defined(RENDER_SCALER_AVX2)
+#define SCALERVECTOR	AVX2
+#define SCALERBLOCK		conc3d(Hq3xBlock,SBPP,AVX2)(line0, line1, line2, fc)
+#include "render_loops.h"
+#undef SCALERVECTOR
+#undef SCALERBLOCK
+#endif
 #undef SCALERNAME
 #undef SCALERWIDTH
 #undef SCALERHEIGHT
 #undef SCALERFUNC
+#undef RGBtoYUV
 
 #include "render_templates_sai.h"
 
@@ -540,6 +736,26 @@ static void conc3d(Cache,SBPP,DBPP) (const void * s) {
 
 #endif // #if (DBPP > 8)
 
+#if defined(RENDER_SCALER_VECTOR)
+static SIMD_TARGET_SSE2 void conc3d(AdvMame2xBlock,SBPP,SSE2)(PTYPE * line0, PTYPE * line1, const PTYPE * fc) {
+	for (Bitu i=0;i<SCALER_BLOCKSIZE;i+=SSE2_PIXELS) {
+		const __m128i c1=SSE2_LOAD(C1),c3=SSE2_LOAD(C3),c4=SSE2_LOAD(C4);
+		const __m128i c5=SSE2_LOAD(C5),c7=SSE2_LOAD(C7);
+		/* The pixels that get C4 everywhere */
+		const __m128i flat=_mm_or_si128(SSE2_CMPEQ(c1,c7),SSE2_CMPEQ(c3,c5));
+		SSE2_STORE2(line0,
+			SSE2_SELECT(_mm_andnot_si128(flat,SSE2_CMPEQ(c3,c1)),c3,c4),
+			SSE2_SELECT(_mm_andnot_si128(flat,SSE2_CMPEQ(c1,c5)),c5,c4));
+		SSE2_STORE2(line1,
+			SSE2_SELECT(_mm_andnot_si128(flat,SSE2_CMPEQ(c3,c7)),c3,c4),
+			SSE2_SELECT(_mm_andnot_si128(flat,SSE2_CMPEQ(c7,c5)),c5,c4));
+		line0+=2*SSE2_PIXELS;
+		line1+=2*SSE2_PIXELS;
+		fc+=SSE2_PIXELS;
+	}
+}
+#endif
+
 #define SCALERNAME		AdvMame2x
 #define SCALERWIDTH		2
 #define SCALERHEIGHT	2
@@ -554,11 +770,52 @@ static void conc3d(Cache,SBPP,DBPP) (const void * s) {
 		line1[0] = line1[1] = C4;								\
 	}
 #include "render_loops.h"
+#if defined(RENDER_SCALER_VECTOR)
+#define SCALERVECTOR	SSE2
+#define SCALERBLOCK		conc3d(AdvMame2xBlock,SBPP,SSE2)(line0, line1, fc)
+#include "render_loops.h"
+#undef SCALERVECTOR
+#undef SCALERBLOCK
+#endif
 #undef SCALERNAME
 #undef SCALERWIDTH
 #undef SCALERHEIGHT
 #undef SCALERFUNC
 
+#if defined(SSE2_STORE3)
+static SIMD_TARGET_SSE2 void conc3d(AdvMame3xBlock,SBPP,SSE2)(PTYPE * line0, PTYPE * line1, PTYPE * line2, const PTYPE * fc) {
+	for (Bitu i=0;i<SCALER_BLOCKSIZE;i+=SSE2_PIXELS) {
+		const __m128i c0=SSE2_LOAD(C0),c1=SSE2_LOAD(C1),c2=SSE2_LOAD(C2);
+		const __m128i c3=SSE2_LOAD(C3),c4=SSE2_LOAD(C4),c5=SSE2_LOAD(C5);
+		const __m128i c6=SSE2_LOAD(C6),c7=SSE2_LOAD(C7),c8=SSE2_LOAD(C8);
+		const __m128i flat=_mm_or_si128(SSE2_CMPEQ(c1,c7),SSE2_CMPEQ(c3,c5));
+		const __m128i e31=_mm_andnot_si128(flat,SSE2_CMPEQ(c3,c1));
+		const __m128i e51=_mm_andnot_si128(flat,SSE2_CMPEQ(c5,c1));
+		const __m128i e37=_mm_andnot_si128(flat,SSE2_CMPEQ(c3,c7));
+		const __m128i e57=_mm_andnot_si128(flat,SSE2_CMPEQ(c5,c7));
+		/* C4 is the same as a corner */
+		const __m128i s0=SSE2_CMPEQ(c4,c0),s2=SSE2_CMPEQ(c4,c2);
+		const __m128i s6=SSE2_CMPEQ(c4,c6),s8=SSE2_CMPEQ(c4,c8);
+		SSE2_STORE3(line0,
+			SSE2_SELECT(e31,c3,c4),
+			SSE2_SELECT(_mm_or_si128(_mm_andnot_si128(s2,e31),_mm_andnot_si128(s0,e51)),c1,c4),
+			SSE2_SELECT(e51,c5,c4));
+		SSE2_STORE3(line1,
+			SSE2_SELECT(_mm_or_si128(_mm_andnot_si128(s6,e31),_mm_andnot_si128(s0,e37)),c3,c4),
+			c4,
+			SSE2_SELECT(_mm_or_si128(_mm_andnot_si128(s8,e51),_mm_andnot_si128(s2,e57)),c5,c4));
+		SSE2_STORE3(line2,
+			SSE2_SELECT(e37,c3,c4),
+			SSE2_SELECT(_mm_or_si128(_mm_andnot_si128(s8,e37),_mm_andnot_si128(s6,e57)),c7,c4),
+			SSE2_SELECT(e57,c5,c4));
+		line0+=3*SSE2_PIXELS;
+		line1+=3*SSE2_PIXELS;
+		line2+=3*SSE2_PIXELS;
+		fc+=SSE2_PIXELS;
+	}
+}
+#endif
+
 #define SCALERNAME		AdvMame3x
 #define SCALERWIDTH		3
 #define SCALERHEIGHT	3
@@ -580,6 +837,13 @@ static void conc3d(Cache,SBPP,DBPP) (const void * s) {
 	}
 
 #include "render_loops.h"
+#if defined(SSE2_STORE3)
+#define SCALERVECTOR	SSE2
+#define SCALERBLOCK		conc3d(AdvMame3xBlock,SBPP,SSE2)(line0, line1, line2, fc)
+#include "render_loops.h"
+#undef SCALERVECTOR
+#undef SCALERBLOCK
+#endif
 #undef SCALERNAME
 #undef SCALERWIDTH
 #undef SCALERHEIGHT
@@ -608,3 +872,25 @@ static void conc3d(Cache,SBPP,DBPP) (const void * s) {
 #undef greenShift
 #undef blueShift
 #undef SRCTYPE
+#undef SIMD_PIXELS
+#undef SIMD_FETCH
+#undef SIMD_SET
+#undef SIMD_ADD
+#undef SIMD_SLL
+#undef SIMD_SRL
+#undef SIMD_UNPACKLO
+#undef SIMD_UNPACKHI
+#undef SIMD_AND
+#undef SIMD_STORE1
+#undef SIMD_STORE2
+#undef SIMD_STORE3
+#undef SIMD_TVCOLOR
+#undef SIMD_TV
+#undef SSE2_PIXELS
+#undef SSE2_CMPEQ
+#undef SSE2_UNPACKLO
+#undef SSE2_UNPACKHI
+#undef SSE2_LOAD
+#undef SSE2_SELECT
+#undef SSE2_STORE2
+#undef SSE2_STORE3
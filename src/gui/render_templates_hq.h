@@ -58,6 +58,33 @@ static inline bool diffYUV(Bit32u yuv1, Bit32u yuv2)
 	return false;
 }
 
+#if defined(RENDER_SCALER_VECTOR)
+/* diffYUV for every 32 bit lane, the lanes with colours that are close
+   enough get all bits set */
+static SIMD_TARGET_SSE2 inline __m128i sameYUV_SSE2(__m128i yuv1, __m128i yuv2)
+{
+	const __m128i diff = _mm_or_si128(_mm_subs_epu8(yuv1, yuv2), _mm_subs_epu8(yuv2, yuv1));
+	// the bytes are V, U and Y, no difference may be above trV, trU and trY
+	const __m128i over = _mm_subs_epu8(diff, _mm_set1_epi32(0x00300706));
+	return _mm_cmpeq_epi32(over, _mm_setzero_si128());
+}
+
+/* The row and column in the YUV values of a block for the neighbours C0-C8
+   without C4, in the order of the pattern bits */
+static const Bitu hqNeighbours[8][2] = {
+	{0,0},{0,1},{0,2},{1,0},{1,2},{2,0},{2,1},{2,2}
+};
+#endif
+
+#if defined(RENDER_SCALER_AVX2)
+static SIMD_TARGET_AVX2 inline __m256i sameYUV_AVX2(__m256i yuv1, __m256i yuv2)
+{
+	const __m256i diff = _mm256_or_si256(_mm256_subs_epu8(yuv1, yuv2), _mm256_subs_epu8(yuv2, yuv1));
+	const __m256i over = _mm256_subs_epu8(diff, _mm256_set1_epi32(0x00300706));
+	return _mm256_cmpeq_epi32(over, _mm256_setzero_si256());
+}
+#endif
+
 #endif
 
 static inline void conc2d(InitLUTs,SBPP)(void)
@@ -83,3 +110,93 @@ static inline void conc2d(InitLUTs,SBPP)(void)
 		_RGBtoYUV[color] = (Y << 16) | (u << 8) | v;
 	}
 }
+
+#if SBPP == 32
+#define RGBtoYUV(c) _RGBtoYUV[((c & 0xf80000) >> 8) | ((c & 0x00fc00) >> 5) | ((c & 0x0000f8) >> 3)]
+#else
+#define RGBtoYUV(c) _RGBtoYUV[c]
+#endif
+
+/* The neighbours that differ from the center pixel, HQ2x and HQ3x scale
+   the pixel by this pattern */
+static inline Bit32u conc2d(HqPattern,SBPP)(const PTYPE * fc)
+{
+	if (_RGBtoYUV == 0) conc2d(InitLUTs,SBPP)();
+
+	Bit32u pattern = 0;
+	const Bit32u YUV4 = RGBtoYUV(C4);
+
+	if (C4 != C0 && diffYUV(YUV4, RGBtoYUV(C0))) pattern |= 0x0001;
+	if (C4 != C1 && diffYUV(YUV4, RGBtoYUV(C1))) pattern |= 0x0002;
+	if (C4 != C2 && diffYUV(YUV4, RGBtoYUV(C2))) pattern |= 0x0004;
+	if (C4 != C3 && diffYUV(YUV4, RGBtoYUV(C3))) pattern |= 0x0008;
+	if (C4 != C5 && diffYUV(YUV4, RGBtoYUV(C5))) pattern |= 0x0010;
+	if (C4 != C6 && diffYUV(YUV4, RGBtoYUV(C6))) pattern |= 0x0020;
+	if (C4 != C7 && diffYUV(YUV4, RGBtoYUV(C7))) pattern |= 0x0040;
+	if (C4 != C8 && diffYUV(YUV4, RGBtoYUV(C8))) pattern |= 0x0080;
+	return pattern;
+}
+
+#if defined(RENDER_SCALER_VECTOR)
+/* The patterns of a full block. The YUV values of the block and the pixels
+   around it are looked up once, the compares are done 4 pixels at a time.
+   Equal colours have the same YUV value, so there's no need to check them
+   first like HqPattern. */
+static SIMD_TARGET_SSE2 void conc3d(HqPatterns,SBPP,SSE2)(const PTYPE * fc, Bit32u * patterns)
+{
+	if (_RGBtoYUV == 0) conc2d(InitLUTs,SBPP)();
+
+	Bit32u yuv[3][SCALER_BLOCKSIZE + 2];
+	for (Bitu y = 0; y < 3; y++) {
+		const PTYPE * line = fc + (y * SCALER_COMPLEXWIDTH) - SCALER_COMPLEXWIDTH - 1;
+		for (Bitu x = 0; x < SCALER_BLOCKSIZE + 2; x++)
+			yuv[y][x] = RGBtoYUV(line[x]);
+	}
+	for (Bitu i = 0; i < SCALER_BLOCKSIZE; i += 4) {
+		const __m128i YUV4 = _mm_loadu_si128((const __m128i *)&yuv[1][i + 1]);
+		__m128i pattern = _mm_setzero_si128();
+		for (Bitu n = 0; n < 8; n++) {
+			const __m128i YUV = _mm_loadu_si128((const __m128i *)&yuv[hqNeighbours[n][0]][i + hqNeighbours[n][1]]);
+			pattern = _mm_or_si128(pattern, _mm_andnot_si128(sameYUV_SSE2(YUV4, YUV), _mm_set1_epi32(1 << n)));
+		}
+		_mm_storeu_si128((__m128i *)&patterns[i], pattern);
+	}
+}
+#endif
+
+#if defined(RENDER_SCALER_AVX2)
+/* Like the SSE2 version, with 8 pixels at a time and the YUV values
+   gathered from the table */
+static SIMD_TARGET_AVX2 void conc3d(HqPatterns,SBPP,AVX2)(const PTYPE * fc, Bit32u * patterns)
+{
+	if (_RGBtoYUV == 0) conc2d(InitLUTs,SBPP)();
+
+	Bit32u yuv[3][SCALER_BLOCKSIZE + 2];
+	for (Bitu y = 0; y < 3; y++) {
+		const PTYPE * line = fc + (y * SCALER_COMPLEXWIDTH) - SCALER_COMPLEXWIDTH - 1;
+		for (Bitu x = 0; x < SCALER_BLOCKSIZE; x += 8) {
+#if SBPP == 32
+			const __m256i c = _mm256_loadu_si256((const __m256i *)&line[x]);
+			const __m256i index = _mm256_or_si256(_mm256_or_si256(
+				_mm256_srli_epi32(_mm256_and_si256(c, _mm256_set1_epi32(0xf80000)), 8),
+				_mm256_srli_epi32(_mm256_and_si256(c, _mm256_set1_epi32(0x00fc00)), 5)),
+				_mm256_srli_epi32(_mm256_and_si256(c, _mm256_set1_epi32(0x0000f8)), 3));
+#else
+			const __m256i index = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)&line[x]));
+#endif
+			_mm256_storeu_si256((__m256i *)&yuv[y][x], _mm256_i32gather_epi32((const int *)_RGBtoYUV, index, 4));
+		}
+		yuv[y][SCALER_BLOCKSIZE] = RGBtoYUV(line[SCALER_BLOCKSIZE]);
+		yuv[y][SCALER_BLOCKSIZE + 1] = RGBtoYUV(line[SCALER_BLOCKSIZE + 1]);
+	}
+	for (Bitu i = 0; i < SCALER_BLOCKSIZE; i += 8) {
+		const __m256i YUV4 = _mm256_loadu_si256((const __m256i *)&yuv[1][i + 1]);
+		__m256i pattern = _mm256_setzero_si256();
+		for (Bitu n = 0; n < 8; n++) {
+			const __m256i YUV = _mm256_loadu_si256((const __m256i *)&yuv[hqNeighbours[n][0]][i + hqNeighbours[n][1]]);
+			pattern = _mm256_or_si256(pattern, _mm256_andnot_si256(sameYUV_AVX2(YUV4, YUV), _mm256_set1_epi32(1 << n)));
+		}
+		_mm256_storeu_si256((__m256i *)&patterns[i], pattern);
+	}
+}
+#endif
@@ -81,28 +81,8 @@
 
 #endif
 
-#if SBPP == 32
-#define RGBtoYUV(c) _RGBtoYUV[((c & 0xf80000) >> 8) | ((c & 0x00fc00) >> 5) | ((c & 0x0000f8) >> 3)]
-#else
-#define RGBtoYUV(c) _RGBtoYUV[c]
-#endif
-
-inline void conc2d(Hq3x,SBPP)(PTYPE * line0, PTYPE * line1, PTYPE * line2, const PTYPE * fc)
+inline void conc2d(Hq3x,SBPP)(PTYPE * line0, PTYPE * line1, PTYPE * line2, const PTYPE * fc, Bit32u pattern)
 {
-	if (_RGBtoYUV == 0) conc2d(InitLUTs,SBPP)();
-
-	Bit32u pattern = 0;
-	const Bit32u YUV4 = RGBtoYUV(C4);
-
-	if (C4 != C0 && diffYUV(YUV4, RGBtoYUV(C0))) pattern |= 0x0001;
-	if (C4 != C1 && diffYUV(YUV4, RGBtoYUV(C1))) pattern |= 0x0002;
-	if (C4 != C2 && diffYUV(YUV4, RGBtoYUV(C2))) pattern |= 0x0004;
-	if (C4 != C3 && diffYUV(YUV4, RGBtoYUV(C3))) pattern |= 0x0008;
-	if (C4 != C5 && diffYUV(YUV4, RGBtoYUV(C5))) pattern |= 0x0010;
-	if (C4 != C6 && diffYUV(YUV4, RGBtoYUV(C6))) pattern |= 0x0020;
-	if (C4 != C7 && diffYUV(YUV4, RGBtoYUV(C7))) pattern |= 0x0040;
-	if (C4 != C8 && diffYUV(YUV4, RGBtoYUV(C8))) pattern |= 0x0080;
-
 	switch (pattern) {
 	case 0:
 	case 1:
@@ -2869,4 +2849,22 @@ inline void conc2d(Hq3x,SBPP)(PTYPE * line0, PTYPE * line1, PTYPE * line2, const
 	}
 }
 
-#undef RGBtoYUV
+#if defined(RENDER_SCALER_VECTOR)
+static SIMD_TARGET_SSE2 void conc3d(Hq3xBlock,SBPP,SSE2)(PTYPE * line0, PTYPE * line1, PTYPE * line2, const PTYPE * fc)
+{
+	Bit32u patterns[SCALER_BLOCKSIZE];
+	conc3d(HqPatterns,SBPP,SSE2)(fc, patterns);
+	for (Bitu i = 0; i < SCALER_BLOCKSIZE; i++,line0+=3,line1+=3,line2+=3,fc++)
+		conc2d(Hq3x,SBPP)(line0, line1, line2, fc, patterns[i]);
+}
+#endif
+
+#if defined(RENDER_SCALER_AVX2)
+static SIMD_TARGET_AVX2 void conc3d(Hq3xBlock,SBPP,AVX2)(PTYPE * line0, PTYPE * line1, PTYPE * line2, const PTYPE * fc)
+{
+	Bit32u patterns[SCALER_BLOCKSIZE];
+	conc3d(HqPatterns,SBPP,AVX2)(fc, patterns);
+	for (Bitu i = 0; i < SCALER_BLOCKSIZE; i++,line0+=3,line1+=3,line2+=3,fc++)
+		conc2d(Hq3x,SBPP)(line0, line1, line2, fc, patterns[i]);
+}
+#endif
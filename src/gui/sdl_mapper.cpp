@@ -27,6 +27,7 @@
 
 #include "dosbox.h"
 #include "video.h"
+#include "render.h"
 #include "keyboard.h"
 #include "joystick.h"
 #include "support.h"
@@ -2359,6 +2360,7 @@ void MAPPER_RunInternal() {
 	}
 
 	/* Be sure that there is no update in progress */
+	RENDER_Flush();
 	GFX_EndUpdate( 0 );
 	mapper.surface=SDL_SetVideoMode_Wrap(640,480,8,0);
 	if (mapper.surface == NULL) E_Exit("Could not initialize video mode for mapper: %s",SDL_GetError());
@@ -51,6 +51,7 @@
 #include "cross.h"
 #include "control.h"
 #include "render.h"
+#include "dos_inc.h"
 
 #define MAPPERFILE "mapper-" VERSION ".map"
 //#define DISABLE_JOYSTICK
@@ -1309,6 +1310,7 @@ static SDL_Surface * GFX_SetupSurfaceScaled(Bit32u sdl_flags, Bit32u bpp) {
 }
 
 void GFX_TearDown(void) {
+	RENDER_Flush();
 	if (sdl.updating)
 		GFX_EndUpdate( 0 );
 
@@ -1390,6 +1392,7 @@ static bool LoadGLShaders(const char *src, GLuint *vertex, GLuint *fragment) {
 #endif
 
 Bitu GFX_SetSize(Bitu width,Bitu height,Bitu flags,double scalex,double scaley,GFX_CallBack_t callback) {
+	RENDER_Flush();
 	if (sdl.updating)
 		GFX_EndUpdate( 0 );
 
@@ -2105,6 +2108,7 @@ Bitu GFX_GetRGB(Bit8u red,Bit8u green,Bit8u blue) {
 }
 
 void GFX_Stop() {
+	RENDER_Flush();
 	if (sdl.updating)
 		GFX_EndUpdate( 0 );
 	sdl.active=false;
@@ -2667,6 +2671,9 @@ void GFX_Events() {
 	last_check = current_check;
 #endif
 
+	/* Nothing to receive events from */
+	if (headless) return;
+
 	SDL_Event event;
 #if defined (REDUCE_JOYSTICK_POLLING)
 	static int poll_delay = 0;
@@ -3166,6 +3173,7 @@ int main(int argc, char* argv[]) {
         std::set_terminate(os2_exit);
 #endif
 
+	int exit_code = 0;
 	try {
 		Disable_OS_Scaling(); //Do this early on, maybe override it through some parameter.
 
@@ -3216,6 +3224,7 @@ int main(int argc, char* argv[]) {
 			return 0;
 		}
 		if(control->cmdline->FindExist("-printconf")) printconfiglocation();
+		headless = control->cmdline->FindExist("-headless");
 
 #if C_DEBUG
 		DEBUG_SetupConsole();
@@ -3249,7 +3258,13 @@ int main(int argc, char* argv[]) {
 #endif
 	// Don't init timers, GetTicks seems to work fine and they can use a fair amount of power (Macs again)
 	// Please report problems with audio and other things.
-	if ( SDL_Init( SDL_INIT_AUDIO|SDL_INIT_VIDEO | /*SDL_INIT_TIMER |*/ SDL_INIT_CDROM
+	if (headless) {
+		/* The video subsystem is still needed for the surface functions, but
+		 * it doesn't have to open a window. Audio is never opened. */
+		putenv(const_cast<char*>("SDL_VIDEODRIVER=dummy"));
+		if ( SDL_Init( SDL_INIT_VIDEO | SDL_INIT_CDROM | SDL_INIT_NOPARACHUTE ) < 0 )
+			E_Exit("Can't init SDL %s",SDL_GetError());
+	} else if ( SDL_Init( SDL_INIT_AUDIO|SDL_INIT_VIDEO | /*SDL_INIT_TIMER |*/ SDL_INIT_CDROM
 		|SDL_INIT_NOPARACHUTE
 		) < 0 ) E_Exit("Can't init SDL %s",SDL_GetError());
 	sdl.inited = true;
@@ -3376,8 +3391,11 @@ int main(int argc, char* argv[]) {
 		if (control->cmdline->FindExist("-startmapper")) MAPPER_RunInternal();
 		/* Start up main machine */
 		control->StartUp();
+		/* Scripts driving a headless run get the result of the last program */
+		if (headless) exit_code = dos.return_code;
 		/* Shutdown everything */
 	} catch (char * error) {
+		if (headless) exit_code = 1;
 #if defined (WIN32)
 		sticky_keys(true);
 #endif
@@ -3422,7 +3440,7 @@ int main(int argc, char* argv[]) {
 #ifdef _EE
 	ps2Quit();
 #endif
-	return 0;
+	return exit_code;
 #endif
 }
 
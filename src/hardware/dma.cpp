@@ -25,6 +25,7 @@
 #include "pic.h"
 #include "paging.h"
 #include "setup.h"
+#include "snapshot.h"
 
 DmaController *DmaControllers[2];
 
@@ -41,6 +42,22 @@ static void UpdateEMSMapping(void) {
 	}
 }
 
+/* translate a dma page, care for EMS pageframe etc. */
+static INLINE Bitu DMA_TranslatePage(Bitu page) {
+	if (page < EMM_PAGEFRAME4K) return paging.firstmb[page];
+	else if (page < EMM_PAGEFRAME4K+0x10) return ems_board_mapping[page];
+	else if (page < LINK_START) return paging.firstmb[page];
+	return page;
+}
+
+/* length of the run starting at offset that stays within one page and
+   does not wrap around the dma address space */
+static INLINE Bitu DMA_RunLength(PhysPt offset,Bitu size,Bit32u dma_wrap) {
+	Bitu run=4096-(offset & 4095);
+	if ((Bitu)(dma_wrap-offset)<run-1) run=(Bitu)(dma_wrap-offset)+1;
+	return (run<size) ? run : size;
+}
+
 /* read a block from physical memory */
 static void DMA_BlockRead(PhysPt spage,PhysPt offset,void * data,Bitu size,Bit8u dma16) {
 	Bit8u * write=(Bit8u *) data;
@@ -48,17 +65,17 @@ static void DMA_BlockRead(PhysPt spage,PhysPt offset,void * data,Bitu size,Bit8u
 	size <<= dma16;
 	offset <<= dma16;
 	Bit32u dma_wrap = ((0xffff<<dma16)+dma16) | dma_wrapping;
-	for ( ; size ; size--, offset++) {
+	while (size) {
 		if (offset>(dma_wrapping<<dma16)) {
 			LOG_MSG("DMA segbound wrapping (read): %x:%x size %" sBitfs(x) " [%x] wrap %x",spage,offset,size,dma16,dma_wrapping);
 		}
 		offset &= dma_wrap;
-		Bitu page = highpart_addr_page+(offset >> 12);
-		/* care for EMS pageframe etc. */
-		if (page < EMM_PAGEFRAME4K) page = paging.firstmb[page];
-		else if (page < EMM_PAGEFRAME4K+0x10) page = ems_board_mapping[page];
-		else if (page < LINK_START) page = paging.firstmb[page];
-		*write++=phys_readb(page*4096 + (offset & 4095));
+		Bitu run = DMA_RunLength(offset,size,dma_wrap);
+		Bitu page = DMA_TranslatePage(highpart_addr_page+(offset >> 12));
+		memcpy(write,MemBase+page*4096+(offset & 4095),run);
+		write+=run;
+		offset+=run;
+		size-=run;
 	}
 }
 
@@ -69,17 +86,18 @@ static void DMA_BlockWrite(PhysPt spage,PhysPt offset,void * data,Bitu size,Bit8
 	size <<= dma16;
 	offset <<= dma16;
 	Bit32u dma_wrap = ((0xffff<<dma16)+dma16) | dma_wrapping;
-	for ( ; size ; size--, offset++) {
+	while (size) {
 		if (offset>(dma_wrapping<<dma16)) {
 			LOG_MSG("DMA segbound wrapping (write): %x:%x size %" sBitfs(x) " [%x] wrap %x",spage,offset,size,dma16,dma_wrapping);
 		}
 		offset &= dma_wrap;
-		Bitu page = highpart_addr_page+(offset >> 12);
-		/* care for EMS pageframe etc. */
-		if (page < EMM_PAGEFRAME4K) page = paging.firstmb[page];
-		else if (page < EMM_PAGEFRAME4K+0x10) page = ems_board_mapping[page];
-		else if (page < LINK_START) page = paging.firstmb[page];
-		phys_writeb(page*4096 + (offset & 4095), *read++);
+		Bitu run = DMA_RunLength(offset,size,dma_wrap);
+		Bitu page = DMA_TranslatePage(highpart_addr_page+(offset >> 12));
+		memcpy(MemBase+page*4096+(offset & 4095),read,run);
+		MEM_MarkDirty(page);
+		read+=run;
+		offset+=run;
+		size-=run;
 	}
 }
 
@@ -348,6 +366,42 @@ again:
 	return done;
 }
 
+void DmaController::SaveState(SnapshotStream & stream) {
+	stream.Write(&flipflop,sizeof(flipflop));
+	for (Bit8u i=0;i<4;i++) stream.Write(DmaChannels[i],sizeof(DmaChannel));
+}
+
+void DmaController::LoadState(SnapshotStream & stream) {
+	stream.Read(&flipflop,sizeof(flipflop));
+	for (Bit8u i=0;i<4;i++) stream.Read(DmaChannels[i],sizeof(DmaChannel));
+}
+
+static void DMA_SnapshotSave(SnapshotStream & stream) {
+	for (Bitu i=0;i<2;i++) {
+		bool present=(DmaControllers[i]!=NULL);
+		stream.Write(&present,sizeof(present));
+		if (present) DmaControllers[i]->SaveState(stream);
+	}
+	stream.Write(ems_board_mapping,sizeof(ems_board_mapping));
+	stream.Write(&dma_wrapping,sizeof(dma_wrapping));
+}
+
+static void DMA_SnapshotLoad(SnapshotStream & stream) {
+	for (Bitu i=0;i<2;i++) {
+		bool present;
+		stream.Read(&present,sizeof(present));
+		if (!present) continue;
+		if (DmaControllers[i]) DmaControllers[i]->LoadState(stream);
+		else {
+			/* the second controller was closed after the snapshot */
+			DmaController discard((Bit8u)i);
+			discard.LoadState(stream);
+		}
+	}
+	stream.Read(ems_board_mapping,sizeof(ems_board_mapping));
+	stream.Read(&dma_wrapping,sizeof(dma_wrapping));
+}
+
 class DMA:public Module_base{
 public:
 	DMA(Section* configuration):Module_base(configuration){
@@ -381,8 +435,10 @@ public:
 			DmaControllers[1]->DMA_WriteHandler[0x11].Install(0x8f,DMA_Write_Port,IO_MB,1);
 			DmaControllers[1]->DMA_ReadHandler[0x11].Install(0x8f,DMA_Read_Port,IO_MB,1);
 		}
+		SNAPSHOT_AddHandler("dma",DMA_SnapshotSave,DMA_SnapshotLoad);
 	}
 	~DMA(){
+		SNAPSHOT_Remove("dma");
 		if (DmaControllers[0]) {
 			delete DmaControllers[0];
 			DmaControllers[0]=NULL;
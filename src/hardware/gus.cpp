@@ -18,6 +18,7 @@
 
 
 #include <string.h>
+#include <new>
 #include <iomanip>
 #include <sstream>
 #include "dosbox.h"
@@ -29,6 +30,7 @@
 #include "shell.h"
 #include "math.h"
 #include "regs.h"
+#include "snapshot.h"
 using namespace std;
 
 //Extra bits of precision over normal gus
@@ -62,6 +64,11 @@ static Bit8u dmatable[8] = { 0, 1, 3, 5, 6, 7, 0, 0 };
 // 1024K of GUS Ram
 #define GUSRAM_SIZE (1024*1024)
 static Bit8u* GUSRam;
+// Ram pages written since the last snapshot and the ram at that snapshot
+#define GUSRAM_PAGESHIFT 12
+#define GUSRAM_PAGES (GUSRAM_SIZE >> GUSRAM_PAGESHIFT)
+static Bit8u GUSDirty[GUSRAM_PAGES];
+static Bit8u* GUSSnapshot;
 static Bit16u vol16bit[4096];
 static Bit32u pantable[16];
 
@@ -721,7 +728,10 @@ static void write_gus(Bitu port,Bitu val,Bitu iolen) {
 		ExecuteGlobRegister();
 		break;
 	case 0x307:
-		if(myGUS.gDramAddr < GUSRAM_SIZE) GUSRam[myGUS.gDramAddr] = (Bit8u)val;
+		if(myGUS.gDramAddr < GUSRAM_SIZE) {
+			GUSRam[myGUS.gDramAddr] = (Bit8u)val;
+			GUSDirty[myGUS.gDramAddr >> GUSRAM_PAGESHIFT] = 1;
+		}
 		break;
 	default:
 #if LOG_GUS
@@ -746,6 +756,8 @@ static void GUS_DMA_Callback(DmaChannel * chan,DMAEvent event) {
 		Bitu read=chan->Read(chan->currcnt+1,&GUSRam[dmaaddr]);
 		//Check for 16 or 8bit channel
 		read*=(chan->DMA16+1);
+		for (Bitu page=dmaaddr >> GUSRAM_PAGESHIFT;page<=((dmaaddr+read) >> GUSRAM_PAGESHIFT) && page<GUSRAM_PAGES;page++)
+			GUSDirty[page] = 1;
 		if((myGUS.DMAControl & 0x80) != 0) {
 			//Invert the MSB to convert twos compliment form
 			Bitu i;
@@ -803,6 +815,49 @@ static void MakeTables(void) {
 	}
 }
 
+static void GUS_SnapshotSave(SnapshotStream & stream) {
+	stream.Write(&myGUS,sizeof(myGUS));
+	stream.Write(&adlib_commandreg,sizeof(adlib_commandreg));
+	Bitu current=32;
+	for (Bitu i=0;i<32;i++) {
+		stream.Write(guschan[i],sizeof(GUSChannels));
+		if (curchan==guschan[i]) current=i;
+	}
+	stream.Write(&current,sizeof(current));
+	/* Only the ram pages written since the last snapshot are copied */
+	if (!GUSSnapshot) {
+		GUSSnapshot = new(std::nothrow) Bit8u[GUSRAM_SIZE];
+		if (!GUSSnapshot) {
+			stream.Fail();
+			return;
+		}
+		memset(GUSDirty,1,GUSRAM_PAGES);
+	}
+	for (Bitu i=0;i<GUSRAM_PAGES;i++) {
+		if (!GUSDirty[i]) continue;
+		memcpy(&GUSSnapshot[i << GUSRAM_PAGESHIFT],&GUSRam[i << GUSRAM_PAGESHIFT],1 << GUSRAM_PAGESHIFT);
+		GUSDirty[i] = 0;
+	}
+}
+
+static void GUS_SnapshotLoad(SnapshotStream & stream) {
+	stream.Read(&myGUS,sizeof(myGUS));
+	stream.Read(&adlib_commandreg,sizeof(adlib_commandreg));
+	for (Bitu i=0;i<32;i++) stream.Read(guschan[i],sizeof(GUSChannels));
+	Bitu current;
+	stream.Read(&current,sizeof(current));
+	curchan=(current<32) ? guschan[current] : 0;
+	for (Bitu i=0;i<GUSRAM_PAGES;i++) {
+		if (!GUSDirty[i]) continue;
+		memcpy(&GUSRam[i << GUSRAM_PAGESHIFT],&GUSSnapshot[i << GUSRAM_PAGESHIFT],1 << GUSRAM_PAGESHIFT);
+		GUSDirty[i] = 0;
+	}
+	if (myGUS.basefreq && myGUS.running) {
+		gus_chan->SetFreq(myGUS.basefreq);
+		gus_chan->Enable(true);
+	} else gus_chan->Enable(false);
+}
+
 class GUS:public Module_base{
 private:
 	IO_ReadHandleObject ReadHandler[8];
@@ -818,6 +873,7 @@ public:
 		memset(&myGUS,0,sizeof(myGUS));
 		GUSRam = new Bit8u[GUSRAM_SIZE];
 		memset(GUSRam,0,GUSRAM_SIZE);
+		GUSSnapshot = NULL;
 	
 		myGUS.portbase = section->Get_hex("gusbase") - 0x200;
 		int dma_val = section->Get_int("gusdma");
@@ -882,6 +938,7 @@ public:
 		// Create autoexec.bat lines
 		autoexecline[0].Install(temp.str());
 		autoexecline[1].Install(std::string("SET ULTRADIR=") + section->Get_string("ultradir"));
+		SNAPSHOT_AddHandler("gus",GUS_SnapshotSave,GUS_SnapshotLoad);
 	}
 
 
@@ -890,6 +947,7 @@ public:
 		Section_prop * section=static_cast<Section_prop *>(m_configuration);
 		if(!section->Get_bool("gus")) return;
 	
+		SNAPSHOT_Remove("gus");
 		myGUS.gRegData=0;
 		GUSReset();
 
@@ -900,6 +958,8 @@ public:
 		memset(&myGUS,0,sizeof(myGUS));
 		delete[] GUSRam;
 		GUSRam = NULL;
+		delete[] GUSSnapshot;
+		GUSSnapshot = NULL;
 	}
 };
 
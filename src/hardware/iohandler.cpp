@@ -18,17 +18,24 @@
 
 
 #include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
 #include "dosbox.h"
 #include "inout.h"
 #include "setup.h"
 #include "cpu.h"
 #include "../src/cpu/lazyflags.h"
 #include "callback.h"
+#include "timer.h"
+#include "mapper.h"
 
 //#define ENABLE_PORTLOG
 
 IO_WriteHandler * io_writehandlers[3][IO_MAX];
 IO_ReadHandler * io_readhandlers[3][IO_MAX];
+static IO_BlockWriteHandler * io_blockwritehandlers[3][IO_MAX];
+static IO_BlockReadHandler * io_blockreadhandlers[3][IO_MAX];
 
 static Bitu IO_ReadBlocked(Bitu /*port*/,Bitu /*iolen*/) {
 	return ~0;
@@ -90,20 +97,39 @@ void IO_RegisterWriteHandler(Bitu port,IO_WriteHandler * handler,Bitu mask,Bitu
 	}
 }
 
+void IO_RegisterBlockReadHandler(Bitu port,IO_BlockReadHandler * handler,Bitu mask,Bitu range) {
+	while (range--) {
+		if (mask&IO_MB) io_blockreadhandlers[0][port]=handler;
+		if (mask&IO_MW) io_blockreadhandlers[1][port]=handler;
+		if (mask&IO_MD) io_blockreadhandlers[2][port]=handler;
+		port++;
+	}
+}
+
+void IO_RegisterBlockWriteHandler(Bitu port,IO_BlockWriteHandler * handler,Bitu mask,Bitu range) {
+	while (range--) {
+		if (mask&IO_MB) io_blockwritehandlers[0][port]=handler;
+		if (mask&IO_MW) io_blockwritehandlers[1][port]=handler;
+		if (mask&IO_MD) io_blockwritehandlers[2][port]=handler;
+		port++;
+	}
+}
+
+/* Freeing a port also removes its block handlers */
 void IO_FreeReadHandler(Bitu port,Bitu mask,Bitu range) {
 	while (range--) {
-		if (mask&IO_MB) io_readhandlers[0][port]=IO_ReadDefault;
-		if (mask&IO_MW) io_readhandlers[1][port]=IO_ReadDefault;
-		if (mask&IO_MD) io_readhandlers[2][port]=IO_ReadDefault;
+		if (mask&IO_MB) {io_readhandlers[0][port]=IO_ReadDefault;io_blockreadhandlers[0][port]=0;}
+		if (mask&IO_MW) {io_readhandlers[1][port]=IO_ReadDefault;io_blockreadhandlers[1][port]=0;}
+		if (mask&IO_MD) {io_readhandlers[2][port]=IO_ReadDefault;io_blockreadhandlers[2][port]=0;}
 		port++;
 	}
 }
 
 void IO_FreeWriteHandler(Bitu port,Bitu mask,Bitu range) {
 	while (range--) {
-		if (mask&IO_MB) io_writehandlers[0][port]=IO_WriteDefault;
-		if (mask&IO_MW) io_writehandlers[1][port]=IO_WriteDefault;
-		if (mask&IO_MD) io_writehandlers[2][port]=IO_WriteDefault;
+		if (mask&IO_MB) {io_writehandlers[0][port]=IO_WriteDefault;io_blockwritehandlers[0][port]=0;}
+		if (mask&IO_MW) {io_writehandlers[1][port]=IO_WriteDefault;io_blockwritehandlers[1][port]=0;}
+		if (mask&IO_MD) {io_writehandlers[2][port]=IO_WriteDefault;io_blockwritehandlers[2][port]=0;}
 		port++;
 	}
 }
@@ -160,6 +186,88 @@ static struct {
 	IOF_Entry entries[IOF_QUEUESIZE];
 } iof_queue;
 
+/* Optional statistics of the port accesses. The handler time is measured on
+ * the microsecond clock, single accesses mostly read as 0 or 1 us but the
+ * sums are right on average. The delay is what IO_USEC took from the cpu. */
+struct IO_PortProfile {
+	Bit32u reads,writes;
+	Bit32u faults;			//Entries into the IO-fault core
+	Bit64u us;
+	Bit64u delay;
+};
+
+static struct {
+	IO_PortProfile * ports;	//Only allocated when enabled
+	Bit32u faults;
+	Bit64u start;
+} io_profile;
+
+static INLINE void IO_ProfileFault(Bitu port) {
+	if (GCC_UNLIKELY(io_profile.ports!=0)) {
+		io_profile.faults++;
+		if (port<IO_MAX) io_profile.ports[port].faults++;
+	}
+}
+
+static void IO_ProfiledWrite(Bitu width,Bitu port,Bitu val,Bitu iolen,Bits delay) {
+	IO_PortProfile & prof=io_profile.ports[port];
+	prof.writes++;
+	prof.delay+=delay;
+	Bit64u start=TIMER_GetTicksUs();
+	io_writehandlers[width][port](port,val,iolen);
+	prof.us+=TIMER_GetTicksUs()-start;
+}
+
+static Bitu IO_ProfiledRead(Bitu width,Bitu port,Bitu iolen,Bits delay) {
+	IO_PortProfile & prof=io_profile.ports[port];
+	prof.reads++;
+	prof.delay+=delay;
+	Bit64u start=TIMER_GetTicksUs();
+	Bitu retval=io_readhandlers[width][port](port,iolen);
+	prof.us+=TIMER_GetTicksUs()-start;
+	return retval;
+}
+
+static bool IO_ProfileCompare(Bitu a,Bitu b) {
+	IO_PortProfile const & pa=io_profile.ports[a];
+	IO_PortProfile const & pb=io_profile.ports[b];
+	return ((Bit64u)pa.reads+pa.writes+pa.faults)>((Bit64u)pb.reads+pb.writes+pb.faults);
+}
+
+#define IO_PROFILE_SHOWN 16
+
+/* Log the busiest ports and start counting again */
+void IO_ProfileDump(void) {
+	if (!io_profile.ports) return;
+	std::vector<Bitu> used;
+	Bit64u total=0;
+	for (Bitu port=0;port<IO_MAX;port++) {
+		IO_PortProfile const & prof=io_profile.ports[port];
+		if (prof.reads || prof.writes || prof.faults) {
+			used.push_back(port);
+			total+=(Bit64u)prof.reads+prof.writes;
+		}
+	}
+	std::sort(used.begin(),used.end(),IO_ProfileCompare);
+	LOG_MSG("IO: %d ports accessed %u times in %u ms, %u io-fault core entries",
+		(int)used.size(),(Bit32u)total,(Bit32u)((TIMER_GetTicksUs()-io_profile.start)/1000),io_profile.faults);
+	if (used.empty()) return;
+	LOG_MSG("IO: port      reads     writes  faults  handler us  delay cycles");
+	for (Bitu i=0;i<used.size() && i<IO_PROFILE_SHOWN;i++) {
+		IO_PortProfile const & prof=io_profile.ports[used[i]];
+		LOG_MSG("IO: %04X %10u %10u %7u %11u %13u",(int)used[i],
+			prof.reads,prof.writes,prof.faults,(Bit32u)prof.us,(Bit32u)prof.delay);
+	}
+	memset(io_profile.ports,0,IO_MAX*sizeof(IO_PortProfile));
+	io_profile.faults=0;
+	io_profile.start=TIMER_GetTicksUs();
+}
+
+static void IO_ProfileEvent(bool pressed) {
+	if (!pressed) return;
+	IO_ProfileDump();
+}
+
 static Bits IOFaultCore(void) {
 	CPU_CycleLeft+=CPU_Cycles;
 	CPU_Cycles=1;
@@ -206,18 +314,20 @@ inline void IO_USEC_write_delay_old() {
 #define IODELAY_READ_MICROSk (Bit32u)(1024/1.0)
 #define IODELAY_WRITE_MICROSk (Bit32u)(1024/0.75)
 
-inline void IO_USEC_read_delay() {
-	Bits delaycyc = CPU_CycleMax/IODELAY_READ_MICROSk;
+inline Bits IO_USEC_read_delay(Bitu count=1) {
+	Bits delaycyc = (CPU_CycleMax/IODELAY_READ_MICROSk)*count;
 	if(GCC_UNLIKELY(delaycyc > CPU_Cycles)) delaycyc = CPU_Cycles;
 	CPU_Cycles -= delaycyc;
 	CPU_IODelayRemoved += delaycyc;
+	return delaycyc;
 }
 
-inline void IO_USEC_write_delay() {
-	Bits delaycyc = CPU_CycleMax/IODELAY_WRITE_MICROSk;
+inline Bits IO_USEC_write_delay(Bitu count=1) {
+	Bits delaycyc = (CPU_CycleMax/IODELAY_WRITE_MICROSk)*count;
 	if(GCC_UNLIKELY(delaycyc > CPU_Cycles)) delaycyc = CPU_Cycles;
 	CPU_Cycles -= delaycyc;
 	CPU_IODelayRemoved += delaycyc;
+	return delaycyc;
 }
 
 #ifdef ENABLE_PORTLOG
@@ -294,6 +404,7 @@ void IO_WriteB(Bitu port,Bitu val) {
 		CPU_Decoder * old_cpudecoder;
 		old_cpudecoder=cpudecoder;
 		cpudecoder=&IOFaultCore;
+		IO_ProfileFault(port);
 		IOF_Entry * entry=&iof_queue.entries[iof_queue.used++];
 		entry->cs=SegValue(cs);
 		entry->eip=reg_eip;
@@ -321,8 +432,10 @@ void IO_WriteB(Bitu port,Bitu val) {
 			LOG(LOG_IO,LOG_ERROR)("Invalid write to port %04X",port);
 			return;
 		}
-		IO_USEC_write_delay();
-		io_writehandlers[0][port](port,val,1);
+		Bits delay=IO_USEC_write_delay();
+		CPU_IdleReset();
+		if (GCC_UNLIKELY(io_profile.ports!=0)) IO_ProfiledWrite(0,port,val,1,delay);
+		else io_writehandlers[0][port](port,val,1);
 	}
 }
 
@@ -334,6 +447,7 @@ void IO_WriteW(Bitu port,Bitu val) {
 		CPU_Decoder * old_cpudecoder;
 		old_cpudecoder=cpudecoder;
 		cpudecoder=&IOFaultCore;
+		IO_ProfileFault(port);
 		IOF_Entry * entry=&iof_queue.entries[iof_queue.used++];
 		entry->cs=SegValue(cs);
 		entry->eip=reg_eip;
@@ -361,8 +475,10 @@ void IO_WriteW(Bitu port,Bitu val) {
 			LOG(LOG_IO,LOG_ERROR)("Invalid write to port %04X",port);
 			return;
 		}
-		IO_USEC_write_delay();
-		io_writehandlers[1][port](port,val,2);
+		Bits delay=IO_USEC_write_delay();
+		CPU_IdleReset();
+		if (GCC_UNLIKELY(io_profile.ports!=0)) IO_ProfiledWrite(1,port,val,2,delay);
+		else io_writehandlers[1][port](port,val,2);
 	}
 }
 
@@ -374,6 +490,7 @@ void IO_WriteD(Bitu port,Bitu val) {
 		CPU_Decoder * old_cpudecoder;
 		old_cpudecoder=cpudecoder;
 		cpudecoder=&IOFaultCore;
+		IO_ProfileFault(port);
 		IOF_Entry * entry=&iof_queue.entries[iof_queue.used++];
 		entry->cs=SegValue(cs);
 		entry->eip=reg_eip;
@@ -401,7 +518,9 @@ void IO_WriteD(Bitu port,Bitu val) {
 			LOG(LOG_IO,LOG_ERROR)("Invalid write to port %04X",port);
 			return;
 		}
-		io_writehandlers[2][port](port,val,4);
+		CPU_IdleReset();
+		if (GCC_UNLIKELY(io_profile.ports!=0)) IO_ProfiledWrite(2,port,val,4,0);
+		else io_writehandlers[2][port](port,val,4);
 	}
 }
 
@@ -413,6 +532,7 @@ Bitu IO_ReadB(Bitu port) {
 		CPU_Decoder * old_cpudecoder;
 		old_cpudecoder=cpudecoder;
 		cpudecoder=&IOFaultCore;
+		IO_ProfileFault(port);
 		IOF_Entry * entry=&iof_queue.entries[iof_queue.used++];
 		entry->cs=SegValue(cs);
 		entry->eip=reg_eip;
@@ -441,8 +561,9 @@ Bitu IO_ReadB(Bitu port) {
 			LOG(LOG_IO,LOG_ERROR)("Invalid read from port %04X",port);
 			return -1;
 		}
-		IO_USEC_read_delay();
-		retval = io_readhandlers[0][port](port,1);
+		Bits delay=IO_USEC_read_delay();
+		if (GCC_UNLIKELY(io_profile.ports!=0)) retval = IO_ProfiledRead(0,port,1,delay);
+		else retval = io_readhandlers[0][port](port,1);
 	}
 	log_io(0, false, port, retval);
 	return retval;
@@ -456,6 +577,7 @@ Bitu IO_ReadW(Bitu port) {
 		CPU_Decoder * old_cpudecoder;
 		old_cpudecoder=cpudecoder;
 		cpudecoder=&IOFaultCore;
+		IO_ProfileFault(port);
 		IOF_Entry * entry=&iof_queue.entries[iof_queue.used++];
 		entry->cs=SegValue(cs);
 		entry->eip=reg_eip;
@@ -483,8 +605,9 @@ Bitu IO_ReadW(Bitu port) {
 			LOG(LOG_IO,LOG_ERROR)("Invalid read from port %04X",port);
 			return -1;
 		}
-		IO_USEC_read_delay();
-		retval = io_readhandlers[1][port](port,2);
+		Bits delay=IO_USEC_read_delay();
+		if (GCC_UNLIKELY(io_profile.ports!=0)) retval = IO_ProfiledRead(1,port,2,delay);
+		else retval = io_readhandlers[1][port](port,2);
 	}
 	log_io(1, false, port, retval);
 	return retval;
@@ -498,6 +621,7 @@ Bitu IO_ReadD(Bitu port) {
 		CPU_Decoder * old_cpudecoder;
 		old_cpudecoder=cpudecoder;
 		cpudecoder=&IOFaultCore;
+		IO_ProfileFault(port);
 		IOF_Entry * entry=&iof_queue.entries[iof_queue.used++];
 		entry->cs=SegValue(cs);
 		entry->eip=reg_eip;
@@ -524,22 +648,86 @@ Bitu IO_ReadD(Bitu port) {
 			LOG(LOG_IO,LOG_ERROR)("Invalid read from port %04X",port);
 			return -1;
 		}
-		retval = io_readhandlers[2][port](port,4);
+		if (GCC_UNLIKELY(io_profile.ports!=0)) retval = IO_ProfiledRead(2,port,4,0);
+		else retval = io_readhandlers[2][port](port,4);
 	}
 	log_io(2, false, port, retval);
 	return retval;
 }
 
+/* The block transfers are only done when no io exception can occur, with
+ * port logging enabled everything goes through the single element path. */
+static INLINE Bitu IO_BlockWidth(Bitu iolen) {
+	return (iolen==4) ? 2 : (iolen-1);
+}
+
+bool IO_CanReadBlock(Bitu port,Bitu iolen) {
+#ifdef ENABLE_PORTLOG
+	return false;
+#else
+	if (GCC_UNLIKELY(GETFLAG(VM)) || (port > IO_MAX - 1)) return false;
+	return io_blockreadhandlers[IO_BlockWidth(iolen)][port]!=0;
+#endif
+}
+
+bool IO_CanWriteBlock(Bitu port,Bitu iolen) {
+#ifdef ENABLE_PORTLOG
+	return false;
+#else
+	if (GCC_UNLIKELY(GETFLAG(VM)) || (port > IO_MAX - 1)) return false;
+	return io_blockwritehandlers[IO_BlockWidth(iolen)][port]!=0;
+#endif
+}
+
+Bitu IO_ReadBlock(Bitu port,void * data,Bitu count,Bitu iolen) {
+	if (!IO_CanReadBlock(port,iolen)) return 0;
+	Bit64u start=io_profile.ports ? TIMER_GetTicksUs() : 0;
+	Bitu done=io_blockreadhandlers[IO_BlockWidth(iolen)][port](port,data,count,iolen);
+	Bits delay=(iolen<4) ? IO_USEC_read_delay(done) : 0;
+	if (GCC_UNLIKELY(io_profile.ports!=0)) {
+		IO_PortProfile & prof=io_profile.ports[port];
+		prof.reads+=(Bit32u)done;
+		prof.delay+=delay;
+		prof.us+=TIMER_GetTicksUs()-start;
+	}
+	return done;
+}
+
+Bitu IO_WriteBlock(Bitu port,void const * data,Bitu count,Bitu iolen) {
+	if (!IO_CanWriteBlock(port,iolen)) return 0;
+	Bit64u start=io_profile.ports ? TIMER_GetTicksUs() : 0;
+	Bitu done=io_blockwritehandlers[IO_BlockWidth(iolen)][port](port,data,count,iolen);
+	Bits delay=(iolen<4) ? IO_USEC_write_delay(done) : 0;
+	if (GCC_UNLIKELY(io_profile.ports!=0)) {
+		IO_PortProfile & prof=io_profile.ports[port];
+		prof.writes+=(Bit32u)done;
+		prof.delay+=delay;
+		prof.us+=TIMER_GetTicksUs()-start;
+	}
+	return done;
+}
+
 class IO :public Module_base {
 public:
 	IO(Section* configuration):Module_base(configuration){
 	iof_queue.used=0;
 	IO_FreeReadHandler(0,IO_MA,IO_MAX);
 	IO_FreeWriteHandler(0,IO_MA,IO_MAX);
+	Section_prop * section=static_cast<Section_prop *>(configuration);
+	io_profile.ports=0;
+	io_profile.faults=0;
+	if (section->Get_bool("ioprofile")) {
+		io_profile.ports=(IO_PortProfile *)calloc(IO_MAX,sizeof(IO_PortProfile));
+		if (!io_profile.ports) E_Exit("IO:Can't allocate the port statistics");
+		io_profile.start=TIMER_GetTicksUs();
+		MAPPER_AddHandler(IO_ProfileEvent,MK_f4,MMOD1|MMOD2,"ioprofile","IO Profile");
+	}
 	}
 	~IO()
 	{
-		//Same as the constructor ?
+		IO_ProfileDump();
+		free(io_profile.ports);
+		io_profile.ports=0;
 	}
 };
 
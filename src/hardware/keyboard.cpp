@@ -21,6 +21,7 @@
 #include "keyboard.h"
 #include "inout.h"
 #include "pic.h"
+#include "cpu.h"
 #include "mem.h"
 #include "mixer.h"
 #include "timer.h"
@@ -96,6 +97,7 @@ static void KEYBOARD_AddBuffer(Bit8u data) {
 
 
 static Bitu read_p60(Bitu /*port*/,Bitu /*iolen*/) {
+	if (!keyb.p60changed) CPU_IdlePoll();
 	keyb.p60changed = false;
 	if (!keyb.scheduled && keyb.used) {
 		keyb.scheduled = true;
@@ -222,6 +224,7 @@ static void write_p64(Bitu /*port*/,Bitu val,Bitu /*iolen*/) {
 
 static Bitu read_p64(Bitu /*port*/,Bitu /*iolen*/) {
 	Bit8u status = 0x1c | (keyb.p60changed ? 0x1 : 0x0);
+	if (!keyb.p60changed) CPU_IdlePoll();
 	return status;
 }
 
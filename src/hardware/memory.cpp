@@ -23,6 +23,7 @@
 #include "setup.h"
 #include "paging.h"
 #include "regs.h"
+#include "snapshot.h"
 
 #include <string.h>
 
@@ -54,9 +55,11 @@ static struct MemoryBlock {
 		bool enabled;
 		Bit8u controlport;
 	} a20;
+	HostPt snapshot;			//Contents of the ram at the last snapshot
 } memory;
 
 HostPt MemBase;
+Bit8u * MemDirty;
 
 class IllegalPageHandler : public PageHandler {
 public:
@@ -119,9 +122,38 @@ public:
 
 
 
+/* Installed on ram pages after a snapshot, the first write to the page marks
+   it dirty and puts the normal ram handler back in place */
+class DirtyPageHandler : public RAMPageHandler {
+public:
+	DirtyPageHandler() {
+		flags=PFLAG_READABLE;
+	}
+	void writeb(PhysPt addr,Bitu val) {
+		host_writeb(MarkDirty(addr),val);
+	}
+	void writew(PhysPt addr,Bitu val) {
+		host_writew(MarkDirty(addr),val);
+	}
+	void writed(PhysPt addr,Bitu val) {
+		host_writed(MarkDirty(addr),val);
+	}
+private:
+	HostPt MarkDirty(PhysPt addr);
+};
+
 static IllegalPageHandler illegal_page_handler;
 static RAMPageHandler ram_page_handler;
 static ROMPageHandler rom_page_handler;
+static DirtyPageHandler dirty_page_handler;
+
+HostPt DirtyPageHandler::MarkDirty(PhysPt addr) {
+	Bitu phys_page=PAGING_GetPhysicalPage(addr)>>12;
+	MemDirty[phys_page]=1;
+	if (memory.phandlers[phys_page]==&dirty_page_handler) memory.phandlers[phys_page]=&ram_page_handler;
+	PAGING_UnlinkPages(addr>>12,1);
+	return MemBase+phys_page*MEM_PAGESIZE+(addr&(MEM_PAGESIZE-1));
+}
 
 void MEM_SetLFB(Bitu page, Bitu pages, PageHandler *handler, PageHandler *mmiohandler) {
 	memory.lfb.handler=handler;
@@ -147,6 +179,7 @@ PageHandler * MEM_GetPageHandler(Bitu phys_page) {
 void MEM_SetPageHandler(Bitu phys_page,Bitu pages,PageHandler * handler) {
 	for (;pages>0;pages--) {
 		memory.phandlers[phys_page]=handler;
+		MemDirty[phys_page]=1;
 		phys_page++;
 	}
 }
@@ -154,6 +187,7 @@ void MEM_SetPageHandler(Bitu phys_page,Bitu pages,PageHandler * handler) {
 void MEM_ResetPageHandler(Bitu phys_page, Bitu pages) {
 	for (;pages>0;pages--) {
 		memory.phandlers[phys_page]=&ram_page_handler;
+		MemDirty[phys_page]=1;
 		phys_page++;
 	}
 }
@@ -173,21 +207,60 @@ void mem_strcpy(PhysPt dest,PhysPt src) {
 	mem_writeb_inline(dest,0);
 }
 
+/* Bulk transfers are split at page boundaries. Pages that are mapped to host
+   memory for the access type are copied directly, everything else (mmio,
+   vga, pages holding translated code) goes through the handlers per byte. */
+static INLINE Bitu mem_pagechunk(PhysPt pt,Bitu size) {
+	Bitu chunk=MEM_PAGESIZE-(pt&(MEM_PAGESIZE-1));
+	return (chunk<size) ? chunk : size;
+}
+
 void mem_memcpy(PhysPt dest,PhysPt src,Bitu size) {
-	while (size--) mem_writeb_inline(dest++,mem_readb_inline(src++));
+	while (size) {
+		Bitu chunk=mem_pagechunk(src,mem_pagechunk(dest,size));
+		HostPt tlb_read=get_tlb_read(src);
+		HostPt tlb_write=get_tlb_write(dest);
+		if (tlb_read && tlb_write) {
+			HostPt from=tlb_read+src;HostPt to=tlb_write+dest;
+			/* Overlapping ranges keep the bytewise forward copy semantics */
+			if (to+chunk<=from || from+chunk<=to) {
+				memcpy(to,from,chunk);
+				dest+=chunk;src+=chunk;size-=chunk;
+				continue;
+			}
+		}
+		size-=chunk;
+		while (chunk--) mem_writeb_inline(dest++,mem_readb_inline(src++));
+	}
 }
 
 void MEM_BlockRead(PhysPt pt,void * data,Bitu size) {
 	Bit8u * write=reinterpret_cast<Bit8u *>(data);
-	while (size--) {
-		*write++=mem_readb_inline(pt++);
+	while (size) {
+		Bitu chunk=mem_pagechunk(pt,size);
+		HostPt tlb_addr=get_tlb_read(pt);
+		if (tlb_addr) {
+			memcpy(write,tlb_addr+pt,chunk);
+			write+=chunk;pt+=chunk;
+		} else {
+			for (Bitu i=chunk;i>0;i--) *write++=mem_readb_inline(pt++);
+		}
+		size-=chunk;
 	}
 }
 
 void MEM_BlockWrite(PhysPt pt,void const * const data,Bitu size) {
 	Bit8u const * read = reinterpret_cast<Bit8u const * const>(data);
-	while (size--) {
-		mem_writeb_inline(pt++,*read++);
+	while (size) {
+		Bitu chunk=mem_pagechunk(pt,size);
+		HostPt tlb_addr=get_tlb_write(pt);
+		if (tlb_addr) {
+			memcpy(tlb_addr+pt,read,chunk);
+			read+=chunk;pt+=chunk;
+		} else {
+			for (Bitu i=chunk;i>0;i--) mem_writeb_inline(pt++,*read++);
+		}
+		size-=chunk;
 	}
 }
 
@@ -537,6 +610,105 @@ void PreparePCJRCartRom(void) {
 
 HostPt GetMemBase(void) { return MemBase; }
 
+/* Pages that can change without passing the dirty page handler, these are
+   copied on every snapshot. Tandy video memory is written through a
+   separate mapping of the low memory. */
+static INLINE bool MEM_UntrackedPage(Bitu page) {
+	PageHandler * handler=memory.phandlers[page];
+	if ((handler!=&ram_page_handler) && (handler!=&dirty_page_handler)) return true;
+	return IS_TANDY_ARCH && (page<0x100);
+}
+
+/* Write a saved page back, code pages are written through their handler so
+   modified translations are dropped */
+static void MEM_RestorePage(Bitu page,HostPt src) {
+	HostPt dest=&MemBase[page*MEM_PAGESIZE];
+	for (Bitu ofs=0;ofs<MEM_PAGESIZE;ofs+=4) {
+		PageHandler * handler=memory.phandlers[page];
+		if (!(handler->flags & (PFLAG_HASCODE|PFLAG_PREDECODE))) break;
+		Bit32u val=host_readd(src+ofs);
+		if (host_readd(dest+ofs)!=val) handler->writed(page*MEM_PAGESIZE+ofs,val);
+	}
+	memcpy(dest,src,MEM_PAGESIZE);
+}
+
+static bool MEM_PageEmpty(Bitu page) {
+	HostPt src=&MemBase[page*MEM_PAGESIZE];
+	for (Bitu ofs=0;ofs<MEM_PAGESIZE;ofs+=4)
+		if (host_readd(src+ofs)) return false;
+	return true;
+}
+
+/* Image files hold all the pages, the empty ones only as a marker */
+static void MEM_SnapshotSaveFile(SnapshotStream & stream) {
+	stream.Write(&memory.pages,sizeof(memory.pages));
+	for (Bitu i=0;i<memory.pages;i++) {
+		Bit8u used=MEM_PageEmpty(i) ? 0 : 1;
+		stream.Write(&used,1);
+		if (used) stream.Write(&MemBase[i*MEM_PAGESIZE],MEM_PAGESIZE);
+	}
+}
+
+static void MEM_SnapshotLoadFile(SnapshotStream & stream) {
+	Bitu pages;
+	stream.Read(&pages,sizeof(pages));
+	if (pages!=memory.pages) E_Exit("SNAPSHOT:Image was made with a different memory size");
+	Bit8u page[MEM_PAGESIZE];
+	for (Bitu i=0;i<memory.pages;i++) {
+		Bit8u used;
+		stream.Read(&used,1);
+		if (used) stream.Read(page,MEM_PAGESIZE);
+		else memset(page,0,MEM_PAGESIZE);
+		MEM_RestorePage(i,page);
+		/* Not the same as the snapshot in memory anymore */
+		MemDirty[i]=1;
+	}
+}
+
+static void MEM_SnapshotSave(SnapshotStream & stream) {
+	if (SNAPSHOT_InFile()) {
+		MEM_SnapshotSaveFile(stream);
+	} else {
+		if (!memory.snapshot) {
+			memory.snapshot=new(std::nothrow) Bit8u[memory.pages*MEM_PAGESIZE];
+			if (!memory.snapshot) {
+				stream.Fail();
+				return;
+			}
+			memset(MemDirty,1,memory.pages);
+		}
+		for (Bitu i=0;i<memory.pages;i++) {
+			if (MemDirty[i] || MEM_UntrackedPage(i)) {
+				memcpy(&memory.snapshot[i*MEM_PAGESIZE],&MemBase[i*MEM_PAGESIZE],MEM_PAGESIZE);
+				MemDirty[i]=0;
+			}
+			if (memory.phandlers[i]==&ram_page_handler) memory.phandlers[i]=&dirty_page_handler;
+		}
+		/* Drop the direct write access to the pages that are tracked now */
+		PAGING_ClearTLB();
+	}
+	stream.Write(memory.mhandles,memory.pages*sizeof(MemHandle));
+	stream.Write(&memory.a20,sizeof(memory.a20));
+}
+
+static void MEM_SnapshotLoad(SnapshotStream & stream) {
+	if (SNAPSHOT_InFile()) {
+		MEM_SnapshotLoadFile(stream);
+	} else {
+		for (Bitu i=0;i<memory.pages;i++) {
+			if (!MemDirty[i] && !MEM_UntrackedPage(i)) continue;
+			MEM_RestorePage(i,&memory.snapshot[i*MEM_PAGESIZE]);
+			MemDirty[i]=0;
+			if (memory.phandlers[i]==&ram_page_handler) memory.phandlers[i]=&dirty_page_handler;
+		}
+	}
+	stream.Read(memory.mhandles,memory.pages*sizeof(MemHandle));
+	bool a20=memory.a20.enabled;
+	stream.Read(&memory.a20,sizeof(memory.a20));
+	if (a20!=memory.a20.enabled) MEM_A20_Enable(memory.a20.enabled);
+	PAGING_ClearTLB();
+}
+
 class MEMORY:public Module_base{
 private:
 	IO_ReadHandleObject ReadHandler;
@@ -568,6 +740,9 @@ public:
 		/* Allocate the data for the different page information blocks */
 		memory.phandlers=new  PageHandler * [memory.pages];
 		memory.mhandles=new MemHandle [memory.pages];
+		MemDirty=new Bit8u [memory.pages];
+		memset(MemDirty,1,memory.pages);
+		memory.snapshot=0;
 		for (i = 0;i < memory.pages;i++) {
 			memory.phandlers[i] = &ram_page_handler;
 			memory.mhandles[i] = 0;				//Set to 0 for memory allocation
@@ -592,11 +767,15 @@ public:
 		WriteHandler.Install(0x92,write_p92,IO_MB);
 		ReadHandler.Install(0x92,read_p92,IO_MB);
 		MEM_A20_Enable(false);
+		SNAPSHOT_AddHandler("memory",MEM_SnapshotSave,MEM_SnapshotLoad,SNAPSHOT_PERSISTENT);
 	}
 	~MEMORY(){
+		SNAPSHOT_Remove("memory");
 		delete [] MemBase;
 		delete [] memory.phandlers;
 		delete [] memory.mhandles;
+		delete [] MemDirty;
+		delete [] memory.snapshot;
 	}
 };	
 
@@ -104,10 +104,16 @@ static struct {
 	float mastervol[2];
 	MixerChannel * channels;
 	bool nosound;
+	bool discard;			//Headless, channels don't produce samples at all
 	Bit32u freq;
 	Bit32u blocksize;
 } mixer;
 
+/* Captures still need the real samples */
+static INLINE bool MIXER_Discard(void) {
+	return mixer.discard && !(CaptureState & (CAPTURE_WAVE|CAPTURE_VIDEO));
+}
+
 #ifndef _EE
 Bit8u MixTemp[MIXER_BUFSIZE];
 #endif
@@ -248,6 +254,23 @@ template<class Type,bool stereo,bool signeddata,bool nativeorder>
 inline void MixerChannel::AddSamples(Bitu len, const Type* data) {
 	last_samples_were_stereo = stereo;
 
+	if (GCC_UNLIKELY(MIXER_Discard())) {
+		/* Only advance the counters like the resampling below would */
+		Bitu pos = 0;
+		while (1) {
+			while (freq_counter >= FREQ_NEXT) {
+				if (pos >= len) {
+					last_samples_were_silence = false;
+					return;
+				}
+				freq_counter -= FREQ_NEXT;
+				pos++;
+			}
+			freq_counter += freq_add;
+			done++;
+		}
+	}
+
 	//Position where to write the data
 	Bitu mixpos = mixer.pos + done;
 	//Position in the incoming data
@@ -390,6 +413,10 @@ void MixerChannel::AddStretched(Bitu len,Bit16s * data) {
 		LOG_MSG("Can't add, buffer full");
 		return;
 	}
+	if (GCC_UNLIKELY(MIXER_Discard())) {
+		done = needed;
+		return;
+	}
 	//Target samples this inputs gets stretched into
 	Bitu outlen = needed - done;
 	Bitu index = 0;
@@ -791,6 +818,9 @@ void MIXER_Init(Section* sec) {
 	mixer.freq=section->Get_int("rate");
 	mixer.nosound=section->Get_bool("nosound");
 	mixer.blocksize=section->Get_int("blocksize");
+	/* Headless mode only mixes to keep the devices going and never opens the audio device */
+	mixer.discard=headless;
+	if (headless) mixer.nosound=true;
 
 	/* Initialize the internal stuff */
 	mixer.channels=0;
@@ -806,6 +836,12 @@ void MIXER_Init(Section* sec) {
 	ee_sema_t sema;
 	int ret;
 	
+	if (mixer.discard) {
+		mixer.tick_add=calc_tickadd(mixer.freq);
+		TIMER_AddTickHandler(MIXER_Mix_NoSound);
+		goto setup_done;
+	}
+
 	ret = audsrv_init();
 	if (ret != 0) {
 		printf("Audsrv returned error: %s\n", audsrv_get_error_string());
@@ -855,6 +891,7 @@ void MIXER_Init(Section* sec) {
 		}
 #endif
 	}
+setup_done:
 #else
 	/* Start the Mixer using SDL Sound at 22 khz */
 	SDL_AudioSpec spec;
@@ -16,6 +16,7 @@
  *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
  */
 
+#include <stdlib.h>
 #include "dosbox.h"
 #include "inout.h"
 #include "cpu.h"
@@ -23,8 +24,10 @@
 #include "pic.h"
 #include "timer.h"
 #include "setup.h"
+#include "snapshot.h"
 
-#define PIC_QUEUESIZE 512
+#define PIC_QUEUESIZE 512			//Initial amount of entries, grows when needed
+#define PIC_NOENTRY (~(Bitu)0)
 
 struct PIC_Controller {
 	Bitu icw_words;
@@ -168,13 +171,20 @@ struct PICEntry {
 	float index;
 	Bitu value;
 	PIC_EventHandler pic_event;
-	PICEntry * next;
+	Bit32u serial;				//Insertion order, keeps events with equal index in order
+	Bitu heap_pos;				//Position in the heap or PIC_NOENTRY when free
+	Bitu next_free;
 };
 
+/* The events are kept in a binary min-heap of entry numbers ordered on index
+   and serial, the entries themselves stay in place so handles remain valid */
 static struct {
-	PICEntry entries[PIC_QUEUESIZE];
-	PICEntry * free_entry;
-	PICEntry * next_entry;
+	PICEntry * entries;
+	Bitu * heap;
+	Bitu used;
+	Bitu size;
+	Bitu free_entry;
+	Bit32u serial;
 } pic_queue;
 
 static void write_command(Bitu port,Bitu val,Bitu /*iolen*/) {
@@ -370,31 +380,85 @@ void PIC_SetIRQMask(Bitu irq, bool masked) {
 	pic->set_imr(newmask);
 }
 
-static void AddEntry(PICEntry * entry) {
-	PICEntry * find_entry=pic_queue.next_entry;
-	if (GCC_UNLIKELY(find_entry ==0)) {
-		entry->next=0;
-		pic_queue.next_entry=entry;
-	} else if (find_entry->index>entry->index) {
-		pic_queue.next_entry=entry;
-		entry->next=find_entry;
-	} else while (find_entry) {
-		if (find_entry->next) {
-			/* See if the next index comes later than this one */
-			if (find_entry->next->index > entry->index) {
-				entry->next=find_entry->next;
-				find_entry->next=entry;
-				break;
-			} else {
-				find_entry=find_entry->next;
-			}
-		} else {
-			entry->next=find_entry->next;
-			find_entry->next=entry;
-			break;
-		}
+static INLINE bool EventBefore(PICEntry const * a,PICEntry const * b) {
+	if (a->index!=b->index) return a->index<b->index;
+	return (Bit32s)(a->serial-b->serial)<0;
+}
+
+static INLINE void HeapSet(Bitu pos,Bitu num) {
+	pic_queue.heap[pos]=num;
+	pic_queue.entries[num].heap_pos=pos;
+}
+
+static void HeapUp(Bitu pos) {
+	Bitu num=pic_queue.heap[pos];
+	PICEntry * entry=&pic_queue.entries[num];
+	while (pos) {
+		Bitu parent=(pos-1)/2;
+		if (!EventBefore(entry,&pic_queue.entries[pic_queue.heap[parent]])) break;
+		HeapSet(pos,pic_queue.heap[parent]);
+		pos=parent;
+	}
+	HeapSet(pos,num);
+}
+
+static void HeapDown(Bitu pos) {
+	Bitu num=pic_queue.heap[pos];
+	PICEntry * entry=&pic_queue.entries[num];
+	for (;;) {
+		Bitu child=pos*2+1;
+		if (child>=pic_queue.used) break;
+		if ((child+1<pic_queue.used) && EventBefore(&pic_queue.entries[pic_queue.heap[child+1]],&pic_queue.entries[pic_queue.heap[child]])) child++;
+		if (!EventBefore(&pic_queue.entries[pic_queue.heap[child]],entry)) break;
+		HeapSet(pos,pic_queue.heap[child]);
+		pos=child;
+	}
+	HeapSet(pos,num);
+}
+
+static void FreeEntry(Bitu num) {
+	pic_queue.entries[num].heap_pos=PIC_NOENTRY;
+	pic_queue.entries[num].next_free=pic_queue.free_entry;
+	pic_queue.free_entry=num;
+}
+
+static void GrowQueue(void) {
+	Bitu size=pic_queue.size ? pic_queue.size*2 : PIC_QUEUESIZE;
+	PICEntry * entries=(PICEntry *)realloc(pic_queue.entries,size*sizeof(PICEntry));
+	Bitu * heap=(Bitu *)realloc(pic_queue.heap,size*sizeof(Bitu));
+	if (!entries || !heap) E_Exit("PIC:Can't allocate event queue");
+	pic_queue.entries=entries;
+	pic_queue.heap=heap;
+	for (Bitu i=size;i>pic_queue.size;i--) FreeEntry(i-1);
+	pic_queue.size=size;
+}
+
+static void RemoveEntry(Bitu pos) {
+	FreeEntry(pic_queue.heap[pos]);
+	if (pos==--pic_queue.used) return;
+	HeapSet(pos,pic_queue.heap[pic_queue.used]);
+	if (pos && EventBefore(&pic_queue.entries[pic_queue.heap[pos]],&pic_queue.entries[pic_queue.heap[(pos-1)/2]])) HeapUp(pos);
+	else HeapDown(pos);
+}
+
+/* Drop all entries matching a handler (and value) and restore the heap */
+static void RemoveMatching(PIC_EventHandler handler,bool match_value,Bitu val) {
+	Bitu keep=0;
+	for (Bitu i=0;i<pic_queue.used;i++) {
+		Bitu num=pic_queue.heap[i];
+		PICEntry * entry=&pic_queue.entries[num];
+		if (GCC_UNLIKELY(entry->pic_event==handler) && (!match_value || (entry->value==val))) FreeEntry(num);
+		else HeapSet(keep++,num);
 	}
-	Bits cycles=PIC_MakeCycles(pic_queue.next_entry->index-PIC_TickIndex());
+	if (keep==pic_queue.used) return;
+	pic_queue.used=keep;
+	for (Bitu i=keep/2;i>0;i--) HeapDown(i-1);
+}
+
+static void AddEntry(Bitu num) {
+	pic_queue.heap[pic_queue.used]=num;
+	HeapUp(pic_queue.used++);
+	Bits cycles=PIC_MakeCycles(pic_queue.entries[pic_queue.heap[0]].index-PIC_TickIndex());
 	if (cycles<CPU_Cycles) {
 		CPU_CycleLeft+=CPU_Cycles;
 		CPU_Cycles=0;
@@ -403,69 +467,36 @@ static void AddEntry(PICEntry * entry) {
 static bool InEventService = false;
 static float srv_lag = 0;
 
-void PIC_AddEvent(PIC_EventHandler handler,float delay,Bitu val) {
-	if (GCC_UNLIKELY(!pic_queue.free_entry)) {
-		LOG(LOG_PIC,LOG_ERROR)("Event queue full");
-		return;
-	}
-	PICEntry * entry=pic_queue.free_entry;
+PIC_EventHandle PIC_AddEvent(PIC_EventHandler handler,float delay,Bitu val) {
+	if (GCC_UNLIKELY(pic_queue.free_entry==PIC_NOENTRY)) GrowQueue();
+	Bitu num=pic_queue.free_entry;
+	PICEntry * entry=&pic_queue.entries[num];
+	pic_queue.free_entry=entry->next_free;
 	if(InEventService) entry->index = delay + srv_lag;
 	else entry->index = delay + PIC_TickIndex();
 
 	entry->pic_event=handler;
 	entry->value=val;
-	pic_queue.free_entry=pic_queue.free_entry->next;
-	AddEntry(entry);
+	if (GCC_UNLIKELY(!++pic_queue.serial)) pic_queue.serial=1;
+	entry->serial=pic_queue.serial;
+	AddEntry(num);
+	return ((PIC_EventHandle)entry->serial << 32) | num;
+}
+
+void PIC_RemoveEvent(PIC_EventHandle handle) {
+	Bitu num=(Bitu)(handle & 0xffffffff);
+	if (num>=pic_queue.size) return;
+	PICEntry * entry=&pic_queue.entries[num];
+	if ((entry->heap_pos==PIC_NOENTRY) || (entry->serial!=(Bit32u)(handle >> 32))) return;
+	RemoveEntry(entry->heap_pos);
 }
 
 void PIC_RemoveSpecificEvents(PIC_EventHandler handler, Bitu val) {
-	PICEntry * entry=pic_queue.next_entry;
-	PICEntry * prev_entry;
-	prev_entry = 0;
-	while (entry) {
-		if (GCC_UNLIKELY((entry->pic_event == handler)) && (entry->value == val)) {
-			if (prev_entry) {
-				prev_entry->next=entry->next;
-				entry->next=pic_queue.free_entry;
-				pic_queue.free_entry=entry;
-				entry=prev_entry->next;
-				continue;
-			} else {
-				pic_queue.next_entry=entry->next;
-				entry->next=pic_queue.free_entry;
-				pic_queue.free_entry=entry;
-				entry=pic_queue.next_entry;
-				continue;
-			}
-		}
-		prev_entry=entry;
-		entry=entry->next;
-	}
+	RemoveMatching(handler,true,val);
 }
 
 void PIC_RemoveEvents(PIC_EventHandler handler) {
-	PICEntry * entry=pic_queue.next_entry;
-	PICEntry * prev_entry;
-	prev_entry=0;
-	while (entry) {
-		if (GCC_UNLIKELY(entry->pic_event==handler)) {
-			if (prev_entry) {
-				prev_entry->next=entry->next;
-				entry->next=pic_queue.free_entry;
-				pic_queue.free_entry=entry;
-				entry=prev_entry->next;
-				continue;
-			} else {
-				pic_queue.next_entry=entry->next;
-				entry->next=pic_queue.free_entry;
-				pic_queue.free_entry=entry;
-				entry=pic_queue.next_entry;
-				continue;
-			}
-		}
-		prev_entry=entry;
-		entry=entry->next;
-	}
+	RemoveMatching(handler,false,0);
 }
 
 
@@ -479,22 +510,19 @@ bool PIC_RunQueue(void) {
 	/* Check the queue for an entry */
 	Bits index_nd=PIC_TickIndexND();
 	InEventService = true;
-	while (pic_queue.next_entry && (pic_queue.next_entry->index*CPU_CycleMax<=index_nd)) {
-		PICEntry * entry=pic_queue.next_entry;
-		pic_queue.next_entry=entry->next;
+	while (pic_queue.used && (pic_queue.entries[pic_queue.heap[0]].index*CPU_CycleMax<=index_nd)) {
+		/* The handler can add events and grow the queue, so take a copy first */
+		PICEntry entry=pic_queue.entries[pic_queue.heap[0]];
+		RemoveEntry(0);
 
-		srv_lag = entry->index;
-		(entry->pic_event)(entry->value); // call the event handler
-
-		/* Put the entry in the free list */
-		entry->next=pic_queue.free_entry;
-		pic_queue.free_entry=entry;
+		srv_lag = entry.index;
+		(entry.pic_event)(entry.value); // call the event handler
 	}
 	InEventService = false;
 
 	/* Check when to set the new cycle end */
-	if (pic_queue.next_entry) {
-		Bits cycles=(Bits)(pic_queue.next_entry->index*CPU_CycleMax-index_nd);
+	if (pic_queue.used) {
+		Bits cycles=(Bits)(pic_queue.entries[pic_queue.heap[0]].index*CPU_CycleMax-index_nd);
 		if (GCC_UNLIKELY(!cycles)) cycles=1;
 		if (cycles<CPU_CycleLeft) {
 			CPU_Cycles=cycles;
@@ -543,10 +571,8 @@ void TIMER_AddTick(void) {
 	CPU_Cycles=0;
 	PIC_Ticks++;
 	/* Go through the list of scheduled events and lower their index with 1000 */
-	PICEntry * entry=pic_queue.next_entry;
-	while (entry) {
-		entry->index -= 1.0;
-		entry=entry->next;
+	for (Bitu i=0;i<pic_queue.used;i++) {
+		pic_queue.entries[pic_queue.heap[i]].index -= 1.0;
 	}
 	/* Call our list of ticker handlers */
 	TickerBlock * ticker=firstticker;
@@ -557,6 +583,42 @@ void TIMER_AddTick(void) {
 	}
 }
 
+/* The event entries hold handler addresses, so they are only valid in the
+   same session of the emulator */
+static void PIC_SnapshotSave(SnapshotStream & stream) {
+	stream.Write(pics,sizeof(pics));
+	stream.Write(&PIC_IRQCheck,sizeof(PIC_IRQCheck));
+	stream.Write(&PIC_Ticks,sizeof(PIC_Ticks));
+	stream.Write(&pic_queue.used,sizeof(pic_queue.used));
+	stream.Write(&pic_queue.size,sizeof(pic_queue.size));
+	stream.Write(&pic_queue.free_entry,sizeof(pic_queue.free_entry));
+	stream.Write(&pic_queue.serial,sizeof(pic_queue.serial));
+	stream.Write(pic_queue.entries,pic_queue.size*sizeof(PICEntry));
+	stream.Write(pic_queue.heap,pic_queue.used*sizeof(Bitu));
+}
+
+static void PIC_SnapshotLoad(SnapshotStream & stream) {
+	stream.Read(pics,sizeof(pics));
+	stream.Read(&PIC_IRQCheck,sizeof(PIC_IRQCheck));
+	stream.Read(&PIC_Ticks,sizeof(PIC_Ticks));
+	Bitu size;
+	stream.Read(&pic_queue.used,sizeof(pic_queue.used));
+	stream.Read(&size,sizeof(size));
+	stream.Read(&pic_queue.free_entry,sizeof(pic_queue.free_entry));
+	stream.Read(&pic_queue.serial,sizeof(pic_queue.serial));
+	if (size>pic_queue.size) {
+		PICEntry * entries=(PICEntry *)realloc(pic_queue.entries,size*sizeof(PICEntry));
+		Bitu * heap=(Bitu *)realloc(pic_queue.heap,size*sizeof(Bitu));
+		if (!entries || !heap) E_Exit("PIC:Can't allocate event queue");
+		pic_queue.entries=entries;
+		pic_queue.heap=heap;
+	}
+	/* A larger queue just keeps its tail unused until it grows again */
+	pic_queue.size=size;
+	stream.Read(pic_queue.entries,pic_queue.size*sizeof(PICEntry));
+	stream.Read(pic_queue.heap,pic_queue.used*sizeof(Bitu));
+}
+
 /* Use full name to avoid name clash with compile option for position-independent code */
 class PIC_8259A: public Module_base {
 private:
@@ -601,15 +663,24 @@ public:
 		WriteHandler[2].Install(0xa0,write_command,IO_MB);
 		WriteHandler[3].Install(0xa1,write_data,IO_MB);
 		/* Initialize the pic queue */
-		for (i=0;i<PIC_QUEUESIZE-1;i++) {
-			pic_queue.entries[i].next=&pic_queue.entries[i+1];
-		}
-		pic_queue.entries[PIC_QUEUESIZE-1].next=0;
-		pic_queue.free_entry=&pic_queue.entries[0];
-		pic_queue.next_entry=0;
+		pic_queue.entries=0;
+		pic_queue.heap=0;
+		pic_queue.used=0;
+		pic_queue.size=0;
+		pic_queue.free_entry=PIC_NOENTRY;
+		pic_queue.serial=0;
+		GrowQueue();
+		SNAPSHOT_AddHandler("pic",PIC_SnapshotSave,PIC_SnapshotLoad);
 	}
 
 	~PIC_8259A(){
+		SNAPSHOT_Remove("pic");
+		free(pic_queue.entries);
+		free(pic_queue.heap);
+		pic_queue.entries=0;
+		pic_queue.heap=0;
+		pic_queue.used=pic_queue.size=0;
+		pic_queue.free_entry=PIC_NOENTRY;
 	}
 };
 
@@ -30,6 +30,7 @@
 #include "setup.h"
 #include "support.h"
 #include "shell.h"
+#include "snapshot.h"
 using namespace std;
 
 void MIDI_RawOutByte(Bit8u data);
@@ -1600,6 +1601,22 @@ static void SBLASTER_CallBack(Bitu len) {
 	}
 }
 
+static void SBLASTER_SnapshotSave(SnapshotStream & stream) {
+	stream.Write(&sb,sizeof(sb));
+	stream.Write(ASP_regs,sizeof(ASP_regs));
+	stream.Write(&ASP_init_in_progress,sizeof(ASP_init_in_progress));
+	stream.Write(&last_dma_callback,sizeof(last_dma_callback));
+}
+
+static void SBLASTER_SnapshotLoad(SnapshotStream & stream) {
+	stream.Read(&sb,sizeof(sb));
+	stream.Read(ASP_regs,sizeof(ASP_regs));
+	stream.Read(&ASP_init_in_progress,sizeof(ASP_init_in_progress));
+	stream.Read(&last_dma_callback,sizeof(last_dma_callback));
+	if (sb.type == SBT_16) sb.chan->Enable(true);
+	else sb.chan->Enable(sb.speaker);
+}
+
 class SBLASTER: public Module_base {
 private:
 	/* Data */
@@ -1732,9 +1749,11 @@ public:
 		/* Soundblaster midi interface */
 		if (!MIDI_Available()) sb.midi = false;
 		else sb.midi = true;
+		SNAPSHOT_AddHandler("sblaster",SBLASTER_SnapshotSave,SBLASTER_SnapshotLoad);
 	}
 
 	~SBLASTER() {
+		SNAPSHOT_Remove("sblaster");
 		switch (oplmode) {
 		case OPL_none:
 			break;
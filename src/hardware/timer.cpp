@@ -18,6 +18,13 @@
 
 
 #include <math.h>
+#include <time.h>
+#include <errno.h>
+#if defined (WIN32)
+#include <windows.h>
+#elif defined (_EE)
+#include <unistd.h>
+#endif
 #include "dosbox.h"
 #include "inout.h"
 #include "pic.h"
@@ -25,6 +32,7 @@
 #include "mixer.h"
 #include "timer.h"
 #include "setup.h"
+#include "snapshot.h"
 
 
 static INLINE void BIN2BCD(Bit16u& val) {
@@ -458,8 +466,16 @@ public:
 		latched_timerstatus_locked=false;
 		gate2 = false;
 		PIC_AddEvent(PIT0_Event,pit[0].delay);
+		SNAPSHOT_AddRegion("pit",pit,sizeof(pit));
+		SNAPSHOT_AddRegion("pit.gate2",&gate2,sizeof(gate2));
+		SNAPSHOT_AddRegion("pit.status",&latched_timerstatus,sizeof(latched_timerstatus));
+		SNAPSHOT_AddRegion("pit.statuslock",&latched_timerstatus_locked,sizeof(latched_timerstatus_locked));
 	}
 	~TIMER(){
+		SNAPSHOT_Remove("pit");
+		SNAPSHOT_Remove("pit.gate2");
+		SNAPSHOT_Remove("pit.status");
+		SNAPSHOT_Remove("pit.statuslock");
 		PIC_RemoveEvents(PIT0_Event);
 	}
 };
@@ -472,3 +488,40 @@ void TIMER_Init(Section* sec) {
 	test = new TIMER(sec);
 	sec->AddDestroyFunction(&TIMER_Destroy);
 }
+
+Bit64u TIMER_GetTicksUs(void) {
+#if defined (_EE)
+	return (Bit64u)clock()*1000000/CLOCKS_PER_SEC;
+#elif defined (WIN32)
+	static LARGE_INTEGER freq;
+	LARGE_INTEGER count;
+	if (!freq.QuadPart) QueryPerformanceFrequency(&freq);
+	QueryPerformanceCounter(&count);
+	return (Bit64u)(count.QuadPart/freq.QuadPart)*1000000+
+		(Bit64u)(count.QuadPart%freq.QuadPart)*1000000/freq.QuadPart;
+#elif defined (CLOCK_MONOTONIC)
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (Bit64u)ts.tv_sec*1000000+ts.tv_nsec/1000;
+#else
+	return (Bit64u)GetTicks()*1000;
+#endif
+}
+
+void TIMER_SleepUntilUs(Bit64u deadline) {
+#if defined (CLOCK_MONOTONIC) && defined (TIMER_ABSTIME) && !defined (_EE) && !defined (WIN32) && !defined (MACOSX)
+	struct timespec ts;
+	ts.tv_sec=(time_t)(deadline/1000000);
+	ts.tv_nsec=(long)(deadline%1000000)*1000;
+	while (clock_nanosleep(CLOCK_MONOTONIC,TIMER_ABSTIME,&ts,0)==EINTR) {}
+#else
+	Bit64u now=TIMER_GetTicksUs();
+	if (deadline<=now) return;
+#if defined (_EE)
+	usleep((useconds_t)(deadline-now));
+#else
+	/* Only millisecond sleeps available, round up so the deadline is not missed */
+	SDL_Delay((Bit32u)((deadline-now+999)/1000));
+#endif
+#endif
+}
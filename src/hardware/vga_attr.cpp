@@ -101,6 +101,10 @@ void write_p3c0(Bitu /*port*/,Bitu val,Bitu iolen) {
 	if (!vga.internal.attrindex) {
 		attr(index)=val & 0x1F;
 		vga.internal.attrindex=true;
+#ifdef VGA_KEEP_CHANGES
+		//Lines drawn while the screen was off are blank and have to be drawn again
+		if (((val & 0x20) == 0) != ((attr(disabled) & 1) != 0)) vga.changes.redraw=true;
+#endif
 		if (val & 0x20) attr(disabled) &= ~1;
 		else attr(disabled) |= 1;
 		/* 
@@ -261,6 +261,7 @@ void vga_write_p3d5(Bitu /*port*/,Bitu val,Bitu iolen) {
 		*/
 		break;
 	case 0x13:	/* Offset register */
+		if (val!=crtc(offset)) VGA_RasterChange();
 		crtc(offset)=val;
 		vga.config.scan_len&=0x300;
 		vga.config.scan_len|=val;
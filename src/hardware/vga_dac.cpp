@@ -55,8 +55,14 @@ static void VGA_DAC_SendColor( Bitu index, Bitu src ) {
 	const Bit8u red = vga.dac.rgb[src].red;
 	const Bit8u green = vga.dac.rgb[src].green;
 	const Bit8u blue = vga.dac.rgb[src].blue;
+	//Lines drawn in 16 bit take the colors at the time they're drawn
+	if (vga.draw.bpp!=8) VGA_RasterChange();
 	//Set entry in (little endian) 16bit output lookup table
 	var_write(&vga.dac.xlat16[index], ((blue>>1)&0x1f) | (((green)&0x3f)<<5) | (((red>>1)&0x1f) << 11));
+#ifdef VGA_KEEP_CHANGES
+	//Lines drawn in 16 bit have the colors in them already
+	if (vga.draw.bpp!=8) vga.changes.redraw=true;
+#endif
 	
 	RENDER_SetPal( index, (red << 2) | ( red >> 4 ), (green << 2) | ( green >> 4 ), (blue << 2) | ( blue >> 4 ) );
 }
@@ -173,6 +179,19 @@ static Bitu read_p3c9(Bitu /*port*/,Bitu /*iolen*/) {
 	return ret;
 }
 
+/* Palette uploads and downloads with rep outsb/insb */
+static Bitu write_block_p3c9(Bitu port,void const * data,Bitu count,Bitu iolen) {
+	Bit8u const * read=(Bit8u const *)data;
+	for (Bitu i=0;i<count;i++) write_p3c9(port,read[i],iolen);
+	return count;
+}
+
+static Bitu read_block_p3c9(Bitu port,void * data,Bitu count,Bitu iolen) {
+	Bit8u * write=(Bit8u *)data;
+	for (Bitu i=0;i<count;i++) write[i]=(Bit8u)read_p3c9(port,iolen);
+	return count;
+}
+
 void VGA_DAC_CombineColor(Bit8u attr,Bit8u pal) {
 	/* Check if this is a new color */
 	vga.dac.combine[attr]=pal;
@@ -198,6 +217,13 @@ void VGA_DAC_SetEntry(Bitu entry,Bit8u red,Bit8u green,Bit8u blue) {
 			VGA_DAC_SendColor( i, i );
 }
 
+/* Send all colors to the renderer again, the attribute combinations are
+   applied on top just like the palette writes do */
+void VGA_DACSetEntirePalette(void) {
+	for (Bitu i=0;i<256;i++) VGA_DAC_UpdateColor(i);
+	for (Bit8u i=0;i<16;i++) VGA_DAC_CombineColor(i,vga.dac.combine[i]);
+}
+
 void VGA_SetupDAC(void) {
 	vga.dac.first_changed=256;
 	vga.dac.bits=6;
@@ -216,5 +242,7 @@ void VGA_SetupDAC(void) {
 		IO_RegisterReadHandler(0x3c8,read_p3c8,IO_MB);
 		IO_RegisterWriteHandler(0x3c9,write_p3c9,IO_MB);
 		IO_RegisterReadHandler(0x3c9,read_p3c9,IO_MB);
+		IO_RegisterBlockWriteHandler(0x3c9,write_block_p3c9,IO_MB);
+		IO_RegisterBlockReadHandler(0x3c9,read_block_p3c9,IO_MB);
 	}
 }
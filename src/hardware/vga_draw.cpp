@@ -31,6 +31,8 @@
 //#define LOG(X,Y) LOG_MSG
 
 #define VGA_PARTS 4
+/* Frames drawn in parts after a raster change, before they're drawn in one go again */
+#define VGA_RASTER_FRAMES 70
 
 #ifdef _EE
 static VGA_Line_Handler VGA_DrawLine;
@@ -162,35 +164,38 @@ static Bit8u * VGA_Draw_4BPP_Line_Double(Bitu vidstart, Bitu line) {
 }
 
 #ifdef VGA_KEEP_CHANGES
+/* Line handler of the mode, the changes handler only calls it for lines
+   drawn from memory written since the last frame */
+static VGA_Line_Handler VGA_ChangesDrawLine;
+
+static INLINE bool VGA_ChangesCheck(Bitu vidstart) {
+	Bit8u checkMask = vga.changes.checkMask;
+	const Bit8u *map = vga.changes.map;
+	Bitu start = vidstart & vga.draw.linear_mask;
+	Bitu end = start + vga.changes.span - 1;
+	if (GCC_UNLIKELY(end > vga.draw.linear_mask)) {
+		/* The line wraps around to the start of the memory */
+		Bitu wrapped = (end & vga.draw.linear_mask) >> VGA_CHANGE_SHIFT;
+		for (Bitu i = 0; i <= wrapped; i++)
+			if (map[i] & checkMask) return true;
+		end = vga.draw.linear_mask;
+	}
+	for (start >>= VGA_CHANGE_SHIFT, end >>= VGA_CHANGE_SHIFT; start <= end; start++)
+		if (map[start] & checkMask) return true;
+	return false;
+}
+
 #ifdef _EE
 static Bit8u * VGA_Draw_Changes_Line(Bitu vidstart, Bitu line, Bit8u *TempLine) {
+	if (!VGA_ChangesCheck(vidstart)) return 0;
+	return VGA_ChangesDrawLine(vidstart, line, TempLine);
+}
 #else
 static Bit8u * VGA_Draw_Changes_Line(Bitu vidstart, Bitu line) {
-#endif
-	Bitu checkMask = vga.changes.checkMask;
-	Bit8u *map = vga.changes.map;
-	Bitu start = (vidstart >> VGA_CHANGE_SHIFT);
-	Bitu end = ((vidstart + vga.draw.line_length ) >> VGA_CHANGE_SHIFT);
-	for (; start <= end;start++) {
-		if ( map[start] & checkMask ) {
-			Bitu offset = vidstart & vga.draw.linear_mask;
-			if (vga.draw.linear_mask-offset < vga.draw.line_length)
-				memcpy(vga.draw.linear_base+vga.draw.linear_mask+1, vga.draw.linear_base, vga.draw.line_length);
-			Bit8u *ret = &vga.draw.linear_base[ offset ];
-#if !defined(C_UNALIGNED_MEMORY)
-			if (GCC_UNLIKELY( ((Bitu)ret) & (sizeof(Bitu)-1)) ) {
-				memcpy( TempLine, ret, vga.draw.line_length );
-				return TempLine;
-			}
-#endif
-			return ret;
-		}
-	}
-//	memset( TempLine, 0x30, vga.changes.lineWidth );
-//	return TempLine;
-	return 0;
+	if (!VGA_ChangesCheck(vidstart)) return 0;
+	return VGA_ChangesDrawLine(vidstart, line);
 }
-
+#endif
 #endif
 
 #ifdef _EE
@@ -435,6 +440,29 @@ static const Bit8u* VGA_Text_Memwrap(Bitu vidstart) {
 }
 
 static Bit32u FontMask[2]={0xffffffff,0x0};
+
+/* Pixels of 4 bit font rows expanded to the colors of every attribute, with
+   the blink mask already applied. Rebuilt when the colors or the blink phase
+   change, the font itself only selects the row. */
+static struct {
+	Bit32u row[256][16];
+	Bit32u mask;
+	bool valid;
+} TXT_Glyphs;
+
+static void VGA_TEXT_BuildGlyphs(void) {
+	for (Bitu col=0;col<256;col++) {
+		Bit32u fg=TXT_FG_Table[col&0xf];
+		Bit32u bg=TXT_BG_Table[col>>4];
+		for (Bitu i=0;i<16;i++) {
+			Bit32u mask=TXT_Font_Table[i] & FontMask[col >> 7];
+			TXT_Glyphs.row[col][i]=(fg&mask) | (bg&~mask);
+		}
+	}
+	TXT_Glyphs.mask=FontMask[1];
+	TXT_Glyphs.valid=true;
+}
+
 #ifdef _EE
 static Bit8u * VGA_TEXT_Draw_Line(Bitu vidstart, Bitu line, Bit8u *TempLine) {
 #else
@@ -447,16 +475,14 @@ static Bit8u * VGA_TEXT_Draw_Line(Bitu vidstart, Bitu line) {
 #else
 	const Bit8u* vidmem = VGA_Text_Memwrap(vidstart);
 #endif
+	if (GCC_UNLIKELY(!TXT_Glyphs.valid || TXT_Glyphs.mask!=FontMask[1])) VGA_TEXT_BuildGlyphs();
 	for (Bitu cx=0;cx<vga.draw.blocks;cx++) {
 		Bitu chr=vidmem[cx*2];
 		Bitu col=vidmem[cx*2+1];
 		Bitu font=vga.draw.font_tables[(col >> 3)&1][chr*32+line];
-		Bit32u mask1=TXT_Font_Table[font>>4] & FontMask[col >> 7];
-		Bit32u mask2=TXT_Font_Table[font&0xf] & FontMask[col >> 7];
-		Bit32u fg=TXT_FG_Table[col&0xf];
-		Bit32u bg=TXT_BG_Table[col>>4];
-		*draw++=(fg&mask1) | (bg&~mask1);
-		*draw++=(fg&mask2) | (bg&~mask2);
+		const Bit32u * row=TXT_Glyphs.row[col];
+		*draw++=row[font>>4];
+		*draw++=row[font&0xf];
 	}
 	if (!vga.draw.cursor.enabled || !(vga.draw.cursor.count&0x10)) goto skip_cursor;
 	font_addr = (vga.draw.cursor.address-vidstart) >> 1;
@@ -660,23 +686,6 @@ static Bit8u* VGA_TEXT_Xlat16_Draw_Line(Bitu vidstart, Bitu line) {
 	return TempLine+32;
 }
 
-#ifdef VGA_KEEP_CHANGES
-static INLINE void VGA_ChangesEnd(void ) {
-	if ( vga.changes.active ) {
-//		vga.changes.active = false;
-		Bitu end = vga.draw.address >> VGA_CHANGE_SHIFT;
-		Bitu total = 4 + end - vga.changes.start;
-		Bit32u clearMask = vga.changes.clearMask;
-		total >>= 2;
-		Bit32u *clear = (Bit32u *)&vga.changes.map[  vga.changes.start & ~3 ];
-		while ( total-- ) {
-			clear[0] &= clearMask;
-			clear++;
-		}
-	}
-}
-#endif
-
 
 static void VGA_ProcessSplit() {
 	if (vga.attr.mode_control&0x20) {
@@ -826,7 +835,7 @@ static void VGA_DrawEGASingleLine(Bitu /*blah*/) {
 	} else RENDER_EndUpdate(false);
 }
 
-static void VGA_DrawPart(Bitu lines) {
+static void VGA_DrawLines(Bitu lines) {
 	while (lines--) {
 #ifdef _EE
 		RENDER_DrawLine(vga.draw.address, vga.draw.address_line, VGA_DrawLine);
@@ -840,25 +849,35 @@ static void VGA_DrawPart(Bitu lines) {
 			vga.draw.address+=vga.draw.address_add;
 		}
 		vga.draw.lines_done++;
-		if (vga.draw.split_line==vga.draw.lines_done) {
-#ifdef VGA_KEEP_CHANGES
-			VGA_ChangesEnd( );
-#endif
-			VGA_ProcessSplit();
-#ifdef VGA_KEEP_CHANGES
-			vga.changes.start = vga.draw.address >> VGA_CHANGE_SHIFT;
-#endif
-		}
+		if (vga.draw.split_line==vga.draw.lines_done) VGA_ProcessSplit();
 	}
+}
+
+static void VGA_DrawPart(Bitu lines) {
+	VGA_DrawLines(lines);
 	if (--vga.draw.parts_left) {
 		PIC_AddEvent(VGA_DrawPart,(float)vga.draw.delay.parts,
 			 (vga.draw.parts_left!=1) ? vga.draw.parts_lines  : (vga.draw.lines_total - vga.draw.lines_done));
-	} else {
-#ifdef VGA_KEEP_CHANGES
-		VGA_ChangesEnd();
-#endif
-		RENDER_EndUpdate(false);
-	}
+	} else RENDER_EndUpdate(false);
+}
+
+/* Called before a register changes that alters the lines still to be drawn.
+   A frame drawn in one go first catches up with the parts the display has
+   passed, the rest of it and the next frames are drawn in parts. */
+void VGA_RasterChange(void) {
+	if (vga.draw.mode!=PART || !vga.draw.parts_left) return;
+	vga.draw.raster_frames=VGA_RASTER_FRAMES;
+	if (!vga.draw.deferred) return;
+	vga.draw.deferred=false;
+	PIC_RemoveEvents(VGA_DrawPart);
+	double elapsed=PIC_FullIndex()-vga.draw.delay.framestart-vga.draw.delay.skip;
+	Bitu parts=(elapsed>0) ? (Bitu)(elapsed/vga.draw.delay.parts) : 0;
+	if (parts>=vga.draw.parts_total) parts=vga.draw.parts_total-1;
+	VGA_DrawLines(parts*vga.draw.parts_lines);
+	vga.draw.parts_left=vga.draw.parts_total-parts;
+	double next=(parts+1)*vga.draw.delay.parts-elapsed;
+	PIC_AddEvent(VGA_DrawPart,(float)((next>0) ? next : 0),
+		 (vga.draw.parts_left!=1) ? vga.draw.parts_lines  : (vga.draw.lines_total - vga.draw.lines_done));
 }
 
 void VGA_SetBlinking(Bitu enabled) {
@@ -874,28 +893,108 @@ void VGA_SetBlinking(Bitu enabled) {
 		vga.tandy.mode_control&=~0x20;
 	}
 	for (Bitu i=0;i<8;i++) TXT_BG_Table[i+8]=(b+i) | ((b+i) << 8)| ((b+i) <<16) | ((b+i) << 24);
+	TXT_Glyphs.valid=false;
+#ifdef VGA_KEEP_CHANGES
+	vga.changes.redraw=true;
+#endif
 }
 
 #ifdef VGA_KEEP_CHANGES
-static void INLINE VGA_ChangesStart( void ) {
-	vga.changes.start = vga.draw.address >> VGA_CHANGE_SHIFT;
-	vga.changes.last = vga.changes.start;
-	if ( vga.changes.lastAddress != vga.draw.address ) {
-//		LOG_MSG("Address");
-		VGA_DrawLine = VGA_Draw_Linear_Line;
-		vga.changes.lastAddress = vga.draw.address;
-	} else if ( render.fullFrame ) {
-//		LOG_MSG("Full Frame");
-		VGA_DrawLine = VGA_Draw_Linear_Line;
-	} else {
-//		LOG_MSG("Changes");
-		VGA_DrawLine = VGA_Draw_Changes_Line;
+/* Everything besides the memory that decides how the lines of a frame look,
+   when any of it changes the whole frame is drawn */
+typedef struct {
+	Bitu address, address_add, address_line, address_line_total;
+	Bitu split_line, lines_total, panning, linear_mask;
+	Bit8u * linear_base;
+	Bit8u * font_tables[2];
+	Bit8u underline, attr_mode;
+	Bit8u disabled;
+} VGA_ChangesLayout;
+
+typedef struct {
+	Bitu address, sline, eline;
+	bool visible;
+} VGA_ChangesCursor;
+
+static VGA_ChangesLayout changes_layout;
+static VGA_ChangesCursor changes_cursor;
+static Bit32u changes_blink;
+
+/* The blink phase only changes the cells with the blink attribute */
+static void VGA_ChangesMarkBlink(void) {
+	const Bit8u *attr = vga.tandy.draw_base + 1;
+	for (Bitu i = 0; i < vga.draw.linear_mask; i += 2) {
+		if (attr[i] & 0x80) {
+			vga.changes.map[i >> VGA_CHANGE_SHIFT] |= vga.changes.checkMask;
+			i |= (1 << VGA_CHANGE_SHIFT) - 2;	//Continue with the next block
+		}
 	}
-	vga.changes.active = true;
+}
+
+static void VGA_ChangesStart(void) {
+	/* Lines are checked against the writes since the last drawn frame, the
+	   writes from now on go to the other bit */
 	vga.changes.checkMask = vga.changes.writeMask;
-	vga.changes.clearMask = ~( 0x01010101 << (vga.changes.frame & 7));
-	vga.changes.frame++;
-	vga.changes.writeMask = 1 << (vga.changes.frame & 7);
+	vga.changes.writeMask ^= 3;
+	Bit32u clearMask = ~(0x01010101 * vga.changes.writeMask);
+	Bit32u *clear = (Bit32u *)vga.changes.map;
+	for (Bitu i = VGA_CHANGES_SIZE(vga.vmemsize) >> 2; i; i--) *clear++ &= clearMask;
+
+	VGA_ChangesLayout layout;
+	memset(&layout, 0, sizeof(layout));
+	layout.address = vga.draw.address;
+	layout.address_add = vga.draw.address_add;
+	layout.address_line = vga.draw.address_line;
+	layout.address_line_total = vga.draw.address_line_total;
+	layout.split_line = vga.draw.split_line;
+	layout.lines_total = vga.draw.lines_total;
+	layout.panning = vga.draw.panning;
+	layout.linear_mask = vga.draw.linear_mask;
+	layout.linear_base = vga.draw.linear_base;
+	layout.disabled = vga.attr.disabled;
+	if (vga.mode == M_TEXT) {
+		layout.font_tables[0] = vga.draw.font_tables[0];
+		layout.font_tables[1] = vga.draw.font_tables[1];
+		layout.underline = vga.crtc.underline_location;
+		layout.attr_mode = vga.attr.mode_control;
+	}
+	bool full = vga.changes.redraw || memcmp(&layout, &changes_layout, sizeof(layout));
+#ifndef _EE
+	if (render.fullFrame) full = true;
+#endif
+	/* The last frame was cut short, its missing lines have to be drawn */
+	if (vga.draw.parts_left || vga.draw.lines_done < vga.draw.lines_total) full = true;
+	/* The hardware cursor moves without any writes to the memory */
+	if (svga.hardware_cursor_active && svga.hardware_cursor_active()) full = true;
+	changes_layout = layout;
+	vga.changes.redraw = false;
+
+	if (vga.mode == M_TEXT) {
+		vga.changes.span = (vga.draw.blocks + 1) * 2;
+		/* Draw the lines of the old and the new cursor when it changed */
+		VGA_ChangesCursor cursor;
+		memset(&cursor, 0, sizeof(cursor));
+		cursor.address = vga.draw.cursor.address & vga.draw.linear_mask;
+		cursor.sline = vga.draw.cursor.sline;
+		cursor.eline = vga.draw.cursor.eline;
+		cursor.visible = vga.draw.cursor.enabled && (vga.draw.cursor.count & 0x10);
+		if (memcmp(&cursor, &changes_cursor, sizeof(cursor))) {
+			vga.changes.map[changes_cursor.address >> VGA_CHANGE_SHIFT] |= vga.changes.checkMask;
+			vga.changes.map[cursor.address >> VGA_CHANGE_SHIFT] |= vga.changes.checkMask;
+			changes_cursor = cursor;
+		}
+		if (changes_blink != FontMask[1]) {
+			changes_blink = FontMask[1];
+			if (!full) VGA_ChangesMarkBlink();
+		}
+	} else vga.changes.span = vga.draw.line_length;
+
+	if (full) {
+		if (VGA_DrawLine == VGA_Draw_Changes_Line) VGA_DrawLine = VGA_ChangesDrawLine;
+	} else if (VGA_DrawLine != VGA_Draw_Changes_Line) {
+		VGA_ChangesDrawLine = VGA_DrawLine;
+		VGA_DrawLine = VGA_Draw_Changes_Line;
+	}
 }
 #endif
 
@@ -978,7 +1077,7 @@ static void VGA_VerticalTimer(Bitu /*val*/) {
 	}
 //	if (machine==MCH_EGA) vga.draw.split_line = ((((vga.config.line_compare&0x5ff)+1)*2-1)/vga.draw.lines_scaled);
 #ifdef VGA_KEEP_CHANGES
-	bool startaddr_changed=false;
+	bool track_changes=false;
 #endif
 	switch (vga.mode) {
 	case M_EGA:
@@ -990,7 +1089,7 @@ static void VGA_VerticalTimer(Bitu /*val*/) {
 		vga.draw.address *= vga.draw.byte_panning_shift;
 		if (machine!=MCH_EGA) vga.draw.address += vga.draw.panning;
 #ifdef VGA_KEEP_CHANGES
-		startaddr_changed=true;
+		track_changes=true;
 #endif
 		break;
 	case M_VGA:
@@ -1010,12 +1109,15 @@ static void VGA_VerticalTimer(Bitu /*val*/) {
 		vga.draw.address *= vga.draw.byte_panning_shift;
 		vga.draw.address += vga.draw.panning;
 #ifdef VGA_KEEP_CHANGES
-		startaddr_changed=true;
+		track_changes=true;
 #endif
 		break;
 	case M_TEXT:
 		vga.draw.byte_panning_shift = 2;
 		vga.draw.address += vga.draw.bytes_skip;
+#ifdef VGA_KEEP_CHANGES
+		track_changes=true;
+#endif
 		// fall-through
 	case M_TANDY_TEXT:
 	case M_HERC_TEXT:
@@ -1046,7 +1148,7 @@ static void VGA_VerticalTimer(Bitu /*val*/) {
 	}
 	if (GCC_UNLIKELY(vga.draw.split_line==0)) VGA_ProcessSplit();
 #ifdef VGA_KEEP_CHANGES
-	if (startaddr_changed) VGA_ChangesStart();
+	if (track_changes) VGA_ChangesStart();
 #endif
 
 	// check if some lines at the top off the screen are blanked
@@ -1065,8 +1167,17 @@ static void VGA_VerticalTimer(Bitu /*val*/) {
 			RENDER_EndUpdate(true);
 		}
 		vga.draw.lines_done = 0;
-		vga.draw.parts_left = vga.draw.parts_total;
-		PIC_AddEvent(VGA_DrawPart,(float)vga.draw.delay.parts + draw_skip,vga.draw.parts_lines);
+		vga.draw.delay.skip = draw_skip;
+		/* Without raster changes lately the whole frame is drawn at the end of the display */
+		if (vga.draw.raster_frames) vga.draw.raster_frames--;
+		vga.draw.deferred = !vga.draw.raster_frames;
+		if (vga.draw.deferred) {
+			vga.draw.parts_left = 1;
+			PIC_AddEvent(VGA_DrawPart,(float)(vga.draw.delay.parts * vga.draw.parts_total) + draw_skip,vga.draw.lines_total);
+		} else {
+			vga.draw.parts_left = vga.draw.parts_total;
+			PIC_AddEvent(VGA_DrawPart,(float)vga.draw.delay.parts + draw_skip,vga.draw.parts_lines);
+		}
 		break;
 	case DRAWLINE:
 	case EGALINE:
@@ -1150,6 +1261,10 @@ void VGA_ActivateHardwareCursor(void) {
 	} else {
 		VGA_DrawLine=VGA_Draw_Linear_Line;
 	}
+#ifdef VGA_KEEP_CHANGES
+	/* Lines of a cursor that went away have to be drawn again */
+	vga.changes.redraw=true;
+#endif
 }
 
 void VGA_SetupDrawing(Bitu /*val*/) {
@@ -1666,9 +1781,7 @@ void VGA_SetupDrawing(Bitu /*val*/) {
 	vga.draw.parts_lines=vga.draw.lines_total/vga.draw.parts_total;
 	vga.draw.line_length = width * ((bpp + 1) / 8);
 #ifdef VGA_KEEP_CHANGES
-	vga.changes.active = false;
-	vga.changes.frame = 0;
-	vga.changes.writeMask = 1;
+	vga.changes.redraw = true;
 #endif
 	/*
 	   Cheap hack to just make all > 640x480 modes have square pixels
@@ -1737,6 +1850,9 @@ void VGA_KillDrawing(void) {
 	PIC_RemoveEvents(VGA_DrawEGASingleLine);
 	vga.draw.parts_left = 0;
 	vga.draw.lines_done = ~0;
+#ifdef VGA_KEEP_CHANGES
+	vga.changes.redraw = true;
+#endif
 	if (!vga.draw.vga_override) RENDER_EndUpdate(true);
 }
 
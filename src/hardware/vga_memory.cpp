@@ -19,6 +19,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <new>
 #include "dosbox.h"
 #include "mem.h"
 #include "vga.h"
@@ -26,6 +27,7 @@
 #include "pic.h"
 #include "inout.h"
 #include "setup.h"
+#include "snapshot.h"
 
 
 #ifndef C_VGARAM_CHECKED
@@ -291,6 +293,7 @@ public:
 		/* Update video memory and the pixel buffer */
 		VGA_Latch pixels;
 		vga.mem.linear[start] = val;
+		VGA_DIRTY( start );
 		start >>= 2;
 		pixels.d=((Bit32u*)vga.mem.linear)[start];
 
@@ -320,14 +323,15 @@ public:
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED(addr);
-		MEM_CHANGED( addr << 3);
+		MEM_CHANGED( (addr&~3) << 1 );
 		writeHandler(addr+0,(Bit8u)(val >> 0));
 	}
 	void writew(PhysPt addr,Bitu val) {
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED(addr);
-		MEM_CHANGED( addr << 3);
+		MEM_CHANGED( (addr&~3) << 1 );
+		MEM_CHANGED( ((addr+1)&~3) << 1 );
 		writeHandler(addr+0,(Bit8u)(val >> 0));
 		writeHandler(addr+1,(Bit8u)(val >> 8));
 	}
@@ -335,7 +339,8 @@ public:
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED(addr);
-		MEM_CHANGED( addr << 3);
+		MEM_CHANGED( (addr&~3) << 1 );
+		MEM_CHANGED( ((addr+3)&~3) << 1 );
 		writeHandler(addr+0,(Bit8u)(val >> 0));
 		writeHandler(addr+1,(Bit8u)(val >> 8));
 		writeHandler(addr+2,(Bit8u)(val >> 16));
@@ -377,6 +382,7 @@ public:
 		pixels.d&=vga.config.full_not_map_mask;
 		pixels.d|=(data & vga.config.full_map_mask);
 		((Bit32u*)vga.mem.linear)[start]=pixels.d;
+		VGA_DIRTY( start << 2 );
 		Bit8u * write_pixels=&vga.fastmem[start<<3];
 
 		Bit32u colors0_3, colors4_7;
@@ -411,6 +417,7 @@ public:
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED2(addr);
 		MEM_CHANGED( addr << 3);
+		MEM_CHANGED( (addr+1) << 3);
 		writeHandler(addr+0,(Bit8u)(val >> 0));
 		writeHandler(addr+1,(Bit8u)(val >> 8));
 	}
@@ -419,6 +426,7 @@ public:
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED2(addr);
 		MEM_CHANGED( addr << 3);
+		MEM_CHANGED( (addr+3) << 3);
 		writeHandler(addr+0,(Bit8u)(val >> 0));
 		writeHandler(addr+1,(Bit8u)(val >> 8));
 		writeHandler(addr+2,(Bit8u)(val >> 16));
@@ -444,10 +452,20 @@ public:
 			hostWrite<Size>( &vga.fastmem[addr+64*1024], val );
 		}
 	}
+#ifdef VGA_KEEP_CHANGES
+	/* Mark both the fastmem copy and the planar memory, either can be drawn */
+	static INLINE void markChanged(PhysPt addr) {
+		MEM_CHANGED( addr );
+		MEM_CHANGED( ((addr&~3)<<2) & (vga.vmemwrap-1) );
+	}
+#else
+	static INLINE void markChanged(PhysPt /*addr*/) {}
+#endif
 	template <class Size>
 	static INLINE void writeHandler(PhysPt addr, Bitu val) {
 		// No need to check for compatible chains here, this one is only enabled if that bit is set
 		hostWrite<Size>( &vga.mem.linear[((addr&~3)<<2)+(addr&3)], val );
+		VGA_DIRTY( (addr&~3)<<2 );
 	}
 	Bitu readb(PhysPt addr ) {
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
@@ -483,7 +501,7 @@ public:
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED(addr);
-		MEM_CHANGED( addr );
+		markChanged( addr );
 		writeHandler<Bit8u>( addr, val );
 		writeCache<Bit8u>( addr, val );
 	}
@@ -491,8 +509,8 @@ public:
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED(addr);
-		MEM_CHANGED( addr );
-//		MEM_CHANGED( addr + 1);
+		markChanged( addr );
+		markChanged( addr + 1 );
 		if (GCC_UNLIKELY(addr & 1)) {
 			writeHandler<Bit8u>( addr+0, val >> 0 );
 			writeHandler<Bit8u>( addr+1, val >> 8 );
@@ -505,8 +523,8 @@ public:
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED(addr);
-		MEM_CHANGED( addr );
-//		MEM_CHANGED( addr + 3);
+		markChanged( addr );
+		markChanged( addr + 3 );
 		if (GCC_UNLIKELY(addr & 3)) {
 			writeHandler<Bit8u>( addr+0, val >> 0 );
 			writeHandler<Bit8u>( addr+1, val >> 8 );
@@ -528,6 +546,7 @@ public:
 		pixels.d&=vga.config.full_not_map_mask;
 		pixels.d|=(data & vga.config.full_map_mask);
 		((Bit32u*)vga.mem.linear)[addr]=pixels.d;
+		VGA_DIRTY( addr << 2 );
 //		if(vga.config.compatible_chain4)
 //			((Bit32u*)vga.mem.linear)[CHECKED2(addr+64*1024)]=pixels.d; 
 	}
@@ -547,6 +566,7 @@ public:
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED2(addr);
 		MEM_CHANGED( addr << 2);
+		MEM_CHANGED( (addr+1) << 2);
 		writeHandler(addr+0,(Bit8u)(val >> 0));
 		writeHandler(addr+1,(Bit8u)(val >> 8));
 	}
@@ -555,6 +575,7 @@ public:
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED2(addr);
 		MEM_CHANGED( addr << 2);
+		MEM_CHANGED( (addr+3) << 2);
 		writeHandler(addr+0,(Bit8u)(val >> 0));
 		writeHandler(addr+1,(Bit8u)(val >> 8));
 		writeHandler(addr+2,(Bit8u)(val >> 16));
@@ -585,13 +606,27 @@ public:
 		
 		if (GCC_LIKELY(vga.seq.map_mask == 0x4)) {
 			vga.draw.font[addr]=(Bit8u)val;
+#ifdef VGA_KEEP_CHANGES
+			/* Any character on the screen could use the changed font */
+			vga.changes.redraw=true;
+#endif
 		} else {
-			if (vga.seq.map_mask & 0x4) // font map
+			if (vga.seq.map_mask & 0x4) { // font map
 				vga.draw.font[addr]=(Bit8u)val;
-			if (vga.seq.map_mask & 0x2) // character attribute
+#ifdef VGA_KEEP_CHANGES
+				vga.changes.redraw=true;
+#endif
+			}
+			if (vga.seq.map_mask & 0x2) { // character attribute
 				vga.mem.linear[CHECKED3(vga.svga.bank_read_full+addr+1)]=(Bit8u)val;
-			if (vga.seq.map_mask & 0x1) // character index
+				MEM_CHANGED( CHECKED3(vga.svga.bank_read_full+addr+1) );
+				VGA_DIRTY( CHECKED3(vga.svga.bank_read_full+addr+1) );
+			}
+			if (vga.seq.map_mask & 0x1) { // character index
 				vga.mem.linear[CHECKED3(vga.svga.bank_read_full+addr)]=(Bit8u)val;
+				MEM_CHANGED( CHECKED3(vga.svga.bank_read_full+addr) );
+				VGA_DIRTY( CHECKED3(vga.svga.bank_read_full+addr) );
+			}
 		}
 	}
 };
@@ -639,6 +674,7 @@ public:
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED(addr);
 		MEM_CHANGED( addr );
+		VGA_DIRTY( addr );
 		hostWrite<Bit8u>( &vga.mem.linear[addr], val );
 	}
 	void writew(PhysPt addr,Bitu val) {
@@ -646,13 +682,19 @@ public:
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED(addr);
 		MEM_CHANGED( addr );
+		MEM_CHANGED( addr + 1 );
+		VGA_DIRTY( addr );
+		VGA_DIRTY( addr + 1 );
 		hostWrite<Bit16u>( &vga.mem.linear[addr], val );
 	}
 	void writed(PhysPt addr,Bitu val) {
 		addr = PAGING_GetPhysicalAddress(addr) & vgapages.mask;
 		addr += vga.svga.bank_write_full;
 		addr = CHECKED(addr);
-		MEM_CHANGED( addr );	
+		MEM_CHANGED( addr );
+		MEM_CHANGED( addr + 3 );
+		VGA_DIRTY( addr );
+		VGA_DIRTY( addr + 3 );
 		hostWrite<Bit32u>( &vga.mem.linear[addr], val );
 	}
 };
@@ -672,6 +714,7 @@ public:
 		addr = vga.svga.bank_write_full + (PAGING_GetPhysicalAddress(addr) & 0xffff);
 		addr = CHECKED4(addr);
 		MEM_CHANGED( addr << 3 );
+		MEM_CHANGED( (addr+1) << 3 );
 		writeHandler(addr+0,(Bit8u)(val >> 0));
 		writeHandler(addr+1,(Bit8u)(val >> 8));
 	}
@@ -679,6 +722,7 @@ public:
 		addr = vga.svga.bank_write_full + (PAGING_GetPhysicalAddress(addr) & 0xffff);
 		addr = CHECKED4(addr);
 		MEM_CHANGED( addr << 3 );
+		MEM_CHANGED( (addr+3) << 3 );
 		writeHandler(addr+0,(Bit8u)(val >> 0));
 		writeHandler(addr+1,(Bit8u)(val >> 8));
 		writeHandler(addr+2,(Bit8u)(val >> 16));
@@ -733,18 +777,25 @@ public:
 		addr = CHECKED(addr);
 		hostWrite<Bit8u>( &vga.mem.linear[addr], val );
 		MEM_CHANGED( addr );
+		VGA_DIRTY( addr );
 	}
 	void writew(PhysPt addr,Bitu val) {
 		addr = PAGING_GetPhysicalAddress(addr) - vga.lfb.addr;
 		addr = CHECKED(addr);
 		hostWrite<Bit16u>( &vga.mem.linear[addr], val );
 		MEM_CHANGED( addr );
+		MEM_CHANGED( addr + 1 );
+		VGA_DIRTY( addr );
+		VGA_DIRTY( addr + 1 );
 	}
 	void writed(PhysPt addr,Bitu val) {
 		addr = PAGING_GetPhysicalAddress(addr) - vga.lfb.addr;
 		addr = CHECKED(addr);
 		hostWrite<Bit32u>( &vga.mem.linear[addr], val );
 		MEM_CHANGED( addr );
+		MEM_CHANGED( addr + 3 );
+		VGA_DIRTY( addr );
+		VGA_DIRTY( addr + 3 );
 	}
 };
 
@@ -983,7 +1034,11 @@ void VGA_SetupHandlers(void) {
 		break;	
 	case M_TEXT:
 		/* Check if we're not in odd/even mode */
+#ifdef VGA_KEEP_CHANGES
+		if (vga.gfx.miscellaneous & 0x2) newHandler = &vgaph.changes;
+#else
 		if (vga.gfx.miscellaneous & 0x2) newHandler = &vgaph.map;
+#endif
 		else newHandler = &vgaph.text;
 		break;
 	case M_CGA4:
@@ -1044,12 +1099,111 @@ void VGA_StartUpdateLFB(void) {
 	MEM_SetLFB(vga.s3.la_window << 4 ,vga.vmemsize/4096, vga.lfb.handler, &vgaph.mmio);
 }
 
+Bit8u * VGADirty;
+static Bit8u * vga_snapshot;		//Video memory at the last snapshot
+
+/* Pages mapped straight into the cpu address space are written without
+   passing a handler, these are copied on every snapshot */
+static void VGA_DirtyMappedPages(void) {
+	for (Bitu page=VGA_PAGE_A0;page<VGA_PAGE_A0+VGA_PAGES;page++) {
+		PageHandler * handler=MEM_GetPageHandler(page);
+		if (!(handler->flags & PFLAG_WRITEABLE)) continue;
+		HostPt host=handler->GetHostWritePt(page);
+		if (host<vga.mem.linear || host>=vga.mem.linear+vga.vmemsize) continue;
+		VGA_DIRTY( host-vga.mem.linear );
+		VGA_DIRTY( host-vga.mem.linear+4095 );
+	}
+	if (vga.lfb.handler && (vga.lfb.handler->flags & PFLAG_WRITEABLE))
+		memset(VGADirty,1,(vga.vmemsize >> VGA_DIRTY_SHIFT)+1);
+}
+
+/* Build the pixel buffer again from the video memory, first the 16 color
+   pixels of the planar modes and on top the copy of chained mode 13h */
+static void VGA_RebuildFastmem(void) {
+	for (Bitu start=0;start<(vga.vmemsize >> 2);start++) {
+		VGA_Latch pixels,temp;
+		pixels.d=((Bit32u*)vga.mem.linear)[start];
+		Bit8u * write_pixels=&vga.fastmem[start<<3];
+		temp.d=(pixels.d>>4) & 0x0f0f0f0f;
+		*(Bit32u *)write_pixels=
+			Expand16Table[0][temp.b[0]] |
+			Expand16Table[1][temp.b[1]] |
+			Expand16Table[2][temp.b[2]] |
+			Expand16Table[3][temp.b[3]];
+		temp.d=pixels.d & 0x0f0f0f0f;
+		*(Bit32u *)(write_pixels+4)=
+			Expand16Table[0][temp.b[0]] |
+			Expand16Table[1][temp.b[1]] |
+			Expand16Table[2][temp.b[2]] |
+			Expand16Table[3][temp.b[3]];
+	}
+	if ((vga.mode==M_VGA || vga.mode==M_LIN8) && vga.config.chained && vga.config.compatible_chain4) {
+		for (Bitu addr=0;addr<(vga.vmemwrap >> 2);addr++)
+			vga.fastmem[addr]=vga.mem.linear[((addr&~3)<<2)+(addr&3)];
+		memcpy(&vga.fastmem[64*1024],vga.fastmem,320);
+	}
+}
+
+static void VGA_SnapshotSave(SnapshotStream & stream) {
+	stream.Write(&vga,sizeof(vga));
+#ifdef VGA_KEEP_CHANGES
+	stream.Write(vga.changes.map,VGA_CHANGES_SIZE(vga.vmemsize));
+#endif
+	/* Only the pages written since the last snapshot are copied, the pixel
+	   buffer is not saved at all */
+	Bitu pages=vga.vmemsize >> VGA_DIRTY_SHIFT;
+	if (!vga_snapshot) {
+		vga_snapshot=new(std::nothrow) Bit8u[vga.vmemsize];
+		if (!vga_snapshot) {
+			stream.Fail();
+			return;
+		}
+		memset(VGADirty,1,pages+1);
+	}
+	VGA_DirtyMappedPages();
+	for (Bitu i=0;i<pages;i++) {
+		if (!VGADirty[i]) continue;
+		memcpy(&vga_snapshot[i << VGA_DIRTY_SHIFT],&vga.mem.linear[i << VGA_DIRTY_SHIFT],1 << VGA_DIRTY_SHIFT);
+		VGADirty[i]=0;
+	}
+	VGADirty[pages]=0;
+}
+
+static void VGA_SnapshotLoad(SnapshotStream & stream) {
+	/* Uses the banks of the current state to find the mapped pages */
+	VGA_DirtyMappedPages();
+	stream.Read(&vga,sizeof(vga));
+#ifdef VGA_KEEP_CHANGES
+	stream.Read(vga.changes.map,VGA_CHANGES_SIZE(vga.vmemsize));
+#endif
+	Bitu pages=vga.vmemsize >> VGA_DIRTY_SHIFT;
+	for (Bitu i=0;i<pages;i++) {
+		if (!VGADirty[i]) continue;
+		memcpy(&vga.mem.linear[i << VGA_DIRTY_SHIFT],&vga_snapshot[i << VGA_DIRTY_SHIFT],1 << VGA_DIRTY_SHIFT);
+		VGADirty[i]=0;
+	}
+	VGADirty[pages]=0;
+	VGA_RebuildFastmem();
+	VGA_SetupHandlers();
+	VGA_DACSetEntirePalette();
+	/* Force the output to be set up again for the restored mode */
+	vga.draw.resizing=false;
+	if (!vga.draw.vga_override) {
+		vga.draw.width=0;
+		VGA_SetupDrawing(0);
+	}
+}
+
 static void VGA_Memory_ShutDown(Section * /*sec*/) {
+	SNAPSHOT_Remove("vga");
 	delete[] vga.mem.linear_orgptr;
 	delete[] vga.fastmem_orgptr;
 #ifdef VGA_KEEP_CHANGES
 	delete[] vga.changes.map;
 #endif
+	delete[] VGADirty;
+	delete[] vga_snapshot;
+	vga_snapshot=0;
 }
 
 void VGA_SetupMemory(Section* sec) {
@@ -1068,13 +1222,19 @@ void VGA_SetupMemory(Section* sec) {
 	vga.fastmem_orgptr = new Bit8u[(vga.vmemsize<<1)+4096+16];
 	vga.fastmem=(Bit8u*)(((Bitu)vga.fastmem_orgptr + 16-1) & ~(16-1));
 
+	// One page more for the last bytes of writes crossing the end
+	VGADirty = new Bit8u[(vga.vmemsize >> VGA_DIRTY_SHIFT)+1];
+	memset(VGADirty,1,(vga.vmemsize >> VGA_DIRTY_SHIFT)+1);
+	vga_snapshot = 0;
+
 	// In most cases these values stay the same. Assumptions: vmemwrap is power of 2,
 	// vmemwrap <= vmemsize, fastmem implicitly has mem wrap twice as big
 	vga.vmemwrap = vga.vmemsize;
 
 #ifdef VGA_KEEP_CHANGES
 	memset( &vga.changes, 0, sizeof( vga.changes ));
-	int changesMapSize = (vga.vmemsize >> VGA_CHANGE_SHIFT) + 32;
+	vga.changes.writeMask = 1;
+	int changesMapSize = VGA_CHANGES_SIZE(vga.vmemsize);
 	vga.changes.map = new Bit8u[changesMapSize];
 	memset(vga.changes.map, 0, changesMapSize);
 #endif
@@ -1083,6 +1243,7 @@ void VGA_SetupMemory(Section* sec) {
 	vga.svga.bank_size = 0x10000; /* most common bank size is 64K */
 
 	sec->AddDestroyFunction(&VGA_Memory_ShutDown);
+	SNAPSHOT_AddHandler("vga",VGA_SnapshotSave,VGA_SnapshotLoad);
 
 	if (machine==MCH_PCJR) {
 		/* PCJr does not have dedicated graphics memory but uses
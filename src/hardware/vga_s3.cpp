@@ -86,6 +86,7 @@ void SVGA_S3_WriteCRTC(Bitu reg,Bitu val,Bitu /*iolen*/) {
 	case 0x43:	/* CR43 Extended Mode */
 		vga.s3.reg_43=val & ~0x4;
 		if (((val & 0x4) ^ (vga.config.scan_len >> 6)) & 0x4) {
+			VGA_RasterChange();
 			vga.config.scan_len&=0x2ff;
 			vga.config.scan_len|=(val & 0x4) << 6;
 			VGA_CheckScanLength();
@@ -169,6 +170,7 @@ void SVGA_S3_WriteCRTC(Bitu reg,Bitu val,Bitu /*iolen*/) {
 			VGA_SetupHandlers();
 		}
 		if (((val & 0x30) ^ (vga.config.scan_len >> 4)) & 0x30) {
+			VGA_RasterChange();
 			vga.config.scan_len&=0xff;
 			vga.config.scan_len|=(val & 0x30) << 4;
 			VGA_CheckScanLength();
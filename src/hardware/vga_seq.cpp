@@ -48,6 +48,9 @@ void write_p3c5(Bitu /*port*/,Bitu val,Bitu iolen) {
 			}
 			if (val & 0x20) vga.attr.disabled |= 0x2;
 			else vga.attr.disabled &= ~0x2;
+#ifdef VGA_KEEP_CHANGES
+			vga.changes.redraw=true;
+#endif
 		}
 		/* TODO Figure this out :)
 			0	If set character clocks are 8 dots wide, else 9.
@@ -75,6 +78,7 @@ void write_p3c5(Bitu /*port*/,Bitu val,Bitu iolen) {
 		break;
 	case 3:		/* Character Map Select */
 		{
+			if (val!=seq(character_map_select)) VGA_RasterChange();
 			seq(character_map_select)=val;
 			Bit8u font1=(val & 0x3) << 1;
 			if (IS_VGA_ARCH) font1|=(val & 0x10) >> 4;
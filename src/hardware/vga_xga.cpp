@@ -31,6 +31,13 @@
 
 #define XGA_SHOW_COMMAND_TRACE 0
 
+/* The accelerator writes the memory directly, mark the pixels for the drawing */
+#ifdef VGA_KEEP_CHANGES
+#define XGA_CHANGED(_MEM) vga.changes.map[(_MEM) >> VGA_CHANGE_SHIFT] |= vga.changes.writeMask
+#else
+#define XGA_CHANGED(_MEM)
+#endif
+
 #if (IO_MAX > 0xe2ea)
 
 struct XGAStatus {
@@ -146,18 +153,26 @@ void XGA_DrawPoint(Bitu x, Bitu y, Bitu c) {
 		case M_LIN8:
 			if (GCC_UNLIKELY(memaddr >= vga.vmemsize)) break;
 			vga.mem.linear[memaddr] = c;
+			XGA_CHANGED(memaddr);
+			VGA_DIRTY(memaddr);
 			break;
 		case M_LIN15:
 			if (GCC_UNLIKELY(memaddr*2 >= vga.vmemsize)) break;
 			((Bit16u*)(vga.mem.linear))[memaddr] = (Bit16u)(c&0x7fff);
+			XGA_CHANGED(memaddr*2);
+			VGA_DIRTY(memaddr*2);
 			break;
 		case M_LIN16:
 			if (GCC_UNLIKELY(memaddr*2 >= vga.vmemsize)) break;
 			((Bit16u*)(vga.mem.linear))[memaddr] = (Bit16u)(c&0xffff);
+			XGA_CHANGED(memaddr*2);
+			VGA_DIRTY(memaddr*2);
 			break;
 		case M_LIN32:
 			if (GCC_UNLIKELY(memaddr*4 >= vga.vmemsize)) break;
 			((Bit32u*)(vga.mem.linear))[memaddr] = c;
+			XGA_CHANGED(memaddr*4);
+			VGA_DIRTY(memaddr*4);
 			break;
 		default:
 			break;
@@ -318,6 +318,7 @@ static Bitu INT1A_Handler(void) {
 	case 0x00:	/* Get System time */
 		{
 			Bit32u ticks=mem_readd(BIOS_TIMER);
+			CPU_IdlePoll();
 			reg_al=mem_readb(BIOS_24_HOURS_FLAG);
 			mem_writeb(BIOS_24_HOURS_FLAG,0); // reset the "flag"
 			reg_cx=(Bit16u)(ticks >> 16);
@@ -492,7 +493,7 @@ static Bitu INT11_Handler(void) {
 #define DOSBOX_CLOCKSYNC 0
 #endif
 
-static void BIOS_HostTimeSync() {
+void BIOS_HostTimeSync(void) {
 	Bit32u milli = 0;
 #if defined(DB_HAVE_CLOCK_GETTIME) && ! defined(WIN32)
 	struct timespec tp;
@@ -23,6 +23,7 @@
 #include "bios.h"
 #include "keyboard.h"
 #include "regs.h"
+#include "cpu.h"
 #include "inout.h"
 #include "dos_inc.h"
 #ifdef _EE
@@ -541,6 +542,7 @@ static Bitu INT16_Handler(void) {
 				}
 			} else {
 				/* no key available, return key at buffer head anyway */
+				CPU_IdlePoll();
 				break;
 			}
 //			CALLBACK_Idle();
@@ -555,7 +557,7 @@ static Bitu INT16_Handler(void) {
 				/* special enhanced key, clear low part before returning key */
 				temp&=0xff00;
 			}
-		}
+		} else CPU_IdlePoll();
 		reg_ax=temp;
 		break;
 	case 0x02:	/* GET SHIFT FLAGS */
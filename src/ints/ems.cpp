@@ -32,6 +32,7 @@
 #include "support.h"
 #include "cpu.h"
 #include "dma.h"
+#include "snapshot.h"
 
 #define EMM_PAGEFRAME	0xE000
 #define EMM_PAGEFRAME4K	((EMM_PAGEFRAME*16)/4096)
@@ -1419,6 +1420,10 @@ public:
 			emm_segmentmappings[i].page=NULL_PAGE;
 			emm_segmentmappings[i].handle=NULL_HANDLE;
 		}
+		/* The mappings themselves are part of the paging state */
+		SNAPSHOT_AddRegion("ems.handles",emm_handles,sizeof(emm_handles),SNAPSHOT_PERSISTENT);
+		SNAPSHOT_AddRegion("ems.mappings",emm_mappings,sizeof(emm_mappings),SNAPSHOT_PERSISTENT);
+		SNAPSHOT_AddRegion("ems.segments",emm_segmentmappings,sizeof(emm_segmentmappings),SNAPSHOT_PERSISTENT);
 
 		EMM_AllocateSystemHandle(24);	// allocate OS-dedicated handle (ems handle zero, 384kb)
 
@@ -1473,6 +1478,9 @@ public:
 	}
 
 	~EMS() {
+		SNAPSHOT_Remove("ems.handles");
+		SNAPSHOT_Remove("ems.mappings");
+		SNAPSHOT_Remove("ems.segments");
 		if (ems_type<=0) return;
 
 		/* Undo Biosclearing */
@@ -476,6 +476,10 @@ static void FinishSetMode(bool clearmem) {
 			/* Hack we just access the memory directly */
 			memset(vga.mem.linear,0,vga.vmemsize);
 			memset(vga.fastmem, 0, vga.vmemsize<<1);
+			memset(VGADirty,1,(vga.vmemsize >> VGA_DIRTY_SHIFT)+1);
+#ifdef VGA_KEEP_CHANGES
+			vga.changes.redraw=true;
+#endif
 		}
 	}
 	/* Setup the BIOS */
@@ -29,6 +29,7 @@
 #include "inout.h"
 #include "xms.h"
 #include "bios.h"
+#include "snapshot.h"
 
 #define XMS_HANDLES							50		/* 50 XMS Memory Blocks */ 
 #define XMS_VERSION    						0x0300	/* version 3.00 */
@@ -444,6 +445,7 @@ public:
 		}
 		/* Disable the 0 handle */
 		xms_handles[0].free	= false;
+		SNAPSHOT_AddRegion("xms",xms_handles,sizeof(xms_handles),SNAPSHOT_PERSISTENT);
 
 		/* Set up UMB chain */
 		umb_available=section->Get_bool("umb");
@@ -453,6 +455,7 @@ public:
 
 	~XMS(){
 		Section_prop * section = static_cast<Section_prop *>(m_configuration);
+		SNAPSHOT_Remove("xms");
 		/* Remove upper memory information */
 		dos_infoblock.SetStartOfUMBChain(0xffff);
 		if (umb_available) {
@@ -0,0 +1,349 @@
+/*
+ *  Copyright (C) 2002-2021  The DOSBox Team
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License along
+ *  with this program; if not, write to the Free Software Foundation, Inc.,
+ *  51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "dosbox.h"
+#include "snapshot.h"
+#include "mapper.h"
+#include "setup.h"
+#include "timer.h"
+
+SnapshotStream::SnapshotStream() {
+	buffer=0;
+	alloc=used=pos=0;
+	failed=false;
+}
+
+SnapshotStream::~SnapshotStream() {
+	free(buffer);
+}
+
+void SnapshotStream::Write(void const * data,Bitu size) {
+	if (failed) return;
+	if (pos+size>alloc) {
+		Bitu newalloc=alloc ? alloc : 64*1024;
+		while (newalloc<pos+size) newalloc*=2;
+		Bit8u * newbuffer=(Bit8u *)realloc(buffer,newalloc);
+		if (!newbuffer) {
+			failed=true;
+			return;
+		}
+		buffer=newbuffer;
+		alloc=newalloc;
+	}
+	memcpy(buffer+pos,data,size);
+	pos+=size;
+	if (pos>used) used=pos;
+}
+
+void SnapshotStream::Read(void * data,Bitu size) {
+	if (pos+size>used) E_Exit("SNAPSHOT:Read past the end of the saved state");
+	memcpy(data,buffer+pos,size);
+	pos+=size;
+}
+
+struct SnapshotEntry {
+	std::string name;
+	void * data;
+	Bitu size;
+	SNAPSHOT_Handler * save;
+	SNAPSHOT_Handler * load;
+	Bitu flags;
+	Bitu start,length;			//Part of the stream holding this entry
+};
+
+static struct {
+	std::vector<SnapshotEntry> entries;
+	SnapshotStream stream;
+	bool valid;
+	bool infile;				//Saving or loading an image file
+	Bitu depth;					//Nesting of the emulation loop when saved
+} snapshot;
+
+static void AddEntry(SnapshotEntry const & entry) {
+	snapshot.valid=false;
+	for (std::vector<SnapshotEntry>::iterator it=snapshot.entries.begin();it!=snapshot.entries.end();++it) {
+		if (it->name==entry.name) {
+			*it=entry;
+			return;
+		}
+	}
+	snapshot.entries.push_back(entry);
+}
+
+void SNAPSHOT_AddRegion(char const * const name,void * data,Bitu size,Bitu flags) {
+	SnapshotEntry entry;
+	entry.name=name;
+	entry.data=data;
+	entry.size=size;
+	entry.save=entry.load=0;
+	entry.flags=flags;
+	entry.start=entry.length=0;
+	AddEntry(entry);
+}
+
+void SNAPSHOT_AddHandler(char const * const name,SNAPSHOT_Handler * save,SNAPSHOT_Handler * load,Bitu flags) {
+	SnapshotEntry entry;
+	entry.name=name;
+	entry.data=0;
+	entry.size=0;
+	entry.save=save;
+	entry.load=load;
+	entry.flags=flags;
+	entry.start=entry.length=0;
+	AddEntry(entry);
+}
+
+void SNAPSHOT_Remove(char const * const name) {
+	for (std::vector<SnapshotEntry>::iterator it=snapshot.entries.begin();it!=snapshot.entries.end();++it) {
+		if (it->name==name) {
+			snapshot.entries.erase(it);
+			snapshot.valid=false;
+			return;
+		}
+	}
+}
+
+bool SNAPSHOT_Available(void) {
+	return snapshot.valid;
+}
+
+bool SNAPSHOT_Save(void) {
+	snapshot.stream.Clear();
+	for (std::vector<SnapshotEntry>::iterator it=snapshot.entries.begin();it!=snapshot.entries.end();++it) {
+		it->start=snapshot.stream.Tell();
+		if (it->save) (*it->save)(snapshot.stream);
+		else snapshot.stream.Write(it->data,it->size);
+		it->length=snapshot.stream.Tell()-it->start;
+	}
+	if (snapshot.stream.Failed()) {
+		LOG_MSG("SNAPSHOT:Not enough memory to save the state");
+		snapshot.valid=false;
+		return false;
+	}
+	snapshot.depth=DOSBOX_GetRunDepth();
+	snapshot.valid=true;
+	return true;
+}
+
+bool SNAPSHOT_Load(void) {
+	if (!snapshot.valid) {
+		LOG_MSG("SNAPSHOT:No snapshot available");
+		return false;
+	}
+	/* The host stack of nested emulation loops can't be restored */
+	if (snapshot.depth!=DOSBOX_GetRunDepth()) {
+		LOG_MSG("SNAPSHOT:Can't restore, the emulation is in a different nesting level");
+		return false;
+	}
+	for (std::vector<SnapshotEntry>::iterator it=snapshot.entries.begin();it!=snapshot.entries.end();++it) {
+		snapshot.stream.Seek(it->start);
+		if (it->load) (*it->load)(snapshot.stream);
+		else snapshot.stream.Read(it->data,it->size);
+		if (snapshot.stream.Tell()!=it->start+it->length)
+			E_Exit("SNAPSHOT:State of %s has a different size",it->name.c_str());
+	}
+	return true;
+}
+
+bool SNAPSHOT_InFile(void) {
+	return snapshot.infile;
+}
+
+/* Image file layout, all numbers are 32 bit in host order:
+   magic, version, key length, key, entry count and then for every entry
+   the name length, name, data length and data */
+static char const image_magic[8]={'D','B','X','I','M','A','G','E'};
+#define IMAGE_VERSION 1
+
+static bool WriteNumber(FILE * f,Bitu val) {
+	Bit32u num=(Bit32u)val;
+	return fwrite(&num,sizeof(num),1,f)==1;
+}
+
+static bool WriteString(FILE * f,std::string const & str) {
+	if (!WriteNumber(f,str.size())) return false;
+	return str.empty() || fwrite(str.data(),str.size(),1,f)==1;
+}
+
+static bool ReadNumber(FILE * f,Bitu & val) {
+	Bit32u num;
+	if (fread(&num,sizeof(num),1,f)!=1) return false;
+	val=num;
+	return true;
+}
+
+static bool ReadString(FILE * f,std::string & str) {
+	Bitu len;
+	if (!ReadNumber(f,len) || len>4096) return false;
+	str.resize(len);
+	return !len || fread(&str[0],len,1,f)==1;
+}
+
+/* Opens the file and reads the header up to the entries */
+static FILE * OpenImage(char const * filename,std::string & key) {
+	FILE * f=fopen(filename,"rb");
+	if (!f) return 0;
+	char magic[sizeof(image_magic)];
+	Bitu version;
+	if (fread(magic,sizeof(magic),1,f)!=1 || memcmp(magic,image_magic,sizeof(magic)) ||
+		!ReadNumber(f,version) || version!=IMAGE_VERSION || !ReadString(f,key)) {
+		fclose(f);
+		return 0;
+	}
+	return f;
+}
+
+bool SNAPSHOT_FileKey(char const * filename,std::string & key) {
+	FILE * f=OpenImage(filename,key);
+	if (!f) return false;
+	fclose(f);
+	return true;
+}
+
+bool SNAPSHOT_SaveFile(char const * filename,std::string const & key) {
+	SnapshotStream stream;
+	std::vector<SnapshotEntry> saved;
+	snapshot.infile=true;
+	for (std::vector<SnapshotEntry>::iterator it=snapshot.entries.begin();it!=snapshot.entries.end();++it) {
+		if (!(it->flags & SNAPSHOT_PERSISTENT)) continue;
+		SnapshotEntry entry=*it;
+		entry.start=stream.Tell();
+		if (entry.save) (*entry.save)(stream);
+		else stream.Write(entry.data,entry.size);
+		entry.length=stream.Tell()-entry.start;
+		saved.push_back(entry);
+	}
+	snapshot.infile=false;
+	if (stream.Failed()) {
+		LOG_MSG("SNAPSHOT:Not enough memory to save the state");
+		return false;
+	}
+
+	FILE * f=fopen(filename,"wb");
+	if (!f) {
+		LOG_MSG("SNAPSHOT:Can't create image %s",filename);
+		return false;
+	}
+	bool ok=fwrite(image_magic,sizeof(image_magic),1,f)==1 &&
+		WriteNumber(f,IMAGE_VERSION) && WriteString(f,key) && WriteNumber(f,saved.size());
+	for (std::vector<SnapshotEntry>::iterator it=saved.begin();ok && it!=saved.end();++it) {
+		ok=WriteString(f,it->name) && WriteNumber(f,it->length) &&
+			(!it->length || fwrite(stream.Data()+it->start,it->length,1,f)==1);
+	}
+	if (fclose(f)) ok=false;
+	if (!ok) {
+		LOG_MSG("SNAPSHOT:Error writing image %s",filename);
+		remove(filename);
+	}
+	return ok;
+}
+
+bool SNAPSHOT_LoadFile(char const * filename,std::string const & key) {
+	std::string filekey;
+	FILE * f=OpenImage(filename,filekey);
+	if (!f) {
+		LOG_MSG("SNAPSHOT:Can't open image %s",filename);
+		return false;
+	}
+	if (filekey!=key) {
+		fclose(f);
+		LOG_MSG("SNAPSHOT:Image %s was made for a different setup",filename);
+		return false;
+	}
+	/* Read everything before touching the machine, the image has to fit
+	   the registered entries exactly */
+	long here=ftell(f);
+	fseek(f,0,SEEK_END);
+	long filesize=ftell(f);
+	fseek(f,here,SEEK_SET);
+	SnapshotStream stream;
+	std::vector<SnapshotEntry> loaded;
+	Bitu count;
+	bool ok=ReadNumber(f,count);
+	for (Bitu i=0;ok && i<count;i++) {
+		std::string name;
+		Bitu length;
+		ok=ReadString(f,name) && ReadNumber(f,length);
+		if (!ok) break;
+		std::vector<SnapshotEntry>::iterator it;
+		for (it=snapshot.entries.begin();it!=snapshot.entries.end();++it)
+			if (it->name==name && (it->flags & SNAPSHOT_PERSISTENT)) break;
+		if (it==snapshot.entries.end() || (!it->load && it->size!=length) ||
+			length>(Bitu)(filesize-ftell(f))) {
+			LOG_MSG("SNAPSHOT:Image %s doesn't match the state of %s",filename,name.c_str());
+			ok=false;
+			break;
+		}
+		SnapshotEntry entry=*it;
+		entry.start=stream.Tell();
+		entry.length=length;
+		std::vector<Bit8u> data(length+1);
+		ok=!length || fread(&data[0],length,1,f)==1;
+		stream.Write(&data[0],length);
+		loaded.push_back(entry);
+	}
+	fclose(f);
+	Bitu persistent=0;
+	for (std::vector<SnapshotEntry>::iterator it=snapshot.entries.begin();it!=snapshot.entries.end();++it)
+		if (it->flags & SNAPSHOT_PERSISTENT) persistent++;
+	if (!ok || loaded.size()!=persistent) {
+		LOG_MSG("SNAPSHOT:Image %s is damaged or incomplete",filename);
+		return false;
+	}
+	snapshot.infile=true;
+	for (std::vector<SnapshotEntry>::iterator it=loaded.begin();it!=loaded.end();++it) {
+		stream.Seek(it->start);
+		if (it->load) (*it->load)(stream);
+		else stream.Read(it->data,it->size);
+		if (stream.Tell()!=it->start+it->length)
+			E_Exit("SNAPSHOT:State of %s in the image has a different size",it->name.c_str());
+	}
+	snapshot.infile=false;
+	/* The machine moved away from the snapshot in memory */
+	snapshot.valid=false;
+	return true;
+}
+
+static void SNAPSHOT_SaveEvent(bool pressed) {
+	if (!pressed) return;
+	Bit64u start=TIMER_GetTicksUs();
+	if (SNAPSHOT_Save())
+		LOG_MSG("SNAPSHOT:Saved %" sBitfs(d) " KB of state in %d us",
+			snapshot.stream.Size()/1024,(int)(TIMER_GetTicksUs()-start));
+}
+
+static void SNAPSHOT_LoadEvent(bool pressed) {
+	if (!pressed) return;
+	Bit64u start=TIMER_GetTicksUs();
+	if (SNAPSHOT_Load())
+		LOG_MSG("SNAPSHOT:Restored in %d us",(int)(TIMER_GetTicksUs()-start));
+}
+
+void SNAPSHOT_Init(Section * /*sec*/) {
+	snapshot.valid=false;
+	snapshot.infile=false;
+	MAPPER_AddHandler(SNAPSHOT_SaveEvent,MK_f2,MMOD1|MMOD2,"savestate","Save State");
+	MAPPER_AddHandler(SNAPSHOT_LoadEvent,MK_f3,MMOD1|MMOD2,"loadstate","Load State");
+}
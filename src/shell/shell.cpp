@@ -26,6 +26,8 @@
 #include "shell.h"
 #include "callback.h"
 #include "support.h"
+#include "setup.h"
+#include "snapshot.h"
 
 
 Bitu call_shellstop;
@@ -312,6 +314,82 @@ void DOS_Shell::RunInternal(void) {
 	}
 }
 
+/* Boot image of the machine at the BOOTIMAGE line of the autoexec. The key
+   holds a hash of the configuration the autoexec was started with followed
+   by the mounted directories. */
+static struct {
+	std::string file;
+	std::string config;
+	std::string key;
+	bool restore;
+} boot_image;
+
+static void HashString(Bit32u & hash,std::string const & str) {
+	for (std::string::size_type i=0;i<str.size();i++) {
+		hash^=(Bit8u)str[i];
+		hash*=16777619;
+	}
+	hash^=0;hash*=16777619;
+}
+
+static void SHELL_BootImageSetup(void) {
+	boot_image.restore=false;
+	Section_prop * section=static_cast<Section_prop *>(control->GetSection("dos"));
+	boot_image.file=section->Get_path("bootimage")->realpath;
+	if (boot_image.file.empty()) return;
+
+	Bit32u hash=2166136261U;
+	HashString(hash,VERSION);
+	for (Bitu i=0;i<control->startup_params.size();i++) HashString(hash,control->startup_params[i]);
+	Section * sec;
+	for (int i=0;(sec=control->GetSection(i));i++) {
+		HashString(hash,sec->GetName());
+		Section_prop * prop=dynamic_cast<Section_prop *>(sec);
+		if (!prop) continue;
+		Property * p;
+		for (int j=0;(p=prop->Get_prop(j));j++) {
+			HashString(hash,p->propname);
+			HashString(hash,p->GetValue().ToString());
+		}
+	}
+	HashString(hash,autoexec_data);
+	char line[16];
+	sprintf(line,"%08x\n",(unsigned int)hash);
+	boot_image.config=line;
+
+	/* An image is only used when it was made with the same setup and
+	   the directories it mounts are unchanged */
+	std::string key;
+	if (!SNAPSHOT_FileKey(boot_image.file.c_str(),key)) return;
+	if (key.compare(0,boot_image.config.size(),boot_image.config)) {
+		LOG_MSG("SHELL:Boot image %s is for a different configuration",boot_image.file.c_str());
+		return;
+	}
+	if (!DOS_ImageMountsValid(key.substr(boot_image.config.size()))) return;
+	boot_image.key=key;
+	boot_image.restore=true;
+}
+
+static bool IsBootImageLine(char const * line) {
+	while (*line=='@' || isspace(*reinterpret_cast<unsigned char const*>(line))) line++;
+	return !strncasecmp(line,"BOOTIMAGE",9) && (!line[9] || isspace(*reinterpret_cast<unsigned char const*>(line+9)));
+}
+
+bool SHELL_BootImagePending(void) {
+	return boot_image.restore;
+}
+
+bool SHELL_LoadBootImage(void) {
+	boot_image.restore=false;
+	return SNAPSHOT_LoadFile(boot_image.file.c_str(),boot_image.key);
+}
+
+bool SHELL_SaveBootImage(void) {
+	if (boot_image.file.empty()) return false;
+	if (!DOS_ImageReady()) return false;
+	return SNAPSHOT_SaveFile(boot_image.file.c_str(),boot_image.config+DOS_ImageMounts());
+}
+
 void DOS_Shell::Run(void) {
 	char input_line[CMD_MAXLINE] = {0};
 	std::string line;
@@ -337,7 +415,17 @@ void DOS_Shell::Run(void) {
 
 		strcpy(input_line,line.c_str());
 		line.erase();
+		SHELL_BootImageSetup();
 		ParseLine(input_line);
+		/* Skip the autoexec up to the point the image was made */
+		if (boot_image.restore) {
+			while (bf && bf->ReadLine(input_line)) {
+				if (IsBootImageLine(input_line)) {
+					ParseLine(input_line);
+					break;
+				}
+			}
+		}
 	} else {
 		WriteOut(MSG_Get("SHELL_STARTUP_SUB"),VERSION);
 	}
@@ -677,6 +765,15 @@ void SHELL_Init() {
 	MSG_Add("SHELL_CMD_PATH_HELP","Provided for compatibility.\n");
 	MSG_Add("SHELL_CMD_VER_HELP","View and set the reported DOS version.\n");
 	MSG_Add("SHELL_CMD_VER_VER","DOSBox version %s. Reported DOS version %d.%02d.\n");
+	MSG_Add("SHELL_CMD_BOOTIMAGE_HELP","Saves the machine to the bootimage file, later starts continue from here.\n");
+	MSG_Add("SHELL_CMD_BOOTIMAGE_HELP_LONG","BOOTIMAGE\n\n"
+	        "Only works in the autoexec. When the bootimage file in the [dos] section\n"
+	        "matches the configuration the autoexec skips to this line and loads it.\n"
+	        "Otherwise the file is made again.\n");
+	MSG_Add("SHELL_CMD_BOOTIMAGE_AUTOEXEC","BOOTIMAGE can only be used in the autoexec.\n");
+	MSG_Add("SHELL_CMD_BOOTIMAGE_NOFILE","No bootimage file is set in the [dos] section.\n");
+	MSG_Add("SHELL_CMD_BOOTIMAGE_SAVED","Boot image saved to %s.\n");
+	MSG_Add("SHELL_CMD_BOOTIMAGE_ERROR","Can't save the boot image, see the log for the reason.\n");
 
 	/* Regular startup */
 	call_shellstop=CALLBACK_Allocate();
@@ -769,7 +866,9 @@ void SHELL_Init() {
 
 
 	SHELL_ProgramStart_First_shell(&first_shell);
+	SNAPSHOT_AddRegion("shell.echo",&first_shell->echo,sizeof(first_shell->echo),SNAPSHOT_PERSISTENT);
 	first_shell->Run();
+	SNAPSHOT_Remove("shell.echo");
 	delete first_shell;
 	first_shell = 0;//Make clear that it shouldn't be used anymore
 }
@@ -37,6 +37,7 @@ static SHELL_Cmd cmd_list[]={
 {	"DIR",		0,			&DOS_Shell::CMD_DIR,		"SHELL_CMD_DIR_HELP"},
 {	"CHDIR",	1,			&DOS_Shell::CMD_CHDIR,		"SHELL_CMD_CHDIR_HELP"},
 {	"ATTRIB",	1,			&DOS_Shell::CMD_ATTRIB,		"SHELL_CMD_ATTRIB_HELP"},
+{	"BOOTIMAGE",1,			&DOS_Shell::CMD_BOOTIMAGE,	"SHELL_CMD_BOOTIMAGE_HELP"},
 {	"CALL",		1,			&DOS_Shell::CMD_CALL,		"SHELL_CMD_CALL_HELP"},
 {	"CD",		0,			&DOS_Shell::CMD_CHDIR,		"SHELL_CMD_CHDIR_HELP"},
 {	"CHOICE",	1,			&DOS_Shell::CMD_CHOICE,		"SHELL_CMD_CHOICE_HELP"},
@@ -1331,3 +1332,24 @@ void DOS_Shell::CMD_VER(char *args) {
 		}
 	} else WriteOut(MSG_Get("SHELL_CMD_VER_VER"),VERSION,dos.version.major,dos.version.minor);
 }
+
+void DOS_Shell::CMD_BOOTIMAGE(char * args) {
+	HELP("BOOTIMAGE");
+	/* The image is taken at a fixed point of the autoexec, so the shell
+	   can skip to the same point when it is loaded */
+	if (this!=first_shell || !bf || bf->prev) {
+		WriteOut(MSG_Get("SHELL_CMD_BOOTIMAGE_AUTOEXEC"));
+		return;
+	}
+	if (SHELL_BootImagePending()) {
+		if (SHELL_LoadBootImage()) return;
+		/* Run the skipped part of the autoexec after all, the image is
+		   made again when this line is reached */
+		bf->location=0;
+		return;
+	}
+	const char * file=static_cast<Section_prop *>(control->GetSection("dos"))->Get_string("bootimage");
+	if (!*file) WriteOut(MSG_Get("SHELL_CMD_BOOTIMAGE_NOFILE"));
+	else if (!SHELL_SaveBootImage()) WriteOut(MSG_Get("SHELL_CMD_BOOTIMAGE_ERROR"));
+	else if (echo) WriteOut(MSG_Get("SHELL_CMD_BOOTIMAGE_SAVED"),file);
+}